@@ -0,0 +1,81 @@
+#ifndef CALLSTACKTABLE_H
+#define CALLSTACKTABLE_H
+
+#include <QDataStream>
+#include <QHash>
+#include <QMultiHash>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+#include "hashstring.h"
+
+// frames from the allocation site to the root, library and address
+typedef QVector<QPair<HashString, quint64>> CallStack;
+
+// Deduplicated callstacks of a capture. Records reference their callstack by
+// a dense index into the table, index 0 is the empty callstack.
+class CallStackTable {
+public:
+    CallStackTable();
+
+    // index of an equal callstack, the callstack is added if there is none
+    quint32 Intern(const CallStack& callstack);
+    // same for the raw addresses sent by the agent, libraries are filled in
+    // when the addresses are translated
+    quint32 Intern(const QVector<quint64>& addresses);
+    quint32 Intern(const quint64* addresses, int count);
+    // adds the callstack without looking for an equal one
+    quint32 Append(const CallStack& callstack);
+    // the empty callstack if index is out of range
+    const CallStack& At(quint32 index) const;
+    // frames are rewritten in place once addresses are translated, Intern()
+    // doesn't find the rewritten callstack afterwards
+    CallStack& operator[](quint32 index) { return stacks_[static_cast<int>(index)]; }
+    int Size() const { return stacks_.size(); }
+    void Reserve(int size) { stacks_.reserve(size); }
+    // pads the table with empty callstacks to be filled in place
+    void Resize(int size) { stacks_.resize(qMax(size, 1)); }
+    void Clear();
+    // drops the callstacks that aren't used, returns the new index of every old one
+    QVector<quint32> Compact(const QVector<bool>& used);
+
+    void Write(QDataStream& stream) const;
+    void Read(QDataStream& stream);
+    // callstack map of files older than the table, callstacks are keyed by the
+    // uuid of their record. Returns the index of every uuid.
+    QHash<QString, quint32> ReadLegacy(QDataStream& stream);
+
+private:
+    static bool Equals(const CallStack& a, const CallStack& b);
+    static uint Hash(const CallStack& callstack);
+
+    QVector<CallStack> stacks_;
+    QMultiHash<uint, quint32> lookup_;
+};
+
+// Callstack indices of the stack ids sent by the agent. The agent sends a
+// stack's definition and the records of other threads through different
+// buffers, a record can arrive before the definition of its stack. Its
+// callstack stays empty until the definition is decoded.
+class AgentStackMap {
+public:
+    explicit AgentStackMap(CallStackTable& table)
+        : table_(table) {}
+
+    // definition is nullptr if it hasn't arrived yet
+    quint32 Index(quint32 stackId, const QVector<quint64>* definition);
+    // fills the callstack of records that arrived before the definition
+    void Define(quint32 stackId, const quint64* frames, int count);
+    bool HasPending() const { return !pending_.isEmpty(); }
+    // indices aren't valid anymore once the table is compacted
+    void Clear();
+
+private:
+    CallStackTable& table_;
+    QHash<quint32, quint32> indices_;
+    // stack id to the empty callstack waiting for its definition
+    QHash<quint32, quint32> pending_;
+};
+
+#endif // CALLSTACKTABLE_H
@@ -0,0 +1,118 @@
+#ifndef CALLTREEBUILDER_H
+#define CALLTREEBUILDER_H
+
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+#include <functional>
+
+#include "callstacktable.h"
+#include "stacktracemodel.h"
+
+// Merges the callstacks of records into a tree of function names, the
+// outermost frames are the roots. Records sharing a callstack are counted
+// once per callstack, chunks of callstacks are merged into partial trees
+// keyed by library and address on worker threads, then into one tree. Names
+// are only resolved for the frames of that tree, frames with the same name
+// under the same parent end up in one node. Baseline records are counted
+// apart in the same tree, so two sets of records are diffed node by node.
+class CallTreeBuilder {
+public:
+    static const quint32 NONE = 0xffffffff;
+
+    struct Node {
+        quint32 parent_; // NONE for roots
+        quint32 symbol_;
+        // hash of the names from the root down to the node, equal for the
+        // same path in trees of other records or captures
+        quint64 key_;
+        quint64 size_;
+        quint64 count_;
+        // of the baseline records
+        quint64 baseSize_;
+        quint64 baseCount_;
+    };
+
+    // name of a frame, only called on the thread calling Build()
+    typedef std::function<QString(const HashString& library, quint64 addr)> Resolver;
+
+    explicit CallTreeBuilder(const CallStackTable& callStacks);
+    // baseline records reference the callstacks of another capture
+    CallTreeBuilder(const CallStackTable& callStacks, const CallStackTable& baselineStacks);
+
+    void Add(const StackRecord& record) {
+        Add(record.stackIndex_, static_cast<quint64>(record.size_), 1);
+    }
+    // records of a callstack that were counted up front
+    void Add(quint32 stackIndex, quint64 size, quint64 count) {
+        // records of the same callstack take the same path
+        if (stackIndex >= static_cast<quint32>(sizes_.size()))
+            return;
+        sizes_[static_cast<int>(stackIndex)] += size;
+        counts_[static_cast<int>(stackIndex)] += count;
+    }
+    // records of the earlier state the added ones are compared to, a record
+    // may be added both ways
+    void AddBaseline(const StackRecord& record) {
+        if (baseCounts_.isEmpty()) {
+            baseSizes_.fill(0, baselineStacks_.Size());
+            baseCounts_.fill(0, baselineStacks_.Size());
+        }
+        if (record.stackIndex_ >= static_cast<quint32>(baseSizes_.size()))
+            return;
+        baseSizes_[static_cast<int>(record.stackIndex_)] += static_cast<quint64>(record.size_);
+        baseCounts_[static_cast<int>(record.stackIndex_)]++;
+    }
+    // merges the records added so far, the skipRootLevels outermost frames
+    // of every callstack are left out
+    void Build(const Resolver& resolve, int skipRootLevels = 0);
+
+    // parents come before their children
+    const QVector<Node>& Nodes() const { return nodes_; }
+    const QString& Name(const Node& node) const { return names_[static_cast<int>(node.symbol_)]; }
+    // names of the symbols, nodes refer to them by index
+    const QVector<QString>& Names() const { return names_; }
+    // node of the allocation site of every callstack, NONE for callstacks
+    // without records or with no frames left after skipping the root levels
+    const QVector<quint32>& StackNodes() const { return stackNodes_; }
+    // library and address of the first frame resolved to the node's name
+    const QPair<HashString, quint64>& Frame(const Node& node) const { return frames_[static_cast<int>(node.symbol_)]; }
+
+private:
+    struct FrameNode {
+        quint32 parent_;
+        quint32 library_;
+        quint64 addr_;
+        quint64 size_;
+        quint64 count_;
+        quint64 baseSize_;
+        quint64 baseCount_;
+    };
+    // a frame tree and the child of every parent and frame
+    struct FrameTree {
+        QVector<FrameNode> nodes_;
+        QHash<QPair<quint32, QPair<quint32, quint64>>, quint32> children_;
+
+        quint32 Child(quint32 parent, quint32 library, quint64 addr);
+    };
+
+    // the allocation site of stacks[i] is leaves[i] of the tree
+    void BuildFrameTree(const QVector<quint32>& stacks, int skipRootLevels, int begin, int end,
+        FrameTree& tree, quint32* leaves) const;
+
+    const CallStackTable& callStacks_;
+    const CallStackTable& baselineStacks_;
+    // size and count of the records of every callstack
+    QVector<quint64> sizes_;
+    QVector<quint64> counts_;
+    QVector<quint64> baseSizes_;
+    QVector<quint64> baseCounts_;
+    QVector<Node> nodes_;
+    QVector<quint32> stackNodes_;
+    QVector<QString> names_;
+    QVector<QPair<HashString, quint64>> frames_;
+};
+
+#endif // CALLTREEBUILDER_H
@@ -0,0 +1,77 @@
+#ifndef CALLTREEMODEL_H
+#define CALLTREEMODEL_H
+
+#include <QAbstractItemModel>
+#include <QFuture>
+#include <QHash>
+#include <QVector>
+
+#include "calltreebuilder.h"
+
+// Merged callstacks as a tree of function, size and count columns. Nodes are
+// kept in one array linked by parent, first child and next sibling indices,
+// names are symbol indices. The children of a node are only collected and
+// sorted when a view asks for them, rows that are never expanded cost
+// nothing but their node.
+class CallTreeModel : public QAbstractItemModel {
+    Q_OBJECT
+public:
+    static const quint32 NONE = CallTreeBuilder::NONE;
+
+    CallTreeModel(QObject* parent = nullptr);
+    // parents have to come before their children like CallTreeBuilder's
+    void setTree(const QVector<CallTreeBuilder::Node>& nodes, const QVector<QString>& names);
+    quint32 nodeCount() const { return static_cast<quint32>(nodes_.size()); }
+    quint32 node(const QModelIndex& index) const {
+        return index.isValid() ? static_cast<quint32>(index.internalId()) : NONE;
+    }
+    // index of a node, the rows of its ancestors are created if needed
+    QModelIndex indexOf(quint32 node, int column = 0) const;
+    const QString& name(quint32 node) const { return names_[static_cast<int>(nodes_[static_cast<int>(node)].symbol_)]; }
+    quint64 size(quint32 node) const { return nodes_[static_cast<int>(node)].size_; }
+    quint64 count(quint32 node) const { return nodes_[static_cast<int>(node)].count_; }
+    // nodes whose name contains the keyword in node order, names are
+    // matched once on a worker thread no matter how many nodes share them
+    QFuture<QVector<quint32>> search(const QString& keyword) const;
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role) const override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+private:
+    struct Node {
+        quint32 parent_;
+        quint32 firstChild_;
+        quint32 nextSibling_;
+        quint32 symbol_;
+        quint64 size_;
+        quint64 count_;
+    };
+
+    // children of a node in the current sort order, NONE for the roots
+    const QVector<quint32>& children(quint32 node) const;
+    void sortChildren(QVector<quint32>& children) const;
+
+    QVector<Node> nodes_;
+    quint32 firstRoot_ = NONE;
+    QVector<QString> names_;
+    // rank of every symbol's name, names sort by it
+    QVector<quint32> nameRanks_;
+    // nodes of every symbol, nodes_ of symbol i are
+    // symbolNodes_[symbolOffsets_[i]] to symbolNodes_[symbolOffsets_[i + 1]]
+    QVector<quint32> symbolNodes_;
+    QVector<int> symbolOffsets_;
+    // sorted children of the nodes a view has expanded and the row of
+    // every node among its siblings
+    mutable QHash<quint32, QVector<quint32>> children_;
+    mutable QVector<quint32> rows_;
+    int sortColumn_ = 1;
+    Qt::SortOrder sortOrder_ = Qt::DescendingOrder;
+};
+
+#endif // CALLTREEMODEL_H
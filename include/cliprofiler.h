@@ -5,10 +5,15 @@
 #include <QTimer>
 #include <QFile>
 #include <QHash>
-#include <QUuid>
 #include <QSet>
+#include <QStringList>
 
+#include <memory>
+
+#include "callstacktable.h"
+#include "liveaddressmap.h"
 #include "screenshotprocess.h"
+#include "spilllog.h"
 #include "meminfoprocess.h"
 #include "stacktraceprocess.h"
 #include "stacktracemodel.h"
@@ -25,8 +30,9 @@ public:
         QString appName;
         QString subProcessName;
         QString outputFile;
-        QString symbolPath;
+        QStringList symbolPaths;  // one symbol file per library
         QString deviceSerial;
+        QString recordFile;  // raw stack trace packets, input of the lz4 benchmark
         int duration = 0;  // seconds, 0 means wait for process exit
         bool attachMode = false;
         bool verbose = false;
@@ -59,21 +65,22 @@ private:
     void PrintError(const QString& str);
     void ConnectionFailed();
     void StopCaptureProcess();
-    void SaveToFile(QFile *file);
+    bool SaveToFile(QFile *file);
     void ReadSMapsFile(QFile* file);
-    void ReadStacktraceData(const QVector<RawStackInfo>& stacks);
+    void ReadStacktraceData(const StackTraceBatch& batch);
     void ReadStacktraceDataCache();
     void PushEmptySMapsFile();
     
     struct StacktraceData {
         QVector<QPair<HashString, quint64>> records_;
-        QVector<QString> libraries_;
+        // first frame outside of libloli of every callstack of the job
+        QVector<QPair<HashString, quint64>> allocSites_;
     };
     
-    StacktraceData InterpretRecordsLibrary(int start, int count);
-    void InterpretRecordLibrary(StackRecord& record, StacktraceData& data);
+    StacktraceData InterpretCallStacks(int start, int count);
+    void InterpretCallStack(CallStack& callStack, StacktraceData& data);
     void InterpretStacktraceData();
-    bool LoadSymbolFile(const QString& symbolPath);
+    bool LoadSymbolFiles(const QStringList& symbolPaths);
     void Cleanup(int exitCode);
 
 private:
@@ -86,6 +93,7 @@ private:
     int lastScreenshotTime_ = 0;
     int maxMemInfoValue_ = 128;
     bool showJDWPErrorLog_ = false;
+    quint64 droppedEvents_ = 0;
     
     // Processes
     StartAppProcess *startAppProcess_;
@@ -101,9 +109,16 @@ private:
     
     // Data structures
     StackTraceModel *stacktraceModel_;
-    QHash<QUuid, QVector<QPair<HashString, quint64>>> callStackMap_;
+    CallStackTable callStacks_;
+    // callstack index of every stack id the agent sent
+    AgentStackMap agentStacks_ { callStacks_ };
     QSet<QString> libraries_;
     QVector<StackRecord> recordsCache_;
+    // records received while capturing
+    std::unique_ptr<SpillWriter> spillWriter_;
+    quint32 spilledRecords_ = 0;
+    // record of every live address while capturing, by spill order
+    LiveAddressMap liveAddresses_;
     QHash<quint64, quint32> freeAddrMap_;
     QHash<QString, QHash<quint64, QString>> symbloMap_;
     QVector<QPair<int, QByteArray>> screenshots_;
@@ -32,6 +32,7 @@ public:
 
     struct Settings {
         int threshold_ = 128;
+        int depth_ = 128;
         QString mode_ = "strict";
         QString build_ = "default";
         QString type_ = "white list";
@@ -0,0 +1,94 @@
+#ifndef ELFSYMBOLIZER_H
+#define ELFSYMBOLIZER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Symbols and source lines of a little endian ELF library, read in process
+// from the mapped file instead of dumping them with the NDK's nm and
+// addr2line. Symbols of .symtab and .dynsym are sorted by address once,
+// names are demangled the first time they're looked up and kept in a pool,
+// every address of a function shares its name. The DWARF line tables of
+// .debug_line are only decoded when a line is asked for.
+class ElfSymbolizer {
+public:
+    struct Library {
+        QString name_; // of the addresses in the symbol map, like libfoo.so
+        int symbolCount_ = 0;
+        int translated_ = 0;
+        QString error_;
+    };
+
+    ElfSymbolizer() = default;
+    ElfSymbolizer(const ElfSymbolizer&) = delete;
+    ElfSymbolizer& operator=(const ElfSymbolizer&) = delete;
+
+    // false if the file can't be mapped or isn't a little endian ELF
+    bool Open(const QString& path);
+    const QString& ErrorString() const { return error_; }
+    int SymbolCount() const { return symbols_.size(); }
+    // demangled name of the symbol containing addr, empty if there is none
+    QString Symbolize(quint64 addr);
+    // translates the addresses of the map that have no name yet, returns
+    // how many got one
+    int Translate(QHash<quint64, QString>& addrMap);
+    // translates the addresses of the library named after every symbol
+    // file, the libraries are translated in parallel
+    static QVector<Library> TranslateLibraries(const QStringList& paths,
+        QHash<QString, QHash<quint64, QString>>& symbolMap);
+    // "file:line" of addr like addr2line prints it, "??:0" if unknown
+    QString LineInfo(quint64 addr);
+
+private:
+    struct Section {
+        quint32 type_;
+        quint64 flags_;
+        quint64 offset_;
+        quint64 size_;
+        quint32 link_;
+        quint64 entrySize_;
+        QString name_;
+    };
+    struct Symbol {
+        quint64 addr_;
+        quint64 size_;
+        const char* name_;
+    };
+    struct LineRow {
+        quint64 addr_;
+        quint32 file_; // into files_, NONE past the end of a sequence
+        quint32 line_;
+    };
+    static const quint32 NONE = 0xffffffff;
+
+    bool ReadSections();
+    void ReadSymbols(const Section& symbols);
+    // contents of a section, inflated if it's compressed
+    QByteArray SectionData(const Section& section) const;
+    // name of the symbol containing addr among the ones starting at the
+    // address of symbols_[last], symbols_[last + 1] starts past addr
+    const char* SymbolName(int last, quint64 addr) const;
+    void DecodeLines();
+    bool DecodeLineProgram(const uchar*& data, const uchar* end, const QByteArray& lineStrings,
+        const QByteArray& strings);
+    QString Demangle(const char* name);
+
+    QFile file_;
+    const uchar* data_ = nullptr;
+    quint64 size_ = 0;
+    bool is64_ = false;
+    bool thumb_ = false;
+    QVector<Section> sections_;
+    QVector<Symbol> symbols_;
+    QHash<const char*, QString> demangled_;
+    bool linesDecoded_ = false;
+    QVector<LineRow> lines_;
+    QVector<QString> files_;
+    QString error_;
+};
+
+#endif // ELFSYMBOLIZER_H
@@ -0,0 +1,31 @@
+#ifndef LEAKDIFF_H
+#define LEAKDIFF_H
+
+#include <QVector>
+
+#include "calltreebuilder.h"
+
+// Growth of a built call tree from its baseline records to its other
+// records. The records ending in a node are diffed, growth under the size
+// limit or without more allocations is dropped. Every node keeps the growth
+// of its subtree, nodes without any are pruned. Both is done in one pass
+// over the nodes from the leaves up.
+class LeakDiff {
+public:
+    LeakDiff(const CallTreeBuilder& builder, quint64 sizeLimit);
+
+    // the grown nodes, parents come before their children. size_ and count_
+    // are the growth, baseSize_ and baseCount_ the baseline of the subtree
+    const QVector<CallTreeBuilder::Node>& Nodes() const { return nodes_; }
+    // nodes whose own records grew
+    int GrownCount() const { return grownCount_; }
+    // of those the ones without baseline records
+    int NewCount() const { return newCount_; }
+
+private:
+    QVector<CallTreeBuilder::Node> nodes_;
+    int grownCount_ = 0;
+    int newCount_ = 0;
+};
+
+#endif // LEAKDIFF_H
@@ -0,0 +1,46 @@
+#ifndef LEAKTREND_H
+#define LEAKTREND_H
+
+#include <QVector>
+
+#include "calltreebuilder.h"
+
+// Growth of a built call tree across a series of snapshots, LeakDiff for
+// more than two. The records ending in a node are followed from snapshot to
+// snapshot, a callsite grows when their size never drops and ends up at
+// least the size limit above where it started with more allocations. Every
+// node keeps the growth of its subtree from the first snapshot to the last,
+// nodes without any are pruned.
+class LeakTrend {
+public:
+    struct Callsite {
+        quint32 node_; // into Nodes()
+        // least squares fit of the size over the snapshot index, bytes per
+        // snapshot
+        double slope_;
+        // size and count of the records ending in the callsite, per snapshot
+        QVector<quint64> sizes_;
+        QVector<quint64> counts_;
+    };
+
+    // sizes and counts of the records of every callstack of the builder's
+    // table, one vector per snapshot in capture order. Vectors may be shorter
+    // than the table, missing callstacks have no records.
+    LeakTrend(const CallTreeBuilder& builder, const QVector<QVector<quint64>>& sizes,
+        const QVector<QVector<quint64>>& counts, quint64 sizeLimit);
+
+    // the grown nodes, parents come before their children. size_ and count_
+    // are the growth, baseSize_ and baseCount_ the first snapshot of the subtree
+    const QVector<CallTreeBuilder::Node>& Nodes() const { return nodes_; }
+    // grown callsites, steepest first
+    const QVector<Callsite>& Callsites() const { return callsites_; }
+    // of those the ones without records in the first snapshot
+    int NewCount() const { return newCount_; }
+
+private:
+    QVector<CallTreeBuilder::Node> nodes_;
+    QVector<Callsite> callsites_;
+    int newCount_ = 0;
+};
+
+#endif // LEAKTREND_H
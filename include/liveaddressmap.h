@@ -0,0 +1,76 @@
+#ifndef LIVEADDRESSMAP_H
+#define LIVEADDRESSMAP_H
+
+#include <QHash>
+#include <QVector>
+
+// Addresses seen while capturing, kept up to date as records and frees
+// arrive. A slot holds the record currently allocated at the address, if
+// any, and the seq of the last free there. Records are referenced by an
+// index of the caller's choosing.
+//
+// Threads send from their own buffers so events of an address may arrive out
+// of order, seqs decide: a free only releases a record allocated before it,
+// and a record allocated before a free that was already received is dead
+// right away. An address can't be allocated twice, a newer record replaces
+// the one whose free hasn't arrived yet.
+//
+// Live bytes are counted as records come and go, in total, by the size
+// classes of the record size filter and by a group such as the library.
+class LiveAddressMap {
+public:
+    static const quint32 NONE = 0xffffffff;
+
+    enum SizeClass {
+        SMALL = 0, // up to 1KB
+        MEDIUM = 1,
+        LARGE = 2, // from 1MB on
+        SIZE_CLASSES = 3,
+    };
+
+    LiveAddressMap();
+
+    // returns the index of the record that is released by this one, NONE if
+    // there is none, live is false if the record itself is already freed.
+    // group 0 isn't counted on its own
+    quint32 Allocate(quint64 addr, quint32 seq, quint32 index, quint32 size, quint32 group, bool& live);
+    // returns the index of the record it releases, NONE if there is none
+    quint32 Free(quint64 addr, quint32 seq);
+    // number of live records
+    int LiveCount() const { return live_; }
+    qint64 LiveBytes() const { return liveBytes_; }
+    qint64 LiveBytes(SizeClass sizeClass) const { return classBytes_[sizeClass]; }
+    // live bytes of every group that had records
+    const QHash<quint32, qint64>& GroupBytes() const { return groupBytes_; }
+    // indices of the live records, in no particular order
+    QVector<quint32> LiveIndices() const;
+    // address to the seq of its last free, the layout of saved captures
+    QHash<quint64, quint32> Frees() const;
+    void Clear();
+
+private:
+    struct Slot {
+        quint64 addr_; // 0 if the slot is empty
+        quint32 index_; // NONE if nothing is allocated there
+        quint32 seq_;
+        quint32 freeSeq_;
+        quint32 size_;
+        quint32 group_;
+        quint32 padding_;
+    };
+    // slot of addr, a new one is taken if it isn't there
+    Slot& Find(quint64 addr);
+    void Grow();
+    // adds or removes the live record of the slot from the counters
+    void Count(const Slot& slot, qint64 sign);
+
+    QVector<Slot> slots_;
+    quint32 mask_ = 0;
+    int used_ = 0;
+    int live_ = 0;
+    qint64 liveBytes_ = 0;
+    qint64 classBytes_[SIZE_CLASSES];
+    QHash<quint32, qint64> groupBytes_;
+};
+
+#endif // LIVEADDRESSMAP_H
@@ -0,0 +1,110 @@
+#ifndef LOLIFILE_H
+#define LOLIFILE_H
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QFile>
+#include <QFuture>
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QVector>
+
+#include <functional>
+
+#include "callstacktable.h"
+#include "stacktracemodel.h"
+
+// .loli files from version 200 on are a section container:
+//   [u32 magic][i32 version] big endian like the older files
+//   [u32 section count][u32 reserved]
+//   [u32 id][u32 reserved][u64 offset][u64 size] * MAX_SECTIONS
+// followed by the sections, each 8 byte aligned. Records, callstacks and frees
+// are little endian fixed width columns read straight from the mapped file,
+// the small sections are QDataStream blobs laid out like the older files.
+namespace LoliFile {
+
+const quint32 MAGIC = 0xA4B3C2D1;
+const qint32 VERSION = 200;
+const int MAX_SECTIONS = 16;
+
+enum class Section : quint32 {
+    MEMINFO = 1, // max value, series of points
+    STRINGS = 2, // HashString map
+    RECORDS = 3, // count, then columns addr, funcAddr, seq, time, size, stackIndex, library
+    STACKS = 4, // count, frame offsets[count + 1], then frame columns addr, library
+    SYMBOLS = 5, // library, address, function name
+    FREES = 6, // count, then columns addr, seq
+    SCREENSHOTS = 7, // count, times, offsets[count + 1], jpg bytes
+    SMAPS = 8, // SMapsSection by name
+};
+
+}
+
+class LoliFileWriter {
+public:
+    // device must be seekable, the directory is written by Finish()
+    explicit LoliFileWriter(QIODevice* device);
+
+    void WriteBlob(LoliFile::Section id, const std::function<void(QDataStream&)>& write);
+    void WriteRecords(const QVector<StackRecord>& records);
+    void WriteStacks(const CallStackTable& callStacks);
+    void WriteFrees(const QHash<quint64, quint32>& freeAddrMap);
+    void WriteScreenshots(const QVector<QPair<int, QByteArray>>& screenshots);
+    bool Finish();
+
+private:
+    void BeginSection(LoliFile::Section id);
+    void EndSection();
+    // buffered little endian write of a column value
+    template<typename T> void Put(T value);
+    void Flush();
+
+    struct Entry {
+        quint32 id_;
+        quint64 offset_;
+        quint64 size_;
+    };
+    QIODevice* device_;
+    QByteArray buffer_;
+    QVector<Entry> sections_;
+    bool ok_ = true;
+};
+
+// Maps a version 200 file, sections are only touched when they are read.
+// Records and callstacks are decoded in chunks on the global thread pool.
+class LoliFileReader : public QObject {
+    Q_OBJECT
+public:
+    LoliFileReader(QObject* parent = nullptr) : QObject(parent) {}
+    ~LoliFileReader() override;
+
+    // false if the file can't be mapped or isn't a section container,
+    // version is set whenever the header could be read
+    bool Open(const QString& path, qint32* version = nullptr);
+    bool Has(LoliFile::Section id) const { return sections_.contains(static_cast<quint32>(id)); }
+
+    bool ReadBlob(LoliFile::Section id, const std::function<void(QDataStream&)>& read) const;
+    // both block until every chunk is decoded, Progress() is emitted on the
+    // calling thread as chunks complete
+    bool ReadRecords(QVector<StackRecord>& records);
+    bool ReadStacks(CallStackTable& callStacks);
+    bool ReadFrees(QHash<quint64, quint32>& freeAddrMap) const;
+    // the jpg bytes aren't copied, they stay valid while the reader is alive
+    bool ReadScreenshots(QVector<QPair<int, QByteArray>>& screenshots) const;
+
+signals:
+    void Progress(int value, int maximum);
+
+private:
+    // pointer to the section and its size, nullptr if there is none
+    const uchar* Data(LoliFile::Section id, quint64& size) const;
+    bool WaitForChunks(QVector<QFuture<bool>>& futures);
+
+    QFile file_;
+    uchar* data_ = nullptr;
+    quint64 size_ = 0;
+    QHash<quint32, QPair<quint64, quint64>> sections_;
+};
+
+#endif // LOLIFILE_H
@@ -7,13 +7,19 @@
 #include <QtCharts/QChartView>
 #include <QtCharts/QLineSeries>
 #include <QtCharts/QValueAxis>
-#include <QUuid>
 
+#include <memory>
+
+#include "callstacktable.h"
+#include "liveaddressmap.h"
+#include "lolifile.h"
+#include "recordindex.h"
 #include "screenshotprocess.h"
+#include "spilllog.h"
 #include "meminfoprocess.h"
+#include "mapsprocess.h"
 #include "stacktraceprocess.h"
 #include "stacktracemodel.h"
-#include "stacktraceproxymodel.h"
 #include "addressprocess.h"
 #include "startappprocess.h"
 #include "fixedscrollarea.h"
@@ -25,7 +31,6 @@ namespace Ui {
 class MainWindow;
 }
 
-class QTreeWidgetItem;
 class QStandardItemModel;
 class QGraphicsPixmapItem;
 class QProgressDialog;
@@ -43,9 +48,16 @@ public:
 
 private:
     void Print(const QString& str);
-    void ExportToText(QFile *file, bool optimal);
-    void SaveToFile(QFile *file);
+    bool ExportToText(QFile *file, bool optimal, bool compressed);
+    bool SaveToFile(QFile *file);
     int LoadFromFile(QFile *file);
+    bool ReadLoliFile(LoliFileReader& loliFile, QVector<StackRecord>& records);
+    bool ReadStreamFile(QDataStream& stream, qint32 version, QVector<StackRecord>& records);
+    void ReadMemInfo(QDataStream& stream);
+    void ReadSymbolMap(QDataStream& stream);
+    void ReadSMaps(QDataStream& stream);
+    // copies the mapped screenshots so the loaded file can be replaced
+    void ReleaseLoliFile();
     QString GetLastOpenDir() const;
     QString GetLastSymbolDir() const;
 
@@ -55,32 +67,41 @@ private:
     void ShowScreenshotAt(int index);
     void HideToolTips();
     void UpdateMemInfoRange();
+    // appends the live bytes counted from the hooked allocations to the chart
+    void SampleLiveHeap();
+    // library of the first frame outside the profiler, the live heap is
+    // counted by it while capturing
+    quint32 LiveHeapLibrary(const RawStackInfo& stack, const StackTraceBatch& batch) const;
+    void ClearLiveHeapLibraries();
     QString TryAddNewAddress(const QString& lib, quint64 addr);
     void ShowCallStack(const QModelIndex& index);
     void ShowSummary();
-    void ShowMergedCallstacks(QList<QTreeWidgetItem*>& topLevelItems, std::function<void(class QTreeWidget*)> widgetCallback = nullptr);
-    void ShowMergedCallstacksInTreeMap(QList<QTreeWidgetItem*>& topLevelItems);
+    void ShowMergedCallstacks(class CallTreeModel* model, std::function<void(class QTreeView*)> widgetCallback = nullptr);
+    void ShowMergedCallstacksInTreeMap(class CallTreeModel* model);
     StackTraceModel* GetCurrentModelChecked();
     void FilterStackTraceModel();
     void FilterStackTraceModel(StackTraceModel* filteredModel, double minTime, double maxTime);
-    void SwitchStackTraceModel(StackTraceProxyModel* model);
+    void SwitchStackTraceModel(StackTraceModel* model);
     void ReadSMapsFile(QFile* file);
-    QHash<uint, class CustomTreeWidgetItem*> GetMergedCallstacks(StackTraceModel* model, QList<QTreeWidgetItem*>& topLevelItems);
+    // items keyed by CallTreeBuilder::Node::key_
+    void GetMergedCallstacks(StackTraceModel* model, class CallTreeBuilder& builder);
     void ResetFilters();
     void PushEmptySMapsFile();
 
-    void ReadStacktraceData(const QVector<RawStackInfo>& stacks);
+    void ReadStacktraceData(const StackTraceBatch& batch);
     void ReadStacktraceDataCache();
-    void FilterPersistentRecords();
+    // removes the records of live only captures that were freed
+    void DropFreedRecords();
     void StopCaptureProcess();
 
     struct StacktraceData {
         QVector<QPair<HashString, quint64>> records_;
-        QVector<QString> libraries_;
+        // first frame outside of libloli of every callstack of the job
+        QVector<QPair<HashString, quint64>> allocSites_;
     };
 
-    StacktraceData InterpretRecordsLibrary(int start, int count);
-    void InterpretRecordLibrary(StackRecord& record, StacktraceData& data);
+    StacktraceData InterpretCallStacks(int start, int count);
+    void InterpretCallStack(CallStack& callStack, StacktraceData& data);
     void InterpretStacktraceData();
 
     // Console functionality
@@ -133,10 +154,12 @@ private:
     QProgressDialog *progressDialog_;
     QStandardItemModel *callStackModel_;
     StackTraceModel *stacktraceModel_;
+    // filters of the stack table, built when the records are loaded
+    RecordIndex recordIndex_;
     StackTraceModel *filteredStacktraceModel_;
-    StackTraceProxyModel *stacktraceProxyModel_;
-    StackTraceProxyModel *filteredStacktraceProxyModel_;
-    QHash<QUuid, QVector<QPair<HashString, quint64>>> callStackMap_;
+    CallStackTable callStacks_;
+    // callstack index of every stack id the agent sent
+    AgentStackMap agentStacks_ { callStacks_ };
     QSet<QString> libraries_;
     QString appPid_;
     QString appName_;
@@ -157,10 +180,20 @@ private:
     QGraphicsPixmapItem* screenshotItem_;
     int lastScreenshotTime_ = 0;
     QVector<QPair<int, QByteArray>> screenshots_;
+    // file the screenshots of a loaded capture are mapped from
+    std::unique_ptr<LoliFileReader> loliFile_;
 
     // stacktrace process
     StackTraceProcess *stacktraceProcess_;
     QVector<StackRecord> recordsCache_;
+    // records received while capturing with useCache_ on
+    std::unique_ptr<SpillWriter> spillWriter_;
+    quint32 spilledRecords_ = 0;
+    // record of every live address while capturing, by recordsCache_ index
+    // or by spill order with useCache_ on
+    LiveAddressMap liveAddresses_;
+    // recordsCache_ slots of freed records, reused in live only captures
+    QVector<quint32> freeRecordSlots_;
 
     // address process
     QVector<AddressProcess*> addrProcesses_;
@@ -173,6 +206,11 @@ private:
     MemInfoProcess* memInfoProcess_;
     int maxMemInfoValue_ = 128;
     QVector<QtCharts::QLineSeries*> memInfoSeries_;
+    // live bytes of the libraries that were among the largest while capturing
+    QHash<quint32, QtCharts::QLineSeries*> liveHeapLibrarySeries_;
+    // library ranges of stack captures, polled while capturing
+    MapsProcess* mapsProcess_;
+    int lastMapsTime_ = 0;
     QtCharts::QValueAxis *memInfoAxisX_;
     QtCharts::QValueAxis *memInfoAxisY_;
     QtCharts::QChart *memInfoChart_;
@@ -185,6 +223,8 @@ private:
 
     // cache
     bool useCache_ = true;
+    // freed records are dropped as they are freed
+    bool liveOnly_ = false;
     bool showJDWPErrorLog_ = true;
 
     bool isCapturing_ = false;
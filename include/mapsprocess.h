@@ -0,0 +1,39 @@
+#ifndef MAPSPROCESS_H
+#define MAPSPROCESS_H
+
+#include "adbprocess.h"
+#include <QVector>
+
+// Executable library mappings of the app, read from /proc/<pid>/maps while
+// capturing. Records only know their libraries once the smaps dump is read
+// when the capture stops, the live heap is attributed to libraries through
+// these ranges before that.
+class MapsProcess : public AdbProcess {
+public:
+    MapsProcess(QObject* parent = nullptr);
+
+    // cat through run-as like the smaps dump, through su on rooted devices
+    void DumpMapsAsync(const QString& appName, const QString& appPid, bool rootDevice);
+    // hashcode of the library mapped at addr, 0 if there is none
+    quint32 FindLibrary(quint64 addr) const;
+    bool IsEmpty() const {
+        return ranges_.isEmpty();
+    }
+    void Clear() {
+        ranges_.clear();
+    }
+
+protected:
+    void OnProcessFinihed() override;
+
+private:
+    struct LibraryRange {
+        quint64 start_;
+        quint64 end_;
+        quint32 library_;
+    };
+    // sorted by start, mappings don't overlap
+    QVector<LibraryRange> ranges_;
+};
+
+#endif // MAPSPROCESS_H
@@ -2,22 +2,26 @@
 #define PROFILECOMPARATOR_H
 
 #include <QString>
+#include <QStringList>
 #include <QHash>
 #include <QVector>
 #include <QPair>
-#include <QUuid>
+#include "callstacktable.h"
+#include "calltreebuilder.h"
 #include "hashstring.h"
 #include "stacktracemodel.h"
 #include "smaps/smapssection.h"
 
 // Forward declarations
-class QTextStream;
+class TextWriter;
+class LoliFileReader;
 
 /**
  * ProfileComparator - Compares two .loli profiling files and generates diff reports
  * 
  * Supports:
  * - Loading and comparing two profiling sessions
+ * - Following the growth of call sites across a series of sessions
  * - Generating text diff reports with hierarchical call stack format
  * - Exporting diff as .loli file for GUI visualization
  */
@@ -33,6 +37,14 @@ public:
      * @return true if successful
      */
     bool LoadProfile(const QString& filePath, bool isBaseline);
+
+    /**
+     * Fill a profile with synthetic records instead of loading a file, for benchmarking
+     * Both profiles share most callstacks, the comparison has some of its own
+     * @param recordCount Number of allocation records
+     * @param isBaseline true for baseline/file1, false for comparison/file2
+     */
+    void GenerateProfile(int recordCount, bool isBaseline);
     
     /**
      * Compare the two loaded profiles
@@ -50,6 +62,17 @@ public:
      * @return true if successful
      */
     bool DumpProfile(int skipRootLevels = 0);
+
+    /**
+     * Load a series of profiles and find the call sites whose live memory grows in all of them
+     * Profiles are read in parallel and merged into one callstack table, only the size and
+     * count of every callstack are kept per profile
+     * The growth tree from the first profile to the last is exported by ExportToLoli
+     * @param filePaths .loli files in capture order, at least 2
+     * @param skipRootLevels Number of root stack frames to skip (default: 0)
+     * @return true if successful
+     */
+    bool CompareTrend(const QStringList& filePaths, int skipRootLevels = 0);
     
     /**
      * Export comparison result to text format (deep copy style)
@@ -67,6 +90,14 @@ public:
      */
     bool ExportDumpToText(const QString& outputPath);
 
+    /**
+     * Export trend result to text format
+     * Growing call sites by slope with their size in every profile, then the growth tree
+     * @param outputPath Path to output text file
+     * @return true if export successful
+     */
+    bool ExportTrendToText(const QString& outputPath);
+
     /**
      * Export comparison result to .loli format for GUI visualization
      * Creates a .loli file containing delta call stacks (positive = growth, negative = reduction)
@@ -89,6 +120,17 @@ public:
     };
     
     ComparisonStats GetStats() const { return stats_; }
+
+    /**
+     * Live allocations of every profile of CompareTrend
+     */
+    struct TrendSnapshot {
+        QString filePath;
+        int allocCount;
+        quint64 totalSize;
+    };
+
+    const QVector<TrendSnapshot>& GetTrendSnapshots() const { return trendSnapshots_; }
     
     QString GetErrorMessage() const { return errorMessage_; }
     
@@ -98,13 +140,20 @@ private:
         QVector<QPair<int, QVector<QPair<int, int>>>> memInfoSeries;  // series[time, value]
         QHash<quint32, QString> stringHashMap;
         QVector<StackRecord> stackRecords;
-        QHash<QUuid, QVector<QPair<HashString, quint64>>> callStackMap;
+        CallStackTable callStacks;
         QHash<QString, QHash<quint64, QString>> symbolMap;
         QHash<quint64, quint32> freeAddrMap;
         QVector<QPair<int, QByteArray>> screenshots;
         QHash<QString, SMapsSection> smapsSections;
     };
     
+    // A call site of CompareTrend whose own allocations grew in every profile
+    struct TrendCallsite {
+        QString functionName;
+        double slope;              // bytes per profile, least squares fit
+        QVector<quint64> sizes;    // size of the call site's own allocations per profile
+    };
+
     struct CallTreeNode {
         QString functionName;      // Display name (resolved symbol or "library!0xaddress")
         QString libraryName;       // Original library name
@@ -121,23 +170,29 @@ private:
     };
     
     bool LoadFromFile(const QString& filePath, ProfileData& data);
+    bool LoadFromLoliFile(LoliFileReader& loliFile, const QString& filePath, ProfileData& data);
     
-    // Efficient hash-based call tree building (matches MainWindow::GetMergedCallstacks logic)
-    QHash<uint, CallTreeNode*> BuildCallTreeWithHashMap(const ProfileData& data, QVector<CallTreeNode*>& roots);
+    // Name of a frame from the profile's symbol map, empty if it has none
+    static QString ResolveFrame(const ProfileData& data, const HashString& library, quint64 funcAddr);
 
-    // Write call tree to text output (delta format with +/- prefix)
-    void WriteCallTreeToText(QTextStream& stream, CallTreeNode* node, int depth);
+    // Nodes of a CallTreeBuilder or LeakDiff as a tree of CallTreeNodes
+    void BuildCallTree(const CallTreeBuilder& builder, const QVector<CallTreeBuilder::Node>& treeNodes,
+        QVector<CallTreeNode*>& roots);
 
-    // Write call tree to text output (absolute format, no +/- prefix)
-    void WriteCallTreeToTextAbsolute(QTextStream& stream, CallTreeNode* node, int depth);
+    // Write call trees to text output, delta format with +/- prefix or absolute values
+    void WriteCallTree(TextWriter& stream, const QVector<CallTreeNode*>& roots, bool delta);
 
-    // Convert delta tree to stack records and callstack map for .loli export
+    // Convert delta tree to stack records and callstack table for .loli export
     void ConvertDeltaTreeToRecords(
         QVector<StackRecord>& stackRecords,
-        QHash<QUuid, QVector<QPair<HashString, quint64>>>& callStackMap);
+        CallStackTable& callStacks);
 
     ProfileData baselineData_;
     ProfileData comparisonData_;
+    // callstacks and symbols of all profiles of CompareTrend
+    ProfileData trendData_;
+    QVector<TrendSnapshot> trendSnapshots_;
+    QVector<TrendCallsite> trendCallsites_;
     ComparisonStats stats_;
     QString errorMessage_;
     bool baselineLoaded_;
@@ -0,0 +1,46 @@
+#ifndef RECORDINDEX_H
+#define RECORDINDEX_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include "stacktracemodel.h"
+
+// Index over the records of a capture so the stack table is filtered without
+// scanning them: rows sorted by time, and bitmaps of the rows of every
+// library, every size class and of the records that are never freed. A filter
+// intersects the bitmaps it needs and returns the rows that pass in record
+// order.
+class RecordIndex {
+public:
+    // in the order of the size combo box
+    enum SizeFilter {
+        ANY_SIZE = 0,
+        LARGE = 1, // from 1MB on
+        MEDIUM = 2,
+        SMALL = 3, // up to 1KB
+    };
+
+    // freeAddrMap decides which records are persistent, build again when it changes
+    void Build(const QVector<StackRecord>& records, const QHash<quint64, quint32>& freeAddrMap);
+    void Clear();
+    int Size() const { return count_; }
+    // rows with a time in seconds from minTime to maxTime, an empty library
+    // matches every library
+    QVector<quint32> Filter(double minTime, double maxTime, SizeFilter sizeFilter,
+        const QString& library, bool persistent) const;
+
+private:
+    typedef QVector<quint64> Bitmap;
+
+    int count_ = 0;
+    // rows sorted by time and their times in seconds
+    QVector<quint32> timeOrder_;
+    QVector<qint32> seconds_;
+    QHash<quint32, Bitmap> libraries_;
+    Bitmap sizes_[3]; // by SizeFilter - 1
+    Bitmap persistent_;
+};
+
+#endif // RECORDINDEX_H
@@ -0,0 +1,99 @@
+#ifndef SPILLLOG_H
+#define SPILLLOG_H
+
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+#include <functional>
+
+#include "stacktraceprocess.h"
+
+// Records received while capturing are spilled to preallocated files of
+// 64KB blocks. A block holds either fixed size records or callstacks, and
+// entries never cross a block. Callstacks sent with a record are stored once
+// and referenced by index. The files are only read by this process, they use
+// the host's byte order.
+struct SpillRecord {
+    quint32 seq_;
+    quint32 size_;
+    qint64 time_;
+    quint64 addr_;
+    quint32 library_; // hashcode, no stack mode
+    quint32 stack_; // agent stack id for STACKID_, spilled callstack index for STACKTRACE_
+    quint8 recType_;
+    quint8 padding_[7];
+};
+
+// Writes the spill files on its own thread, the receiving thread only queues
+// the packets.
+class SpillWriter : public QThread {
+public:
+    SpillWriter(const QString& dirPath, QObject* parent = nullptr);
+    ~SpillWriter() override;
+
+    // the records of a batch, its vectors are shared until they're written
+    void Append(const StackTraceBatch& batch);
+    // writes what is queued and stops the thread, returns the spill files
+    QStringList Finish();
+    bool HasFailed() const { return failed_; }
+
+protected:
+    void run() override;
+
+private:
+    void Write(const RawStackInfo& stack, const StackTraceBatch& batch);
+    quint32 SpillStack(const quint64* stacktraces, int count);
+    // room for size more bytes in the block, the full block is written first
+    char* Reserve(QByteArray& block, quint32 type, int size);
+    void WriteBlock(QByteArray& block);
+    bool OpenFile();
+    void CloseFile();
+
+    QString dirPath_;
+    QMutex mutex_;
+    QWaitCondition condition_;
+    QVector<StackTraceBatch> queue_;
+    bool finishing_ = false;
+    bool failed_ = false;
+
+    // only touched by the writer thread
+    QFile file_;
+    qint64 fileOffset_ = 0;
+    QStringList paths_;
+    QByteArray recordBlock_;
+    QByteArray stackBlock_;
+    // 64 bit hash of the frames to the spilled index, a collision is as
+    // likely as a duplicated stack id and isn't checked
+    QHash<quint64, quint32> stackIndices_;
+};
+
+// Maps the spill files once the writer has finished.
+class SpillReader {
+public:
+    SpillReader() = default;
+    ~SpillReader();
+    SpillReader(const SpillReader&) = delete;
+    SpillReader& operator=(const SpillReader&) = delete;
+
+    bool Open(const QStringList& paths);
+    int RecordCount() const { return recordCount_; }
+    // one past the highest stack index, stacks of lost blocks are empty
+    int StackCount() const { return stacks_.size(); }
+    // records in the order they were received
+    void ForEachRecord(const std::function<void(const SpillRecord&)>& visit) const;
+    QVector<quint64> Stack(quint32 index) const;
+
+private:
+    QVector<QFile*> files_;
+    QVector<const uchar*> recordBlocks_;
+    // by stack index, nullptr for stacks that weren't written
+    QVector<const uchar*> stacks_;
+    int recordCount_ = 0;
+};
+
+#endif // SPILLLOG_H
@@ -0,0 +1,46 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <QtGlobal>
+
+#include <atomic>
+
+// Bounded lock free queue between exactly one producer thread and one
+// consumer thread. CAPACITY must be a power of two.
+template<typename T, quint32 CAPACITY>
+class SpscQueue {
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "capacity must be a power of two");
+public:
+    // producer only, false if the queue is full
+    bool Push(const T& value) {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == CAPACITY)
+            return false;
+        items_[tail & (CAPACITY - 1)] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+    // consumer only, false if the queue is empty
+    bool Pop(T& value) {
+        auto head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return false;
+        value = items_[head & (CAPACITY - 1)];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    // a snapshot, either side may have moved on already
+    quint32 Size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+private:
+    T items_[CAPACITY];
+    // each is written by one side only, the padding keeps them on separate
+    // cache lines without over aligning the owner, c++11 new ignores that
+    std::atomic<quint32> head_{0};
+    char padding_[64];
+    std::atomic<quint32> tail_{0};
+};
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,112 @@
+#ifndef STACKTRACEDECODER_H
+#define STACKTRACEDECODER_H
+
+#include <QByteArray>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+#include <QVector>
+
+#include <atomic>
+
+#include "spscqueue.h"
+#include "stacktraceprocess.h"
+
+#define DECODER_BATCH_COUNT 8
+
+class QFile;
+class QTcpSocket;
+
+// Owns the agent's socket and lives on StackTraceProcess's worker thread.
+// Packets are framed, decompressed and parsed there into recycled batches
+// which are handed to the main thread through a lock free queue. The main
+// thread only calls the methods marked as such, everything else runs on the
+// worker thread through queued invocations.
+class StackTraceDecoder : public QObject {
+    Q_OBJECT
+public:
+    StackTraceDecoder(QObject* parent = nullptr);
+    ~StackTraceDecoder() override;
+
+    void Connect(int port, quint32 connection);
+    void Abort();
+    void Send(const QByteArray& bytes);
+    // takes ownership of an opened file, nullptr stops recording
+    void SetRecordFile(QFile* file);
+
+    // main thread, the batch is handed back with RecycleBatch() once read
+    bool TakeBatch(StackTraceBatch*& batch);
+    void RecycleBatch(StackTraceBatch* batch);
+    // main thread, called before taking the batches of a BatchesReady()
+    void BeginDrain() { drainPending_.store(false); }
+    quint32 PendingBatches() const { return readyBatches_.Size(); }
+    // main thread, makes a worker waiting for a free batch drop its records
+    void Stop() { stopping_.store(true); }
+    // totals since the decoder was created, read from any thread
+    quint64 DecodedBytes() const { return decodedBytes_.load(std::memory_order_relaxed); }
+    quint64 DecodedRecords() const { return decodedRecords_.load(std::memory_order_relaxed); }
+
+signals:
+    // only emitted when the main thread has drained the previous batches
+    void BatchesReady();
+    void CommandReceived(quint32 cmd, const QByteArray& bytes);
+    void Connected(quint32 connection);
+    void Disconnected(quint32 connection);
+
+private:
+    void OnReadyRead();
+    void OnConnected();
+    void OnDisconnected();
+    void ReadPacket(const QByteArray& bytes);
+    void ReadStackTracePacket(const QByteArray& bytes, bool streamed);
+    bool ReadRecord(const uchar* data, const uchar* end, StackTraceBatch* batch);
+    void MapRange(const RawStackInfo& info, const StackTraceBatch* batch);
+    void UnmapRange(quint32 seq, quint64 addr, quint64 length);
+    // the batch records are decoded into, waits for the main thread to
+    // recycle one when all are queued
+    StackTraceBatch* Batch();
+    // queues the current batch if it holds anything
+    void PushBatch();
+
+    struct MappedRange {
+        RawStackInfo info_;
+        QVector<quint64> frames_;
+    };
+    struct UnmapInfo {
+        quint32 seq_;
+        quint64 addr_;
+        quint64 length_;
+    };
+
+    StackTraceBatch batches_[DECODER_BATCH_COUNT];
+    SpscQueue<StackTraceBatch*, DECODER_BATCH_COUNT> freeBatches_;
+    SpscQueue<StackTraceBatch*, DECODER_BATCH_COUNT> readyBatches_;
+    std::atomic<bool> drainPending_{false};
+    std::atomic<bool> stopping_{false};
+    std::atomic<quint64> decodedBytes_{0};
+    std::atomic<quint64> decodedRecords_{0};
+
+    // worker thread only
+    StackTraceBatch* batch_ = nullptr;
+    // records land here once stopping, nobody reads them anymore
+    StackTraceBatch discarded_;
+    quint32 connection_ = 0;
+    // live mmap ranges by start address, a partial munmap frees the range
+    // and records what is left of it again
+    QMap<quint64, MappedRange> mappedRanges_;
+    // munmaps of the packet being decoded
+    QVector<UnmapInfo> unmaps_;
+    // hashcodes of the library names already sent to the main thread
+    QSet<quint32> libraries_;
+    // last 64KB of decompressed data, the window of the next streamed block
+    QByteArray streamHistory_;
+    QFile* recordFile_ = nullptr;
+    QTcpSocket* socket_ = nullptr;
+    quint32 packetSize_ = 0;
+    char* buffer_ = nullptr;
+    char* compressBuffer_ = nullptr;
+    quint32 compressBufferSize_ = 1024;
+    QByteArray bufferCache_;
+};
+
+#endif // STACKTRACEDECODER_H
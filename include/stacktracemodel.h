@@ -2,15 +2,14 @@
 #define STACKTRACEMODEL_H
 
 #include <QAbstractTableModel>
-#include <QUuid>
 
 #include "hashstring.h"
 
 struct StackRecord {
-    QUuid uuid_;
     quint32 seq_;
     qint32 time_;
     qint32 size_;
+    quint32 stackIndex_ = 0; // into the capture's CallStackTable
     quint64 addr_;
     quint64 funcAddr_;
     HashString library_;
@@ -19,6 +18,9 @@ struct StackRecord {
 QString sizeToString(quint64 size);
 QString timeToString(int time);
 
+// Records of a capture, or a view over rows of another model's records.
+// Sorting doesn't move records, every column keeps a permutation of the rows
+// sorted by its raw field that is built the first time the column is sorted.
 class StackTraceModel : public QAbstractTableModel {
     Q_OBJECT
 public:
@@ -27,13 +29,45 @@ public:
     int columnCount(const QModelIndex &parent = QModelIndex()) const override;
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
     QVariant headerData(int section, Qt::Orientation orientation, int role) const override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
     void clear();
     void append(const QVector<StackRecord>& records);
+    // shows rows of the source's records instead of records of its own, the
+    // source must outlive the view or clear it first
+    void setRows(const StackTraceModel* source, const QVector<quint32>& rows);
+    // record of a row in the current sort order
     const StackRecord& recordAt(int index) const {
-        return records_[index];
+        return unsortedAt(sortedRow(index));
+    }
+    // own records only in the order they were appended, empty for views
+    const QVector<StackRecord>& records() const {
+        return records_;
     }
 private:
+    static const int COLUMNS = 5;
+
+    const StackRecord& unsortedAt(int row) const {
+        if (source_ != nullptr)
+            return source_->records_[static_cast<int>(rows_[row])];
+        return records_[row];
+    }
+    int sortedRow(int index) const {
+        if (sortColumn_ < 0)
+            return index;
+        const auto& order = orders_[sortColumn_];
+        return static_cast<int>(order[sortOrder_ == Qt::AscendingOrder ? index : order.size() - 1 - index]);
+    }
+    // builds the permutation of a column if there is none yet
+    void buildOrder(int column);
+    // drops the permutations, they're built again for the current sort column
+    void resetOrders();
+
     QVector<StackRecord> records_;
+    const StackTraceModel* source_ = nullptr;
+    QVector<quint32> rows_;
+    QVector<quint32> orders_[COLUMNS];
+    int sortColumn_ = -1;
+    Qt::SortOrder sortOrder_ = Qt::AscendingOrder;
 };
 
 #endif // STACKTRACEMODEL_H
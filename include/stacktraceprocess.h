@@ -2,6 +2,8 @@
 #define STACKTRACEPROCESS_H
 
 #include <QObject>
+#include <QHash>
+#include <QPair>
 #include <QVector>
 
 #include "hashstring.h"
@@ -12,10 +14,21 @@ enum class loliFlags : quint8 {
     CALLOC_ = 2,
     MEMALIGN_ = 3,
     REALLOC_ = 4,
+    STACK_ = 5,
+    MMAP_ = 6, // a mapped range, size_ is its length
+    MUNMAP_ = 7, // seq, addr, length
+};
+
+enum class loliRecordTypes : quint8 {
+    NOSTACK_ = 0,
+    STACKTRACE_ = 1,
+    STACKID_ = 2,
 };
 
 enum class loliCommands : quint8 {
     SMAPS_DUMP = 0,
+    STATS = 1,
+    PROTOCOL_VERSION = 2,
 };
 
 struct RawStackInfo {
@@ -24,11 +37,63 @@ struct RawStackInfo {
     quint32 size_;
     quint64 addr_;
     quint8 recType_;
+    quint32 stackId_ = 0;
     HashString library_;
-    QVector<quint64> stacktraces_;
+    // STACKTRACE_ frames, a range of the batch's frame pool
+    quint32 frameOffset_ = 0;
+    quint32 frameCount_ = 0;
+};
+
+// a callstack the agent sent once and refers to by id
+struct StackDefinition {
+    quint32 stackId_;
+    quint32 frameOffset_;
+    quint32 frameCount_;
+};
+
+// Records decoded from one or more packets. Batches are recycled by the
+// decoder, the vectors keep their capacity between uses.
+struct StackTraceBatch {
+    QVector<RawStackInfo> stacks_;
+    QVector<QPair<quint32, quint64>> frees_;
+    QVector<StackDefinition> definitions_;
+    QVector<quint64> frames_;
+    // library names seen for the first time, registered as HashStrings on
+    // the main thread since their table isn't thread safe
+    QVector<QPair<quint32, QString>> libraries_;
+    quint32 connection_ = 0;
+
+    const quint64* Frames(const RawStackInfo& info) const { return frames_.constData() + info.frameOffset_; }
+    void Clear() {
+        stacks_.resize(0);
+        frees_.resize(0);
+        definitions_.resize(0);
+        frames_.resize(0);
+        libraries_.resize(0);
+    }
+};
+
+// decoder throughput during the last agent stats period
+struct DecoderStats {
+    quint64 bytes_ = 0; // uncompressed bytes decoded
+    quint64 records_ = 0;
+    quint32 pendingBatches_ = 0; // decoded but not read yet
+};
+
+// sent by the agent once per second
+struct AgentStats {
+    quint64 backlog_ = 0; // bytes waiting to be sent on the device
+    quint64 rawBytes_ = 0; // uncompressed bytes sent during the last second
+    quint64 compressedBytes_ = 0; // compressed bytes sent during the last second
+    quint64 dropped_ = 0; // events dropped since the app started
+
+    double CompressionRatio() const {
+        return compressedBytes_ > 0 ? static_cast<double>(rawBytes_) / compressedBytes_ : 0.0;
+    }
 };
 
-class QTcpSocket;
+class QThread;
+class StackTraceDecoder;
 class StackTraceProcess : public QObject {
     Q_OBJECT
 public:
@@ -42,8 +107,18 @@ public:
     bool IsConnected() const { return serverConnected_; }
     void Send(const char* data, int length);
 
-    const QVector<RawStackInfo>& GetStackInfo() const { return stackInfo_; }
-    const QVector<QPair<quint32, quint64>>& GetFreeInfo() const { return freeInfo_; }
+    // the batch being delivered, only valid while DataReceived() is emitted
+    const StackTraceBatch& GetBatch() const { return *batch_; }
+    const AgentStats& GetAgentStats() const { return agentStats_; }
+    const DecoderStats& GetDecoderStats() const { return decoderStats_; }
+    // protocol version agreed with the agent, 0 until the agent answers
+    quint32 GetProtocolVersion() const { return protocolVersion_; }
+    // appends the uncompressed payload of every stack trace packet to path,
+    // as [quint32 size][records], an empty path stops recording
+    bool SetRecordFile(const QString& path);
+    // callstacks defined by the agent, a record may arrive before its stack's definition
+    const QVector<quint64>* FindStack(quint32 stackId) const;
+    void ClearStacks() { stackTable_.clear(); }
 
     void SetExecutablePath(const QString& str) { execPath_ = str; }
     const QString& GetExecutablePath() const { return execPath_; }
@@ -55,28 +130,33 @@ signals:
     void DataReceived();
     void ConnectionLost();
     void SMapsDumped();
+    void StatsReceived();
 
 private:
-    void ReadPacket(const QByteArray& bytes);
-    void ReadStackTracePacket(const QByteArray& bytes);
-    void CommandHandler(quint32 cmd);
-    void OnDataReceived();
-    void OnConnected();
-    void OnDisconnected();
+    // reads every batch the decoder has queued
+    void DrainBatches();
+    void CommandHandler(quint32 cmd, const QByteArray& bytes);
+    void OnConnected(quint32 connection);
+    void OnDisconnected(quint32 connection);
 
 private:
     QString execPath_;
     QString deviceSerial_;
-    QVector<RawStackInfo> stackInfo_;
-    QVector<QPair<quint32, quint64>> freeInfo_;
-    QTcpSocket* socket_ = nullptr;
+    QHash<quint32, QVector<quint64>> stackTable_;
+    AgentStats agentStats_;
+    DecoderStats decoderStats_;
+    quint64 decodedBytes_ = 0;
+    quint64 decodedRecords_ = 0;
+    quint32 protocolVersion_ = 0;
+    // the socket is read and decoded on its own thread
+    QThread* thread_ = nullptr;
+    StackTraceDecoder* decoder_ = nullptr;
+    const StackTraceBatch* batch_ = nullptr;
+    // bumped by every ConnectToServer(), late batches and events of an
+    // older connection are dropped
+    quint32 connection_ = 0;
     bool connectingServer_ = false;
     bool serverConnected_ = false;
-    quint32 packetSize_ = 0;
-    char* buffer_ = nullptr;
-    char* compressBuffer_ = nullptr;
-    quint32 compressBufferSize_ = 1024;
-    QByteArray bufferCache_;
 };
 
 #endif // STACKTRACEPROCESS_H
@@ -24,6 +24,10 @@ public:
         const QString& arch, bool interceptMode, QProgressDialog* dialog);
     bool GetSMapsByRunAs(const QString& appName, const QString& appPid);
 
+    bool IsRootDevice() const {
+        return isRootDevice_;
+    }
+
 protected:
     bool StartProcess(QProcess* process, const QString& message);
     void OnProcessFinihed() override;
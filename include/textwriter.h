@@ -0,0 +1,58 @@
+#ifndef TEXTWRITER_H
+#define TEXTWRITER_H
+
+#include <QByteArray>
+#include <QFuture>
+#include <QString>
+#include <QVector>
+
+class QIODevice;
+
+// Buffered text output for exports of whole captures. Numbers are formatted
+// straight into the buffer, text reaches the device in large chunks. Gzip
+// output is one member per chunk, deflated on the global thread pool while
+// the next chunk is filled, gzip and zcat read the members as one file.
+class TextWriter {
+public:
+    // hexadecimal digits of a number, lower case without a prefix
+    struct Hex {
+        explicit Hex(quint64 value) : value_(value) {}
+        quint64 value_;
+    };
+
+    // text stays in memory, see Text()
+    TextWriter();
+    TextWriter(QIODevice* device, bool compressed);
+
+    TextWriter& operator<<(char c);
+    TextWriter& operator<<(const char* text);
+    TextWriter& operator<<(const QByteArray& text);
+    // utf-8
+    TextWriter& operator<<(const QString& text);
+    TextWriter& operator<<(qint32 value) { return *this << static_cast<qint64>(value); }
+    TextWriter& operator<<(quint32 value) { return *this << static_cast<quint64>(value); }
+    TextWriter& operator<<(qint64 value);
+    TextWriter& operator<<(quint64 value);
+    TextWriter& operator<<(Hex value);
+
+    // text of a writer without device
+    const QByteArray& Text() const { return buffer_; }
+    // writes what's left and waits for the compressed chunks, false if
+    // writing to the device failed at any point
+    bool Finish();
+
+private:
+    void Append(const char* data, int size);
+    void Flush();
+    void Write(const QByteArray& data);
+    void WriteMember(const QByteArray& member);
+
+    QIODevice* device_ = nullptr;
+    bool compressed_ = false;
+    QByteArray buffer_;
+    // gzip members in the order they go out
+    QVector<QFuture<QByteArray>> pending_;
+    bool ok_ = true;
+};
+
+#endif // TEXTWRITER_H
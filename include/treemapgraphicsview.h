@@ -4,10 +4,10 @@
 #include <QGraphicsView>
 #include <QGraphicsObject>
 #include <QMap>
+#include <QModelIndex>
 
+class QAbstractItemModel;
 class QGraphicsScene;
-class QTreeWidget;
-class QTreeWidgetItem;
 class QTimer;
 
 class TreeMap {
@@ -53,21 +53,21 @@ class TreeMapGraphicsView : public QGraphicsView {
     Q_OBJECT
 private:
     struct ItemInfo {
-        QTreeWidgetItem* treeItem_ = nullptr;
+        QModelIndex index_;
         TreeMapNode* node_ = nullptr;
         QRectF rect_;
         qulonglong size_ = 0ull;
         int depth_ = 0;
     };
 public:
-    TreeMapGraphicsView(QList<QTreeWidgetItem*>& topLevelItems, QWidget *parent = nullptr);
-    ~TreeMapGraphicsView() override;
-    void Generate(QTreeWidgetItem* parent, QRectF rect, int depth);
+    // rows of the model's first column, sizes are the UserRole of its second
+    TreeMapGraphicsView(QAbstractItemModel* model, QWidget *parent = nullptr);
+    void Generate(const QModelIndex& parent, QRectF rect, int depth);
 
 protected:
-    void Generate(QTreeWidgetItem* item, int maxDepth);
-    QTreeWidgetItem* GetChild(QTreeWidgetItem* item, int index) const;
-    int GetChildCount(QTreeWidgetItem* item) const;
+    void Generate(const QModelIndex& item, int maxDepth);
+    QModelIndex GetChild(const QModelIndex& item, int index) const;
+    int GetChildCount(const QModelIndex& item) const;
     TreeMapNode* GetTreeMapNode(ItemInfo& item, QRectF rect);
 
     void showEvent(QShowEvent *event) override;
@@ -77,12 +77,12 @@ private slots:
 
 private:
     QTimer* mainTimer_;
-    QList<QTreeWidgetItem*>& topLevelItems_;
+    QAbstractItemModel* model_;
     QGraphicsScene* scene_ = nullptr;
-    QMap<QTreeWidgetItem*, ItemInfo> itemInfoMap_;
+    QMap<QModelIndex, ItemInfo> itemInfoMap_;
     int prevWidth_ = 0;
     int prevHeight_ = 0;
-    QTreeWidgetItem* targetItem_ = nullptr;
+    QModelIndex targetItem_;
     int targetDepth_ = -1;
 
     QPen rectPen { QColor(255, 255, 255) };
@@ -42,12 +42,23 @@ SOURCES += \
         src/mainwindow.cpp \
         src/memgraphicsview.cpp \
         src/meminfoprocess.cpp \
+        src/mapsprocess.cpp \
         src/pathutils.cpp \
         src/screenshotprocess.cpp \
         src/selectappdialog.cpp \
         src/stacktracemodel.cpp \
+        src/stacktracedecoder.cpp \
         src/stacktraceprocess.cpp \
-        src/stacktraceproxymodel.cpp \
+        src/callstacktable.cpp \
+        src/calltreebuilder.cpp \
+        src/calltreemodel.cpp \
+        src/leakdiff.cpp \
+        src/elfsymbolizer.cpp \
+        src/textwriter.cpp \
+        src/liveaddressmap.cpp \
+        src/recordindex.cpp \
+        src/lolifile.cpp \
+        src/spilllog.cpp \
         src/startappprocess.cpp \
         src/treemapgraphicsview.cpp \
         src/hashstring.cpp
@@ -70,10 +81,22 @@ HEADERS += \
         include/mainwindow.h \
         include/memgraphicsview.h \
         include/meminfoprocess.h \
+        include/mapsprocess.h \
         include/screenshotprocess.h \
         include/stacktracemodel.h \
+        include/spscqueue.h \
+        include/stacktracedecoder.h \
         include/stacktraceprocess.h \
-        include/stacktraceproxymodel.h \
+        include/callstacktable.h \
+        include/calltreebuilder.h \
+        include/calltreemodel.h \
+        include/leakdiff.h \
+        include/elfsymbolizer.h \
+        include/textwriter.h \
+        include/liveaddressmap.h \
+        include/recordindex.h \
+        include/lolifile.h \
+        include/spilllog.h \
         include/startappprocess.h \
         include/timeprofiler.h \
         include/treemapgraphicsview.h \
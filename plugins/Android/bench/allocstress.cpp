@@ -0,0 +1,221 @@
+// Multi-threaded allocation stress test for the host agent. Run it once as is
+// and once under libloli_preload.so to get the per allocation overhead:
+//
+//   allocstress [threads] [operations per thread]
+//   LOLI_THRESHOLD=0 LD_PRELOAD=./libloli_preload.so allocstress [threads] [operations per thread]
+//
+// When the agent is preloaded a client in the same process connects to it
+// on LOLI_PORT, decodes packets the way StackTraceProcess does and reports
+// how many events per second are delivered.
+
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "lz4/lz4.h"
+
+#define LZ4DICTSIZE (64 * 1024)
+
+typedef std::chrono::steady_clock clock_type;
+
+struct clientStats {
+    std::atomic<uint64_t> allocs {0};
+    std::atomic<uint64_t> frees {0};
+    std::atomic<uint64_t> stacks {0};
+    std::atomic<uint64_t> bytes {0};
+    std::atomic<uint64_t> dropped {0};
+    std::atomic<int64_t> lastEventNs {0};
+    std::atomic<bool> connected {false};
+    std::atomic<bool> stop {false};
+};
+
+static bool readFully(int sock, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t length = recv(sock, data, size, 0);
+        if (length <= 0)
+            return false;
+        data += length;
+        size -= length;
+    }
+    return true;
+}
+
+static void countRecords(const char* data, size_t size, clientStats& stats) {
+    size_t offset = 0;
+    while (offset + sizeof(uint16_t) < size) {
+        uint16_t recordSize = 0;
+        memcpy(&recordSize, data + offset, sizeof(recordSize));
+        uint8_t type = static_cast<uint8_t>(data[offset + sizeof(uint16_t)]);
+        if (type == 0)
+            stats.frees++;
+        else if (type == 5)
+            stats.stacks++;
+        else
+            stats.allocs++;
+        offset += sizeof(uint16_t) + recordSize;
+    }
+}
+
+// same framing as StackTraceProcess::OnDataReceived / ReadStackTracePacket
+static void runClient(int port, clock_type::time_point start, clientStats& stats) {
+    int sock = -1;
+    for (int retry = 0; retry < 100 && !stats.stop; retry++) {
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0)
+            break;
+        close(sock);
+        sock = -1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (sock < 0) {
+        fprintf(stderr, "Failed to connect to port %d\n", port);
+        stats.connected = true;
+        return;
+    }
+    timeval timeout = {0, 100000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    const char handshake[2] = {2, 1}; // PROTOCOL_VERSION, streamed lz4
+    send(sock, handshake, sizeof(handshake), 0);
+    stats.connected = true;
+    // buffers are allocated once, the client must not show up in its own capture
+    std::vector<char> packet(8 << 20), history(LZ4DICTSIZE), records(8 << 20);
+    size_t historySize = 0;
+    while (!stats.stop) {
+        uint32_t packetSize = 0;
+        if (!readFully(sock, reinterpret_cast<char*>(&packetSize), sizeof(packetSize))) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                continue;
+            break;
+        }
+        if (packetSize > packet.size() || !readFully(sock, packet.data(), packetSize))
+            break;
+        uint32_t type = 0;
+        memcpy(&type, packet.data(), sizeof(type));
+        if (type == 1) { // command, only stats are of interest
+            uint32_t command = 0;
+            memcpy(&command, packet.data() + 4, sizeof(command));
+            if (command == 1 && packetSize >= 8 + 4 * sizeof(uint64_t)) {
+                uint64_t dropped = 0;
+                memcpy(&dropped, packet.data() + 8 + 3 * sizeof(uint64_t), sizeof(dropped));
+                stats.dropped = dropped;
+            }
+            continue;
+        }
+        int compressedSize = static_cast<int>(packetSize) - 8;
+        int size = 0;
+        if (type == 2) {
+            LZ4_streamDecode_t streamDecode;
+            LZ4_setStreamDecode(&streamDecode, history.data(), static_cast<int>(historySize));
+            size = LZ4_decompress_safe_continue(&streamDecode, packet.data() + 8, records.data(),
+                compressedSize, static_cast<int>(records.size()));
+            if (size > 0) {
+                size_t keep = size >= LZ4DICTSIZE ? 0 : std::min(historySize, static_cast<size_t>(LZ4DICTSIZE - size));
+                memmove(history.data(), history.data() + historySize - keep, keep);
+                size_t append = std::min(static_cast<size_t>(size), static_cast<size_t>(LZ4DICTSIZE));
+                memcpy(history.data() + keep, records.data() + size - append, append);
+                historySize = keep + append;
+            }
+        } else {
+            size = LZ4_decompress_safe(packet.data() + 8, records.data(), compressedSize, static_cast<int>(records.size()));
+        }
+        if (size <= 0) {
+            fprintf(stderr, "LZ4 decompression failed\n");
+            break;
+        }
+        countRecords(records.data(), size, stats);
+        stats.bytes += size;
+        stats.lastEventNs = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count();
+    }
+    close(sock);
+}
+
+static void runWorker(int seed, size_t operations, std::atomic<bool>& go) {
+    // live set of 1024 blocks, log-uniform sizes between 16 bytes and 4KB
+    std::vector<void*> slots(1024, nullptr);
+    uint64_t random = 0x9E3779B97F4A7C15ULL * (seed + 1);
+    while (!go)
+        std::this_thread::yield();
+    for (size_t i = 0; i < operations; i++) {
+        random ^= random >> 12;
+        random ^= random << 25;
+        random ^= random >> 27;
+        uint64_t value = random * 0x2545F4914F6CDD1DULL;
+        auto& slot = slots[value & 1023];
+        free(slot);
+        slot = malloc(static_cast<size_t>(16) << ((value >> 10) % 9));
+        *static_cast<volatile char*>(slot) = 0;
+    }
+    for (auto ptr : slots)
+        free(ptr);
+}
+
+int main(int argc, char** argv) {
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    size_t operations = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1000000;
+    bool preloaded = dlsym(RTLD_DEFAULT, "loli_start_standalone") != nullptr;
+    int port = getenv("LOLI_PORT") ? atoi(getenv("LOLI_PORT")) : 7100;
+
+    clientStats stats;
+    auto start = clock_type::now();
+    std::thread client;
+    if (preloaded) {
+        client = std::thread(runClient, port, start, std::ref(stats));
+        while (!stats.connected)
+            std::this_thread::yield();
+    }
+    std::atomic<bool> go {false};
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back(runWorker, i, operations, std::ref(go));
+    start = clock_type::now();
+    go = true;
+    for (auto& worker : workers)
+        worker.join();
+    double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+    uint64_t total = static_cast<uint64_t>(threads) * operations;
+    printf("%s: %d threads, %llu malloc/free pairs, %.1f ns per pair per thread\n",
+        preloaded ? "preloaded" : "baseline", threads, static_cast<unsigned long long>(total),
+        seconds * 1e9 * threads / total);
+    if (!preloaded)
+        return 0;
+    // wait until the backlog is drained, every pair is one malloc and one free event
+    uint64_t expected = 2 * total;
+    auto lastCount = stats.allocs + stats.frees;
+    auto lastChange = clock_type::now();
+    while (stats.allocs + stats.frees + stats.dropped < expected &&
+           clock_type::now() - lastChange < std::chrono::seconds(2)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        auto count = stats.allocs + stats.frees;
+        if (count != lastCount) {
+            lastCount = count;
+            lastChange = clock_type::now();
+        }
+    }
+    stats.stop = true;
+    client.join();
+    uint64_t events = stats.allocs + stats.frees;
+    double eventSeconds = stats.lastEventNs / 1e9;
+    printf("client: %llu allocs, %llu frees, %llu stacks, %.1f MB decoded, %llu dropped\n",
+        static_cast<unsigned long long>(stats.allocs.load()), static_cast<unsigned long long>(stats.frees.load()),
+        static_cast<unsigned long long>(stats.stacks.load()), stats.bytes / (1024.0 * 1024.0),
+        static_cast<unsigned long long>(stats.dropped.load()));
+    printf("client: %.0f events/s delivered\n", eventSeconds > 0 ? events / eventSeconds : 0.0);
+    return 0;
+}
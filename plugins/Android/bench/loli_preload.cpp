@@ -0,0 +1,116 @@
+// LD_PRELOAD front end of the host agent, records the allocations of any
+// dynamically linked program:
+//
+//   LOLI_MODE=strict LOLI_THRESHOLD=0 LD_PRELOAD=./libloli_preload.so ./program
+//
+// LOLI_MODE is strict, loose or nostack, LOLI_THRESHOLD the minimum recorded
+// size (the sampling interval in loose mode) and LOLI_PORT the server port,
+// 7100 by default. Connect to it like to the agent on a device.
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "loli.h"
+#include "loli_server.h"
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+void loli_custom_free(void* ptr);
+}
+
+namespace {
+
+int index_ = -1;
+// set while the agent itself allocates, or before it is started
+thread_local bool inside_ = false;
+
+inline void loli_preload_alloc(void* ptr, size_t size) {
+    if (index_ < 0 || ptr == nullptr || inside_)
+        return;
+    inside_ = true;
+    loli_index_custom_alloc(ptr, size, index_);
+    inside_ = false;
+}
+
+inline void loli_preload_free(void* ptr) {
+    if (index_ < 0 || ptr == nullptr || inside_)
+        return;
+    inside_ = true;
+    loli_custom_free(ptr);
+    inside_ = false;
+}
+
+__attribute__((constructor)) void loli_preload_init() {
+    int mode = 0;
+    if (auto value = getenv("LOLI_MODE")) {
+        mode = strcmp(value, "loose") == 0 ? 1 : strcmp(value, "nostack") == 0 ? 2 : 0;
+    }
+    auto threshold = getenv("LOLI_THRESHOLD");
+    auto port = getenv("LOLI_PORT");
+    inside_ = true;
+    index_ = loli_start_standalone(mode, threshold ? atoi(threshold) : 0, port ? atoi(port) : 7100, "preload");
+    inside_ = false;
+}
+
+__attribute__((destructor)) void loli_preload_shutdown() {
+    // stop the server thread before the statics it uses are destroyed
+    index_ = -1;
+    loli_server_shutdown();
+}
+
+} // namespace
+
+extern "C" {
+
+void* malloc(size_t size) {
+    auto ptr = __libc_malloc(size);
+    loli_preload_alloc(ptr, size);
+    return ptr;
+}
+
+void* calloc(size_t n, size_t size) {
+    auto ptr = __libc_calloc(n, size);
+    loli_preload_alloc(ptr, n * size);
+    return ptr;
+}
+
+void* realloc(void* ptr, size_t size) {
+    auto addr = __libc_realloc(ptr, size);
+    if (addr != nullptr || size == 0)
+        loli_preload_free(ptr);
+    loli_preload_alloc(addr, size);
+    return addr;
+}
+
+void* memalign(size_t alignment, size_t size) {
+    auto ptr = __libc_memalign(alignment, size);
+    loli_preload_alloc(ptr, size);
+    return ptr;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    auto addr = memalign(alignment, size);
+    if (addr == nullptr)
+        return ENOMEM;
+    *ptr = addr;
+    return 0;
+}
+
+void free(void* ptr) {
+    loli_preload_free(ptr);
+    __libc_free(ptr);
+}
+
+} // extern "C"
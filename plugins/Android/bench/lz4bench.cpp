@@ -0,0 +1,160 @@
+// Compares per packet lz4 compression with the streamed mode of protocol
+// version 1 on a capture recorded by LoliProfilerCLI --record-packets.
+//
+//   lz4bench <capture> [batch bytes]
+//
+// The capture is a sequence of [uint32 size][records] packets. Packets are
+// replayed as recorded, or re-split into batches of framed records no bigger
+// than the given size to simulate other send patterns.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "lz4/lz4.h"
+
+#define LZ4DICTSIZE (64 * 1024)
+
+typedef std::vector<char> packet;
+
+static bool loadCapture(const char* path, std::vector<packet>& packets) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+    uint32_t size = 0;
+    while (fread(&size, sizeof(size), 1, file) == 1) {
+        packet data(size);
+        if (size > 0 && fread(data.data(), 1, size, file) != size) {
+            fprintf(stderr, "Truncated packet in %s\n", path);
+            break;
+        }
+        packets.push_back(std::move(data));
+    }
+    fclose(file);
+    return true;
+}
+
+// re-split the records of all packets into batches of at most batchSize bytes
+static std::vector<packet> rebatch(const std::vector<packet>& packets, size_t batchSize) {
+    std::vector<packet> batches(1);
+    for (auto& data : packets) {
+        size_t offset = 0;
+        while (offset + sizeof(uint16_t) <= data.size()) {
+            uint16_t size = 0;
+            memcpy(&size, data.data() + offset, sizeof(size));
+            size_t recordSize = sizeof(uint16_t) + size;
+            if (offset + recordSize > data.size())
+                break;
+            if (!batches.back().empty() && batches.back().size() + recordSize > batchSize)
+                batches.emplace_back();
+            batches.back().insert(batches.back().end(), data.data() + offset, data.data() + offset + recordSize);
+            offset += recordSize;
+        }
+    }
+    return batches;
+}
+
+struct result {
+    size_t rawBytes = 0;
+    size_t compressedBytes = 0;
+    double compressSeconds = 0;
+    double decompressSeconds = 0;
+    bool valid = true;
+};
+
+static double seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static result run(const std::vector<packet>& packets, bool streamed) {
+    result res;
+    std::vector<packet> compressed;
+    compressed.reserve(packets.size());
+    // compression side, mirrors sendRecords in loli_server.cpp
+    LZ4_stream_t* stream = LZ4_createStream();
+    std::vector<char> dict(LZ4DICTSIZE);
+    auto start = std::chrono::steady_clock::now();
+    for (auto& data : packets) {
+        int srcSize = static_cast<int>(data.size());
+        packet dst(LZ4_compressBound(srcSize));
+        int size = 0;
+        if (streamed) {
+            size = LZ4_compress_fast_continue(stream, data.data(), dst.data(), srcSize, static_cast<int>(dst.size()), 1);
+            LZ4_saveDict(stream, dict.data(), LZ4DICTSIZE);
+        } else {
+            size = LZ4_compress_default(data.data(), dst.data(), srcSize, static_cast<int>(dst.size()));
+        }
+        dst.resize(size);
+        res.rawBytes += data.size();
+        res.compressedBytes += size;
+        compressed.push_back(std::move(dst));
+    }
+    res.compressSeconds = seconds(start);
+    LZ4_freeStream(stream);
+    // decompression side, mirrors StackTraceProcess::ReadStackTracePacket
+    std::vector<char> history;
+    packet out;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < packets.size(); i++) {
+        out.resize(packets[i].size());
+        auto& src = compressed[i];
+        int size = 0;
+        if (streamed) {
+            LZ4_streamDecode_t streamDecode;
+            LZ4_setStreamDecode(&streamDecode, history.data(), static_cast<int>(history.size()));
+            size = LZ4_decompress_safe_continue(&streamDecode, src.data(), out.data(),
+                static_cast<int>(src.size()), static_cast<int>(out.size()));
+            if (size > 0) {
+                history.insert(history.end(), out.data(), out.data() + size);
+                if (history.size() > LZ4DICTSIZE)
+                    history.erase(history.begin(), history.end() - LZ4DICTSIZE);
+            }
+        } else {
+            size = LZ4_decompress_safe(src.data(), out.data(), static_cast<int>(src.size()), static_cast<int>(out.size()));
+        }
+        if (size != static_cast<int>(packets[i].size()) || memcmp(out.data(), packets[i].data(), size) != 0)
+            res.valid = false;
+    }
+    res.decompressSeconds = seconds(start);
+    return res;
+}
+
+static void print(const char* name, const result& res) {
+    double mb = res.rawBytes / (1024.0 * 1024.0);
+    printf("%-10s ratio %6.2f  compress %8.2f ms/MB  decompress %8.2f ms/MB%s\n", name,
+        res.compressedBytes > 0 ? static_cast<double>(res.rawBytes) / res.compressedBytes : 0.0,
+        mb > 0 ? res.compressSeconds * 1000 / mb : 0.0,
+        mb > 0 ? res.decompressSeconds * 1000 / mb : 0.0,
+        res.valid ? "" : "  ROUND TRIP FAILED");
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <capture> [batch bytes]\n", argv[0]);
+        return 1;
+    }
+    std::vector<packet> packets;
+    if (!loadCapture(argv[1], packets) || packets.empty()) {
+        fprintf(stderr, "No packets in %s\n", argv[1]);
+        return 1;
+    }
+    if (argc > 2)
+        packets = rebatch(packets, static_cast<size_t>(strtoul(argv[2], nullptr, 10)));
+    size_t rawBytes = 0;
+    for (auto& data : packets)
+        rawBytes += data.size();
+    printf("%zu packets, %.2f MB, %.1f KB per packet\n", packets.size(), 
+        rawBytes / (1024.0 * 1024.0), rawBytes / 1024.0 / packets.size());
+    auto perPacket = run(packets, false);
+    auto streamed = run(packets, true);
+    print("packet", perPacket);
+    print("stream", streamed);
+    return perPacket.valid && streamed.valid ? 0 : 2;
+}
@@ -0,0 +1,169 @@
+// Checks the per thread sampler against the original std::exponential_distribution
+// based one on synthetic allocation streams, and compares their cost.
+//
+//   samplerbench [sampling interval] [allocations]
+//
+// Both samplers are unbiased estimators of the allocated bytes, their
+// estimate and the number of sampled allocations must be within 1% of the
+// expected values. On a stream of allocations smaller than the interval the
+// estimate of every power of two size bucket must be within 2% of its bytes.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "sampler.h"
+#include "spinlock.h"
+
+// enough allocations for every bucket of the small size stream to be within
+// 2% at a 4096 byte interval, the smallest bucket gets half of them
+#define SMALLSIZECOUNT 32000000
+
+// the sampler loli.cpp used before, behind samplerLock_
+class ReferenceSampler {
+public:
+    explicit ReferenceSampler(uint64_t interval)
+        : interval_(interval), rate_(1.0 / static_cast<double>(interval)), engine_(1),
+          next_(NextSampleInterval()) {}
+
+    size_t SampleSize(size_t size) {
+        if (size >= interval_)
+            return size;
+        next_ -= size;
+        size_t samples = 0;
+        while (next_ <= 0) {
+            next_ += NextSampleInterval();
+            ++samples;
+        }
+        return static_cast<size_t>(interval_ * samples);
+    }
+
+private:
+    int64_t NextSampleInterval() {
+        std::exponential_distribution<double> dist(rate_);
+        return static_cast<int64_t>(dist(engine_)) + 1;
+    }
+
+    uint64_t interval_;
+    double rate_;
+    std::default_random_engine engine_;
+    int64_t next_;
+};
+
+struct stats {
+    double estimated = 0;
+    uint64_t samples = 0;
+    double seconds = 0;
+};
+
+// log-uniform sizes from 8 bytes to 64KB with a few big ones, like a typical heap
+static std::vector<size_t> makeStream(size_t count, uint64_t seed) {
+    std::mt19937_64 engine(seed);
+    std::uniform_real_distribution<double> exponent(3.0, 16.0);
+    std::vector<size_t> sizes(count);
+    for (auto& size : sizes)
+        size = static_cast<size_t>(pow(2.0, exponent(engine)));
+    return sizes;
+}
+
+// allocations below the interval only, each power of two bucket from 8 bytes gets
+// about the same number of bytes, so the small buckets get most allocations
+static bool checkSmallSizes(uint64_t interval, size_t count, uint64_t seed) {
+    std::vector<uint64_t> lows;
+    std::vector<double> weights;
+    for (uint64_t low = 8; low < interval; low *= 2) {
+        lows.push_back(low);
+        weights.push_back(1.0 / low);
+    }
+    if (lows.empty())
+        return true;
+    std::mt19937_64 engine(seed);
+    std::discrete_distribution<size_t> bucket(weights.begin(), weights.end());
+    std::vector<double> bytes(lows.size(), 0);
+    std::vector<double> estimated(lows.size(), 0);
+    loli::Sampler sampler(interval);
+    loli::SamplerState state;
+    for (size_t i = 0; i < count; i++) {
+        auto index = bucket(engine);
+        auto high = std::min(lows[index] * 2, interval);
+        auto size = static_cast<size_t>(lows[index] + engine() % (high - lows[index]));
+        bytes[index] += size;
+        estimated[index] += sampler.SampleSize(state, size);
+    }
+    bool ok = true;
+    printf("%zu allocations below the interval\n", count);
+    for (size_t i = 0; i < lows.size(); i++) {
+        auto error = estimated[i] / bytes[i] - 1;
+        auto high = std::min(lows[i] * 2, interval);
+        printf("  %5llu-%-5llu %8.1f MB  estimate %+.3f%%\n", static_cast<unsigned long long>(lows[i]),
+            static_cast<unsigned long long>(high - 1), bytes[i] / (1024 * 1024), error * 100);
+        ok = ok && fabs(error) < 0.02;
+    }
+    return ok;
+}
+
+template <typename Fn>
+static stats run(const std::vector<size_t>& sizes, Fn sample) {
+    stats res;
+    auto start = std::chrono::steady_clock::now();
+    for (auto size : sizes) {
+        size_t sampled = sample(size);
+        if (sampled > 0) {
+            res.estimated += sampled;
+            res.samples++;
+        }
+    }
+    res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return res;
+}
+
+int main(int argc, char** argv) {
+    uint64_t interval = argc > 1 ? strtoull(argv[1], nullptr, 10) : 4096;
+    if (interval == 0) {
+        fprintf(stderr, "sampling interval must be positive\n");
+        return 1;
+    }
+    size_t count = argc > 2 ? strtoull(argv[2], nullptr, 10) : 10000000;
+    auto sizes = makeStream(count, 42);
+    double total = 0;
+    for (auto size : sizes)
+        total += size;
+
+    ReferenceSampler reference(interval);
+    loli::spinlock lock;
+    auto ref = run(sizes, [&](size_t size) {
+        std::lock_guard<loli::spinlock> guard(lock);
+        return reference.SampleSize(size);
+    });
+    loli::Sampler sampler(interval);
+    loli::SamplerState state;
+    auto cur = run(sizes, [&](size_t size) { return sampler.SampleSize(state, size); });
+
+    // every byte is sampled with probability 1 / interval, so an allocation smaller than
+    // the interval is sampled at least once with probability 1 - exp(-size / interval)
+    double expected = 0;
+    for (auto size : sizes)
+        expected += size < interval ? 1 - exp(-static_cast<double>(size) / interval) : 1;
+    printf("%zu allocations, %.1f MB, interval %llu, expected samples %.0f\n", count,
+        total / (1024 * 1024), static_cast<unsigned long long>(interval), expected);
+    auto print = [&](const char* name, const stats& res) {
+        printf("%-10s samples %10llu (%+.2f%%)  estimate %+.3f%%  %.2f ns/alloc\n", name,
+            static_cast<unsigned long long>(res.samples), (res.samples / expected - 1) * 100,
+            (res.estimated / total - 1) * 100, res.seconds * 1e9 / count);
+    };
+    print("reference", ref);
+    print("sampler", cur);
+    // within 1% of the expected number of sampled allocations and of the real total
+    bool ok = fabs(cur.samples / expected - 1) < 0.01 && fabs(cur.estimated / total - 1) < 0.01;
+    ok = checkSmallSizes(interval, SMALLSIZECOUNT, 7) && ok;
+    printf("%s\n", ok ? "OK" : "MISMATCH");
+    return ok ? 0 : 2;
+}
@@ -0,0 +1,46 @@
+#pragma once
+// Host replacement of the NDK's android/log.h, messages go to stderr.
+// Set LOLI_LOG_LEVEL to the lowest priority to print, default is warnings.
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+typedef enum android_LogPriority {
+    ANDROID_LOG_UNKNOWN = 0,
+    ANDROID_LOG_DEFAULT,
+    ANDROID_LOG_VERBOSE,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL,
+    ANDROID_LOG_SILENT,
+} android_LogPriority;
+
+static inline int __android_log_print(int prio, const char* tag, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static inline int __android_log_print(int prio, const char* tag, const char* fmt, ...) {
+    static int minPrio = -1;
+    if (minPrio < 0) {
+        const char* level = getenv("LOLI_LOG_LEVEL");
+        minPrio = level != NULL ? atoi(level) : ANDROID_LOG_WARN;
+    }
+    if (prio < minPrio)
+        return 0;
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "%s: ", tag);
+    int result = vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+    return result;
+}
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -0,0 +1,20 @@
+#pragma once
+// The few jni.h declarations JNI_OnLoad needs to compile on the host, there is
+// no JVM there so the host build starts with loli_start_standalone instead.
+
+#define JNI_OK 0
+#define JNI_ERR (-1)
+#define JNI_VERSION_1_6 0x00010006
+#define JNIEXPORT __attribute__((visibility("default")))
+
+typedef int jint;
+
+struct _JNIEnv;
+typedef struct _JNIEnv JNIEnv;
+
+#ifdef __cplusplus
+struct _JavaVM {
+    jint GetEnv(void**, jint) { return JNI_ERR; }
+};
+typedef _JavaVM JavaVM;
+#endif // __cplusplus
@@ -0,0 +1,50 @@
+// Host versions of the Android only parts of the agent. PLT hooking through
+// xhook is not available, LD_PRELOAD of libloli_preload replaces it, and
+// linker namespaces don't exist so fake_dlopen is plain dlopen.
+
+#include <dlfcn.h>
+
+#include "xhook.h"
+#include "loli_dlfcn.h"
+
+int xhook_register(const char *pathname_regex_str, const char *symbol,
+                   void *new_func, void **old_func) {
+    (void)pathname_regex_str;
+    (void)symbol;
+    (void)new_func;
+    (void)old_func;
+    return -1;
+}
+
+int xhook_ignore(const char *pathname_regex_str, const char *symbol) {
+    (void)pathname_regex_str;
+    (void)symbol;
+    return -1;
+}
+
+int xhook_refresh(int async) {
+    (void)async;
+    return -1;
+}
+
+void xhook_clear() {}
+
+void xhook_enable_debug(int flag) {
+    (void)flag;
+}
+
+void xhook_enable_sigsegv_protection(int flag) {
+    (void)flag;
+}
+
+void *fake_dlopen(const char *libpath, int flags) {
+    return dlopen(libpath, flags);
+}
+
+void *fake_dlsym(void *handle, const char *name) {
+    return dlsym(handle, name);
+}
+
+int fake_dlclose(void *handle) {
+    return dlclose(handle);
+}
@@ -15,6 +15,11 @@ void *loli_index_realloc(void *ptr, size_t new_size, int index);
 void *loli_index_mmap(void *ptr, size_t length, int prot, int flags, int fd, off_t offset, int index);
 void *loli_index_mmap64(void *ptr, size_t length, int prot, int flags, int fd, off64_t offset, int index);
 
+// starts recording without a JVM and without hooking any library, mode is a
+// loliDataMode. Returns the index to pass to loli_index_* for events that are
+// attributed to name, or -1.
+int loli_start_standalone(int mode, int minRecSize, int port, const char* name);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
\ No newline at end of file
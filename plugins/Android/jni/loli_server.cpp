@@ -1,6 +1,8 @@
 #include "loli_server.h"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <iomanip>
 #include <iostream>
 #include <mutex>
@@ -9,6 +11,8 @@
 #include <thread>
 #include <vector>
 
+#include "ringbuffer.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
@@ -16,33 +20,98 @@ extern "C" {
 #include <android/log.h>
 #include <string.h>
 
+#include <pthread.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
-#include <sys/select.h>
+#include <linux/sockios.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <errno.h>
 
 #include "lz4/lz4.h"
 #include "buffer.h"
-#include "spinlock.h"
 #include "loli_utils.h"
 
+#define RINGBUFFERSIZE (1 << 18)
+// 0: every packet is compressed on its own
+// 1: packets are the blocks of a single lz4 stream, see LZ4DICTSIZE
+#define LOLI_PROTOCOL_VERSION 1
+// history kept between two blocks of the lz4 stream
+#define LZ4DICTSIZE (64 * 1024)
+
 enum class loliCommands : std::uint8_t {
     SMAPS_DUMP = 0,
+    STATS = 1,
+    PROTOCOL_VERSION = 2,
 };
 
-std::vector<io::buffer> cache_;
-loli::spinlock cacheLock_;
+// every thread that records events owns one ring, rings are never freed so
+// the server can walk this list without locking. rings of exited threads
+// are handed over to new threads.
+std::atomic<loli::ringbuffer*> rings_ {nullptr};
+std::atomic<std::uint64_t> droppedCount_ {0};
+std::atomic<std::uint32_t> generation_ {0};
+pthread_key_t ringKey_;
+static thread_local loli::ringbuffer* threadRing_ = nullptr;
+static thread_local bool threadExited_ = false;
+// allocations of the server thread itself are never recorded
+static thread_local bool serverThread_ = false;
 
 char* buffer_ = NULL;
-const std::size_t bandwidth_ = 3000;
+// batches smaller than minBatchSize_ wait at most maxLatency_ ms for more events
+const std::size_t minBatchSize_ = 16 * 1024;
+const std::size_t maxBatchSize_ = 1024 * 1024;
+const std::size_t minWritableSize_ = 4 * 1024;
+// runs of records smaller than this are copied together before compression
+const std::size_t minRunSize_ = 8 * 1024;
+const int maxLatency_ = 50;
+const int idleTimeout_ = 100;
+const int statsInterval_ = 1000;
+// producers wake the server up once their ring holds at least wakeThreshold_ bytes
+int wakeFd_ = -1;
+std::atomic<std::size_t> wakeThreshold_ {SIZE_MAX};
 std::atomic<bool> serverRunning_ {true};
 std::atomic<bool> hasClient_ {false};
 std::thread socketThread_;
 bool started_ = false;
-bool ignoreCache_ = false;
+std::atomic<bool> ignoreCache_ {false};
+
+void loli_ring_release(void* ptr) {
+    // called on thread exit, events recorded by later tls destructors are dropped
+    auto ring = static_cast<loli::ringbuffer*>(ptr);
+    threadRing_ = nullptr;
+    threadExited_ = true;
+    ring->owned_.store(false, std::memory_order_release);
+}
+
+loli::ringbuffer* loli_ring_acquire() {
+    if (threadRing_ != nullptr)
+        return threadRing_;
+    if (threadExited_)
+        return nullptr;
+    for (auto ring = rings_.load(std::memory_order_acquire); ring != nullptr; ring = ring->next_) {
+        bool owned = false;
+        if (!ring->owned_.load(std::memory_order_relaxed) &&
+            ring->owned_.compare_exchange_strong(owned, true, std::memory_order_acquire)) {
+            threadRing_ = ring;
+            break;
+        }
+    }
+    if (threadRing_ == nullptr) {
+        auto ring = new loli::ringbuffer(RINGBUFFERSIZE);
+        ring->owned_.store(true, std::memory_order_relaxed);
+        ring->next_ = rings_.load(std::memory_order_relaxed);
+        while (!rings_.compare_exchange_weak(ring->next_, ring, std::memory_order_release, std::memory_order_relaxed));
+        threadRing_ = ring;
+    }
+    pthread_setspecific(ringKey_, threadRing_);
+    return threadRing_;
+}
 
 void loli_dump_smaps() {
     auto srcFile = fopen("/proc/self/smaps", "r");
@@ -87,131 +156,332 @@ bool loli_server_started() {
     return started_;
 }
 
+// returns the run of framed records at offset, no more than maxSize bytes unless the first record is bigger
+std::size_t loli_peek_pending(const io::buffer& pending, std::size_t offset, const char*& data, std::size_t maxSize) {
+    std::size_t start = offset;
+    while (offset < pending.size()) {
+        uint16_t size = 0;
+        memcpy(&size, pending.data() + offset, sizeof(uint16_t));
+        if (offset != start && offset + sizeof(uint16_t) + size - start > maxSize)
+            break;
+        offset += sizeof(uint16_t) + size;
+    }
+    data = pending.data() + start;
+    return offset - start;
+}
+
+void loli_collect_rings(std::vector<loli::ringbuffer*>& rings, loli::ringbuffer*& head) {
+    // rings are only ever prepended, so refreshing is only needed when the head changes
+    auto current = rings_.load(std::memory_order_acquire);
+    if (current == head)
+        return;
+    head = current;
+    rings.clear();
+    for (auto ring = current; ring != nullptr; ring = ring->next_)
+        rings.push_back(ring);
+}
+
+std::size_t loli_ring_backlog(const std::vector<loli::ringbuffer*>& rings) {
+    std::size_t backlog = 0;
+    for (auto ring : rings)
+        backlog += ring->size();
+    return backlog;
+}
+
+// free space in the client socket's send queue
+std::size_t loli_socket_writable(int sock, int sendBufferSize) {
+    int queued = 0;
+    if (ioctl(sock, SIOCOUTQ, &queued) < 0)
+        return static_cast<std::size_t>(sendBufferSize);
+    return queued < sendBufferSize ? static_cast<std::size_t>(sendBufferSize - queued) : 0;
+}
+
+// sends [packet size][packet type][payload] with a single syscall
+bool loli_send_packet(int sock, uint32_t packetType, const struct iovec* payload, int count) {
+    uint32_t header[2] = {sizeof(uint32_t), packetType};
+    struct iovec iov[4];
+    iov[0].iov_base = header;
+    iov[0].iov_len = sizeof(header);
+    for (int i = 0; i < count && i < 3; i++) {
+        iov[i + 1] = payload[i];
+        header[0] += static_cast<uint32_t>(payload[i].iov_len);
+    }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count + 1;
+    std::size_t remainBytes = sizeof(uint32_t) + header[0];
+    while (remainBytes > 0) {
+        // MSG_NOSIGNAL: a closed connection must not raise SIGPIPE in the app
+        ssize_t sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            LOLILOGE("Failed to send packet, error: %d", errno);
+            return false;
+        }
+        remainBytes -= sent;
+        // skip what was sent on a partial write
+        while (msg.msg_iovlen > 0 && static_cast<std::size_t>(sent) >= msg.msg_iov->iov_len) {
+            sent -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = static_cast<char*>(msg.msg_iov->iov_base) + sent;
+            msg.msg_iov->iov_len -= sent;
+        }
+    }
+    return true;
+}
+
+bool loli_send_command(int sock, loliCommands command, const void* data = nullptr, std::size_t size = 0) {
+    uint32_t cmd = static_cast<uint32_t>(command);
+    struct iovec payload[2] = {{&cmd, sizeof(cmd)}, {const_cast<void*>(data), size}};
+    return loli_send_packet(sock, 1, payload, size > 0 ? 2 : 1);
+}
+
+void loli_send_stats(int sock, std::uint64_t backlog, std::uint64_t rawBytes, std::uint64_t compressedBytes) {
+    std::uint64_t stats[4] = {backlog, rawBytes, compressedBytes, droppedCount_.load(std::memory_order_relaxed)};
+    loli_send_command(sock, loliCommands::STATS, stats, sizeof(stats));
+}
+
 void loli_server_loop(int sock) {
-    std::vector<io::buffer> cacheCopy;
-    std::vector<io::buffer> sendCache;
-    io::buffer sendBuffer(10240);
+    serverThread_ = true;
+    std::vector<loli::ringbuffer*> rings;
+    loli::ringbuffer* ringsHead = nullptr;
+    std::size_t drainStart = 0;
+    // small runs of records are gathered here instead of being sent one by one
+    io::buffer sendBuffer;
+    io::buffer pending;
+    std::size_t pendingOffset = 0;
     uint32_t compressBufferSize = 1024;
     char* compressBuffer = new char[compressBufferSize];
-    struct timeval time;
-    time.tv_sec = 0; // must initialize this value to prevent uninitialised memory
-    time.tv_usec = 100;
-    fd_set fds;
-    memset(&fds, 0, sizeof(fd_set));
-    FD_ZERO(&fds);
+    // the client asks for the stream protocol right after it connects,
+    // until then packets are compressed independently for older clients
+    uint8_t protocolVersion = 0;
+    LZ4_stream_t* lz4Stream = LZ4_createStream();
+    char* lz4Dict = new char[LZ4DICTSIZE];
     int clientSock = -1;
-    auto lastTickTime = std::chrono::steady_clock::now();
+    int sendBufferSize = 0;
+    // compressed / uncompressed size of the last packet, used to size batches
+    double compressRatio = 1.0;
+    // per second statistics reported to the client
+    std::uint64_t rawBytes = 0;
+    std::uint64_t compressedBytes = 0;
+    std::uint64_t lastDroppedCount = 0;
+    auto lastSendTime = std::chrono::steady_clock::now();
+    auto nextStatsTime = lastSendTime;
+    sendBuffer.capacity(minRunSize_ * 2);
+    // compresses one run of framed records and sends it as a packet
+    auto sendRecords = [&](const char* data, std::size_t size) {
+        // TODO: add option to turn off compression for performance reason
+        std::uint32_t srcSize = static_cast<std::uint32_t>(size);
+        // lz4 compression
+        uint32_t requiredSize = LZ4_compressBound(srcSize);
+        if (requiredSize > compressBufferSize) { // enlarge compress buffer if necessary
+            compressBufferSize = static_cast<std::uint32_t>(requiredSize * 1.5f);
+            delete[] compressBuffer;
+            compressBuffer = new char[compressBufferSize];
+        }
+        uint32_t compressSize = 0;
+        if (protocolVersion > 0) {
+            compressSize = LZ4_compress_fast_continue(lz4Stream, data, compressBuffer, srcSize, requiredSize, 1);
+            // data may live in a ring that is about to be consumed, keep our own copy of the window
+            LZ4_saveDict(lz4Stream, lz4Dict, LZ4DICTSIZE);
+        } else {
+            compressSize = LZ4_compress_default(data, compressBuffer, srcSize, requiredSize);
+        }
+        if (compressSize == 0) {
+            LOLILOGE("LZ4 compression failed!");
+            return;
+        }
+        // uncompressed size first, for decompression
+        struct iovec payload[2] = {{&srcSize, sizeof(srcSize)}, {compressBuffer, compressSize}};
+        loli_send_packet(clientSock, protocolVersion > 0 ? 2 : 0, payload, 2);
+        compressRatio = std::max(0.05, static_cast<double>(compressSize) / srcSize);
+        rawBytes += srcSize;
+        compressedBytes += compressSize;
+    };
+    auto flushRecords = [&]() {
+        if (sendBuffer.size() > 0) {
+            sendRecords(sendBuffer.data(), sendBuffer.size());
+            sendBuffer.clear();
+        }
+    };
     while (serverRunning_) {
-        if (!serverRunning_)
-            break;
+        loli_collect_rings(rings, ringsHead);
         if (!hasClient_) { // handle new connection
-            FD_ZERO(&fds);
-            FD_SET(sock, &fds);
-            if (select(sock + 1, &fds, NULL, NULL, &time) < 1)
-                continue;
-            if (FD_ISSET(sock, &fds)) {
-                clientSock = accept(sock, NULL, NULL);
-                if (clientSock >= 0) {
-                    LOLILOGI("Client connected");
-                    hasClient_ = true;
+            // keep events recorded before the client shows up
+            if (!ignoreCache_) {
+                for (auto ring : rings) {
+                    const char* data = nullptr;
+                    while (std::size_t size = ring->peek(data, SIZE_MAX)) {
+                        pending.append(data, size);
+                        ring->consume(size);
+                    }
                 }
             }
+            struct pollfd pfd = {sock, POLLIN, 0};
+            if (poll(&pfd, 1, maxLatency_) < 1 || !(pfd.revents & POLLIN))
+                continue;
+            clientSock = accept(sock, NULL, NULL);
+            if (clientSock >= 0) {
+                LOLILOGI("Client connected");
+                socklen_t optlen = sizeof(sendBufferSize);
+                if (getsockopt(clientSock, SOL_SOCKET, SO_SNDBUF, &sendBufferSize, &optlen) < 0)
+                    sendBufferSize = static_cast<int>(minBatchSize_);
+                rawBytes = compressedBytes = 0;
+                protocolVersion = 0;
+                lastSendTime = nextStatsTime = std::chrono::steady_clock::now();
+                hasClient_ = true;
+            }
+            continue;
+        }
+        if (ignoreCache_) {
+            for (auto ring : rings)
+                ring->discard();
+        }
+        // decide whether to send now, wait for a bigger batch, wait for the socket or sleep
+        auto now = std::chrono::steady_clock::now();
+        auto sinceLastSend = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastSendTime).count();
+        std::size_t backlog = ignoreCache_ ? 0 : (pending.size() - pendingOffset) + loli_ring_backlog(rings);
+        bool batchReady = backlog >= minBatchSize_ || (backlog > 0 && sinceLastSend >= maxLatency_);
+        std::size_t writable = batchReady ? loli_socket_writable(clientSock, sendBufferSize) : 0;
+        bool canSend = batchReady && writable >= minWritableSize_;
+        int timeout = static_cast<int>(std::max<std::int64_t>(0, 
+            std::chrono::duration_cast<std::chrono::milliseconds>(nextStatsTime - now).count()));
+        struct pollfd pfds[2] = {{clientSock, POLLIN, 0}, {wakeFd_, POLLIN, 0}};
+        nfds_t nfds = 1;
+        std::size_t wakeThreshold = SIZE_MAX;
+        if (canSend) {
+            timeout = 0;
+        } else if (batchReady) { // socket send queue is full
+            pfds[0].events |= POLLOUT;
+            timeout = std::min(timeout, maxLatency_);
+        } else if (backlog > 0) { // let the batch grow, unless a ring is filling up
+            wakeThreshold = RINGBUFFERSIZE / 4;
+            timeout = std::min(timeout, static_cast<int>(maxLatency_ - sinceLastSend));
+        } else { // idle, wait for the first event
+            wakeThreshold = 1;
+            timeout = std::min(timeout, idleTimeout_);
+        }
+        if (wakeThreshold != SIZE_MAX && wakeFd_ >= 0) {
+            // a wake up can be missed if an event is pushed right before the threshold
+            // is published, the timeout bounds the latency in that case
+            wakeThreshold_.store(wakeThreshold, std::memory_order_relaxed);
+            nfds = 2;
         } else {
+            timeout = std::min(timeout, maxLatency_);
+        }
+        int ready = poll(pfds, nfds, timeout);
+        wakeThreshold_.store(SIZE_MAX, std::memory_order_relaxed);
+        if (ready > 0) {
+            if (nfds > 1 && (pfds[1].revents & POLLIN)) {
+                uint64_t value;
+                if (read(wakeFd_, &value, sizeof(value)) < 0) {
+                    LOLILOGE("Failed to read wake up event, error: %d", errno);
+                }
+            }
             // check for client connectivity
-            FD_ZERO(&fds);
-            if (clientSock >= 0)
-                FD_SET(clientSock, &fds);
-            if (select(clientSock + 1, &fds, NULL, NULL, &time) > 0 && FD_ISSET(clientSock, &fds)) {
+            if (pfds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
                 int length = recv(clientSock, buffer_, BUFSIZ, 0);
                 if (length <= 0) {
                     hasClient_ = false;
+                    close(clientSock);
+                    clientSock = -1;
                     LOLILOGI("Client disconnected, ecode: %i", length);
+                    // events left for this client may use stack ids it was the only one
+                    // to get the definitions of, the next client starts from scratch
+                    generation_.fetch_add(1, std::memory_order_relaxed);
+                    for (auto ring : rings)
+                        ring->discard();
+                    io::buffer().swap(pending);
+                    pendingOffset = 0;
                     continue;
                 } else {
-                    if (length > 0) {
-                        uint8_t type = *reinterpret_cast<uint8_t*>(buffer_);
+                    bool smapsDumped = false;
+                    for (int i = 0; i < length && !smapsDumped; i++) {
+                        uint8_t type = *reinterpret_cast<uint8_t*>(buffer_ + i);
                         LOLILOGI("Server Recv: %i", (int)type);
                         if (type == static_cast<std::uint8_t>(loliCommands::SMAPS_DUMP)) {
                             LOLILOGI("Dumping smaps");
                             loli_dump_smaps();
-                            uint32_t packetSize = 8;
-                            send(clientSock, &packetSize, 4, 0); // send packet size
-                            uint32_t packetType = 1;
-                            send(clientSock, &packetType, 4, 0); // send packet type
-                            uint32_t command = static_cast<uint32_t>(loliCommands::SMAPS_DUMP);
-                            send(clientSock, &command, 4, 0);
+                            loli_send_command(clientSock, loliCommands::SMAPS_DUMP);
                             ignoreCache_ = true;
-                            {
-                                std::lock_guard<loli::spinlock> lock(cacheLock_);
-                                cache_.clear();
+                            smapsDumped = true;
+                        } else if (type == static_cast<std::uint8_t>(loliCommands::PROTOCOL_VERSION) && i + 1 < length) {
+                            // [command][version], answer with the version both sides support
+                            uint8_t version = std::min<uint8_t>(*reinterpret_cast<uint8_t*>(buffer_ + ++i), LOLI_PROTOCOL_VERSION);
+                            if (version != protocolVersion) {
+                                LZ4_resetStream_fast(lz4Stream);
+                                protocolVersion = version;
                             }
+                            uint32_t reply = version;
+                            loli_send_command(clientSock, loliCommands::PROTOCOL_VERSION, &reply, sizeof(reply));
+                            LOLILOGI("Protocol version %i", (int)version);
                         }
                     }
+                    if (smapsDumped)
+                        continue;
                 }
             }
-            if (ignoreCache_) {
-                continue;
+        }
+        if (canSend && !ignoreCache_) {
+            // fill the socket's free space, assuming the last packet's compression ratio
+            std::size_t batchSize = static_cast<std::size_t>(writable / compressRatio);
+            batchSize = std::max(minWritableSize_, std::min(batchSize, maxBatchSize_));
+            std::size_t size = 0;
+            const char* data = nullptr;
+            // backlog recorded before the client connected goes first
+            while (size < batchSize && pendingOffset < pending.size()) {
+                auto runSize = loli_peek_pending(pending, pendingOffset, data, batchSize - size);
+                sendRecords(data, runSize);
+                pendingOffset += runSize;
+                size += runSize;
             }
-            // fill cached messages
-            auto now = std::chrono::steady_clock::now();
-            if (std::chrono::duration<double, std::milli>(now - lastTickTime).count() > 66.6) {
-                lastTickTime = now;
-                std::lock_guard<loli::spinlock> lock(cacheLock_);
-                if (sendCache.size() > 0) {
-                    sendCache.insert(sendCache.end(), cache_.begin(), cache_.end());
-                    cache_.clear();
-                }
-                else {
-                    sendCache = std::move(cache_);
-                }
+            if (pendingOffset >= pending.size() && pending.capacity() > 0) {
+                io::buffer().swap(pending); // release memory once the backlog is sent
+                pendingOffset = 0;
             }
-            // send cached messages with limited banwidth
-            {
-                auto cacheSize = sendCache.size();
-                if (cacheSize <= bandwidth_) {
-                    cacheCopy = std::move(sendCache);
-                } else {
-                    cacheCopy.reserve(bandwidth_);
-                    for (std::size_t i = cacheSize - bandwidth_; i < cacheSize; i++)
-                        cacheCopy.emplace_back(std::move(sendCache[i]));
-                    sendCache.erase(sendCache.begin() + (cacheSize - bandwidth_), sendCache.end());
+            // rotate the first ring so every thread gets its share of the batch,
+            // large runs go to lz4 straight from the ring memory
+            for (std::size_t i = 0; i < rings.size() && size < batchSize; i++) {
+                auto ring = rings[(drainStart + i) % rings.size()];
+                while (size < batchSize) {
+                    auto runSize = ring->peek(data, batchSize - size);
+                    if (runSize == 0)
+                        break;
+                    if (runSize < minRunSize_) {
+                        sendBuffer.append(data, runSize);
+                    } else {
+                        flushRecords(); // keep the order of records
+                        sendRecords(data, runSize);
+                    }
+                    ring->consume(runSize);
+                    size += runSize;
                 }
             }
-            if (cacheCopy.size() > 0) {
-                sendBuffer.clear();
-                for (auto& buffer : cacheCopy) {
-                    sendBuffer << static_cast<uint16_t>(buffer.size());
-                    sendBuffer.append(buffer);
-                }
-                // TODO: add option to turn off compression for performance reason
-                std::uint32_t srcSize = static_cast<std::uint32_t>(sendBuffer.size());
-                // lz4 compression
-                uint32_t requiredSize = LZ4_compressBound(srcSize);
-                if (requiredSize > compressBufferSize) { // enlarge compress buffer if necessary
-                    compressBufferSize = static_cast<std::uint32_t>(requiredSize * 1.5f);
-                    delete[] compressBuffer;
-                    compressBuffer = new char[compressBufferSize];
-                    // __android_log_print(ANDROID_LOG_INFO, "Loli", "Buffer exapnding: %i", static_cast<uint32_t>(compressBufferSize));
-                }
-                uint32_t compressSize = LZ4_compress_default(sendBuffer.data(), compressBuffer, srcSize, requiredSize);
-                if (compressSize == 0) {
-                    LOLILOGE("LZ4 compression failed!");
-                } else {
-                    uint32_t packetSize = compressSize + 8;
-                    // send messages
-                    send(clientSock, &packetSize, 4, 0); // send packet size
-                    uint32_t packetType = 0;
-                    send(clientSock, &packetType, 4, 0); // send packet type
-                    send(clientSock, &srcSize, 4, 0); // send uncompressed buffer size (for decompression)
-                    send(clientSock, compressBuffer, compressSize, 0); // then send data
-                    // LOLILOGI("send size %i, compressed size %i, lineCount: %i", srcSize, 
-                    //    compressSize, static_cast<int>(cacheCopy.size()));
-                }
-                cacheCopy.clear();
+            flushRecords();
+            drainStart++;
+            lastSendTime = now;
+        }
+        if (std::chrono::steady_clock::now() >= nextStatsTime) {
+            nextStatsTime += std::chrono::milliseconds(statsInterval_);
+            backlog = (pending.size() - pendingOffset) + loli_ring_backlog(rings);
+            loli_send_stats(clientSock, backlog, rawBytes, compressedBytes);
+            rawBytes = compressedBytes = 0;
+            auto droppedCount = droppedCount_.load(std::memory_order_relaxed);
+            if (droppedCount != lastDroppedCount) {
+                LOLILOGW("Ring buffers full, %llu events dropped in total", 
+                    static_cast<unsigned long long>(droppedCount));
+                lastDroppedCount = droppedCount;
             }
         }
     }
     delete[] compressBuffer;
+    delete[] lz4Dict;
+    LZ4_freeStream(lz4Stream);
     close(sock);
     if (hasClient_ && clientSock >= 0)
         close(clientSock);
@@ -220,6 +490,10 @@ void loli_server_loop(int sock) {
 int loli_server_start(int port) {
     if (started_)
         return 0;
+    if (pthread_key_create(&ringKey_, loli_ring_release) != 0) {
+        LOLILOGI("start.pthread_key_create");
+        return -1;
+    }
     // allocate buffer
     buffer_ = (char*)malloc(BUFSIZ);
     memset(buffer_, 0, BUFSIZ);
@@ -257,6 +531,10 @@ int loli_server_start(int port) {
         LOLILOGI("start.listen %i", ecode);
         return -1;
     }
+    wakeFd_ = eventfd(0, EFD_NONBLOCK);
+    if (wakeFd_ < 0) {
+        LOLILOGW("start.eventfd %i, falling back to polling", errno);
+    }
     started_ = true;
     serverRunning_ = true;
     hasClient_ = false;
@@ -266,10 +544,41 @@ int loli_server_start(int port) {
 }
 
 void loli_server_send(const char* data, unsigned int size) {
-    if (ignoreCache_)
-        return;
-    std::lock_guard<loli::spinlock> lock(cacheLock_);
-    cache_.emplace_back(io::buffer(data, size));
+    if (auto buffer = loli_server_reserve(size)) {
+        memcpy(buffer, data, size);
+        loli_server_commit(size);
+    }
+}
+
+char* loli_server_reserve(unsigned int size) {
+    if (ignoreCache_ || !started_ || serverThread_)
+        return NULL;
+    auto ring = loli_ring_acquire();
+    char* data = ring != nullptr ? ring->reserve(size) : nullptr;
+    if (data == nullptr) {
+        droppedCount_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return data;
+}
+
+void loli_server_commit(unsigned int size) {
+    auto ring = threadRing_;
+    ring->commit(size);
+    if (ring->size() >= wakeThreshold_.load(std::memory_order_relaxed) && 
+        wakeThreshold_.exchange(SIZE_MAX, std::memory_order_relaxed) != SIZE_MAX) {
+        uint64_t value = 1;
+        if (write(wakeFd_, &value, sizeof(value)) < 0) {
+            LOLILOGE("Failed to wake up server, error: %d", errno);
+        }
+    }
+}
+
+uint64_t loli_server_dropped_count() {
+    return droppedCount_.load(std::memory_order_relaxed);
+}
+
+uint32_t loli_server_generation() {
+    return generation_.load(std::memory_order_relaxed);
 }
 
 void loli_server_shutdown() {
@@ -280,6 +589,10 @@ void loli_server_shutdown() {
     socketThread_.join();
     free(buffer_);
     buffer_ = NULL;
+    if (wakeFd_ >= 0) {
+        close(wakeFd_);
+        wakeFd_ = -1;
+    }
     started_ = false;
 }
 
@@ -5,10 +5,18 @@ extern "C" {
 #endif // __cplusplus
 
 #include <stdlib.h>
+#include <stdint.h>
 
 bool loli_server_started();
 int loli_server_start(int port);
 void loli_server_send(const char* data, unsigned int size);
+// reserve space for a record of at most size bytes in the calling thread's buffer,
+// returns NULL if the event has to be dropped. Publish it with loli_server_commit.
+char* loli_server_reserve(unsigned int size);
+void loli_server_commit(unsigned int size);
+uint64_t loli_server_dropped_count();
+// bumped when a client disconnects, stack definitions sent before are unknown to the next client
+uint32_t loli_server_generation();
 void loli_server_shutdown();
 
 #ifdef __cplusplus
@@ -80,14 +80,12 @@ bool loli_is_stackframe_valid(uintptr_t fp, uintptr_t prev_fp, uintptr_t stack_e
 
 uintptr_t loli_get_stackend() {
     // Bionic reads proc/maps on every call to pthread_getattr_np() when called
-    // from the main thread. So we need to cache end of stack in that case to get
-    // acceptable performance.
-    // For all other threads pthread_getattr_np() is fast enough as it just reads
-    // values from its pthread_t argument.
-    static uintptr_t main_stack_end = 0;
-    bool is_main_thread = getpid() == gettid();
-    if (is_main_thread && main_stack_end) {
-        return main_stack_end;
+    // from the main thread. For all other threads it only reads values from its
+    // pthread_t argument, but that is still a lock and a syscall per allocation.
+    // The stack of a thread never moves, so cache its end per thread.
+    static thread_local uintptr_t stack_end_cache = 0;
+    if (stack_end_cache) {
+        return stack_end_cache;
     }
     uintptr_t stack_begin = 0;
     size_t stack_size = 0;
@@ -98,14 +96,13 @@ uintptr_t loli_get_stackend() {
             &attributes, reinterpret_cast<void**>(&stack_begin), &stack_size);
         pthread_attr_destroy(&attributes);
     }
-    uintptr_t stack_end = stack_begin + stack_size;
-    if (is_main_thread) {
-        main_stack_end = stack_end;
-    }
-    return stack_end;  // 0 in case of error
+    stack_end_cache = stack_begin + stack_size;
+    return stack_end_cache;  // 0 in case of error
 }
 
-size_t loli_trace_stackframepointers(void** out_trace, size_t max_depth, size_t skip_initial) {
+// truncated is set if the walk stopped at a frame without a valid frame pointer
+// instead of the end of the chain
+size_t loli_trace_stackframepointers(void** out_trace, size_t max_depth, size_t skip_initial, bool* truncated) {
     // Usage of __builtin_frame_address() enables frame pointers in this
     // function even if they are not enabled globally. So 'fp' will always
     // be valid.
@@ -124,6 +121,7 @@ size_t loli_trace_stackframepointers(void** out_trace, size_t max_depth, size_t
             continue;
         }
         // Failed to find next frame.
+        if (truncated) *truncated = next_fp != 0;
         break;
     }
     return depth;
@@ -185,6 +183,9 @@ void loli_demangle(const std::string& name, std::string& demangled) {
     }
 }
 
+// same as the deepest stack loli.cpp records
+#define UNWINDBUFFERSIZE 256
+
 struct TraceState {
     void** current;
     void** end;
@@ -204,7 +205,7 @@ static _Unwind_Reason_Code loli_unwind(struct _Unwind_Context* context, void* ar
 }
 
 size_t loli_fastcapture(void **buffer, size_t max) {
-    return loli_trace_stackframepointers(buffer, max, 0);
+    return loli_trace_stackframepointers(buffer, max, 0, nullptr);
 }
 
 size_t loli_capture(void** buffer, size_t max) {
@@ -213,7 +214,31 @@ size_t loli_capture(void** buffer, size_t max) {
     return state.current - buffer;
 }
 
-void loli_dump(io::buffer& obuffer, void** buffer, size_t count) {
+size_t loli_hybridcapture(void** buffer, size_t max) {
+    bool truncated = false;
+    size_t count = loli_trace_stackframepointers(buffer, max, 0, &truncated);
+    if (!truncated || count < 2) {
+        return count;
+    }
+    // the chain went through code built without frame pointers, unwind the whole
+    // stack with the unwind tables and append what lies past the last good frame
+    static thread_local void* unwound[UNWINDBUFFERSIZE];
+    size_t unwoundCount = loli_capture(unwound, UNWINDBUFFERSIZE);
+    for (size_t idx = 1; idx < unwoundCount; ++idx) {
+        if (unwound[idx] == buffer[count - 1] && unwound[idx - 1] == buffer[count - 2]) {
+            for (++idx; idx < unwoundCount && count < max; ++idx) {
+                buffer[count++] = unwound[idx];
+            }
+            return count;
+        }
+    }
+    // no common frame to splice at, the unwind tables are more reliable
+    count = std::min(unwoundCount, max);
+    memcpy(buffer, unwound, count * sizeof(void*));
+    return count;
+}
+
+void loli_dump(loli::writer& obuffer, void** buffer, size_t count) {
     for (size_t idx = 2; idx < count; ++idx) { // idx = 1 to ignore loli's hook function
         const void* addr = buffer[idx];
         obuffer << reinterpret_cast<uint64_t>(addr);
@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 
+#include "ringbuffer.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
@@ -69,7 +71,9 @@ void loli_demangle(const std::string& name, std::string& demangled);
 
 size_t loli_fastcapture(void** buffer, size_t max);
 size_t loli_capture(void** buffer, size_t max);
-void loli_dump(io::buffer& obuffer, void** buffer, size_t count);
+// frame pointers as far as they are valid, then the unwind tables for the rest
+size_t loli_hybridcapture(void** buffer, size_t max);
+void loli_dump(loli::writer& obuffer, void** buffer, size_t count);
 
 #ifdef __cplusplus
 }
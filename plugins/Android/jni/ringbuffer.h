@@ -0,0 +1,161 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+namespace loli {
+
+// Single producer, single consumer byte ring.
+// The owning thread encodes records in place as [uint16 size][data], the
+// server thread hands whole runs of framed records to lz4 without copying
+// them. A record never wraps around the end of the ring, the remaining bytes
+// are skipped instead. Capacity must be a power of two.
+class ringbuffer {
+public:
+    explicit ringbuffer(size_t capacity)
+        : next_(nullptr), data_(new char[capacity]), mask_(capacity - 1), reserved_(0) {
+        owned_.store(false, std::memory_order_relaxed);
+        head_.value.store(0, std::memory_order_relaxed);
+        tail_.value.store(0, std::memory_order_relaxed);
+    }
+    ringbuffer(const ringbuffer&) = delete;
+    ~ringbuffer() { delete[] data_; }
+
+    // producer side, returns contiguous space for a record of at most size
+    // bytes or nullptr if the ring is full, must be followed by commit()
+    char* reserve(size_t size) {
+        size_t head = head_.value.load(std::memory_order_relaxed);
+        size_t tail = tail_.value.load(std::memory_order_acquire);
+        size_t offset = head & mask_;
+        size_t required = sizeof(uint16_t) + size;
+        size_t skipped = 0;
+        if (offset + required > mask_ + 1) // does not fit before the end
+            skipped = mask_ + 1 - offset;
+        if (size >= skipMarker || mask_ + 1 - (head - tail) < skipped + required)
+            return nullptr;
+        if (skipped > 0) {
+            if (skipped >= sizeof(uint16_t))
+                write(offset, skipMarker);
+            head += skipped;
+            head_.value.store(head, std::memory_order_release);
+            offset = 0;
+        }
+        reserved_ = head;
+        return data_ + offset + sizeof(uint16_t);
+    }
+
+    // producer side, publishes the record written to the reserved space
+    void commit(size_t size) {
+        write(reserved_ & mask_, static_cast<uint16_t>(size));
+        head_.value.store(reserved_ + sizeof(uint16_t) + size, std::memory_order_release);
+    }
+
+    // consumer side, returns the contiguous run of framed records at the tail,
+    // at least one record and no more than maxSize bytes unless the first
+    // record is bigger. The data stays valid until consume() is called.
+    size_t peek(const char*& data, size_t maxSize) {
+        size_t tail = tail_.value.load(std::memory_order_relaxed);
+        size_t head = head_.value.load(std::memory_order_acquire);
+        if (tail != head && skipped(tail & mask_)) {
+            tail += mask_ + 1 - (tail & mask_);
+            tail_.value.store(tail, std::memory_order_release);
+        }
+        size_t start = tail;
+        while (tail != head) {
+            size_t next = tail + sizeof(uint16_t) + read(tail & mask_);
+            if (tail != start && next - start > maxSize)
+                break;
+            tail = next;
+            // stop at the end of the ring, the rest continues at offset 0
+            if ((tail & mask_) == 0 || (tail != head && skipped(tail & mask_)))
+                break;
+        }
+        data = data_ + (start & mask_);
+        return tail - start;
+    }
+
+    // consumer side, releases size bytes returned by peek()
+    void consume(size_t size) {
+        tail_.value.store(tail_.value.load(std::memory_order_relaxed) + size, std::memory_order_release);
+    }
+
+    // consumer side, throws away everything pushed so far
+    void discard() {
+        tail_.value.store(head_.value.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // number of bytes waiting to be consumed
+    size_t size() const {
+        size_t tail = tail_.value.load(std::memory_order_acquire);
+        return head_.value.load(std::memory_order_acquire) - tail;
+    }
+
+    // true while a live thread produces into this ring
+    std::atomic<bool> owned_;
+    // intrusive link for the global ring list, never changes once published
+    ringbuffer* next_;
+
+private:
+    static const uint16_t skipMarker = 0xFFFF;
+
+    // true if the bytes from offset to the end of the ring are unused
+    bool skipped(size_t offset) const {
+        return mask_ + 1 - offset < sizeof(uint16_t) || read(offset) == skipMarker;
+    }
+
+    void write(size_t offset, uint16_t value) {
+        memcpy(data_ + offset, &value, sizeof(uint16_t));
+    }
+
+    uint16_t read(size_t offset) const {
+        uint16_t value;
+        memcpy(&value, data_ + offset, sizeof(uint16_t));
+        return value;
+    }
+
+    // keep producer and consumer indices on separate cache lines
+    struct index {
+        char padding[64];
+        std::atomic<size_t> value;
+    };
+
+    char* data_;
+    size_t mask_;
+    size_t reserved_;
+    index head_;
+    index tail_;
+};
+
+// Encodes a record in place, same layout as io::buffer's operator<<.
+class writer {
+public:
+    explicit writer(char* data) : data_(data), size_(0) {}
+
+    template <typename T>
+    writer& operator<<(T value) {
+        memcpy(data_ + size_, &value, sizeof(T));
+        size_ += sizeof(T);
+        return *this;
+    }
+
+    writer& operator<<(const char* str) {
+        uint16_t len = static_cast<uint16_t>(strlen(str));
+        *this << len;
+        memcpy(data_ + size_, str, len);
+        size_ += len;
+        return *this;
+    }
+
+    size_t size() const { return size_; }
+
+private:
+    char* data_;
+    size_t size_;
+};
+
+} // namespace loli
@@ -0,0 +1,111 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace loli {
+
+// Lock-free set of callstack hashes, each hash is assigned a 32 bit id the
+// first time its definition is sent. Capacity must be a power of two, entries
+// are never removed. Two stacks with the same 64 bit hash share the same id.
+// A definition is sent once per generation, the server starts a new one for
+// every client.
+class stacktable {
+public:
+    struct entry {
+        std::atomic<uint64_t> hash;
+        std::atomic<uint32_t> id;
+        // generation + 1 of the last committed definition, 0 if there is none
+        std::atomic<uint32_t> defined;
+        // set while a thread sends the definition
+        std::atomic<bool> defining;
+    };
+
+    explicit stacktable(size_t capacity)
+        : entries_(new entry[capacity]), mask_(capacity - 1) {
+        for (size_t i = 0; i < capacity; i++) {
+            entries_[i].hash.store(0, std::memory_order_relaxed);
+            entries_[i].id.store(0, std::memory_order_relaxed);
+            entries_[i].defined.store(0, std::memory_order_relaxed);
+            entries_[i].defining.store(false, std::memory_order_relaxed);
+        }
+        nextId_.store(1, std::memory_order_relaxed);
+    }
+    stacktable(const stacktable&) = delete;
+    ~stacktable() { delete[] entries_; }
+
+    static uint64_t hash(void* const* frames, size_t count) {
+        uint64_t hash = 0xcbf29ce484222325ULL ^ count;
+        for (size_t i = 0; i < count; i++) {
+            hash ^= reinterpret_cast<uintptr_t>(frames[i]);
+            hash *= 0x100000001b3ULL;
+            hash ^= hash >> 29;
+        }
+        return hash == 0 ? 1 : hash;
+    }
+
+    // returns 0 if the table is full or another thread is sending the
+    // definition. pending is set when the caller must send the definition of
+    // the returned id, then call publish() once it's committed or abandon()
+    uint32_t intern(uint64_t hash, uint32_t generation, entry*& pending) {
+        pending = nullptr;
+        auto slot = find(hash);
+        if (slot == nullptr) {
+            return 0;
+        }
+        if (slot->defined.load(std::memory_order_acquire) == generation + 1) {
+            return slot->id.load(std::memory_order_relaxed);
+        }
+        bool defining = false;
+        if (!slot->defining.compare_exchange_strong(defining, true, std::memory_order_acq_rel)) {
+            return 0;
+        }
+        // published while we took the slot
+        if (slot->defined.load(std::memory_order_acquire) == generation + 1) {
+            slot->defining.store(false, std::memory_order_release);
+            return slot->id.load(std::memory_order_relaxed);
+        }
+        // the id is only written by the defining thread
+        auto id = slot->id.load(std::memory_order_relaxed);
+        if (id == 0) {
+            id = nextId_.fetch_add(1, std::memory_order_relaxed);
+            slot->id.store(id, std::memory_order_relaxed);
+        }
+        pending = slot;
+        return id;
+    }
+
+    void publish(entry* slot, uint32_t generation) {
+        slot->defined.store(generation + 1, std::memory_order_release);
+        slot->defining.store(false, std::memory_order_release);
+    }
+
+    // the definition couldn't be sent, the next thread that sees the stack retries
+    void abandon(entry* slot) {
+        slot->defining.store(false, std::memory_order_release);
+    }
+
+private:
+    static const size_t maxProbe = 64;
+
+    entry* find(uint64_t hash) {
+        for (size_t probe = 0; probe < maxProbe; probe++) {
+            auto& slot = entries_[(hash + probe) & mask_];
+            auto current = slot.hash.load(std::memory_order_acquire);
+            if (current == 0 && slot.hash.compare_exchange_strong(current, hash, std::memory_order_acq_rel)) {
+                return &slot;
+            }
+            // current holds the winner's hash if the exchange lost the race
+            if (current == hash) {
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    entry* entries_;
+    size_t mask_;
+    std::atomic<uint32_t> nextId_;
+};
+
+} // namespace loli
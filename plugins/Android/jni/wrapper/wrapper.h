@@ -9,6 +9,7 @@
 #ifndef WRAPPER_H
 #define WRAPPER_H
 
+#include <stdint.h>
 #include <stdlib.h>
 
 #ifdef __cplusplus
@@ -0,0 +1,172 @@
+#include "callstacktable.h"
+
+CallStackTable::CallStackTable() {
+    stacks_.push_back(CallStack());
+}
+
+quint32 CallStackTable::Intern(const CallStack& callstack) {
+    if (callstack.isEmpty())
+        return 0;
+    auto hash = Hash(callstack);
+    for (auto it = lookup_.find(hash); it != lookup_.end() && it.key() == hash; ++it) {
+        if (Equals(stacks_[static_cast<int>(it.value())], callstack))
+            return it.value();
+    }
+    auto index = static_cast<quint32>(stacks_.size());
+    stacks_.push_back(callstack);
+    lookup_.insert(hash, index);
+    return index;
+}
+
+quint32 CallStackTable::Intern(const QVector<quint64>& addresses) {
+    return Intern(addresses.constData(), addresses.size());
+}
+
+quint32 CallStackTable::Intern(const quint64* addresses, int count) {
+    CallStack callstack;
+    callstack.reserve(count);
+    for (int i = 0; i < count; i++) {
+        callstack.push_back(qMakePair(HashString(), addresses[i]));
+    }
+    return Intern(callstack);
+}
+
+quint32 CallStackTable::Append(const CallStack& callstack) {
+    auto index = static_cast<quint32>(stacks_.size());
+    stacks_.push_back(callstack);
+    return index;
+}
+
+const CallStack& CallStackTable::At(quint32 index) const {
+    if (index >= static_cast<quint32>(stacks_.size()))
+        return stacks_[0];
+    return stacks_[static_cast<int>(index)];
+}
+
+void CallStackTable::Clear() {
+    stacks_.clear();
+    lookup_.clear();
+    stacks_.push_back(CallStack());
+}
+
+QVector<quint32> CallStackTable::Compact(const QVector<bool>& used) {
+    QVector<quint32> indices(stacks_.size(), 0);
+    QVector<CallStack> stacks;
+    stacks.push_back(CallStack());
+    lookup_.clear();
+    for (int i = 1; i < stacks_.size(); i++) {
+        if (i >= used.size() || !used[i] || stacks_[i].isEmpty())
+            continue;
+        indices[i] = static_cast<quint32>(stacks.size());
+        lookup_.insert(Hash(stacks_[i]), indices[i]);
+        stacks.push_back(stacks_[i]);
+    }
+    stacks_.swap(stacks);
+    return indices;
+}
+
+void CallStackTable::Write(QDataStream& stream) const {
+    stream << static_cast<qint32>(stacks_.size());
+    for (const auto& callstack : stacks_) {
+        stream << static_cast<qint32>(callstack.size());
+        for (const auto& frame : callstack) {
+            stream << frame.first.hashcode_ << frame.second;
+        }
+    }
+}
+
+void CallStackTable::Read(QDataStream& stream) {
+    stacks_.clear();
+    lookup_.clear();
+    qint32 count;
+    stream >> count;
+    stacks_.reserve(qMax(count, 1));
+    for (int i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        qint32 len;
+        stream >> len;
+        CallStack callstack;
+        callstack.reserve(len);
+        for (int j = 0; j < len; j++) {
+            QPair<HashString, quint64> frame;
+            stream >> frame.first.hashcode_ >> frame.second;
+            callstack.push_back(frame);
+        }
+        // Intern() finds the loaded callstacks like Compact() keeps them
+        if (i > 0 && !callstack.isEmpty())
+            lookup_.insert(Hash(callstack), static_cast<quint32>(stacks_.size()));
+        stacks_.push_back(callstack);
+    }
+    if (stacks_.isEmpty())
+        stacks_.push_back(CallStack());
+}
+
+QHash<QString, quint32> CallStackTable::ReadLegacy(QDataStream& stream) {
+    Clear();
+    QHash<QString, quint32> indices;
+    qint32 count;
+    stream >> count;
+    indices.reserve(count);
+    CallStack callstack;
+    for (int i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        QString uuid;
+        qint32 len;
+        stream >> uuid >> len;
+        callstack.clear();
+        for (int j = 0; j < len; j++) {
+            QPair<HashString, quint64> frame;
+            stream >> frame.first.hashcode_ >> frame.second;
+            callstack.push_back(frame);
+        }
+        indices.insert(uuid, Intern(callstack));
+    }
+    return indices;
+}
+
+bool CallStackTable::Equals(const CallStack& a, const CallStack& b) {
+    if (a.size() != b.size())
+        return false;
+    for (int i = 0; i < a.size(); i++) {
+        if (a[i].first.hashcode_ != b[i].first.hashcode_ || a[i].second != b[i].second)
+            return false;
+    }
+    return true;
+}
+
+uint CallStackTable::Hash(const CallStack& callstack) {
+    uint seed = 0;
+    for (const auto& frame : callstack) {
+        seed ^= qHash(frame.second, frame.first.hashcode_) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+    return seed;
+}
+
+quint32 AgentStackMap::Index(quint32 stackId, const QVector<quint64>* definition) {
+    auto it = indices_.find(stackId);
+    if (it != indices_.end())
+        return it.value();
+    quint32 index;
+    if (definition != nullptr) {
+        index = table_.Intern(*definition);
+    } else {
+        index = table_.Append(CallStack());
+        pending_.insert(stackId, index);
+    }
+    indices_.insert(stackId, index);
+    return index;
+}
+
+void AgentStackMap::Define(quint32 stackId, const quint64* frames, int count) {
+    auto it = pending_.find(stackId);
+    if (it == pending_.end())
+        return;
+    auto& callstack = table_[it.value()];
+    callstack.reserve(count);
+    for (int i = 0; i < count; i++)
+        callstack.push_back(qMakePair(HashString(), frames[i]));
+    pending_.erase(it);
+}
+
+void AgentStackMap::Clear() {
+    indices_.clear();
+    pending_.clear();
+}
@@ -0,0 +1,180 @@
+#include "calltreebuilder.h"
+
+#include <QFuture>
+#include <QtConcurrent>
+
+// callstacks merged by one worker
+#define CALLTREE_CHUNK_SIZE (16 * 1024)
+// marks callstacks of the baseline table when it isn't the same table
+#define CALLTREE_BASELINE_STACK 0x80000000u
+
+const quint32 CallTreeBuilder::NONE;
+
+static quint64 MixKey(quint64 key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return key;
+}
+
+quint32 CallTreeBuilder::FrameTree::Child(quint32 parent, quint32 library, quint64 addr) {
+    auto key = qMakePair(parent, qMakePair(library, addr));
+    auto it = children_.find(key);
+    if (it != children_.end())
+        return it.value();
+    auto index = static_cast<quint32>(nodes_.size());
+    nodes_.push_back({parent, library, addr, 0, 0, 0, 0});
+    children_.insert(key, index);
+    return index;
+}
+
+CallTreeBuilder::CallTreeBuilder(const CallStackTable& callStacks)
+    : CallTreeBuilder(callStacks, callStacks) {
+}
+
+CallTreeBuilder::CallTreeBuilder(const CallStackTable& callStacks, const CallStackTable& baselineStacks)
+    : callStacks_(callStacks), baselineStacks_(baselineStacks),
+    sizes_(callStacks.Size(), 0), counts_(callStacks.Size(), 0) {
+}
+
+void CallTreeBuilder::BuildFrameTree(const QVector<quint32>& stacks, int skipRootLevels, int begin, int end,
+    FrameTree& tree, quint32* leaves) const {
+    auto sameStacks = &callStacks_ == &baselineStacks_;
+    for (int i = begin; i < end; i++) {
+        auto stackIndex = static_cast<int>(stacks[i] & ~CALLTREE_BASELINE_STACK);
+        auto baseline = (stacks[i] & CALLTREE_BASELINE_STACK) != 0;
+        const auto& callStack = (baseline ? baselineStacks_ : callStacks_).At(static_cast<quint32>(stackIndex));
+        auto size = baseline ? 0 : sizes_[stackIndex];
+        auto count = baseline ? 0 : counts_[stackIndex];
+        quint64 baseSize = 0, baseCount = 0;
+        if ((baseline || sameStacks) && stackIndex < baseCounts_.size()) {
+            baseSize = baseSizes_[stackIndex];
+            baseCount = baseCounts_[stackIndex];
+        }
+        auto parent = NONE;
+        // frames are stored from the allocation site to the root
+        for (int j = callStack.size() - skipRootLevels - 1; j >= 0; j--)
+            parent = tree.Child(parent, callStack[j].first.hashcode_, callStack[j].second);
+        // only the allocation site counts the records, Build() sums them up
+        leaves[i] = parent;
+        auto& node = tree.nodes_[static_cast<int>(parent)];
+        node.size_ += size;
+        node.count_ += count;
+        node.baseSize_ += baseSize;
+        node.baseCount_ += baseCount;
+    }
+}
+
+void CallTreeBuilder::Build(const Resolver& resolve, int skipRootLevels) {
+    nodes_.clear();
+    stackNodes_.clear();
+    names_.clear();
+    frames_.clear();
+    QVector<quint32> stacks;
+    auto sameStacks = &callStacks_ == &baselineStacks_;
+    for (int i = 0; i < counts_.size(); i++) {
+        auto baseCount = sameStacks && i < baseCounts_.size() ? baseCounts_[i] : 0;
+        if ((counts_[i] > 0 || baseCount > 0) && callStacks_.At(static_cast<quint32>(i)).size() > skipRootLevels)
+            stacks.push_back(static_cast<quint32>(i));
+    }
+    for (int i = 0; !sameStacks && i < baseCounts_.size(); i++) {
+        if (baseCounts_[i] > 0 && baselineStacks_.At(static_cast<quint32>(i)).size() > skipRootLevels)
+            stacks.push_back(static_cast<quint32>(i) | CALLTREE_BASELINE_STACK);
+    }
+
+    // partial trees of every chunk, then merged in chunk order
+    auto chunkCount = (stacks.size() + CALLTREE_CHUNK_SIZE - 1) / CALLTREE_CHUNK_SIZE;
+    QVector<FrameTree> partials(chunkCount);
+    QVector<quint32> leaves(stacks.size());
+    auto leafData = leaves.data();
+    QVector<QFuture<void>> futures;
+    for (int chunk = 1; chunk < chunkCount; chunk++) {
+        auto tree = &partials[chunk];
+        futures.push_back(QtConcurrent::run([this, &stacks, skipRootLevels, tree, chunk, leafData]() {
+            auto begin = chunk * CALLTREE_CHUNK_SIZE;
+            BuildFrameTree(stacks, skipRootLevels, begin, qMin(begin + CALLTREE_CHUNK_SIZE, stacks.size()), *tree,
+                leafData);
+        }));
+    }
+    FrameTree frameTree;
+    BuildFrameTree(stacks, skipRootLevels, 0, qMin(CALLTREE_CHUNK_SIZE, stacks.size()), frameTree, leafData);
+    for (int chunk = 1; chunk < chunkCount; chunk++) {
+        futures[chunk - 1].waitForFinished();
+        auto& partial = partials[chunk];
+        // parents come first, their merged index is known by then
+        QVector<quint32> merged(partial.nodes_.size());
+        for (int i = 0; i < partial.nodes_.size(); i++) {
+            const auto& node = partial.nodes_[i];
+            auto parent = node.parent_ == NONE ? NONE : merged[static_cast<int>(node.parent_)];
+            auto index = frameTree.Child(parent, node.library_, node.addr_);
+            auto& target = frameTree.nodes_[static_cast<int>(index)];
+            target.size_ += node.size_;
+            target.count_ += node.count_;
+            target.baseSize_ += node.baseSize_;
+            target.baseCount_ += node.baseCount_;
+            merged[i] = index;
+        }
+        auto begin = chunk * CALLTREE_CHUNK_SIZE;
+        for (int i = begin; i < qMin(begin + CALLTREE_CHUNK_SIZE, stacks.size()); i++)
+            leaves[i] = merged[static_cast<int>(leaves[i])];
+        partial = FrameTree();
+    }
+
+    // frames resolving to the same name under the same parent are one node
+    QHash<QPair<quint32, quint64>, quint32> frameSymbols;
+    QHash<QString, quint32> symbols;
+    QVector<quint64> symbolHashes;
+    QHash<QPair<quint32, quint32>, quint32> children;
+    QVector<quint32> merged(frameTree.nodes_.size());
+    for (int i = 0; i < frameTree.nodes_.size(); i++) {
+        const auto& frameNode = frameTree.nodes_[i];
+        auto frame = qMakePair(frameNode.library_, frameNode.addr_);
+        auto frameIt = frameSymbols.find(frame);
+        if (frameIt == frameSymbols.end()) {
+            auto name = resolve(HashString(frameNode.library_), frameNode.addr_);
+            auto symbolIt = symbols.find(name);
+            if (symbolIt == symbols.end()) {
+                symbolIt = symbols.insert(name, static_cast<quint32>(names_.size()));
+                symbolHashes.push_back((static_cast<quint64>(qHash(name)) << 32) | qHash(name, 0x9e3779b9u));
+                names_.push_back(name);
+                frames_.push_back(qMakePair(HashString(frameNode.library_), frameNode.addr_));
+            }
+            frameIt = frameSymbols.insert(frame, symbolIt.value());
+        }
+        auto symbol = frameIt.value();
+        auto parent = frameNode.parent_ == NONE ? NONE : merged[static_cast<int>(frameNode.parent_)];
+        auto childIt = children.find(qMakePair(parent, symbol));
+        if (childIt == children.end()) {
+            auto parentKey = parent == NONE ? 0 : nodes_[static_cast<int>(parent)].key_;
+            auto key = MixKey(parentKey ^ symbolHashes[static_cast<int>(symbol)]);
+            childIt = children.insert(qMakePair(parent, symbol), static_cast<quint32>(nodes_.size()));
+            nodes_.push_back({parent, symbol, key, 0, 0, 0, 0});
+        }
+        auto& node = nodes_[static_cast<int>(childIt.value())];
+        node.size_ += frameNode.size_;
+        node.count_ += frameNode.count_;
+        node.baseSize_ += frameNode.baseSize_;
+        node.baseCount_ += frameNode.baseCount_;
+        merged[i] = childIt.value();
+    }
+    stackNodes_.fill(NONE, callStacks_.Size());
+    for (int i = 0; i < stacks.size(); i++) {
+        if ((stacks[i] & CALLTREE_BASELINE_STACK) == 0)
+            stackNodes_[static_cast<int>(stacks[i])] = merged[static_cast<int>(leaves[i])];
+    }
+
+    // children come after their parents, one reverse pass turns the records
+    // of every node into the totals of its subtree
+    for (int i = nodes_.size() - 1; i >= 0; i--) {
+        auto node = nodes_[i];
+        if (node.parent_ == NONE)
+            continue;
+        auto& parent = nodes_[static_cast<int>(node.parent_)];
+        parent.size_ += node.size_;
+        parent.count_ += node.count_;
+        parent.baseSize_ += node.baseSize_;
+        parent.baseCount_ += node.baseCount_;
+    }
+}
@@ -0,0 +1,220 @@
+#include "calltreemodel.h"
+#include "stacktracemodel.h"
+
+#include <QtConcurrent>
+
+#include <algorithm>
+
+const quint32 CallTreeModel::NONE;
+
+CallTreeModel::CallTreeModel(QObject* parent)
+    : QAbstractItemModel(parent) {
+
+}
+
+void CallTreeModel::setTree(const QVector<CallTreeBuilder::Node>& nodes, const QVector<QString>& names) {
+    beginResetModel();
+    children_.clear();
+    names_ = names;
+    nodes_.resize(nodes.size());
+    rows_.fill(0, nodes.size());
+    firstRoot_ = NONE;
+    for (auto& node : nodes_)
+        node.firstChild_ = NONE;
+    // linked from the last node so siblings keep the order of the nodes
+    for (int i = nodes.size() - 1; i >= 0; i--) {
+        const auto& source = nodes[i];
+        auto& node = nodes_[i];
+        node.parent_ = source.parent_;
+        node.symbol_ = source.symbol_;
+        node.size_ = source.size_;
+        node.count_ = source.count_;
+        auto& first = source.parent_ == NONE ? firstRoot_ : nodes_[static_cast<int>(source.parent_)].firstChild_;
+        node.nextSibling_ = first;
+        first = static_cast<quint32>(i);
+    }
+
+    QVector<quint32> symbols(names_.size());
+    for (int i = 0; i < symbols.size(); i++)
+        symbols[i] = static_cast<quint32>(i);
+    std::sort(symbols.begin(), symbols.end(), [this](quint32 a, quint32 b) {
+        return names_[static_cast<int>(a)] < names_[static_cast<int>(b)];
+    });
+    nameRanks_.resize(names_.size());
+    for (int i = 0; i < symbols.size(); i++)
+        nameRanks_[static_cast<int>(symbols[i])] = static_cast<quint32>(i);
+
+    symbolOffsets_.fill(0, names_.size() + 1);
+    for (const auto& node : nodes_)
+        symbolOffsets_[static_cast<int>(node.symbol_) + 1]++;
+    for (int i = 0; i < names_.size(); i++)
+        symbolOffsets_[i + 1] += symbolOffsets_[i];
+    symbolNodes_.resize(nodes_.size());
+    auto offsets = symbolOffsets_;
+    for (int i = 0; i < nodes_.size(); i++)
+        symbolNodes_[offsets[static_cast<int>(nodes_[i].symbol_)]++] = static_cast<quint32>(i);
+    endResetModel();
+}
+
+QModelIndex CallTreeModel::indexOf(quint32 node, int column) const {
+    if (node == NONE || node >= nodeCount())
+        return QModelIndex();
+    // rows of a node are known once its parent's children are sorted
+    for (auto current = node; current != NONE; current = nodes_[static_cast<int>(current)].parent_)
+        children(nodes_[static_cast<int>(current)].parent_);
+    return createIndex(static_cast<int>(rows_[static_cast<int>(node)]), column, static_cast<quintptr>(node));
+}
+
+QFuture<QVector<quint32>> CallTreeModel::search(const QString& keyword) const {
+    auto names = names_;
+    auto symbolNodes = symbolNodes_;
+    auto symbolOffsets = symbolOffsets_;
+    return QtConcurrent::run([names, symbolNodes, symbolOffsets, keyword]() {
+        QVector<quint32> matches;
+        for (int i = 0; i < names.size(); i++) {
+            if (!names[i].contains(keyword, Qt::CaseInsensitive))
+                continue;
+            for (int j = symbolOffsets[i]; j < symbolOffsets[i + 1]; j++)
+                matches.push_back(symbolNodes[j]);
+        }
+        std::sort(matches.begin(), matches.end());
+        return matches;
+    });
+}
+
+QModelIndex CallTreeModel::index(int row, int column, const QModelIndex &parent) const {
+    if (row < 0 || column < 0 || column >= 3)
+        return QModelIndex();
+    const auto& nodes = children(node(parent));
+    if (row >= nodes.size())
+        return QModelIndex();
+    return createIndex(row, column, static_cast<quintptr>(nodes[row]));
+}
+
+QModelIndex CallTreeModel::parent(const QModelIndex &child) const {
+    auto childNode = node(child);
+    if (childNode == NONE)
+        return QModelIndex();
+    auto parentNode = nodes_[static_cast<int>(childNode)].parent_;
+    if (parentNode == NONE)
+        return QModelIndex();
+    return createIndex(static_cast<int>(rows_[static_cast<int>(parentNode)]), 0, static_cast<quintptr>(parentNode));
+}
+
+int CallTreeModel::rowCount(const QModelIndex &parent) const {
+    if (parent.column() > 0)
+        return 0;
+    return children(node(parent)).size();
+}
+
+int CallTreeModel::columnCount(const QModelIndex &) const {
+    return 3;
+}
+
+bool CallTreeModel::hasChildren(const QModelIndex &parent) const {
+    // answered from the links, the children aren't collected before expanding
+    if (parent.column() > 0)
+        return false;
+    auto parentNode = node(parent);
+    return parentNode == NONE ? firstRoot_ != NONE : nodes_[static_cast<int>(parentNode)].firstChild_ != NONE;
+}
+
+QVariant CallTreeModel::data(const QModelIndex &index, int role) const {
+    auto indexNode = node(index);
+    if (indexNode == NONE)
+        return QVariant();
+    const auto& treeNode = nodes_[static_cast<int>(indexNode)];
+    if (role == Qt::DisplayRole) {
+        switch (index.column()) {
+            case 0:
+                return names_[static_cast<int>(treeNode.symbol_)];
+            case 1:
+                return sizeToString(treeNode.size_);
+            case 2:
+                return treeNode.count_;
+        }
+    } else if (role == Qt::UserRole) {
+        switch (index.column()) {
+            case 0:
+                return names_[static_cast<int>(treeNode.symbol_)];
+            case 1:
+                return treeNode.size_;
+            case 2:
+                return treeNode.count_;
+        }
+    }
+    return QVariant();
+}
+
+QVariant CallTreeModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (role == Qt::DisplayRole && orientation == Qt::Horizontal) {
+        switch (section) {
+            case 0:
+                return QString("Function");
+            case 1:
+                return QString("Size");
+            case 2:
+                return QString("Count");
+        }
+    }
+    return QVariant();
+}
+
+void CallTreeModel::sort(int column, Qt::SortOrder order) {
+    if (column < 0 || column >= 3)
+        return;
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+    sortColumn_ = column;
+    sortOrder_ = order;
+    // only the children views have seen are sorted again, indexes keep
+    // their nodes
+    for (auto it = children_.begin(); it != children_.end(); ++it)
+        sortChildren(it.value());
+    auto persistent = persistentIndexList();
+    QModelIndexList moved;
+    moved.reserve(persistent.size());
+    for (const auto& persistentIndex : persistent) {
+        auto indexNode = node(persistentIndex);
+        moved.push_back(createIndex(static_cast<int>(rows_[static_cast<int>(indexNode)]), persistentIndex.column(),
+            static_cast<quintptr>(indexNode)));
+    }
+    changePersistentIndexList(persistent, moved);
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
+
+const QVector<quint32>& CallTreeModel::children(quint32 node) const {
+    auto it = children_.find(node);
+    if (it != children_.end())
+        return it.value();
+    QVector<quint32> nodes;
+    auto child = node == NONE ? firstRoot_ : nodes_[static_cast<int>(node)].firstChild_;
+    for (; child != NONE; child = nodes_[static_cast<int>(child)].nextSibling_)
+        nodes.push_back(child);
+    sortChildren(nodes);
+    return children_.insert(node, nodes).value();
+}
+
+void CallTreeModel::sortChildren(QVector<quint32>& children) const {
+    auto key = [this](quint32 node) {
+        const auto& treeNode = nodes_[static_cast<int>(node)];
+        switch (sortColumn_) {
+            case 0:
+                return static_cast<quint64>(nameRanks_[static_cast<int>(treeNode.symbol_)]);
+            case 1:
+                return treeNode.size_;
+            default:
+                return treeNode.count_;
+        }
+    };
+    // ties keep the order of the nodes in both directions
+    auto descending = sortOrder_ == Qt::DescendingOrder;
+    std::sort(children.begin(), children.end(), [&key, descending](quint32 a, quint32 b) {
+        auto keyA = key(a);
+        auto keyB = key(b);
+        if (keyA != keyB)
+            return descending ? keyA > keyB : keyA < keyB;
+        return a < b;
+    });
+    for (int i = 0; i < children.size(); i++)
+        rows_[static_cast<int>(children[i])] = static_cast<quint32>(i);
+}
@@ -3,6 +3,8 @@
 #include "pathutils.h"
 #include "hashstring.h"
 #include "clilogger.h"
+#include "lolifile.h"
+#include "elfsymbolizer.h"
 
 #include <QCoreApplication>
 #include <QDataStream>
@@ -21,9 +23,6 @@
 #include <algorithm>
 #include <limits>
 
-#define APP_MAGIC 0xA4B3C2D1
-#define APP_VERSION 106
-
 CliProfiler::CliProfiler(QObject *parent) : QObject(parent) {
     stacktraceModel_ = new StackTraceModel(this);
     
@@ -54,6 +53,22 @@ CliProfiler::CliProfiler(QObject *parent) : QObject(parent) {
         smapsTimer_->stop();
         StopCaptureProcess();
     });
+    connect(stacktraceProcess_, &StackTraceProcess::StatsReceived, [this]() {
+        const auto& stats = stacktraceProcess_->GetAgentStats();
+        if (stats.dropped_ > droppedEvents_) {
+            PrintError(QString("Agent is falling behind, %1 events dropped").arg(stats.dropped_ - droppedEvents_));
+            droppedEvents_ = stats.dropped_;
+        }
+        if (options_.verbose) {
+            const auto& decoder = stacktraceProcess_->GetDecoderStats();
+            Print(QString("Agent backlog: %1 KB, sending %2 KB/s, compression %3x, decoded %4 KB/s, %5 records/s, "
+                "live heap %6 MB")
+                .arg(stats.backlog_ / 1024).arg(stats.rawBytes_ / 1024)
+                .arg(stats.CompressionRatio(), 0, 'f', 1)
+                .arg(decoder.bytes_ / 1024).arg(decoder.records_)
+                .arg(liveAddresses_.LiveBytes() / 1048576.0, 0, 'f', 1));
+        }
+    });
 
     mainTimer_ = new QTimer(this);
     connect(mainTimer_, &QTimer::timeout, this, &CliProfiler::OnFixedUpdate);
@@ -125,6 +140,14 @@ bool CliProfiler::Initialize(const CliOptions& options) {
         screenshotProcess_->SetDeviceSerial(options_.deviceSerial);
     }
     
+    if (!options_.recordFile.isEmpty()) {
+        CLI_LOG(QString("[Initialize] Recording packets to: %1").arg(options_.recordFile));
+        if (!stacktraceProcess_->SetRecordFile(options_.recordFile)) {
+            PrintError(QString("Failed to open record file: %1").arg(options_.recordFile));
+            return false;
+        }
+    }
+    
     // Set executable paths
     CLI_LOG("[Initialize] Setting executable paths...");
     screenshotProcess_->SetExecutablePath(adbPath);
@@ -145,8 +168,8 @@ void CliProfiler::Start() {
         Print(QString("SubProcess: %1").arg(options_.subProcessName));
     }
     Print(QString("Output: %1").arg(options_.outputFile));
-    if (!options_.symbolPath.isEmpty()) {
-        Print(QString("Symbol: %1").arg(options_.symbolPath));
+    for (const auto& symbolPath : options_.symbolPaths) {
+        Print(QString("Symbol: %1").arg(symbolPath));
     }
     if (options_.duration > 0) {
         Print(QString("Duration: %1 seconds").arg(options_.duration));
@@ -158,6 +181,7 @@ void CliProfiler::Start() {
     
     CLI_LOG("[Start] Clearing cache folder...");
     // Clear cache folder
+    spillWriter_.reset();
     auto cachePath = QCoreApplication::applicationDirPath() + "/cache";
     auto cacheDir = QDir(cachePath);
     if (cacheDir.exists()) {
@@ -165,7 +189,11 @@ void CliProfiler::Start() {
         for (auto fileName : files) {
             cacheDir.remove(fileName);
         }
+    } else {
+        QDir().mkdir(cachePath);
     }
+    spillWriter_.reset(new SpillWriter(cachePath));
+    spillWriter_->start();
     
     CLI_LOG("[Start] Clearing data structures...");
     // Clear data structures
@@ -176,13 +204,17 @@ void CliProfiler::Start() {
     symbloMap_.clear();
     recordsCache_.clear();
     freeAddrMap_.clear();
-    callStackMap_.clear();
+    liveAddresses_.Clear();
+    spilledRecords_ = 0;
+    callStacks_.Clear();
+    agentStacks_.Clear();
     HashString::hashmap_.clear();
     memInfoData_.clear();
     
     maxMemInfoValue_ = 128;
     time_ = 0;
     lastScreenshotTime_ = 0;
+    droppedEvents_ = 0;
     
     CLI_LOG("[Start] Getting configuration settings...");
     // Start profiling
@@ -357,46 +389,26 @@ void CliProfiler::OnStacktraceDataReceived() {
     if (!isConnected_ || !isCapturing_)
         return;
     
-    const auto& stacks = stacktraceProcess_->GetStackInfo();
-    const auto& frees = stacktraceProcess_->GetFreeInfo();
-    
-    // Cache data
-    auto cacheDirPath = QCoreApplication::applicationDirPath() + "/cache";
-    if (!QDir(cacheDirPath).exists()) {
-        QDir().mkdir(cacheDirPath);
-    }
-    
-    static quint32 cacheIndex = 0;
-    auto cachePath = QString("%1/cache_%2.bin").arg(cacheDirPath).arg(cacheIndex);
-    QFile cacheFile(cachePath);
-    if (!cacheFile.open(QFile::OpenModeFlag::WriteOnly | QFile::OpenModeFlag::Append)) {
-        Print("Failed to open cache file: " + cachePath);
-        return;
-    }
-    
-    QDataStream stream(&cacheFile);
-    stream << static_cast<qint32>(stacks.size());
-    for (auto& stack : stacks) {
-        stream << stack.seq_ << stack.addr_ << stack.size_ << stack.time_
-               << stack.library_.hashcode_ << stack.recType_ << stack.stacktraces_;
+    const auto& batch = stacktraceProcess_->GetBatch();
+    if (agentStacks_.HasPending()) {
+        for (const auto& definition : batch.definitions_)
+            agentStacks_.Define(definition.stackId_, batch.frames_.constData() + definition.frameOffset_,
+                                static_cast<int>(definition.frameCount_));
     }
-    cacheFile.flush();
     
-    if (cacheFile.size() > 1024 * 1024 * 512) {
-        cacheIndex++;
+    // Spill data, written on the spill writer's thread
+    if (spillWriter_) {
+        spillWriter_->Append(batch);
+        // spilled records are tracked by the order they're spilled in
+        bool live;
+        for (const auto& stack : batch.stacks_)
+            liveAddresses_.Allocate(stack.addr_, stack.seq_, spilledRecords_++,
+                stack.size_, stack.library_.hashcode_, live);
     }
-    cacheFile.close();
     
     // Read free call infos
-    if (frees.size() > 0) {
-        for (const auto& free : frees) {
-            const auto address = free.second;
-            auto curSeq = freeAddrMap_[address];
-            if (free.first > curSeq) {
-                freeAddrMap_[address] = free.first;
-            }
-        }
-    }
+    for (const auto& free : batch.frees_)
+        liveAddresses_.Free(free.second, free.first);
 }
 
 void CliProfiler::OnStacktraceConnectionLost() {
@@ -540,23 +552,21 @@ void CliProfiler::ReadSMapsFile(QFile* file) {
     }
 }
 
-void CliProfiler::ReadStacktraceData(const QVector<RawStackInfo>& stacks) {
+void CliProfiler::ReadStacktraceData(const StackTraceBatch& batch) {
     auto isNoStack = ConfigDialog::IsNoStackMode();
-    if (stacks.size() > 0) {
-        for (const auto& stack : stacks) {
+    if (batch.stacks_.size() > 0) {
+        for (const auto& stack : batch.stacks_) {
             StackRecord record;
-            record.uuid_ = QUuid::createUuid();
             record.seq_ = stack.seq_;
             record.time_ = stack.time_;
             record.size_ = stack.size_;
             record.addr_ = stack.addr_;
             if (isNoStack) {
                 record.library_ = HashString(stack.library_);
+            } else if (stack.recType_ == static_cast<quint8>(loliRecordTypes::STACKID_)) {
+                record.stackIndex_ = agentStacks_.Index(stack.stackId_, stacktraceProcess_->FindStack(stack.stackId_));
             } else {
-                auto& callstack = callStackMap_[record.uuid_];
-                for (int i = 0; i < stack.stacktraces_.size(); i++) {
-                    callstack.append(qMakePair(QString(), stack.stacktraces_[i]));
-                }
+                record.stackIndex_ = callStacks_.Intern(batch.Frames(stack), static_cast<int>(stack.frameCount_));
             }
             recordsCache_.push_back(record);
         }
@@ -564,46 +574,66 @@ void CliProfiler::ReadStacktraceData(const QVector<RawStackInfo>& stacks) {
 }
 
 void CliProfiler::ReadStacktraceDataCache() {
-    auto cachePath = QCoreApplication::applicationDirPath() + "/cache";
-    QDir cacheDir(cachePath);
-    auto files = cacheDir.entryList(QDir::Filter::Files, QDir::SortFlag::Time);
+    if (!spillWriter_)
+        return;
+    auto paths = spillWriter_->Finish();
+    if (spillWriter_->HasFailed())
+        PrintError("Failed to write spill files, some records or callstacks are missing");
+    auto isNoStack = ConfigDialog::IsNoStackMode();
     quint32 recordCount = 0;
-    QVector<RawStackInfo> stacks;
-    
-    for (auto filePath : files) {
-        QFile file(cachePath + "/" + filePath);
-        stacks.clear();
-        if (file.open(QFile::OpenModeFlag::ReadOnly)) {
-            QDataStream stream(&file);
-            while (!stream.atEnd()) {
-                qint32 size;
-                stream >> size;
-                recordCount += size;
-                for (int i = 0; i < size; i++) {
-                    RawStackInfo stack;
-                    stream >> stack.seq_ >> stack.addr_ >> stack.size_ >> stack.time_
-                           >> stack.library_.hashcode_ >> stack.recType_ >> stack.stacktraces_;
-                    // ignore freed records
-                    auto it = freeAddrMap_.find(stack.addr_);
-                    if (it != freeAddrMap_.end()) {
-                        if (stack.seq_ < it.value())
-                            continue;
-                    }
-                    stacks.push_back(stack);
-                }
-            }
-            ReadStacktraceData(stacks);
-            file.remove();
+    {
+        SpillReader reader;
+        if (!reader.Open(paths))
+            PrintError("Failed to map spill files");
+        // live records by spill order, unless records went missing and the
+        // order doesn't match, their seqs are compared to the last frees then
+        auto inOrder = reader.RecordCount() == static_cast<int>(spilledRecords_);
+        QVector<bool> liveRecords(inOrder ? reader.RecordCount() : 0, false);
+        for (auto index : liveAddresses_.LiveIndices()) {
+            if (index < static_cast<quint32>(liveRecords.size()))
+                liveRecords[static_cast<int>(index)] = true;
         }
+        // callstack index of every spilled callstack, interned on first use
+        QVector<quint32> spilledStacks(reader.StackCount(), std::numeric_limits<quint32>::max());
+        recordsCache_.reserve(recordsCache_.size() + reader.RecordCount());
+        reader.ForEachRecord([&](const SpillRecord& spilled) {
+            // ignore freed records
+            if (inOrder) {
+                if (!liveRecords[static_cast<int>(recordCount++)])
+                    return;
+            } else {
+                recordCount++;
+                auto it = freeAddrMap_.find(spilled.addr_);
+                if (it != freeAddrMap_.end() && spilled.seq_ < it.value())
+                    return;
+            }
+            StackRecord record;
+            record.seq_ = spilled.seq_;
+            record.time_ = static_cast<qint32>(spilled.time_);
+            record.size_ = static_cast<qint32>(spilled.size_);
+            record.addr_ = spilled.addr_;
+            if (isNoStack) {
+                record.library_ = HashString(spilled.library_);
+            } else if (spilled.recType_ == static_cast<quint8>(loliRecordTypes::STACKID_)) {
+                record.stackIndex_ = agentStacks_.Index(spilled.stack_, stacktraceProcess_->FindStack(spilled.stack_));
+            } else if (spilled.recType_ == static_cast<quint8>(loliRecordTypes::STACKTRACE_) &&
+                       spilled.stack_ < static_cast<quint32>(spilledStacks.size())) {
+                // a stack of a block that failed to write comes back empty
+                auto& index = spilledStacks[static_cast<int>(spilled.stack_)];
+                if (index == std::numeric_limits<quint32>::max())
+                    index = callStacks_.Intern(reader.Stack(spilled.stack_));
+                record.stackIndex_ = index;
+            }
+            recordsCache_.push_back(record);
+        });
     }
+    spillWriter_.reset();
+    for (const auto& path : paths)
+        QFile::remove(path);
     Print(QString("Cached %1 records.").arg(recordCount));
 }
 
-void CliProfiler::InterpretRecordLibrary(StackRecord& record, StacktraceData& data) {
-    auto it = callStackMap_.find(record.uuid_);
-    if (it == callStackMap_.end())
-        return;
-    
+void CliProfiler::InterpretCallStack(CallStack& callStack, StacktraceData& data) {
     static QVector<QPair<HashString, SMapsSection*>> sMapsCache_;
     if (sMapsCache_.isEmpty()) {
         for (auto it = sMapsSections_.begin(); it != sMapsSections_.end(); ++it) {
@@ -615,7 +645,6 @@ void CliProfiler::InterpretRecordLibrary(StackRecord& record, StacktraceData& da
         }
     }
     
-    auto& callStack = it.value();
     for (int i = 0; i < callStack.size(); i++) {
         auto& libName = callStack[i].first;
         auto& funcAddr = callStack[i].second;
@@ -623,7 +652,7 @@ void CliProfiler::InterpretRecordLibrary(StackRecord& record, StacktraceData& da
         for (int i = 0; i < sMapsCache_.size(); i++) {
             const auto& cache = sMapsCache_[i];
             quint64 symbolVAddr;
-            if (cache.second->Contains(funcAddr, record.size_, symbolVAddr)) {
+            if (cache.second->Contains(funcAddr, 0, symbolVAddr)) {
                 funcAddr = symbolVAddr;
                 libName = cache.first;
                 data.records_.push_back(qMakePair(libName, funcAddr));
@@ -635,30 +664,30 @@ void CliProfiler::InterpretRecordLibrary(StackRecord& record, StacktraceData& da
             libName = HashString(qHash("unknown"));
     }
     
-    if (callStack.size() == 0)
+    if (callStack.size() == 0) {
+        data.allocSites_.push_back(qMakePair(HashString(), 0ull));
         return;
+    }
     
-    record.library_ = callStack[0].first;
-    record.funcAddr_ = callStack[0].second;
+    auto allocSite = callStack[0];
     int level = 1;
-    while (record.library_.Get() == "libloli.so" && level < callStack.size()) {
-        record.library_ = callStack[level].first;
-        record.funcAddr_ = callStack[level].second;
+    while (allocSite.first.Get() == "libloli.so" && level < callStack.size()) {
+        allocSite = callStack[level];
         level++;
     }
     
-    if (record.library_.hashcode_ == 0) {
-        record.library_ = callStack[0].first = HashString(qHash("unknown"));
+    if (allocSite.first.hashcode_ == 0) {
+        allocSite.first = callStack[0].first = HashString(qHash("unknown"));
     }
     
-    if (!data.libraries_.contains(record.library_.Get()))
-        data.libraries_.push_back(record.library_.Get());
+    data.allocSites_.push_back(allocSite);
 }
 
-CliProfiler::StacktraceData CliProfiler::InterpretRecordsLibrary(int start, int count) {
+CliProfiler::StacktraceData CliProfiler::InterpretCallStacks(int start, int count) {
     StacktraceData data;
+    data.allocSites_.reserve(count);
     for (int i = 0; i < count; i++)
-        InterpretRecordLibrary(recordsCache_[start + i], data);
+        InterpretCallStack(callStacks_[static_cast<quint32>(start + i)], data);
     return data;
 }
 
@@ -674,20 +703,35 @@ void CliProfiler::InterpretStacktraceData() {
         Print("Translating stack traces...");
         HashString::hashmap_.insert(qHash("unknown"), "unknown");
         
+        // callstacks of freed records are dropped, the others are translated
+        // once no matter how many records share them
+        QVector<bool> usedStacks(callStacks_.Size(), false);
+        for (const auto& record : recordsCache_)
+            usedStacks[static_cast<int>(record.stackIndex_)] = true;
+        auto stackIndices = callStacks_.Compact(usedStacks);
+        for (auto& record : recordsCache_)
+            record.stackIndex_ = stackIndices[static_cast<int>(record.stackIndex_)];
+        agentStacks_.Clear();
+        
         auto threadCount = std::max(2, QThread::idealThreadCount());
-        auto payload = recordsCache_.size() / threadCount;
+        auto stackCount = callStacks_.Size() - 1;
+        auto payload = stackCount / threadCount;
         QVector<QFuture<StacktraceData>> futures;
-        int currentIndex = 0;
+        int currentIndex = 1;
         
         for (int i = 0; i < threadCount - 1; i++) {
-            futures.push_back(QtConcurrent::run(this, &CliProfiler::InterpretRecordsLibrary, currentIndex, payload));
+            futures.push_back(QtConcurrent::run(this, &CliProfiler::InterpretCallStacks, currentIndex, payload));
             currentIndex += payload;
         }
-        futures.push_back(QtConcurrent::run(this, &CliProfiler::InterpretRecordsLibrary, 
-            currentIndex, recordsCache_.size() - currentIndex));
+        futures.push_back(QtConcurrent::run(this, &CliProfiler::InterpretCallStacks, 
+            currentIndex, callStacks_.Size() - currentIndex));
         
-        Print(QString("Translating %1 records using %2 threads...").arg(recordsCache_.size()).arg(threadCount));
+        Print(QString("Translating %1 callstacks of %2 records using %3 threads...")
+            .arg(stackCount).arg(recordsCache_.size()).arg(threadCount));
         
+        QVector<QPair<HashString, quint64>> allocSites;
+        allocSites.reserve(callStacks_.Size());
+        allocSites.push_back(qMakePair(HashString(), 0ull));
         for (int i = 0; i < futures.size(); i++) {
             auto& future = futures[i];
             const auto& trace = future.result();
@@ -699,10 +743,16 @@ void CliProfiler::InterpretStacktraceData() {
                     symblos.insert(record.second, "");
                 }
             }
-            for (const auto& library : trace.libraries_) {
-                if (!libraries_.contains(library)) {
-                    libraries_.insert(library);
-                }
+            allocSites += trace.allocSites_;
+        }
+        
+        for (auto& record : recordsCache_) {
+            if (callStacks_.At(record.stackIndex_).isEmpty())
+                continue;
+            record.library_ = allocSites[static_cast<int>(record.stackIndex_)].first;
+            record.funcAddr_ = allocSites[static_cast<int>(record.stackIndex_)].second;
+            if (!libraries_.contains(record.library_.Get())) {
+                libraries_.insert(record.library_.Get());
             }
         }
     }
@@ -711,108 +761,31 @@ void CliProfiler::InterpretStacktraceData() {
     recordsCache_.clear();
 }
 
-bool CliProfiler::LoadSymbolFile(const QString& symbolPath) {
-    if (symbolPath.isEmpty() || !QFile::exists(symbolPath)) {
-        return false;
-    }
-    
-    Print(QString("Loading symbol file: %1").arg(symbolPath));
-    
-    auto nmPath = PathUtils::GetNDKToolPath("nm", ConfigDialog::GetCurrentSettings().arch_ != "arm64-v8a");
-    if (nmPath.isEmpty() || !QFile::exists(nmPath)) {
-        PrintError("NDK tool 'nm' not found");
-        return false;
-    }
-    
-    QFileInfo info(symbolPath);
-    auto soName = info.baseName() + ".so";
-    auto it = symbloMap_.find(soName);
-    if (it == symbloMap_.end()) {
-        Print(QString("Warning: No addresses found for library %1").arg(soName));
-        return false;
-    }
-    
-    QString symbolMapFilePath = symbolPath + ".txt";
-    
-    // Run nm to extract symbols
-    Print("Extracting symbols...");
-    {
-        QProcess nmProcess;
-        AdbProcess::SetArguments(&nmProcess, QStringList() << "-nCS" << symbolPath);
-        nmProcess.setStandardOutputFile(symbolMapFilePath);
-        nmProcess.setProgram(nmPath);
-        nmProcess.start();
-        if (!nmProcess.waitForStarted()) {
-            PrintError("Failed to start nm process");
-            return false;
+bool CliProfiler::LoadSymbolFiles(const QStringList& symbolPaths) {
+    QStringList existingPaths;
+    for (const auto& symbolPath : symbolPaths) {
+        if (!symbolPath.isEmpty() && QFile::exists(symbolPath)) {
+            Print(QString("Loading symbol file: %1").arg(symbolPath));
+            existingPaths << symbolPath;
         }
-        nmProcess.waitForFinished(-1);  // Wait indefinitely
     }
-    
-    // Parse symbol map
-    Print("Parsing symbols...");
-    struct SymbolRecord {
-        QString name;
-        quint64 addr;
-        quint32 size;
-    };
-    QVector<SymbolRecord> sortedRecords;
-    
-    {
-        QFile symbolMapFile(symbolMapFilePath);
-        if (!symbolMapFile.open(QFile::OpenModeFlag::ReadOnly)) {
-            PrintError(QString("Failed to read symbol map: %1").arg(symbolMapFilePath));
-            return false;
-        }
-        
-        QRegExp recordRx("([0-9a-z]+)\\s([0-9a-z]+)\\s(\\w)\\s(.+)");
-        QTextStream in(&symbolMapFile);
-        while (!in.atEnd()) {
-            QString line = in.readLine();
-            if (recordRx.indexIn(line) < 0)
-                continue;
-            SymbolRecord record;
-            record.name = recordRx.cap(4);
-            record.size = recordRx.cap(2).toUInt(nullptr, 16);
-            record.addr = recordRx.cap(1).toULong(nullptr, 16);
-            sortedRecords.push_back(record);
-        }
-        symbolMapFile.close();
+    if (existingPaths.isEmpty()) {
+        return false;
     }
     
-    Print(QString("Loaded %1 symbols, translating addresses...").arg(sortedRecords.size()));
-    
-    // Translate addresses
-    if (sortedRecords.size() > 0) {
-        auto& addrMap = it.value();
-        int translatedCount = 0;
-        for (auto addrMapIt = addrMap.begin(); addrMapIt != addrMap.end(); ++addrMapIt) {
-            if (addrMapIt.value().size() != 0)
-                continue;
-            auto addr = addrMapIt.key();
-            int left = 0;
-            int right = sortedRecords.size() - 1;
-            while (left != right) {
-                auto mid = static_cast<int>(std::ceil(static_cast<float>(left + right) / 2));
-                auto& midRecord = sortedRecords[mid];
-                if (addr >= midRecord.addr && addr <= midRecord.addr + midRecord.size) {
-                    addrMapIt.value() = midRecord.name;
-                    translatedCount++;
-                    break;
-                } else if (addr < midRecord.addr) {
-                    right = mid - 1;
-                } else {
-                    left = mid;
-                }
-            }
+    // Libraries are read and translated in parallel
+    bool loaded = false;
+    for (const auto& library : ElfSymbolizer::TranslateLibraries(existingPaths, symbloMap_)) {
+        if (!library.error_.isEmpty()) {
+            PrintError(library.error_);
+            continue;
         }
-        Print(QString("Translated %1 addresses").arg(translatedCount));
+        Print(QString("Loaded %1 symbols of %2, translated %3 addresses")
+            .arg(library.symbolCount_).arg(library.name_).arg(library.translated_));
+        loaded = true;
     }
     
-    // Clean up temp file
-    QFile::remove(symbolMapFilePath);
-    
-    return true;
+    return loaded;
 }
 
 void CliProfiler::StopCaptureProcess() {
@@ -848,6 +821,9 @@ void CliProfiler::StopCaptureProcess() {
         file.remove();
     }
     
+    // the last free of every address, saved with the records
+    freeAddrMap_ = liveAddresses_.Frees();
+    
     if (!readSMaps) {
         Print("Failed to read proc/pid/smaps");
     } else {
@@ -858,9 +834,9 @@ void CliProfiler::StopCaptureProcess() {
     
     Print(QString("Captured %1 records.").arg(stacktraceModel_->rowCount()));
     
-    // Load symbol file if specified
-    if (!options_.symbolPath.isEmpty()) {
-        LoadSymbolFile(options_.symbolPath);
+    // Load symbol files if specified
+    if (!options_.symbolPaths.isEmpty()) {
+        LoadSymbolFiles(options_.symbolPaths);
     }
     
     // Save to output file
@@ -878,116 +854,100 @@ void CliProfiler::StopCaptureProcess() {
     
     // Open in WriteOnly | Truncate mode to ensure file is overwritten, not appended
     if (outputFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-        SaveToFile(&outputFile);
+        auto saved = SaveToFile(&outputFile);
         outputFile.close();
-        Print("Profile saved successfully!");
-        Cleanup(0);
+        if (saved) {
+            Print("Profile saved successfully!");
+            Cleanup(0);
+        } else {
+            PrintError("Failed to write output file");
+            Cleanup(1);
+        }
     } else {
         PrintError("Failed to save output file");
         Cleanup(1);
     }
 }
 
-void CliProfiler::SaveToFile(QFile *file) {
-    QDataStream stream(file);
-    stream << static_cast<quint32>(APP_MAGIC);
-    stream << static_cast<qint32>(APP_VERSION);
-    stream.setVersion(QDataStream::Qt_5_12);
+bool CliProfiler::SaveToFile(QFile *file) {
+    LoliFileWriter writer(file);
     
     // meminfo charts
-    stream << static_cast<qint32>(maxMemInfoValue_);
-    stream << static_cast<qint32>(6);  // 6 series
-    
-    // Create series data from memInfoData_
-    QVector<QVector<QPointF>> seriesData(6);
-    for (const auto& point : memInfoData_) {
-        seriesData[0].append(QPointF(point.time, point.total));
-        seriesData[1].append(QPointF(point.time, point.nativeHeap));
-        seriesData[2].append(QPointF(point.time, point.gfxDev));
-        seriesData[3].append(QPointF(point.time, point.eglMtrack));
-        seriesData[4].append(QPointF(point.time, point.glMtrack));
-        seriesData[5].append(QPointF(point.time, point.unknown));
-    }
-    
-    for (int i = 0; i < 6; i++) {
-        stream << static_cast<qint32>(seriesData[i].size());
-        for (const auto& point : seriesData[i]) {
-            stream << point;
+    writer.WriteBlob(LoliFile::Section::MEMINFO, [this](QDataStream& stream) {
+        stream << static_cast<qint32>(maxMemInfoValue_);
+        stream << static_cast<qint32>(6);  // 6 series
+        
+        // Create series data from memInfoData_
+        QVector<QVector<QPointF>> seriesData(6);
+        for (const auto& point : memInfoData_) {
+            seriesData[0].append(QPointF(point.time, point.total));
+            seriesData[1].append(QPointF(point.time, point.nativeHeap));
+            seriesData[2].append(QPointF(point.time, point.gfxDev));
+            seriesData[3].append(QPointF(point.time, point.eglMtrack));
+            seriesData[4].append(QPointF(point.time, point.glMtrack));
+            seriesData[5].append(QPointF(point.time, point.unknown));
         }
-    }
+        
+        for (int i = 0; i < 6; i++) {
+            stream << static_cast<qint32>(seriesData[i].size());
+            for (const auto& point : seriesData[i]) {
+                stream << point;
+            }
+        }
+    });
     
     // string hashes
-    stream << HashString::hashmap_;
+    writer.WriteBlob(LoliFile::Section::STRINGS, [](QDataStream& stream) {
+        stream << HashString::hashmap_;
+    });
     
     // callstack tree view
-    qint32 count = stacktraceModel_->rowCount();
-    stream << count;
-    for (int i = 0; i < count; i++) {
-        auto& record = stacktraceModel_->recordAt(i);
-        stream << record.uuid_.toString();
-        stream << record.seq_;
-        stream << record.time_;
-        stream << record.size_;
-        stream << record.addr_;
-        stream << record.funcAddr_;
-        stream << record.library_.hashcode_;
-    }
-    
-    // callstack map
-    stream << static_cast<qint32>(callStackMap_.size());
-    for (auto it = callStackMap_.begin(); it != callStackMap_.end(); ++it) {
-        stream << it.key().toString();
-        auto& callstacks = it.value();
-        stream << static_cast<qint32>(callstacks.size());
-        for (auto stack : callstacks) {
-            stream << stack.first.hashcode_ << stack.second;
-        }
-    }
+    writer.WriteRecords(stacktraceModel_->records());
+    
+    // callstack table
+    writer.WriteStacks(callStacks_);
     
     // symbol map
-    stream << static_cast<qint32>(symbloMap_.size());
-    for (auto it = symbloMap_.begin(); it != symbloMap_.end(); ++it) {
-        stream << it.key();
-        stream << static_cast<qint32>(it.value().size());
-        for (auto it1 = it.value().begin(); it1 != it.value().end(); ++it1) {
-            stream << it1.key();
-            stream << it1.value();
+    writer.WriteBlob(LoliFile::Section::SYMBOLS, [this](QDataStream& stream) {
+        stream << static_cast<qint32>(symbloMap_.size());
+        for (auto it = symbloMap_.begin(); it != symbloMap_.end(); ++it) {
+            stream << it.key();
+            stream << static_cast<qint32>(it.value().size());
+            for (auto it1 = it.value().begin(); it1 != it.value().end(); ++it1) {
+                stream << it1.key();
+                stream << it1.value();
+            }
         }
-    }
+    });
     
     // freeaddr map
-    stream << static_cast<qint32>(freeAddrMap_.size());
-    for (auto it = freeAddrMap_.begin(); it != freeAddrMap_.end(); ++it) {
-        stream << it.key();
-        stream << static_cast<quint32>(it.value());
-    }
+    writer.WriteFrees(freeAddrMap_);
     
     // screen shots
-    stream << static_cast<qint32>(screenshots_.size());
-    for (auto& pair : screenshots_) {
-        stream << static_cast<qint32>(pair.first);
-        stream << pair.second;
-    }
+    writer.WriteScreenshots(screenshots_);
     
     // smaps
-    stream << static_cast<qint32>(sMapsSections_.size());
-    for (auto it = sMapsSections_.begin(); it != sMapsSections_.end(); ++it) {
-        stream << it.key();
-        auto& section = it.value();
-        stream << static_cast<qint32>(section.addrs_.size());
-        for (auto& addr : section.addrs_) {
-            stream << addr.start_;
-            stream << addr.end_;
-            stream << addr.offset_;
+    writer.WriteBlob(LoliFile::Section::SMAPS, [this](QDataStream& stream) {
+        stream << static_cast<qint32>(sMapsSections_.size());
+        for (auto it = sMapsSections_.begin(); it != sMapsSections_.end(); ++it) {
+            stream << it.key();
+            auto& section = it.value();
+            stream << static_cast<qint32>(section.addrs_.size());
+            for (auto& addr : section.addrs_) {
+                stream << addr.start_;
+                stream << addr.end_;
+                stream << addr.offset_;
+            }
+            stream << section.virtual_;
+            stream << section.rss_;
+            stream << section.pss_;
+            stream << section.privateClean_;
+            stream << section.privateDirty_;
+            stream << section.sharedClean_;
+            stream << section.sharedDirty_;
         }
-        stream << section.virtual_;
-        stream << section.rss_;
-        stream << section.pss_;
-        stream << section.privateClean_;
-        stream << section.privateDirty_;
-        stream << section.sharedClean_;
-        stream << section.sharedDirty_;
-    }
+    });
+    return writer.Finish();
 }
 
 void CliProfiler::Cleanup(int exitCode) {
@@ -59,6 +59,7 @@ void ConfigDialog::ReadCurrentSettings() {
         item->setFlags(item->flags() | Qt::ItemIsEditable);
     }
     ui->thresholdSpinBox->setValue(currentSettings_.threshold_);
+    ui->depthSpinBox->setValue(currentSettings_.depth_);
     ui->typeComboBox->setCurrentText(currentSettings_.type_);
     ui->libraryStackedWidget->setCurrentIndex(ui->typeComboBox->currentIndex());
 }
@@ -68,6 +69,7 @@ void ConfigDialog::WriteCurrentSettings() {
     currentSettings_.build_ = ui->buildComboBox->currentText();
     currentSettings_.type_ = ui->typeComboBox->currentText();
     currentSettings_.threshold_ = ui->thresholdSpinBox->value();
+    currentSettings_.depth_ = ui->depthSpinBox->value();
     currentSettings_.arch_ = ui->archComboBox->currentText();
     currentSettings_.compiler_ = ui->compilerComboBox->currentText();
     currentSettings_.hook_ = ui->hookComboBox->currentText();
@@ -129,6 +131,7 @@ void ConfigDialog::SaveConfigFile() {
             stream << endl;
             stream << "mode:" << settings.mode_ << endl;
             stream << "build:" << settings.build_ << endl;
+            stream << "depth:" << settings.depth_ << endl;
             stream << "type:" << settings.type_ << endl;
             stream << "arch:" << settings.arch_ << endl;
             stream << "compiler:" << settings.compiler_ << endl;
@@ -176,6 +179,8 @@ ConfigDialog::Settings ConfigDialog::ParseConfigFile() {
                 settings->mode_ = words[1];
             } else if (words[0] == "build") {
                 settings->build_ = words[1];
+            } else if (words[0] == "depth") {
+                settings->depth_ = words[1].toInt();
             } else if (words[0] == "type") {
                 settings->type_ = words[1];
             } else if (words[0] == "arch") {
@@ -264,6 +269,7 @@ void ConfigDialog::on_btnNDKFolder_clicked() {
 void ConfigDialog::on_modeComboBox_currentIndexChanged(const QString &arg) {
     ui->thresholdSpinBox->setEnabled(arg != "nostack");
     ui->buildComboBox->setEnabled(arg != "nostack");
+    ui->depthSpinBox->setEnabled(arg != "nostack");
 }
 
 void ConfigDialog::on_typeComboBox_currentIndexChanged(int index) {
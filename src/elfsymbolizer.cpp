@@ -0,0 +1,638 @@
+#include "elfsymbolizer.h"
+
+#include <QFileInfo>
+#include <QSet>
+#include <QtConcurrent>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+#if defined(__GNUC__) || defined(__clang__)
+#include <cxxabi.h>
+#define LOLI_HAS_CXXABI
+#else
+#include <QProcess>
+#include "pathutils.h"
+#endif
+
+#define SHT_SYMTAB 2
+#define SHT_NOBITS 8
+#define SHT_DYNSYM 11
+#define SHF_COMPRESSED 0x800
+#define ELFCOMPRESS_ZLIB 1
+#define STT_FUNC 2
+#define STT_SECTION 3
+#define STT_FILE 4
+#define EM_ARM 40
+
+const quint32 ElfSymbolizer::NONE;
+
+// bounds checked reads of little endian data, reads past the end return 0
+// and mark the reader as failed
+struct ElfReader {
+    const uchar* data_;
+    const uchar* end_;
+    bool failed_ = false;
+
+    ElfReader(const uchar* data, const uchar* end)
+        : data_(data), end_(end) {}
+    bool Has(quint64 size) {
+        if (static_cast<quint64>(end_ - data_) >= size)
+            return true;
+        failed_ = true;
+        data_ = end_;
+        return false;
+    }
+    quint8 U8() { return Has(1) ? *data_++ : 0; }
+    quint16 U16() { return Read<quint16>(); }
+    quint32 U32() { return Read<quint32>(); }
+    quint64 U64() { return Read<quint64>(); }
+    template<typename T>
+    T Read() {
+        if (!Has(sizeof(T)))
+            return 0;
+        auto value = qFromLittleEndian<T>(data_);
+        data_ += sizeof(T);
+        return value;
+    }
+    quint64 Sized(int size) {
+        switch (size) {
+            case 1: return U8();
+            case 2: return U16();
+            case 4: return U32();
+            case 8: return U64();
+        }
+        Skip(static_cast<quint64>(size));
+        return 0;
+    }
+    quint64 ULeb() {
+        quint64 value = 0;
+        for (int shift = 0; Has(1); shift += 7) {
+            auto byte = *data_++;
+            if (shift < 64)
+                value |= static_cast<quint64>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                break;
+        }
+        return value;
+    }
+    qint64 SLeb() {
+        quint64 value = 0;
+        int shift = 0;
+        quint8 byte = 0;
+        while (Has(1)) {
+            byte = *data_++;
+            if (shift < 64)
+                value |= static_cast<quint64>(byte & 0x7f) << shift;
+            shift += 7;
+            if ((byte & 0x80) == 0)
+                break;
+        }
+        if (shift < 64 && (byte & 0x40) != 0)
+            value |= ~0ull << shift;
+        return static_cast<qint64>(value);
+    }
+    const char* CString() {
+        auto str = reinterpret_cast<const char*>(data_);
+        while (data_ < end_ && *data_ != 0)
+            data_++;
+        if (!Has(1))
+            return "";
+        data_++;
+        return str;
+    }
+    void Skip(quint64 size) {
+        if (Has(size))
+            data_ += size;
+    }
+};
+
+static QString StringAt(const QByteArray& strings, quint64 offset) {
+    if (offset >= static_cast<quint64>(strings.size()))
+        return QString();
+    auto str = strings.constData() + offset;
+    return QString::fromUtf8(str, static_cast<int>(qstrnlen(str, static_cast<uint>(strings.size() - offset))));
+}
+
+bool ElfSymbolizer::Open(const QString& path) {
+    file_.setFileName(path);
+    if (!file_.open(QIODevice::ReadOnly)) {
+        error_ = QString("Can't open %1").arg(path);
+        return false;
+    }
+    size_ = static_cast<quint64>(file_.size());
+    data_ = file_.map(0, file_.size());
+    if (data_ == nullptr) {
+        error_ = QString("Can't map %1").arg(path);
+        return false;
+    }
+    if (size_ < 64 || memcmp(data_, "\x7f" "ELF", 4) != 0) {
+        error_ = QString("%1 isn't an ELF file").arg(path);
+        return false;
+    }
+    if (data_[5] != 1) {
+        error_ = QString("%1 is a big endian ELF file").arg(path);
+        return false;
+    }
+    is64_ = data_[4] == 2;
+    thumb_ = qFromLittleEndian<quint16>(data_ + 18) == EM_ARM;
+    if (!ReadSections()) {
+        error_ = QString("%1 has corrupted section headers").arg(path);
+        return false;
+    }
+    for (const auto& section : sections_) {
+        if (section.type_ == SHT_SYMTAB || section.type_ == SHT_DYNSYM)
+            ReadSymbols(section);
+    }
+    // aliases share an address, the smallest symbol containing an address
+    // is the last of them
+    std::sort(symbols_.begin(), symbols_.end(), [](const Symbol& a, const Symbol& b) {
+        return a.addr_ < b.addr_ || (a.addr_ == b.addr_ && a.size_ > b.size_);
+    });
+    // .dynsym repeats the exported symbols of .symtab
+    symbols_.erase(std::unique(symbols_.begin(), symbols_.end(), [](const Symbol& a, const Symbol& b) {
+        return a.addr_ == b.addr_ && a.size_ == b.size_;
+    }), symbols_.end());
+    return true;
+}
+
+bool ElfSymbolizer::ReadSections() {
+    quint64 offset;
+    quint32 entrySize, count, namesIndex;
+    if (is64_) {
+        offset = qFromLittleEndian<quint64>(data_ + 0x28);
+        entrySize = qFromLittleEndian<quint16>(data_ + 0x3a);
+        count = qFromLittleEndian<quint16>(data_ + 0x3c);
+        namesIndex = qFromLittleEndian<quint16>(data_ + 0x3e);
+    } else {
+        offset = qFromLittleEndian<quint32>(data_ + 0x20);
+        entrySize = qFromLittleEndian<quint16>(data_ + 0x2e);
+        count = qFromLittleEndian<quint16>(data_ + 0x30);
+        namesIndex = qFromLittleEndian<quint16>(data_ + 0x32);
+    }
+    if (offset == 0)
+        return true;
+    if (entrySize < (is64_ ? 64u : 40u) || offset > size_ || size_ - offset < entrySize)
+        return false;
+    auto header = [this, offset, entrySize](quint32 index) {
+        auto entry = data_ + offset + static_cast<quint64>(index) * entrySize;
+        Section section;
+        if (is64_) {
+            section.type_ = qFromLittleEndian<quint32>(entry + 4);
+            section.flags_ = qFromLittleEndian<quint64>(entry + 8);
+            section.offset_ = qFromLittleEndian<quint64>(entry + 24);
+            section.size_ = qFromLittleEndian<quint64>(entry + 32);
+            section.link_ = qFromLittleEndian<quint32>(entry + 40);
+            section.entrySize_ = qFromLittleEndian<quint64>(entry + 56);
+        } else {
+            section.type_ = qFromLittleEndian<quint32>(entry + 4);
+            section.flags_ = qFromLittleEndian<quint32>(entry + 8);
+            section.offset_ = qFromLittleEndian<quint32>(entry + 16);
+            section.size_ = qFromLittleEndian<quint32>(entry + 20);
+            section.link_ = qFromLittleEndian<quint32>(entry + 24);
+            section.entrySize_ = qFromLittleEndian<quint32>(entry + 36);
+        }
+        return section;
+    };
+    // more sections than the header can count keep their count and the
+    // index of their names in the first header
+    auto first = header(0);
+    if (count == 0)
+        count = static_cast<quint32>(first.size_);
+    if (namesIndex == 0xffff)
+        namesIndex = first.link_;
+    if ((size_ - offset) / entrySize < count)
+        return false;
+    sections_.reserve(static_cast<int>(count));
+    for (quint32 i = 0; i < count; i++) {
+        auto section = header(i);
+        if (section.type_ != SHT_NOBITS && (section.offset_ > size_ || size_ - section.offset_ < section.size_))
+            section.size_ = 0;
+        sections_.push_back(section);
+    }
+    if (namesIndex < count) {
+        auto names = SectionData(sections_[static_cast<int>(namesIndex)]);
+        for (int i = 0; i < sections_.size(); i++) {
+            auto entry = data_ + offset + static_cast<quint64>(i) * entrySize;
+            sections_[i].name_ = StringAt(names, qFromLittleEndian<quint32>(entry));
+        }
+    }
+    return true;
+}
+
+void ElfSymbolizer::ReadSymbols(const Section& symbols) {
+    if (symbols.link_ >= static_cast<quint32>(sections_.size()))
+        return;
+    const auto& strings = sections_[static_cast<int>(symbols.link_)];
+    // names are read in place, the table has to end with a terminator
+    if (strings.size_ == 0 || data_[strings.offset_ + strings.size_ - 1] != 0)
+        return;
+    auto entrySize = is64_ ? 24u : 16u;
+    auto count = symbols.size_ / entrySize;
+    symbols_.reserve(symbols_.size() + static_cast<int>(count));
+    for (quint64 i = 0; i < count; i++) {
+        auto entry = data_ + symbols.offset_ + i * entrySize;
+        auto nameOffset = qFromLittleEndian<quint32>(entry);
+        quint64 addr, size;
+        quint8 info;
+        quint16 sectionIndex;
+        if (is64_) {
+            info = entry[4];
+            sectionIndex = qFromLittleEndian<quint16>(entry + 6);
+            addr = qFromLittleEndian<quint64>(entry + 8);
+            size = qFromLittleEndian<quint64>(entry + 16);
+        } else {
+            addr = qFromLittleEndian<quint32>(entry + 4);
+            size = qFromLittleEndian<quint32>(entry + 8);
+            info = entry[12];
+            sectionIndex = qFromLittleEndian<quint16>(entry + 14);
+        }
+        auto type = info & 0xf;
+        // undefined, mapping symbols like $x and section or file names
+        if (sectionIndex == 0 || size == 0 || type == STT_SECTION || type == STT_FILE)
+            continue;
+        if (nameOffset == 0 || nameOffset >= strings.size_)
+            continue;
+        // thumb functions have the lowest bit of their address set
+        if (thumb_ && type == STT_FUNC)
+            addr &= ~1ull;
+        symbols_.push_back({addr, size, reinterpret_cast<const char*>(data_ + strings.offset_ + nameOffset)});
+    }
+}
+
+QByteArray ElfSymbolizer::SectionData(const Section& section) const {
+    if (section.type_ == SHT_NOBITS || section.size_ == 0)
+        return QByteArray();
+    auto data = data_ + section.offset_;
+    if ((section.flags_ & SHF_COMPRESSED) == 0)
+        return QByteArray::fromRawData(reinterpret_cast<const char*>(data), static_cast<int>(section.size_));
+    // Elf_Chdr, then a zlib stream, qUncompress wants the size up front
+    ElfReader reader(data, data + section.size_);
+    auto type = reader.U32();
+    quint64 size;
+    if (is64_) {
+        reader.U32();
+        size = reader.U64();
+        reader.U64();
+    } else {
+        size = reader.U32();
+        reader.U32();
+    }
+    if (reader.failed_ || type != ELFCOMPRESS_ZLIB || size > 0x7fffffff)
+        return QByteArray();
+    auto compressedSize = static_cast<int>(reader.end_ - reader.data_);
+    QByteArray compressed(4 + compressedSize, Qt::Uninitialized);
+    qToBigEndian(static_cast<quint32>(size), reinterpret_cast<uchar*>(compressed.data()));
+    memcpy(compressed.data() + 4, reader.data_, static_cast<size_t>(compressedSize));
+    return qUncompress(compressed);
+}
+
+const char* ElfSymbolizer::SymbolName(int last, quint64 addr) const {
+    auto start = symbols_[last].addr_;
+    for (auto i = last; i >= 0 && symbols_[i].addr_ == start; i--) {
+        // the end is inclusive like the nm based lookup was, return
+        // addresses of calls at the end of a function still match it
+        if (addr - symbols_[i].addr_ <= symbols_[i].size_)
+            return symbols_[i].name_;
+    }
+    return nullptr;
+}
+
+QString ElfSymbolizer::Symbolize(quint64 addr) {
+    auto it = std::upper_bound(symbols_.begin(), symbols_.end(), addr, [](quint64 value, const Symbol& symbol) {
+        return value < symbol.addr_;
+    });
+    if (it == symbols_.begin())
+        return QString();
+    auto name = SymbolName(static_cast<int>(it - symbols_.begin()) - 1, addr);
+    return name == nullptr ? QString() : Demangle(name);
+}
+
+int ElfSymbolizer::Translate(QHash<quint64, QString>& addrMap) {
+    // the unresolved addresses are sorted and merged with the sorted
+    // symbols in one pass instead of searching them for every address
+    QVector<quint64> addrs;
+    for (auto it = addrMap.constBegin(); it != addrMap.constEnd(); ++it) {
+        if (it.value().isEmpty())
+            addrs.push_back(it.key());
+    }
+    std::sort(addrs.begin(), addrs.end());
+    QVector<const char*> names(addrs.size(), nullptr);
+    int next = 0;
+    for (int i = 0; i < addrs.size(); i++) {
+        while (next < symbols_.size() && symbols_[next].addr_ <= addrs[i])
+            next++;
+        if (next > 0)
+            names[i] = SymbolName(next - 1, addrs[i]);
+    }
+#ifndef LOLI_HAS_CXXABI
+    // no demangler in this runtime, the NDK's c++filt demangles the names
+    // that are used in one go if it is there, every name once
+    QVector<const char*> mangled;
+    QSet<const char*> queued;
+    QByteArray input;
+    for (auto name : names) {
+        if (name == nullptr || queued.contains(name) || !Demangle(name).startsWith("_Z"))
+            continue;
+        queued.insert(name);
+        mangled.push_back(name);
+        input += QByteArray(name) + '\n';
+    }
+    auto cxxfiltPath = PathUtils::GetNDKToolPath("c++filt", false);
+    if (cxxfiltPath.isEmpty())
+        cxxfiltPath = PathUtils::GetNDKToolPath("cxxfilt", false);
+    if (!mangled.isEmpty() && !cxxfiltPath.isEmpty()) {
+        QProcess process;
+        process.setProgram(cxxfiltPath);
+        process.start();
+        if (process.waitForStarted()) {
+            process.write(input);
+            process.closeWriteChannel();
+            process.waitForFinished(-1);
+            auto lines = QString::fromUtf8(process.readAllStandardOutput()).split('\n');
+            for (int i = 0; i < mangled.size() && i < lines.size(); i++)
+                demangled_[mangled[i]] = lines[i].trimmed();
+        }
+    }
+#endif
+    // the names are shared with the pool, not copied for every address
+    int translated = 0;
+    for (int i = 0; i < addrs.size(); i++) {
+        if (names[i] == nullptr)
+            continue;
+        auto& name = addrMap[addrs[i]];
+        name = Demangle(names[i]);
+        if (!name.isEmpty())
+            translated++;
+    }
+    return translated;
+}
+
+QVector<ElfSymbolizer::Library> ElfSymbolizer::TranslateLibraries(const QStringList& paths,
+    QHash<QString, QHash<quint64, QString>>& symbolMap) {
+    // the address maps are found up front, every worker only writes the map
+    // of its own library
+    QVector<Library> libraries(paths.size());
+    QVector<QHash<quint64, QString>*> addrMaps(paths.size(), nullptr);
+    for (int i = 0; i < paths.size(); i++) {
+        auto& library = libraries[i];
+        library.name_ = QFileInfo(paths[i]).baseName() + ".so";
+        auto it = symbolMap.find(library.name_);
+        if (it == symbolMap.end()) {
+            library.error_ = QString("No addresses found for library %1").arg(library.name_);
+        } else if (addrMaps.contains(&it.value())) {
+            library.error_ = QString("More than one symbol file for library %1").arg(library.name_);
+        } else {
+            addrMaps[i] = &it.value();
+        }
+    }
+    auto libraryData = libraries.data();
+    QVector<QFuture<void>> futures;
+    for (int i = 0; i < paths.size(); i++) {
+        if (addrMaps[i] == nullptr)
+            continue;
+        auto path = paths[i];
+        auto addrMap = addrMaps[i];
+        auto library = libraryData + i;
+        futures.push_back(QtConcurrent::run([path, addrMap, library]() {
+            ElfSymbolizer symbolizer;
+            if (!symbolizer.Open(path)) {
+                library->error_ = symbolizer.ErrorString();
+                return;
+            }
+            library->symbolCount_ = symbolizer.SymbolCount();
+            if (library->symbolCount_ > 0)
+                library->translated_ = symbolizer.Translate(*addrMap);
+        }));
+    }
+    for (auto& future : futures)
+        future.waitForFinished();
+    return libraries;
+}
+
+QString ElfSymbolizer::Demangle(const char* name) {
+    auto it = demangled_.find(name);
+    if (it != demangled_.end())
+        return it.value();
+    QString demangled;
+#ifdef LOLI_HAS_CXXABI
+    int status = 0;
+    auto buffer = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (buffer != nullptr) {
+        demangled = QString::fromUtf8(buffer);
+        free(buffer);
+    }
+#endif
+    if (demangled.isEmpty())
+        demangled = QString::fromUtf8(name);
+    demangled_.insert(name, demangled);
+    return demangled;
+}
+
+QString ElfSymbolizer::LineInfo(quint64 addr) {
+    if (!linesDecoded_)
+        DecodeLines();
+    auto it = std::upper_bound(lines_.begin(), lines_.end(), addr, [](quint64 value, const LineRow& row) {
+        return value < row.addr_;
+    });
+    if (it == lines_.begin() || (it - 1)->file_ == NONE)
+        return QString("??:0");
+    --it;
+    return QString("%1:%2").arg(files_[static_cast<int>(it->file_)]).arg(it->line_);
+}
+
+void ElfSymbolizer::DecodeLines() {
+    linesDecoded_ = true;
+    QByteArray lines, lineStrings, strings;
+    for (const auto& section : sections_) {
+        if (section.name_ == ".debug_line")
+            lines = SectionData(section);
+        else if (section.name_ == ".debug_line_str")
+            lineStrings = SectionData(section);
+        else if (section.name_ == ".debug_str")
+            strings = SectionData(section);
+    }
+    auto data = reinterpret_cast<const uchar*>(lines.constData());
+    auto end = data + lines.size();
+    while (data < end && DecodeLineProgram(data, end, lineStrings, strings)) {}
+    // a sequence may start where another one ends, the end comes first
+    std::sort(lines_.begin(), lines_.end(), [](const LineRow& a, const LineRow& b) {
+        return a.addr_ < b.addr_ || (a.addr_ == b.addr_ && a.file_ == NONE && b.file_ != NONE);
+    });
+}
+
+bool ElfSymbolizer::DecodeLineProgram(const uchar*& data, const uchar* end, const QByteArray& lineStrings,
+    const QByteArray& strings) {
+    ElfReader unit(data, end);
+    quint64 unitLength = unit.U32();
+    auto dwarf64 = unitLength == 0xffffffff;
+    if (dwarf64)
+        unitLength = unit.U64();
+    if (unit.failed_ || !unit.Has(unitLength))
+        return false;
+    auto unitEnd = unit.data_ + unitLength;
+    data = unitEnd;
+    ElfReader reader(unit.data_, unitEnd);
+    auto version = reader.U16();
+    if (version < 2 || version > 5)
+        return true;
+    if (version >= 5) {
+        reader.U8(); // address size, set_address has its own length
+        reader.U8(); // segment selector size
+    }
+    auto headerLength = dwarf64 ? reader.U64() : reader.U32();
+    if (!reader.Has(headerLength))
+        return true;
+    auto program = reader.data_ + headerLength;
+    auto minInstructionLength = reader.U8();
+    if (version >= 4)
+        reader.U8(); // max ops per instruction, VLIW only
+    reader.U8(); // default is_stmt
+    auto lineBase = static_cast<qint8>(reader.U8());
+    auto lineRange = reader.U8();
+    auto opcodeBase = reader.U8();
+    if (lineRange == 0 || opcodeBase == 0)
+        return true;
+    QVector<quint8> opcodeLengths(opcodeBase, 0);
+    for (int i = 1; i < opcodeBase; i++)
+        opcodeLengths[i] = reader.U8();
+
+    QVector<QString> dirs;
+    QVector<quint32> files;
+    auto addFile = [this, &dirs, &files](quint64 dir, const QString& name) {
+        auto path = name;
+        if (dir < static_cast<quint64>(dirs.size()) && !dirs[static_cast<int>(dir)].isEmpty() && !name.startsWith('/'))
+            path = dirs[static_cast<int>(dir)] + '/' + name;
+        files.push_back(static_cast<quint32>(files_.size()));
+        files_.push_back(path);
+    };
+    if (version < 5) {
+        // index 0 is the compilation directory, it isn't listed
+        dirs.push_back(QString());
+        while (!reader.failed_ && reader.data_ < reader.end_ && *reader.data_ != 0)
+            dirs.push_back(QString::fromUtf8(reader.CString()));
+        reader.U8();
+        files.push_back(NONE);
+        while (!reader.failed_ && reader.data_ < reader.end_ && *reader.data_ != 0) {
+            auto name = QString::fromUtf8(reader.CString());
+            auto dir = reader.ULeb();
+            reader.ULeb(); // modification time
+            reader.ULeb(); // length
+            addFile(dir, name);
+        }
+        reader.U8();
+    } else {
+        // entries are described by pairs of content type and form
+        auto readEntries = [&](std::function<void(const QString&, quint64)> entry) {
+            auto formatCount = reader.U8();
+            QVector<QPair<quint64, quint64>> formats;
+            for (int i = 0; i < formatCount; i++) {
+                auto type = reader.ULeb();
+                formats.push_back(qMakePair(type, reader.ULeb()));
+            }
+            auto count = reader.ULeb();
+            for (quint64 i = 0; i < count && !reader.failed_; i++) {
+                QString path;
+                quint64 dir = 0;
+                for (const auto& format : formats) {
+                    QString str;
+                    quint64 value = 0;
+                    switch (format.second) {
+                        case 0x08: str = QString::fromUtf8(reader.CString()); break; // string
+                        case 0x1f: str = StringAt(lineStrings, dwarf64 ? reader.U64() : reader.U32()); break; // line_strp
+                        case 0x0e: str = StringAt(strings, dwarf64 ? reader.U64() : reader.U32()); break; // strp
+                        case 0x0f: value = reader.ULeb(); break; // udata
+                        case 0x0b: value = reader.U8(); break; // data1
+                        case 0x05: value = reader.U16(); break; // data2
+                        case 0x06: value = reader.U32(); break; // data4
+                        case 0x07: value = reader.U64(); break; // data8
+                        case 0x1e: reader.Skip(16); break; // data16, md5
+                        case 0x09: reader.Skip(reader.ULeb()); break; // block
+                        default: reader.failed_ = true; return; // strx needs .debug_str_offsets
+                    }
+                    if (format.first == 1) // DW_LNCT_path
+                        path = str;
+                    else if (format.first == 2) // DW_LNCT_directory_index
+                        dir = value;
+                }
+                entry(path, dir);
+            }
+        };
+        readEntries([&dirs](const QString& path, quint64) { dirs.push_back(path); });
+        readEntries([&addFile](const QString& path, quint64 dir) { addFile(dir, path); });
+    }
+    if (reader.failed_)
+        return true;
+
+    reader.data_ = program;
+    quint64 address = 0;
+    quint64 file = 1;
+    quint32 line = 1;
+    auto addRow = [&]() {
+        // rows of unknown files print like the end of a sequence
+        auto index = file < static_cast<quint64>(files.size()) ? files[static_cast<int>(file)] : NONE;
+        lines_.push_back({address, index, line});
+    };
+    while (reader.data_ < reader.end_ && !reader.failed_) {
+        auto opcode = reader.U8();
+        if (opcode >= opcodeBase) {
+            auto adjusted = opcode - opcodeBase;
+            address += static_cast<quint64>(adjusted / lineRange) * minInstructionLength;
+            line += static_cast<quint32>(lineBase + adjusted % lineRange);
+            addRow();
+            continue;
+        }
+        switch (opcode) {
+            case 0: { // extended
+                auto length = reader.ULeb();
+                if (length == 0 || !reader.Has(length))
+                    break;
+                auto next = reader.data_ + length;
+                switch (reader.U8()) {
+                    case 1: // end_sequence
+                        lines_.push_back({address, NONE, 0});
+                        address = 0;
+                        file = 1;
+                        line = 1;
+                        break;
+                    case 2: // set_address
+                        address = reader.Sized(static_cast<int>(length - 1));
+                        break;
+                    case 3: { // define_file
+                        auto name = QString::fromUtf8(reader.CString());
+                        addFile(reader.ULeb(), name);
+                        break;
+                    }
+                }
+                reader.data_ = next;
+                break;
+            }
+            case 1: // copy
+                addRow();
+                break;
+            case 2: // advance_pc
+                address += reader.ULeb() * minInstructionLength;
+                break;
+            case 3: // advance_line
+                line = static_cast<quint32>(static_cast<qint64>(line) + reader.SLeb());
+                break;
+            case 4: // set_file
+                file = reader.ULeb();
+                break;
+            case 8: // const_add_pc
+                address += static_cast<quint64>((255 - opcodeBase) / lineRange) * minInstructionLength;
+                break;
+            case 9: // fixed_advance_pc
+                address += reader.U16();
+                break;
+            default: // operands of the rest only matter to debuggers
+                for (int i = 0; i < opcodeLengths[opcode]; i++)
+                    reader.ULeb();
+                break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#include "leakdiff.h"
+
+LeakDiff::LeakDiff(const CallTreeBuilder& builder, quint64 sizeLimit) {
+    const auto& nodes = builder.Nodes();
+    auto count = nodes.size();
+    // children come after their parents, walking backwards every node has
+    // the totals of its children and the growth of their subtrees
+    QVector<quint64> childSizes(count, 0), childCounts(count, 0);
+    QVector<quint64> childBaseSizes(count, 0), childBaseCounts(count, 0);
+    QVector<quint64> growthSizes(count, 0), growthCounts(count, 0);
+    for (int i = count - 1; i >= 0; i--) {
+        const auto& node = nodes[i];
+        // records ending in the node
+        auto size = node.size_ - childSizes[i];
+        auto records = node.count_ - childCounts[i];
+        auto baseSize = node.baseSize_ - childBaseSizes[i];
+        auto baseRecords = node.baseCount_ - childBaseCounts[i];
+        if (size >= baseSize + sizeLimit && records > baseRecords) {
+            growthSizes[i] += size - baseSize;
+            growthCounts[i] += records - baseRecords;
+            grownCount_++;
+            if (baseRecords == 0)
+                newCount_++;
+        }
+        if (node.parent_ == CallTreeBuilder::NONE)
+            continue;
+        auto parent = static_cast<int>(node.parent_);
+        childSizes[parent] += node.size_;
+        childCounts[parent] += node.count_;
+        childBaseSizes[parent] += node.baseSize_;
+        childBaseCounts[parent] += node.baseCount_;
+        growthSizes[parent] += growthSizes[i];
+        growthCounts[parent] += growthCounts[i];
+    }
+
+    // a grown node's parents have grown as well
+    QVector<quint32> indices(count, CallTreeBuilder::NONE);
+    for (int i = 0; i < count; i++) {
+        if (growthCounts[i] == 0)
+            continue;
+        auto node = nodes[i];
+        node.size_ = growthSizes[i];
+        node.count_ = growthCounts[i];
+        if (node.parent_ != CallTreeBuilder::NONE)
+            node.parent_ = indices[static_cast<int>(node.parent_)];
+        indices[i] = static_cast<quint32>(nodes_.size());
+        nodes_.push_back(node);
+    }
+}
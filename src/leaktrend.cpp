@@ -0,0 +1,105 @@
+#include "leaktrend.h"
+
+#include <algorithm>
+
+static double Slope(const quint64* sizes, int count) {
+    if (count < 2)
+        return 0.0;
+    auto meanX = (count - 1) / 2.0;
+    auto meanY = 0.0;
+    for (int i = 0; i < count; i++)
+        meanY += static_cast<double>(sizes[i]);
+    meanY /= count;
+    auto covariance = 0.0, variance = 0.0;
+    for (int i = 0; i < count; i++) {
+        covariance += (i - meanX) * (static_cast<double>(sizes[i]) - meanY);
+        variance += (i - meanX) * (i - meanX);
+    }
+    return covariance / variance;
+}
+
+LeakTrend::LeakTrend(const CallTreeBuilder& builder, const QVector<QVector<quint64>>& sizes,
+    const QVector<QVector<quint64>>& counts, quint64 sizeLimit) {
+    const auto& nodes = builder.Nodes();
+    const auto& stackNodes = builder.StackNodes();
+    auto count = nodes.size();
+    auto snapshots = sizes.size();
+    if (snapshots == 0)
+        return;
+
+    // records ending in every node, the snapshots of a node are adjacent
+    QVector<quint64> selfSizes(count * snapshots, 0), selfCounts(count * snapshots, 0);
+    for (int snapshot = 0; snapshot < snapshots; snapshot++) {
+        const auto& snapshotSizes = sizes[snapshot];
+        const auto& snapshotCounts = counts[snapshot];
+        for (int i = 0; i < qMin(snapshotCounts.size(), stackNodes.size()); i++) {
+            auto node = stackNodes[i];
+            if (node == CallTreeBuilder::NONE || snapshotCounts[i] == 0)
+                continue;
+            selfSizes[static_cast<int>(node) * snapshots + snapshot] += snapshotSizes[i];
+            selfCounts[static_cast<int>(node) * snapshots + snapshot] += snapshotCounts[i];
+        }
+    }
+
+    // children come after their parents, walking backwards every node has
+    // the growth and first snapshot of its children's subtrees
+    QVector<quint64> growthSizes(count, 0), growthCounts(count, 0);
+    QVector<quint64> firstSizes(count, 0), firstCounts(count, 0);
+    QVector<bool> grown(count, false);
+    for (int i = count - 1; i >= 0; i--) {
+        auto nodeSizes = selfSizes.constData() + i * snapshots;
+        auto nodeCounts = selfCounts.constData() + i * snapshots;
+        auto last = snapshots - 1;
+        auto monotonic = true;
+        for (int snapshot = 1; snapshot < snapshots && monotonic; snapshot++)
+            monotonic = nodeSizes[snapshot] >= nodeSizes[snapshot - 1];
+        if (monotonic && nodeSizes[last] >= nodeSizes[0] + sizeLimit && nodeCounts[last] > nodeCounts[0]) {
+            growthSizes[i] += nodeSizes[last] - nodeSizes[0];
+            growthCounts[i] += nodeCounts[last] - nodeCounts[0];
+            grown[i] = true;
+            if (nodeCounts[0] == 0)
+                newCount_++;
+        }
+        firstSizes[i] += nodeSizes[0];
+        firstCounts[i] += nodeCounts[0];
+        const auto& node = nodes[i];
+        if (node.parent_ == CallTreeBuilder::NONE)
+            continue;
+        auto parent = static_cast<int>(node.parent_);
+        growthSizes[parent] += growthSizes[i];
+        growthCounts[parent] += growthCounts[i];
+        firstSizes[parent] += firstSizes[i];
+        firstCounts[parent] += firstCounts[i];
+    }
+
+    // a grown node's parents have grown as well
+    QVector<quint32> indices(count, CallTreeBuilder::NONE);
+    for (int i = 0; i < count; i++) {
+        if (growthCounts[i] == 0)
+            continue;
+        auto node = nodes[i];
+        node.size_ = growthSizes[i];
+        node.count_ = growthCounts[i];
+        node.baseSize_ = firstSizes[i];
+        node.baseCount_ = firstCounts[i];
+        if (node.parent_ != CallTreeBuilder::NONE)
+            node.parent_ = indices[static_cast<int>(node.parent_)];
+        indices[i] = static_cast<quint32>(nodes_.size());
+        nodes_.push_back(node);
+        if (!grown[i])
+            continue;
+        auto nodeSizes = selfSizes.constData() + i * snapshots;
+        auto nodeCounts = selfCounts.constData() + i * snapshots;
+        Callsite callsite;
+        callsite.node_ = indices[i];
+        callsite.slope_ = Slope(nodeSizes, snapshots);
+        callsite.sizes_.resize(snapshots);
+        callsite.counts_.resize(snapshots);
+        std::copy(nodeSizes, nodeSizes + snapshots, callsite.sizes_.begin());
+        std::copy(nodeCounts, nodeCounts + snapshots, callsite.counts_.begin());
+        callsites_.push_back(callsite);
+    }
+    std::stable_sort(callsites_.begin(), callsites_.end(), [](const Callsite& a, const Callsite& b) {
+        return a.slope_ > b.slope_;
+    });
+}
@@ -0,0 +1,138 @@
+#include "liveaddressmap.h"
+
+#include <cstring>
+
+// starting slot count, a power of two
+#define LIVEMAP_INITIAL_SIZE 4096
+
+static quint32 HashAddress(quint64 addr) {
+    addr ^= addr >> 33;
+    addr *= 0xff51afd7ed558ccdull;
+    addr ^= addr >> 33;
+    return static_cast<quint32>(addr);
+}
+
+LiveAddressMap::LiveAddressMap() {
+    Clear();
+}
+
+quint32 LiveAddressMap::Allocate(quint64 addr, quint32 seq, quint32 index, quint32 size, quint32 group, bool& live) {
+    live = false;
+    // never returned by an allocation, 0 marks empty slots
+    if (addr == 0)
+        return NONE;
+    auto& slot = Find(addr);
+    if (slot.freeSeq_ > seq)
+        return NONE;
+    if (slot.index_ != NONE && slot.seq_ > seq) // replaced by a newer record already
+        return NONE;
+    auto released = slot.index_;
+    if (released == NONE)
+        live_++;
+    else
+        Count(slot, -1);
+    slot.index_ = index;
+    slot.seq_ = seq;
+    slot.size_ = size;
+    slot.group_ = group;
+    Count(slot, 1);
+    live = true;
+    return released;
+}
+
+quint32 LiveAddressMap::Free(quint64 addr, quint32 seq) {
+    if (addr == 0)
+        return NONE;
+    auto& slot = Find(addr);
+    if (seq > slot.freeSeq_)
+        slot.freeSeq_ = seq;
+    if (slot.index_ == NONE || slot.seq_ >= seq)
+        return NONE;
+    auto released = slot.index_;
+    Count(slot, -1);
+    slot.index_ = NONE;
+    live_--;
+    return released;
+}
+
+QVector<quint32> LiveAddressMap::LiveIndices() const {
+    QVector<quint32> indices;
+    indices.reserve(live_);
+    for (const auto& slot : slots_) {
+        if (slot.addr_ != 0 && slot.index_ != NONE)
+            indices.push_back(slot.index_);
+    }
+    return indices;
+}
+
+QHash<quint64, quint32> LiveAddressMap::Frees() const {
+    QHash<quint64, quint32> frees;
+    for (const auto& slot : slots_) {
+        if (slot.addr_ != 0 && slot.freeSeq_ != 0)
+            frees.insert(slot.addr_, slot.freeSeq_);
+    }
+    return frees;
+}
+
+void LiveAddressMap::Clear() {
+    slots_.clear();
+    slots_.resize(LIVEMAP_INITIAL_SIZE);
+    memset(slots_.data(), 0, sizeof(Slot) * LIVEMAP_INITIAL_SIZE);
+    mask_ = LIVEMAP_INITIAL_SIZE - 1;
+    used_ = 0;
+    live_ = 0;
+    liveBytes_ = 0;
+    for (auto& bytes : classBytes_)
+        bytes = 0;
+    groupBytes_.clear();
+}
+
+void LiveAddressMap::Count(const Slot& slot, qint64 sign) {
+    auto bytes = sign * slot.size_;
+    liveBytes_ += bytes;
+    // the bounds of the record size filter
+    if (slot.size_ <= 1024)
+        classBytes_[SMALL] += bytes;
+    else if (slot.size_ < 1048576)
+        classBytes_[MEDIUM] += bytes;
+    else
+        classBytes_[LARGE] += bytes;
+    if (slot.group_ != 0)
+        groupBytes_[slot.group_] += bytes;
+}
+
+LiveAddressMap::Slot& LiveAddressMap::Find(quint64 addr) {
+    // at most half full, linear probing stays short
+    if ((used_ + 1) * 2 > slots_.size())
+        Grow();
+    auto pos = HashAddress(addr) & mask_;
+    while (slots_[static_cast<int>(pos)].addr_ != 0) {
+        if (slots_[static_cast<int>(pos)].addr_ == addr)
+            return slots_[static_cast<int>(pos)];
+        pos = (pos + 1) & mask_;
+    }
+    auto& slot = slots_[static_cast<int>(pos)];
+    slot.addr_ = addr;
+    slot.index_ = NONE;
+    slot.seq_ = 0;
+    slot.freeSeq_ = 0;
+    slot.size_ = 0;
+    slot.group_ = 0;
+    used_++;
+    return slot;
+}
+
+void LiveAddressMap::Grow() {
+    QVector<Slot> slots(slots_.size() * 2);
+    memset(slots.data(), 0, sizeof(Slot) * static_cast<size_t>(slots.size()));
+    mask_ = static_cast<quint32>(slots.size() - 1);
+    for (const auto& slot : slots_) {
+        if (slot.addr_ == 0)
+            continue;
+        auto pos = HashAddress(slot.addr_) & mask_;
+        while (slots[static_cast<int>(pos)].addr_ != 0)
+            pos = (pos + 1) & mask_;
+        slots[static_cast<int>(pos)] = slot;
+    }
+    slots_.swap(slots);
+}
@@ -0,0 +1,366 @@
+#include "lolifile.h"
+
+#include <QtConcurrent>
+#include <QtEndian>
+
+#include <limits>
+
+#define HEADERSIZE 16
+#define ENTRYSIZE 24
+#define DIRECTORYSIZE (HEADERSIZE + ENTRYSIZE * LoliFile::MAX_SECTIONS)
+#define WRITEBUFFERSIZE (64 * 1024)
+// addr, funcAddr, seq, time, size, stackIndex, library
+#define RECORDSIZE (8 + 8 + 4 + 4 + 4 + 4 + 4)
+// rows decoded by one job of the thread pool
+#define RECORDCHUNKSIZE static_cast<quint64>(64 * 1024)
+#define STACKCHUNKSIZE static_cast<quint64>(16 * 1024)
+
+LoliFileWriter::LoliFileWriter(QIODevice* device)
+    : device_(device) {
+    buffer_.reserve(WRITEBUFFERSIZE);
+    // the directory is filled in by Finish()
+    ok_ = device_->write(QByteArray(DIRECTORYSIZE, '\0')) == DIRECTORYSIZE;
+}
+
+template<typename T>
+void LoliFileWriter::Put(T value) {
+    uchar bytes[sizeof(T)];
+    qToLittleEndian<T>(value, bytes);
+    buffer_.append(reinterpret_cast<const char*>(bytes), sizeof(T));
+    if (buffer_.size() >= WRITEBUFFERSIZE)
+        Flush();
+}
+
+void LoliFileWriter::Flush() {
+    if (buffer_.isEmpty())
+        return;
+    if (device_->write(buffer_) != buffer_.size())
+        ok_ = false;
+    buffer_.clear();
+}
+
+void LoliFileWriter::BeginSection(LoliFile::Section id) {
+    Flush();
+    Entry entry;
+    entry.id_ = static_cast<quint32>(id);
+    entry.offset_ = static_cast<quint64>(device_->pos());
+    entry.size_ = 0;
+    sections_.push_back(entry);
+}
+
+void LoliFileWriter::EndSection() {
+    Flush();
+    auto& entry = sections_.last();
+    entry.size_ = static_cast<quint64>(device_->pos()) - entry.offset_;
+    // keeps the columns of the next section aligned in the mapped file
+    auto padding = static_cast<int>((8 - entry.size_ % 8) % 8);
+    if (padding > 0 && device_->write(QByteArray(padding, '\0')) != padding)
+        ok_ = false;
+}
+
+void LoliFileWriter::WriteBlob(LoliFile::Section id, const std::function<void(QDataStream&)>& write) {
+    QByteArray bytes;
+    QDataStream stream(&bytes, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_12);
+    write(stream);
+    BeginSection(id);
+    if (device_->write(bytes) != bytes.size())
+        ok_ = false;
+    EndSection();
+}
+
+void LoliFileWriter::WriteRecords(const QVector<StackRecord>& records) {
+    BeginSection(LoliFile::Section::RECORDS);
+    Put<quint64>(static_cast<quint64>(records.size()));
+    for (const auto& record : records)
+        Put<quint64>(record.addr_);
+    for (const auto& record : records)
+        Put<quint64>(record.funcAddr_);
+    for (const auto& record : records)
+        Put<quint32>(record.seq_);
+    for (const auto& record : records)
+        Put<qint32>(record.time_);
+    for (const auto& record : records)
+        Put<qint32>(record.size_);
+    for (const auto& record : records)
+        Put<quint32>(record.stackIndex_);
+    for (const auto& record : records)
+        Put<quint32>(record.library_.hashcode_);
+    EndSection();
+}
+
+void LoliFileWriter::WriteStacks(const CallStackTable& callStacks) {
+    BeginSection(LoliFile::Section::STACKS);
+    auto count = callStacks.Size();
+    Put<quint64>(static_cast<quint64>(count));
+    quint64 offset = 0;
+    Put<quint64>(offset);
+    for (int i = 0; i < count; i++) {
+        offset += static_cast<quint64>(callStacks.At(static_cast<quint32>(i)).size());
+        Put<quint64>(offset);
+    }
+    for (int i = 0; i < count; i++) {
+        for (const auto& frame : callStacks.At(static_cast<quint32>(i)))
+            Put<quint64>(frame.second);
+    }
+    for (int i = 0; i < count; i++) {
+        for (const auto& frame : callStacks.At(static_cast<quint32>(i)))
+            Put<quint32>(frame.first.hashcode_);
+    }
+    EndSection();
+}
+
+void LoliFileWriter::WriteFrees(const QHash<quint64, quint32>& freeAddrMap) {
+    BeginSection(LoliFile::Section::FREES);
+    Put<quint64>(static_cast<quint64>(freeAddrMap.size()));
+    for (auto it = freeAddrMap.begin(); it != freeAddrMap.end(); ++it)
+        Put<quint64>(it.key());
+    for (auto it = freeAddrMap.begin(); it != freeAddrMap.end(); ++it)
+        Put<quint32>(it.value());
+    EndSection();
+}
+
+void LoliFileWriter::WriteScreenshots(const QVector<QPair<int, QByteArray>>& screenshots) {
+    BeginSection(LoliFile::Section::SCREENSHOTS);
+    Put<quint64>(static_cast<quint64>(screenshots.size()));
+    quint64 offset = 0;
+    Put<quint64>(offset);
+    for (const auto& screenshot : screenshots) {
+        offset += static_cast<quint64>(screenshot.second.size());
+        Put<quint64>(offset);
+    }
+    for (const auto& screenshot : screenshots)
+        Put<qint32>(screenshot.first);
+    Flush();
+    for (const auto& screenshot : screenshots) {
+        if (device_->write(screenshot.second) != screenshot.second.size())
+            ok_ = false;
+    }
+    EndSection();
+}
+
+bool LoliFileWriter::Finish() {
+    Flush();
+    if (sections_.size() > LoliFile::MAX_SECTIONS)
+        return false;
+    auto end = device_->pos();
+    if (!device_->seek(0))
+        return false;
+    // magic and version are big endian like the QDataStream files before
+    // version 200, older builds report a version mismatch
+    uchar bytes[8];
+    qToBigEndian<quint32>(LoliFile::MAGIC, bytes);
+    qToBigEndian<qint32>(LoliFile::VERSION, bytes + 4);
+    buffer_.append(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+    Put<quint32>(static_cast<quint32>(sections_.size()));
+    Put<quint32>(0);
+    for (const auto& entry : sections_) {
+        Put<quint32>(entry.id_);
+        Put<quint32>(0);
+        Put<quint64>(entry.offset_);
+        Put<quint64>(entry.size_);
+    }
+    Flush();
+    return device_->seek(end) && ok_;
+}
+
+LoliFileReader::~LoliFileReader() {
+    if (data_ != nullptr)
+        file_.unmap(data_);
+}
+
+bool LoliFileReader::Open(const QString& path, qint32* version) {
+    file_.setFileName(path);
+    if (!file_.open(QIODevice::ReadOnly))
+        return false;
+    auto header = file_.read(HEADERSIZE);
+    if (header.size() < 8)
+        return false;
+    auto bytes = reinterpret_cast<const uchar*>(header.constData());
+    if (qFromBigEndian<quint32>(bytes) != LoliFile::MAGIC)
+        return false;
+    auto fileVersion = qFromBigEndian<qint32>(bytes + 4);
+    if (version != nullptr)
+        *version = fileVersion;
+    if (fileVersion != LoliFile::VERSION)
+        return false;
+    size_ = static_cast<quint64>(file_.size());
+    if (size_ < static_cast<quint64>(DIRECTORYSIZE))
+        return false;
+    data_ = file_.map(0, static_cast<qint64>(size_));
+    if (data_ == nullptr)
+        return false;
+    auto count = qFromLittleEndian<quint32>(data_ + 8);
+    if (count > static_cast<quint32>(LoliFile::MAX_SECTIONS))
+        return false;
+    for (quint32 i = 0; i < count; i++) {
+        auto entry = data_ + HEADERSIZE + i * ENTRYSIZE;
+        auto offset = qFromLittleEndian<quint64>(entry + 8);
+        auto size = qFromLittleEndian<quint64>(entry + 16);
+        if (offset > size_ || size > size_ - offset)
+            return false;
+        sections_.insert(qFromLittleEndian<quint32>(entry), qMakePair(offset, size));
+    }
+    return true;
+}
+
+const uchar* LoliFileReader::Data(LoliFile::Section id, quint64& size) const {
+    auto it = sections_.find(static_cast<quint32>(id));
+    if (it == sections_.end())
+        return nullptr;
+    size = it.value().second;
+    return data_ + it.value().first;
+}
+
+bool LoliFileReader::ReadBlob(LoliFile::Section id, const std::function<void(QDataStream&)>& read) const {
+    quint64 size;
+    auto data = Data(id, size);
+    if (data == nullptr)
+        return false;
+    auto bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(data), static_cast<int>(size));
+    QDataStream stream(bytes);
+    stream.setVersion(QDataStream::Qt_5_12);
+    read(stream);
+    return stream.status() == QDataStream::Ok;
+}
+
+static bool DecodeRecords(const uchar* columns, quint64 count, quint64 begin, quint64 end, StackRecord* records) {
+    auto addrs = columns;
+    auto funcAddrs = addrs + count * 8;
+    auto seqs = funcAddrs + count * 8;
+    auto times = seqs + count * 4;
+    auto sizes = times + count * 4;
+    auto stackIndices = sizes + count * 4;
+    auto libraries = stackIndices + count * 4;
+    for (auto i = begin; i < end; i++) {
+        auto& record = records[i];
+        record.addr_ = qFromLittleEndian<quint64>(addrs + i * 8);
+        record.funcAddr_ = qFromLittleEndian<quint64>(funcAddrs + i * 8);
+        record.seq_ = qFromLittleEndian<quint32>(seqs + i * 4);
+        record.time_ = qFromLittleEndian<qint32>(times + i * 4);
+        record.size_ = qFromLittleEndian<qint32>(sizes + i * 4);
+        record.stackIndex_ = qFromLittleEndian<quint32>(stackIndices + i * 4);
+        record.library_.hashcode_ = qFromLittleEndian<quint32>(libraries + i * 4);
+    }
+    return true;
+}
+
+static bool DecodeStacks(const uchar* offsets, const uchar* addrs, const uchar* libraries, quint64 frameCount,
+                         quint64 begin, quint64 end, CallStack* callStacks) {
+    for (auto i = begin; i < end; i++) {
+        auto frameBegin = qFromLittleEndian<quint64>(offsets + i * 8);
+        auto frameEnd = qFromLittleEndian<quint64>(offsets + (i + 1) * 8);
+        if (frameEnd < frameBegin || frameEnd > frameCount)
+            return false;
+        auto& callstack = callStacks[i];
+        callstack.reserve(static_cast<int>(frameEnd - frameBegin));
+        for (auto j = frameBegin; j < frameEnd; j++) {
+            callstack.push_back(qMakePair(HashString(qFromLittleEndian<quint32>(libraries + j * 4)),
+                                          qFromLittleEndian<quint64>(addrs + j * 8)));
+        }
+    }
+    return true;
+}
+
+bool LoliFileReader::WaitForChunks(QVector<QFuture<bool>>& futures) {
+    auto decoded = true;
+    for (int i = 0; i < futures.size(); i++) {
+        decoded = futures[i].result() && decoded;
+        emit Progress(i + 1, futures.size());
+    }
+    return decoded;
+}
+
+bool LoliFileReader::ReadRecords(QVector<StackRecord>& records) {
+    quint64 size;
+    auto data = Data(LoliFile::Section::RECORDS, size);
+    if (data == nullptr || size < 8)
+        return false;
+    auto count = qFromLittleEndian<quint64>(data);
+    if (count > static_cast<quint64>(std::numeric_limits<int>::max()) || (size - 8) / RECORDSIZE < count)
+        return false;
+    records.resize(static_cast<int>(count));
+    // every chunk writes its own slice of records
+    auto output = records.data();
+    auto columns = data + 8;
+    QVector<QFuture<bool>> futures;
+    for (quint64 begin = 0; begin < count; begin += RECORDCHUNKSIZE) {
+        auto end = qMin(begin + RECORDCHUNKSIZE, count);
+        futures.push_back(QtConcurrent::run([=]() {
+            return DecodeRecords(columns, count, begin, end, output);
+        }));
+    }
+    return WaitForChunks(futures);
+}
+
+bool LoliFileReader::ReadStacks(CallStackTable& callStacks) {
+    quint64 size;
+    auto data = Data(LoliFile::Section::STACKS, size);
+    if (data == nullptr || size < 16)
+        return false;
+    auto count = qFromLittleEndian<quint64>(data);
+    if (count == 0 || count > static_cast<quint64>(std::numeric_limits<int>::max()) || (size - 8) / 8 <= count)
+        return false;
+    auto offsets = data + 8;
+    auto frameCount = qFromLittleEndian<quint64>(offsets + count * 8);
+    auto framesSize = size - 8 - (count + 1) * 8;
+    if (framesSize / 12 < frameCount)
+        return false;
+    auto addrs = offsets + (count + 1) * 8;
+    auto libraries = addrs + frameCount * 8;
+    callStacks.Clear();
+    callStacks.Resize(static_cast<int>(count));
+    // the frame offsets are the chunk boundaries, every chunk fills its own
+    // slots of the table, index 0 is the table's own empty callstack
+    auto output = &callStacks[0];
+    QVector<QFuture<bool>> futures;
+    for (quint64 begin = 1; begin < count; begin += STACKCHUNKSIZE) {
+        auto end = qMin(begin + STACKCHUNKSIZE, count);
+        futures.push_back(QtConcurrent::run([=]() {
+            return DecodeStacks(offsets, addrs, libraries, frameCount, begin, end, output);
+        }));
+    }
+    return WaitForChunks(futures);
+}
+
+bool LoliFileReader::ReadFrees(QHash<quint64, quint32>& freeAddrMap) const {
+    quint64 size;
+    auto data = Data(LoliFile::Section::FREES, size);
+    if (data == nullptr || size < 8)
+        return false;
+    auto count = qFromLittleEndian<quint64>(data);
+    if (count > static_cast<quint64>(std::numeric_limits<int>::max()) || (size - 8) / 12 < count)
+        return false;
+    auto addrs = data + 8;
+    auto seqs = addrs + count * 8;
+    freeAddrMap.clear();
+    freeAddrMap.reserve(static_cast<int>(count));
+    for (quint64 i = 0; i < count; i++)
+        freeAddrMap.insert(qFromLittleEndian<quint64>(addrs + i * 8), qFromLittleEndian<quint32>(seqs + i * 4));
+    return true;
+}
+
+bool LoliFileReader::ReadScreenshots(QVector<QPair<int, QByteArray>>& screenshots) const {
+    quint64 size;
+    auto data = Data(LoliFile::Section::SCREENSHOTS, size);
+    if (data == nullptr || size < 16)
+        return false;
+    auto count = qFromLittleEndian<quint64>(data);
+    if (count > static_cast<quint64>(std::numeric_limits<int>::max()) || (size - 16) / 12 < count)
+        return false;
+    auto offsets = data + 8;
+    auto times = offsets + (count + 1) * 8;
+    auto jpgs = times + count * 4;
+    auto jpgsSize = size - 8 - (count + 1) * 8 - count * 4;
+    screenshots.clear();
+    screenshots.reserve(static_cast<int>(count));
+    for (quint64 i = 0; i < count; i++) {
+        auto begin = qFromLittleEndian<quint64>(offsets + i * 8);
+        auto end = qFromLittleEndian<quint64>(offsets + (i + 1) * 8);
+        if (end < begin || end > jpgsSize || end - begin > static_cast<quint64>(std::numeric_limits<int>::max()))
+            return false;
+        auto bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(jpgs + begin), static_cast<int>(end - begin));
+        screenshots.push_back(qMakePair(static_cast<int>(qFromLittleEndian<qint32>(times + i * 4)), bytes));
+    }
+    return true;
+}
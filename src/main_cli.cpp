@@ -4,6 +4,7 @@
 #include <QCoreApplication>
 #include <QCommandLineParser>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QMetaObject>
 #include <csignal>
 #include <cstring>
@@ -11,9 +12,12 @@
 
 #ifdef _WIN32
     #include <io.h>
+    #include <windows.h>
+    #include <psapi.h>
     #define write _write
     #define STDOUT_FILENO 1
 #else
+    #include <sys/resource.h>
     #include <unistd.h>
 #endif
 
@@ -35,33 +39,66 @@ void signalHandler(int signal) {
     }
 }
 
+// peak resident memory of the process in bytes, 0 if it isn't known
+static quint64 peakMemoryUsage() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return static_cast<quint64>(counters.PeakWorkingSetSize);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return static_cast<quint64>(usage.ru_maxrss);
+#else
+    // kilobytes on linux
+    return static_cast<quint64>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
 void printUsage() {
     std::cout << "LoliProfiler CLI - Android Memory Profiling Tool\n\n";
     std::cout << "Usage:\n";
     std::cout << "  LoliProfilerCLI --app <package_name> --out <output.loli> [options]\n";
     std::cout << "  LoliProfilerCLI --compare <baseline.loli> <comparison.loli> --out <output> [options]\n";
+    std::cout << "  LoliProfilerCLI --compare --benchmark <records> [options]\n";
+    std::cout << "  LoliProfilerCLI --trend <a.loli> <b.loli> <c.loli> ... --out <output> [options]\n";
     std::cout << "  LoliProfilerCLI --dump <profile.loli> --out <output.txt> [options]\n\n";
     std::cout << "Profiling Mode - Required Options:\n";
     std::cout << "  --app <name>           Target application package name\n";
     std::cout << "  --out <path>           Output .loli file path\n\n";
     std::cout << "Profiling Mode - Optional Options:\n";
-    std::cout << "  --symbol <path>        Symbol file (.so/.sym) for address translation\n";
+    std::cout << "  --symbol <path>        Symbol file (.so/.sym) for address translation, repeat for more libraries\n";
     std::cout << "  --subprocess <name>    Target subprocess name\n";
     std::cout << "  --device <serial>      Device serial number (required if multiple devices)\n";
     std::cout << "  --duration <seconds>   Profiling duration in seconds (omit for manual stop with Ctrl+C)\n";
     std::cout << "  --attach               Attach to running app instead of launching\n";
-    std::cout << "  --verbose              Verbose output\n\n";
+    std::cout << "  --verbose              Verbose output\n";
+    std::cout << "  --record-packets <path> Save uncompressed stack trace packets for benchmarking\n\n";
     std::cout << "Compare Mode - Usage:\n";
     std::cout << "  --compare              Enable compare mode (requires 2 positional file arguments)\n";
     std::cout << "  <baseline.loli>        First .loli file (baseline)\n";
     std::cout << "  <comparison.loli>      Second .loli file (comparison)\n";
-    std::cout << "  --out <path>           Output file path (.txt for text report, .loli for GUI visualization)\n\n";
+    std::cout << "  --out <path>           Output file path (.txt for text report, .txt.gz for gzip text report,\n";
+    std::cout << "                         .loli for GUI visualization)\n\n";
     std::cout << "Compare Mode - Optional Options:\n";
+    std::cout << "  --skip-root-levels <N> Skip N root call stack frames (useful for system libs without symbols)\n";
+    std::cout << "  --benchmark <records>  Compare two synthetic profiles of N records instead of files,\n";
+    std::cout << "                         reports build time and peak memory (--out is optional)\n\n";
+    std::cout << "Trend Mode - Usage:\n";
+    std::cout << "  --trend                Find call sites that grow across 2 or more .loli files\n";
+    std::cout << "  <a.loli> <b.loli> ...  .loli files in capture order (positional arguments)\n";
+    std::cout << "  --out <path>           Output file path (.txt for text report, .txt.gz for gzip text report,\n";
+    std::cout << "                         .loli for GUI visualization)\n\n";
+    std::cout << "Trend Mode - Optional Options:\n";
     std::cout << "  --skip-root-levels <N> Skip N root call stack frames (useful for system libs without symbols)\n\n";
     std::cout << "Dump Mode - Usage:\n";
     std::cout << "  --dump                 Export a single .loli file to text format\n";
     std::cout << "  <profile.loli>         Input .loli file (positional argument)\n";
-    std::cout << "  --out <path>           Output text file path\n\n";
+    std::cout << "  --out <path>           Output text file path (.txt.gz for gzip)\n\n";
     std::cout << "Dump Mode - Optional Options:\n";
     std::cout << "  --skip-root-levels <N> Skip N root call stack frames (useful for system libs without symbols)\n\n";
     std::cout << "General Options:\n";
@@ -79,6 +116,10 @@ void printUsage() {
     std::cout << "  LoliProfilerCLI --compare baseline.loli comparison.loli --out diff.loli\n\n";
     std::cout << "  # Compare and skip 2 root call stack levels (e.g., system library frames)\n";
     std::cout << "  LoliProfilerCLI --compare baseline.loli comparison.loli --out diff.txt --skip-root-levels 2\n\n";
+    std::cout << "  # Time the comparison of two synthetic profiles of 10M records\n";
+    std::cout << "  LoliProfilerCLI --compare --benchmark 10000000\n\n";
+    std::cout << "  # Find call sites that grow across the captures of a soak test\n";
+    std::cout << "  LoliProfilerCLI --trend soak1.loli soak2.loli soak3.loli soak4.loli --out trend.txt\n\n";
     std::cout << "  # Dump a single .loli file to text\n";
     std::cout << "  LoliProfilerCLI --dump profile.loli --out dump.txt\n\n";
     std::cout << "  # Dump with skipping root levels\n";
@@ -117,7 +158,7 @@ int main(int argc, char *argv[]) {
     
     // Optional options
     QCommandLineOption symbolOption(QStringList() << "symbol", 
-        "Symbol file (.so/.sym) for address translation", "file");
+        "Symbol file (.so/.sym) for address translation, repeat for more libraries", "file");
     parser.addOption(symbolOption);
     
     QCommandLineOption subprocessOption(QStringList() << "subprocess", 
@@ -140,11 +181,24 @@ int main(int argc, char *argv[]) {
         "Verbose output");
     parser.addOption(verboseOption);
     
+    QCommandLineOption recordOption(QStringList() << "record-packets", 
+        "Save uncompressed stack trace packets for benchmarking", "file");
+    parser.addOption(recordOption);
+    
     // Compare mode options
     QCommandLineOption compareOption(QStringList() << "compare",
         "Compare two .loli files (baseline vs comparison)");
     parser.addOption(compareOption);
 
+    QCommandLineOption benchmarkOption(QStringList() << "benchmark",
+        "Compare two synthetic profiles of the given number of records", "records");
+    parser.addOption(benchmarkOption);
+
+    // Trend mode option
+    QCommandLineOption trendOption(QStringList() << "trend",
+        "Find call sites that grow across a series of .loli files");
+    parser.addOption(trendOption);
+
     // Dump mode option
     QCommandLineOption dumpOption(QStringList() << "dump",
         "Export a single .loli file to text format");
@@ -164,8 +218,10 @@ int main(int argc, char *argv[]) {
     CLI_LOG("Arguments parsed successfully");
 
     // Mutual exclusion check for modes
-    if (parser.isSet(compareOption) && parser.isSet(dumpOption)) {
-        std::cerr << "Error: --compare and --dump cannot be used together\n";
+    int modeCount = (parser.isSet(compareOption) ? 1 : 0) + (parser.isSet(trendOption) ? 1 : 0) +
+        (parser.isSet(dumpOption) ? 1 : 0);
+    if (modeCount > 1) {
+        std::cerr << "Error: --compare, --trend and --dump cannot be used together\n";
         printUsage();
         CliLogger::Instance().Close();
         return 1;
@@ -176,8 +232,17 @@ int main(int argc, char *argv[]) {
         // Compare mode
         CLI_LOG("Running in COMPARE mode");
         
+        // synthetic profiles stand in for the files when benchmarking
+        int benchmarkRecords = parser.value(benchmarkOption).toInt();
+        bool benchmark = parser.isSet(benchmarkOption);
+        if (benchmark && benchmarkRecords <= 0) {
+            std::cerr << "Error: --benchmark must be a positive number of records\n";
+            CliLogger::Instance().Close();
+            return 1;
+        }
+
         QStringList compareFiles = parser.positionalArguments();
-        if (compareFiles.size() != 2) {
+        if (!benchmark && compareFiles.size() != 2) {
             CLI_ERROR("--compare requires exactly two file arguments");
             std::cerr << "Error: --compare requires exactly two .loli files\n";
             std::cerr << "Usage: LoliProfilerCLI --compare <baseline.loli> <comparison.loli> --out <output>\n";
@@ -187,7 +252,7 @@ int main(int argc, char *argv[]) {
             return 1;
         }
         
-        if (!parser.isSet(outOption)) {
+        if (!benchmark && !parser.isSet(outOption)) {
             CLI_ERROR("--out is required in compare mode");
             std::cerr << "Error: --out is required to specify output file\n";
             printUsage();
@@ -195,8 +260,8 @@ int main(int argc, char *argv[]) {
             return 1;
         }
         
-        QString baselineFile = compareFiles[0];
-        QString comparisonFile = compareFiles[1];
+        QString baselineFile = benchmark ? QString("(synthetic)") : compareFiles[0];
+        QString comparisonFile = benchmark ? QString("(synthetic)") : compareFiles[1];
         QString outputFile = parser.value(outOption);
         int skipRootLevels = parser.value(skipRootLevelsOption).toInt();
 
@@ -211,28 +276,35 @@ int main(int argc, char *argv[]) {
         CLI_LOG(QString("Output file: %1").arg(outputFile));
         CLI_LOG(QString("Skip root levels: %1").arg(skipRootLevels));
         
-        std::cout << "Loading baseline profile: " << baselineFile.toStdString() << "...\n";
-        
         ProfileComparator comparator;
-        
-        // Load baseline
-        if (!comparator.LoadProfile(baselineFile, true)) {
-            CLI_ERROR(QString("Failed to load baseline: %1").arg(comparator.GetErrorMessage()));
-            std::cerr << "Error: " << comparator.GetErrorMessage().toStdString() << "\n";
-            CliLogger::Instance().Close();
-            return 1;
-        }
-        
-        std::cout << "Loading comparison profile: " << comparisonFile.toStdString() << "...\n";
-        
-        // Load comparison
-        if (!comparator.LoadProfile(comparisonFile, false)) {
-            CLI_ERROR(QString("Failed to load comparison: %1").arg(comparator.GetErrorMessage()));
-            std::cerr << "Error: " << comparator.GetErrorMessage().toStdString() << "\n";
-            CliLogger::Instance().Close();
-            return 1;
+
+        if (benchmark) {
+            std::cout << "Generating synthetic profiles of " << benchmarkRecords << " records...\n";
+            comparator.GenerateProfile(benchmarkRecords, true);
+            comparator.GenerateProfile(benchmarkRecords, false);
+            std::cout << "Peak memory after generating: " << sizeToString(peakMemoryUsage()).toStdString() << "\n";
+        } else {
+            std::cout << "Loading baseline profile: " << baselineFile.toStdString() << "...\n";
+
+            // Load baseline
+            if (!comparator.LoadProfile(baselineFile, true)) {
+                CLI_ERROR(QString("Failed to load baseline: %1").arg(comparator.GetErrorMessage()));
+                std::cerr << "Error: " << comparator.GetErrorMessage().toStdString() << "\n";
+                CliLogger::Instance().Close();
+                return 1;
+            }
+
+            std::cout << "Loading comparison profile: " << comparisonFile.toStdString() << "...\n";
+
+            // Load comparison
+            if (!comparator.LoadProfile(comparisonFile, false)) {
+                CLI_ERROR(QString("Failed to load comparison: %1").arg(comparator.GetErrorMessage()));
+                std::cerr << "Error: " << comparator.GetErrorMessage().toStdString() << "\n";
+                CliLogger::Instance().Close();
+                return 1;
+            }
         }
-        
+
         std::cout << "Comparing profiles";
         if (skipRootLevels > 0) {
             std::cout << " (skipping " << skipRootLevels << " root levels)";
@@ -240,12 +312,15 @@ int main(int argc, char *argv[]) {
         std::cout << "...\n";
         
         // Perform comparison
+        QElapsedTimer compareTimer;
+        compareTimer.start();
         if (!comparator.Compare(skipRootLevels)) {
             CLI_ERROR(QString("Failed to compare: %1").arg(comparator.GetErrorMessage()));
             std::cerr << "Error: " << comparator.GetErrorMessage().toStdString() << "\n";
             CliLogger::Instance().Close();
             return 1;
         }
+        auto compareTime = compareTimer.elapsed();
         
         // Get stats
         auto stats = comparator.GetStats();
@@ -264,6 +339,17 @@ int main(int argc, char *argv[]) {
         std::cout << "Changed allocations (>1KB growth): " << stats.changedAllocations << "\n";
         std::cout << "New allocations (not in baseline): " << stats.newAllocationsCount << "\n\n";
 
+        if (benchmark) {
+            std::cout << "=== Benchmark Results ===\n";
+            std::cout << "Build time: " << compareTime << " ms\n";
+            std::cout << "Peak memory: " << sizeToString(peakMemoryUsage()).toStdString() << "\n\n";
+            CLI_LOG(QString("Benchmark of %1 records: %2 ms").arg(benchmarkRecords).arg(compareTime));
+            if (!parser.isSet(outOption)) {
+                CliLogger::Instance().Close();
+                return 0;
+            }
+        }
+
         // Detect output format based on file extension
         bool exportAsLoli = outputFile.toLower().endsWith(".loli");
 
@@ -299,6 +385,92 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
+    // Check if this is trend mode
+    if (parser.isSet(trendOption)) {
+        CLI_LOG("Running in TREND mode");
+
+        QStringList trendFiles = parser.positionalArguments();
+        if (trendFiles.size() < 2) {
+            CLI_ERROR("--trend requires at least two file arguments");
+            std::cerr << "Error: --trend requires at least two .loli files\n";
+            std::cerr << "Usage: LoliProfilerCLI --trend <a.loli> <b.loli> <c.loli> ... --out <output>\n";
+            printUsage();
+            CliLogger::Instance().Close();
+            return 1;
+        }
+
+        if (!parser.isSet(outOption)) {
+            CLI_ERROR("--out is required in trend mode");
+            std::cerr << "Error: --out is required to specify output file\n";
+            printUsage();
+            CliLogger::Instance().Close();
+            return 1;
+        }
+
+        QString outputFile = parser.value(outOption);
+        int skipRootLevels = parser.value(skipRootLevelsOption).toInt();
+
+        if (skipRootLevels < 0) {
+            std::cerr << "Error: --skip-root-levels must be a non-negative integer\n";
+            CliLogger::Instance().Close();
+            return 1;
+        }
+
+        CLI_LOG(QString("Trend files: %1").arg(trendFiles.join(", ")));
+        CLI_LOG(QString("Output file: %1").arg(outputFile));
+        CLI_LOG(QString("Skip root levels: %1").arg(skipRootLevels));
+
+        std::cout << "Loading and merging " << trendFiles.size() << " profiles";
+        if (skipRootLevels > 0) {
+            std::cout << " (skipping " << skipRootLevels << " root levels)";
+        }
+        std::cout << "...\n";
+
+        ProfileComparator comparator;
+        if (!comparator.CompareTrend(trendFiles, skipRootLevels)) {
+            CLI_ERROR(QString("Failed to analyze trend: %1").arg(comparator.GetErrorMessage()));
+            std::cerr << "Error: " << comparator.GetErrorMessage().toStdString() << "\n";
+            CliLogger::Instance().Close();
+            return 1;
+        }
+
+        // Print stats
+        auto stats = comparator.GetStats();
+        std::cout << "\n=== Trend Results ===\n";
+        const auto& snapshots = comparator.GetTrendSnapshots();
+        for (int i = 0; i < snapshots.size(); i++) {
+            std::cout << "Profile " << (i + 1) << ": " << snapshots[i].allocCount << " allocations, "
+                      << sizeToString(snapshots[i].totalSize).toStdString() << "\n";
+        }
+        std::cout << "Size delta (first to last): ";
+        if (stats.sizeDelta >= 0) {
+            std::cout << "+" << sizeToString(static_cast<quint64>(stats.sizeDelta)).toStdString();
+        } else {
+            std::cout << "-" << sizeToString(static_cast<quint64>(-stats.sizeDelta)).toStdString();
+        }
+        std::cout << "\n";
+        std::cout << "Growing call sites (never shrinking, >1KB growth): " << stats.changedAllocations << "\n";
+        std::cout << "New call sites (not in first profile): " << stats.newAllocationsCount << "\n\n";
+
+        // Detect output format based on file extension
+        bool exportAsLoli = outputFile.toLower().endsWith(".loli");
+        std::cout << "Exporting trend as " << (exportAsLoli ? ".loli" : "text") << " file: "
+                  << outputFile.toStdString() << "...\n";
+        bool exported = exportAsLoli ? comparator.ExportToLoli(outputFile) : comparator.ExportTrendToText(outputFile);
+        if (!exported) {
+            CLI_ERROR(QString("Failed to export trend: %1").arg(comparator.GetErrorMessage()));
+            std::cerr << "Error: " << comparator.GetErrorMessage().toStdString() << "\n";
+            CliLogger::Instance().Close();
+            return 1;
+        }
+
+        std::cout << "Trend complete! Output saved to: " << outputFile.toStdString() << "\n";
+
+        CLI_LOG("Trend completed successfully");
+        CliLogger::Instance().Close();
+        return 0;
+    }
+
     // Check if this is dump mode
     if (parser.isSet(dumpOption)) {
         CLI_LOG("Running in DUMP mode");
@@ -400,21 +572,24 @@ int main(int argc, char *argv[]) {
     CliProfiler::CliOptions options;
     options.appName = parser.value(appOption);
     options.outputFile = parser.value(outOption);
-    options.symbolPath = parser.value(symbolOption);
+    options.symbolPaths = parser.values(symbolOption);
     options.subProcessName = parser.value(subprocessOption);
     options.deviceSerial = parser.value(deviceOption);
     options.duration = parser.value(durationOption).toInt();
     options.attachMode = parser.isSet(attachOption);
     options.verbose = parser.isSet(verboseOption);
+    options.recordFile = parser.value(recordOption);
     
     CLI_LOG("Configuration:");
     CLI_LOG(QString("  App: %1").arg(options.appName));
     CLI_LOG(QString("  Output: %1").arg(options.outputFile));
-    CLI_LOG(QString("  Symbol: %1").arg(options.symbolPath.isEmpty() ? "(none)" : options.symbolPath));
+    CLI_LOG(QString("  Symbol: %1").arg(options.symbolPaths.isEmpty() ? "(none)" : options.symbolPaths.join(", ")));
     CLI_LOG(QString("  Device: %1").arg(options.deviceSerial.isEmpty() ? "(default)" : options.deviceSerial));
     CLI_LOG(QString("  Duration: %1 seconds").arg(options.duration));
     CLI_LOG(QString("  Attach: %1").arg(options.attachMode ? "yes" : "no"));
     CLI_LOG(QString("  Verbose: %1").arg(options.verbose ? "yes" : "no"));
+    if (!options.recordFile.isEmpty())
+        CLI_LOG(QString("  Record packets: %1").arg(options.recordFile));
     
     // Create CLI profiler
     CLI_LOG("Creating CLI profiler...");
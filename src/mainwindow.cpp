@@ -11,6 +11,11 @@
 #include "smaps/visualizesmapsdialog.h"
 #include "pathutils.h"
 #include "hashstring.h"
+#include "calltreebuilder.h"
+#include "calltreemodel.h"
+#include "leakdiff.h"
+#include "elfsymbolizer.h"
+#include "textwriter.h"
 
 #include <QClipboard>
 #include <QDataStream>
@@ -27,7 +32,8 @@
 #include <QTemporaryFile>
 #include <QTextStream>
 #include <QTableWidget>
-#include <QTreeWidget>
+#include <QTreeView>
+#include <QFutureWatcher>
 #include <QProgressDialog>
 #include <QScrollBar>
 #include <QGLWidget>
@@ -37,6 +43,7 @@
 #include <QMutexLocker>
 #include <QElapsedTimer>
 #include <QRegExp>
+#include <QSharedPointer>
 
 #include <algorithm>
 #include <cmath>
@@ -44,13 +51,26 @@
 #include <limits>
 
 #define APP_MAGIC 0xA4B3C2D1
-#define APP_VERSION 106
+// QDataStream files before the section container of LoliFile::VERSION,
+// records referenced their callstack by uuid in APP_VERSION_UUID
+#define APP_VERSION_STREAM 107
+#define APP_VERSION_UUID 106
 
 #define ANDROID_SDK_NOTFOUND_MSG "Android SDK not found. Please select Android SDK's location in configuration panel."
 #define ANDROID_NDK_NOTFOUND_MSG "Android NDK not found. Please select Android NDK's location in configuration panel."
+// first of the series sampled from LiveAddressMap
+#define LIVE_HEAP_SERIES 6
+// libraries that get a series of their own
+#define LIVE_HEAP_LIBRARIES 5
+#define LIVE_HEAP_LIBRARY_SERIES_MAX 10
+// seconds between reads of the app's library mappings
+#define LIBRARY_MAPS_INTERVAL 5
+// records of the text export formatted by one job of the thread pool
+#define EXPORT_CHUNK_SIZE (64 * 1024)
 #define STRIP_NON_PERSISTENT_MSG "Enable memory optimization? "\
             "Turn this on for large projects that produces massive amount of data. "\
-            "This will optimize loli-profiler's memory usage by data streaming."
+            "This will optimize loli-profiler's memory usage by data streaming. "\
+            "Live Only keeps the records in memory but drops them as soon as they are freed."
 
 enum class IOErrorCode : qint32 {
     NONE = 0,
@@ -119,6 +139,11 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(memInfoProcess_, &MemInfoProcess::ProcessErrorOccurred, 
         this, &MainWindow::MemInfoProcessErrorOccurred);
 
+    mapsProcess_ = new MapsProcess(this);
+    connect(mapsProcess_, &MapsProcess::ProcessErrorOccurred, [this]() {
+        Print("Error reading proc/pid/maps, live heap isn't split by library (needs a debuggable app or root).");
+    });
+
     stacktraceProcess_ = new StackTraceProcess(this);
     connect(stacktraceProcess_, &StackTraceProcess::DataReceived, 
         this, &MainWindow::StacktraceDataReceived);
@@ -128,6 +153,17 @@ MainWindow::MainWindow(QWidget *parent) :
         smapsTimer_->stop();
         StopCaptureProcess();
     });
+    connect(stacktraceProcess_, &StackTraceProcess::StatsReceived, [this]() {
+        if (!isCapturing_)
+            return;
+        const auto& stats = stacktraceProcess_->GetAgentStats();
+        const auto& decoder = stacktraceProcess_->GetDecoderStats();
+        ui->statusBar->showMessage(QString("Agent backlog: %1 KB, sending %2 KB/s, compression %3x, dropped events: %4"
+                                           " | decoded %5 KB/s, %6 records/s, %7 batches pending")
+            .arg(stats.backlog_ / 1024).arg(stats.rawBytes_ / 1024)
+            .arg(stats.CompressionRatio(), 0, 'f', 1).arg(stats.dropped_)
+            .arg(decoder.bytes_ / 1024).arg(decoder.records_).arg(decoder.pendingBatches_));
+    });
 
     // setup screenshot view
     ui->screenshotGraphicsView->setScene(new QGraphicsScene());
@@ -152,7 +188,9 @@ MainWindow::MainWindow(QWidget *parent) :
     memInfoChart_->addAxis(memInfoAxisY_, Qt::AlignLeft);
     UpdateMemInfoRange();
 
-    QVector<QString> memInfoTitles = {"Total", "NativeHeap", "GfxDev", "EGLmtrack", "GLmtrack", "Unknown"};
+    // the Live series are counted from the hooked allocations, the others come from dumpsys meminfo
+    QVector<QString> memInfoTitles = {"Total", "NativeHeap", "GfxDev", "EGLmtrack", "GLmtrack", "Unknown",
+                                      "LiveHeap", "LiveSmall", "LiveMedium", "LiveLarge"};
     for (int i = 0; i < memInfoTitles.size(); i++) {
         auto series = new QLineSeries();
         series->setName(memInfoTitles[i]);
@@ -206,10 +244,8 @@ MainWindow::MainWindow(QWidget *parent) :
     SetupConsole();
 
     filteredStacktraceModel_ = new StackTraceModel(this);
-    filteredStacktraceProxyModel_ = new StackTraceProxyModel(filteredStacktraceModel_, this);
     stacktraceModel_ = new StackTraceModel(this);
-    stacktraceProxyModel_ = new StackTraceProxyModel(stacktraceModel_, this);
-    SwitchStackTraceModel(stacktraceProxyModel_);
+    SwitchStackTraceModel(stacktraceModel_);
     connect(ui->stackTableView, &QTableView::customContextMenuRequested, 
         this, &MainWindow::OnStackTableViewContextMenu);
 
@@ -301,185 +337,214 @@ void MainWindow::Print(const QString& str) {
     ui->consoleWidget->writeStdOut(str);
 }
 
-void MainWindow::ExportToText(QFile* file, bool optimal) {
-    QTextStream stream(file);
-    qint32 count = stacktraceModel_->rowCount();
-    stream << "[seq,time,size,addr,library,funcaddr]" << endl;
-    for (int i = 0; i < count; i++) {
-        auto& record = stacktraceModel_->recordAt(i);
-        stream << record.seq_ << ',' << record.time_ << ',' << record.size_ << ','
-               << record.addr_ << ',' << record.library_.Get() << ',' << record.funcAddr_ << endl;
-        auto it = callStackMap_.find(record.uuid_);
-        if (it != callStackMap_.end()) {
-            auto stackCount = it.value().size();
-            for (int i = 0; i < stackCount; i++) {
-                const auto& libName = it.value()[i].first.Get();
-                const auto& funcAddr = it.value()[i].second;
-                if (optimal) {
-                    stream << libName << ',' << QString("0x%1").arg(funcAddr, 0, 16) << ',';
-                } else {
-                    const auto& funcName = TryAddNewAddress(libName, funcAddr);
-                    stream << libName << ',' << funcName << ',';
-                }
-            }
-            if (it.value().size() > 0) {
-                stream << endl;
+// encoded name of a library or symbol, empty if there is none
+template<typename Key>
+static const QByteArray& FindName(const QHash<Key, QByteArray>& names, Key key) {
+    static const QByteArray none;
+    auto it = names.constFind(key);
+    return it == names.constEnd() ? none : it.value();
+}
+
+bool MainWindow::ExportToText(QFile* file, bool optimal, bool compressed) {
+    TextWriter writer(file, compressed);
+    writer << "[seq,time,size,addr,library,funcaddr]\n";
+    // names are encoded once up front, the workers only read these copies
+    // and the snapshot of the callstacks
+    QHash<quint32, QByteArray> libraries;
+    QHash<quint32, QHash<quint64, QByteArray>> symbols;
+    for (auto it = HashString::hashmap_.constBegin(); it != HashString::hashmap_.constEnd(); ++it) {
+        libraries.insert(it.key(), it.value().toUtf8());
+        auto libIt = symbloMap_.constFind(it.value());
+        if (optimal || libIt == symbloMap_.constEnd())
+            continue;
+        auto& names = symbols[it.key()];
+        for (auto addrIt = libIt.value().constBegin(); addrIt != libIt.value().constEnd(); ++addrIt) {
+            if (!addrIt.value().isEmpty())
+                names.insert(addrIt.key(), addrIt.value().toUtf8());
+        }
+    }
+    auto callStacks = callStacks_;
+    auto format = [optimal, libraries, symbols, callStacks](const QVector<StackRecord>& records) {
+        TextWriter text;
+        for (const auto& record : records) {
+            text << record.seq_ << ',' << record.time_ << ',' << record.size_ << ','
+                 << record.addr_ << ',' << FindName(libraries, record.library_.hashcode_) << ','
+                 << record.funcAddr_ << '\n';
+            const auto& callstack = callStacks.At(record.stackIndex_);
+            for (const auto& frame : callstack) {
+                text << FindName(libraries, frame.first.hashcode_) << ',';
+                auto libSymbols = symbols.constFind(frame.first.hashcode_);
+                auto funcName = libSymbols == symbols.constEnd() ? QByteArray() :
+                    FindName(libSymbols.value(), frame.second);
+                if (funcName.size() > 0)
+                    text << funcName;
+                else
+                    text << "0x" << TextWriter::Hex(frame.second);
+                text << ',';
             }
+            if (callstack.size() > 0)
+                text << '\n';
+            text << '\n';
         }
-        stream << endl;
+        return text.Text();
+    };
+
+    // rows are copied a chunk at a time and formatted on the thread pool,
+    // the chunks are written in order while the later ones are formatted
+    auto count = stacktraceModel_->rowCount();
+    auto chunkCount = (count + EXPORT_CHUNK_SIZE - 1) / EXPORT_CHUNK_SIZE;
+    auto window = qMax(QThread::idealThreadCount(), 1) * 2;
+    QVector<QFuture<QByteArray>> chunks(chunkCount);
+    auto startChunk = [this, &chunks, &format, count](int chunk) {
+        QVector<StackRecord> records;
+        auto begin = chunk * EXPORT_CHUNK_SIZE;
+        auto end = qMin(begin + EXPORT_CHUNK_SIZE, count);
+        records.reserve(end - begin);
+        for (int i = begin; i < end; i++)
+            records.push_back(stacktraceModel_->recordAt(i));
+        chunks[chunk] = QtConcurrent::run([format, records]() { return format(records); });
+    };
+    progressDialog_->setWindowTitle("Export Progress");
+    progressDialog_->setLabelText("Exporting records ...");
+    progressDialog_->setMinimum(0);
+    progressDialog_->setMaximum(qMax(chunkCount, 1));
+    progressDialog_->setValue(0);
+    progressDialog_->show();
+    progressDialog_->raise();
+    for (int chunk = 0; chunk < qMin(window, chunkCount); chunk++)
+        startChunk(chunk);
+    for (int chunk = 0; chunk < chunkCount; chunk++) {
+        writer << chunks[chunk].result();
+        chunks[chunk] = QFuture<QByteArray>();
+        if (chunk + window < chunkCount)
+            startChunk(chunk + window);
+        progressDialog_->setValue(chunk + 1);
     }
+
     if (optimal) {
-        stream << "[stackAddrMap]" << endl;
+        writer << "[stackAddrMap]\n";
         for (auto libIt = symbloMap_.begin(); libIt != symbloMap_.end(); ++libIt) {
-            stream << libIt.key() << ":" << endl;
+            writer << libIt.key() << ":\n";
             auto& addrs = libIt.value();
-            for (auto addrIt = addrs.begin(); addrIt != addrs.end(); ++addrIt) {
-                stream << QString("0x%1").arg(addrIt.key(), 0, 16) << ", " << addrIt.value() << endl;
-            }
+            for (auto addrIt = addrs.begin(); addrIt != addrs.end(); ++addrIt)
+                writer << "0x" << TextWriter::Hex(addrIt.key()) << ", " << addrIt.value() << '\n';
         }
-        stream << endl;
+        writer << '\n';
     }
+    auto written = writer.Finish();
+    progressDialog_->close();
+    return written;
 }
 
-void MainWindow::SaveToFile(QFile *file) {
-    QDataStream stream(file);
-    stream << static_cast<quint32>(APP_MAGIC);
-    stream << static_cast<qint32>(APP_VERSION);
-    stream.setVersion(QDataStream::Qt_5_12);
+bool MainWindow::SaveToFile(QFile *file) {
+    LoliFileWriter writer(file);
     // meminfo charts
-    stream << static_cast<qint32>(maxMemInfoValue_);
-    stream << static_cast<qint32>(memInfoSeries_.size());
-    for (auto series : memInfoSeries_) {
-        auto count = static_cast<qint32>(series->count());
-        stream << count;
-        for (int i = 0; i < count; i++) {
-            auto point = series->at(i);
-            stream << point;
+    writer.WriteBlob(LoliFile::Section::MEMINFO, [this](QDataStream& stream) {
+        stream << static_cast<qint32>(maxMemInfoValue_);
+        stream << static_cast<qint32>(memInfoSeries_.size());
+        for (auto series : memInfoSeries_) {
+            auto count = static_cast<qint32>(series->count());
+            stream << count;
+            for (int i = 0; i < count; i++) {
+                auto point = series->at(i);
+                stream << point;
+            }
         }
-    }
+    });
     // string hashes
-    stream << HashString::hashmap_;
+    writer.WriteBlob(LoliFile::Section::STRINGS, [](QDataStream& stream) {
+        stream << HashString::hashmap_;
+    });
     // callstack tree view
-    qint32 count = stacktraceModel_->rowCount();
-    stream << count;
-    for (int i = 0; i < count; i++) {
-        auto& record = stacktraceModel_->recordAt(i);
-        stream << record.uuid_.toString();
-        stream << record.seq_;
-        stream << record.time_;
-        stream << record.size_;
-        stream << record.addr_;
-        stream << record.funcAddr_;
-        stream << record.library_.hashcode_;
-    }
-    // callstack map
-    stream << static_cast<qint32>(callStackMap_.size());
-    for (auto it = callStackMap_.begin(); it != callStackMap_.end(); ++it) {
-        stream << it.key().toString();
-        auto& callstacks = it.value();
-        stream << static_cast<qint32>(callstacks.size());
-        for (auto stack : callstacks) {
-            stream << stack.first.hashcode_ << stack.second;
-        }
-    }
+    writer.WriteRecords(stacktraceModel_->records());
+    // callstack table
+    writer.WriteStacks(callStacks_);
     // symbol map
-    stream << static_cast<qint32>(symbloMap_.size());
-    for (auto it = symbloMap_.begin(); it != symbloMap_.end(); ++it) {
-        stream << it.key();
-        stream << static_cast<qint32>(it.value().size());
-        for (auto it1 = it.value().begin(); it1 != it.value().end(); ++it1) {
-            stream << it1.key();
-            stream << it1.value();
+    writer.WriteBlob(LoliFile::Section::SYMBOLS, [this](QDataStream& stream) {
+        stream << static_cast<qint32>(symbloMap_.size());
+        for (auto it = symbloMap_.begin(); it != symbloMap_.end(); ++it) {
+            stream << it.key();
+            stream << static_cast<qint32>(it.value().size());
+            for (auto it1 = it.value().begin(); it1 != it.value().end(); ++it1) {
+                stream << it1.key();
+                stream << it1.value();
+            }
         }
-    }
+    });
     // freeaddr map
-    stream << static_cast<qint32>(freeAddrMap_.size());
-    for (auto it = freeAddrMap_.begin(); it != freeAddrMap_.end(); ++it) {
-        stream << it.key();
-        stream << static_cast<quint32>(it.value());
-    }
+    writer.WriteFrees(freeAddrMap_);
     // screen shots
-    stream << static_cast<qint32>(screenshots_.size());
-    for (auto& pair : screenshots_) {
-        stream << static_cast<qint32>(pair.first);
-        stream << pair.second;
-    }
+    writer.WriteScreenshots(screenshots_);
     // smaps
-    stream << static_cast<qint32>(sMapsSections_.size());
-    for (auto it = sMapsSections_.begin(); it != sMapsSections_.end(); ++it) {
-        stream << it.key();
-        auto& section = it.value();
-        stream << static_cast<qint32>(section.addrs_.size());
-        for (auto& addr : section.addrs_) {
-            stream << addr.start_;
-            stream << addr.end_;
-            stream << addr.offset_;
+    writer.WriteBlob(LoliFile::Section::SMAPS, [this](QDataStream& stream) {
+        stream << static_cast<qint32>(sMapsSections_.size());
+        for (auto it = sMapsSections_.begin(); it != sMapsSections_.end(); ++it) {
+            stream << it.key();
+            auto& section = it.value();
+            stream << static_cast<qint32>(section.addrs_.size());
+            for (auto& addr : section.addrs_) {
+                stream << addr.start_;
+                stream << addr.end_;
+                stream << addr.offset_;
+            }
+            stream << section.virtual_;
+            stream << section.rss_;
+            stream << section.pss_;
+            stream << section.privateClean_;
+            stream << section.privateDirty_;
+            stream << section.sharedClean_;
+            stream << section.sharedDirty_;
         }
-        stream << section.virtual_;
-        stream << section.rss_;
-        stream << section.pss_;
-        stream << section.privateClean_;
-        stream << section.privateDirty_;
-        stream << section.sharedClean_;
-        stream << section.sharedDirty_;
-    }
+    });
+    return writer.Finish();
 }
 
 int MainWindow::LoadFromFile(QFile *file) {
+    std::unique_ptr<LoliFileReader> loliFile(new LoliFileReader());
+    qint32 version = 0;
+    bool mapped = loliFile->Open(file->fileName(), &version);
     QDataStream stream(file);
-    quint32 magic;
-    stream >> magic;
-    if (magic != APP_MAGIC)
-        return static_cast<qint32>(IOErrorCode::MAGIC_NUMBER_MISSMATCH);
-    qint32 version;
-    stream >> version;
-    if (version != APP_VERSION)
-        return static_cast<qint32>(IOErrorCode::VERSION_MISSMATCH);
+    if (!mapped) {
+        quint32 magic;
+        stream >> magic;
+        if (magic != APP_MAGIC)
+            return static_cast<qint32>(IOErrorCode::MAGIC_NUMBER_MISSMATCH);
+        stream >> version;
+        if (version == LoliFile::VERSION)
+            return static_cast<qint32>(IOErrorCode::CORRUPTED_DATA);
+        if (version != APP_VERSION_STREAM && version != APP_VERSION_UUID)
+            return static_cast<qint32>(IOErrorCode::VERSION_MISSMATCH);
+    }
     callStackModel_->clear();
-    // meminfo charts
-    qint32 value;
-    stream >> value;
-    maxMemInfoValue_ = value;
-    UpdateMemInfoRange();
-    qint32 seriesCount;
-    stream >> seriesCount;
     for (auto series : memInfoSeries_)
         series->clear();
-    for (int i = 0 ;i < seriesCount; i++) {
-        int pointsCount;
-        stream >> pointsCount;
-        for (int j = 0; j < pointsCount; j++) {
-            QPointF point;
-            stream >> point;
-            memInfoSeries_[i]->append(point);
-        }
-    }
-    // string hashes
+    ClearLiveHeapLibraries();
     HashString::hashmap_.clear();
-    stream >> HashString::hashmap_;
-    // callstack tree view
-    QSet<QString> libraries;
     filteredStacktraceModel_->clear();
     stacktraceModel_->clear();
+    recordIndex_.Clear();
     ResetFilters();
-    SwitchStackTraceModel(stacktraceProxyModel_);
-    stream >> value;
+    SwitchStackTraceModel(stacktraceModel_);
+    agentStacks_.Clear();
+    symbloMap_.clear();
+    freeAddrMap_.clear();
+    screenshots_.clear();
+    sMapsSections_.clear();
+    // nothing points into the previous file anymore
+    loliFile_.reset();
     QVector<StackRecord> records;
-    records.reserve(value);
-    for (int i = 0; i < value; i++) {
-        StackRecord record;
-        QString str;
-        stream >> str;
-        record.uuid_ = QUuid::fromString(str);
-        stream >> record.seq_;
-        stream >> record.time_;
-        stream >> record.size_;
-        stream >> record.addr_;
-        stream >> record.funcAddr_;
-        stream >> record.library_.hashcode_;
+    bool loaded;
+    if (mapped) {
+        loaded = ReadLoliFile(*loliFile, records);
+        loliFile_ = std::move(loliFile);
+    } else {
+        loaded = ReadStreamFile(stream, version, records);
+    }
+    UpdateMemInfoRange();
+    QSet<QString> libraries;
+    for (const auto& record : records) {
         if (!libraries.contains(record.library_.Get()))
             libraries.insert(record.library_.Get());
-        records.push_back(record);
     }
     ui->recordCountLineEdit->setText("");
     ui->libraryComboBox->setCurrentIndex(0);
@@ -487,41 +552,85 @@ int MainWindow::LoadFromFile(QFile *file) {
         ui->libraryComboBox->removeItem(i);
     for (auto& library : libraries)
         ui->libraryComboBox->addItem(library);
-    // callstack map
-    callStackMap_.clear();
+    stacktraceModel_->append(records);
+    recordIndex_.Build(stacktraceModel_->records(), freeAddrMap_);
+    ShowSummary();
+    OnTimelineRubberBandHide();
+    setWindowTitle(QFileInfo(*file).fileName());
+    return static_cast<qint32>(loaded ? IOErrorCode::NONE : IOErrorCode::CORRUPTED_DATA);
+}
+
+bool MainWindow::ReadLoliFile(LoliFileReader& loliFile, QVector<StackRecord>& records) {
+    // every section the window shows, the jpg bytes stay in the mapped file
+    // until a screenshot is drawn
+    auto loaded = loliFile.ReadBlob(LoliFile::Section::MEMINFO, [this](QDataStream& stream) { ReadMemInfo(stream); });
+    loaded &= loliFile.ReadBlob(LoliFile::Section::STRINGS, [](QDataStream& stream) { stream >> HashString::hashmap_; });
+    // symbols and frees are single blocks, they are decoded next to the
+    // record and callstack chunks
+    auto symbols = QtConcurrent::run([this, &loliFile]() {
+        return loliFile.ReadBlob(LoliFile::Section::SYMBOLS, [this](QDataStream& stream) { ReadSymbolMap(stream); });
+    });
+    auto frees = QtConcurrent::run([this, &loliFile]() {
+        return loliFile.ReadFrees(freeAddrMap_);
+    });
+    progressDialog_->setWindowTitle("Load Progress");
+    progressDialog_->setMinimum(0);
+    progressDialog_->setValue(0);
+    progressDialog_->show();
+    progressDialog_->raise();
+    connect(&loliFile, &LoliFileReader::Progress, progressDialog_, [this](int value, int maximum) {
+        progressDialog_->setMaximum(maximum);
+        progressDialog_->setValue(value);
+    });
+    progressDialog_->setLabelText("Decoding records ...");
+    loaded &= loliFile.ReadRecords(records);
+    progressDialog_->setLabelText("Decoding callstacks ...");
+    loaded &= loliFile.ReadStacks(callStacks_);
+    disconnect(&loliFile, &LoliFileReader::Progress, progressDialog_, nullptr);
+    progressDialog_->close();
+    loaded &= symbols.result();
+    loaded &= frees.result();
+    loaded &= loliFile.ReadScreenshots(screenshots_);
+    loaded &= loliFile.ReadBlob(LoliFile::Section::SMAPS, [this](QDataStream& stream) { ReadSMaps(stream); });
+    return loaded;
+}
+
+bool MainWindow::ReadStreamFile(QDataStream& stream, qint32 version, QVector<StackRecord>& records) {
+    ReadMemInfo(stream);
+    // string hashes
+    stream >> HashString::hashmap_;
+    // callstack tree view
+    qint32 value;
     stream >> value;
-    QVector<QPair<HashString, quint64>> callstack;
+    QVector<QString> uuids;
+    records.reserve(value);
     for (int i = 0; i < value; i++) {
-        QString uuid;
-        qint32 len;
-        stream >> uuid >> len;
-        callstack.clear();
-        for (int j = 0; j < len; j++) {
-            QPair<HashString, quint64> pair;
-            stream >> pair.first.hashcode_ >> pair.second;
-            callstack.push_back(pair);
+        StackRecord record;
+        if (version == APP_VERSION_UUID) {
+            QString uuid;
+            stream >> uuid;
+            uuids.push_back(uuid);
         }
-        callStackMap_.insert(QUuid::fromString(uuid), callstack);
+        stream >> record.seq_;
+        stream >> record.time_;
+        stream >> record.size_;
+        stream >> record.addr_;
+        stream >> record.funcAddr_;
+        stream >> record.library_.hashcode_;
+        if (version != APP_VERSION_UUID)
+            stream >> record.stackIndex_;
+        records.push_back(record);
     }
-    // symbol map
-    symbloMap_.clear();
-    stream >> value;
-    for (int i = 0; i < value; i++) {
-        QString str;
-        stream >> str;
-        qint32 size;
-        stream >> size;
-        auto& map = symbloMap_[str];
-        quint64 key;
-        QString value;
-        for (int j = 0; j < size; j++) {
-            stream >> key;
-            stream >> value;
-            map[key] = value;
-        }
+    // callstack table
+    if (version == APP_VERSION_UUID) {
+        auto indices = callStacks_.ReadLegacy(stream);
+        for (int i = 0; i < records.size(); i++)
+            records[i].stackIndex_ = indices.value(uuids[i], 0);
+    } else {
+        callStacks_.Read(stream);
     }
+    ReadSymbolMap(stream);
     // freeaddr map
-    freeAddrMap_.clear();
     stream >> value;
     for (int i = 0; i < value; i++) {
         quint64 addr;
@@ -529,9 +638,7 @@ int MainWindow::LoadFromFile(QFile *file) {
         stream >> addr >> seq;
         freeAddrMap_.insert(addr, seq);
     }
-    stacktraceModel_->append(records);
     // screen shots
-    screenshots_.clear();
     stream >> value;
     screenshots_.reserve(value);
     for (int i = 0; i < value; i++) {
@@ -541,8 +648,49 @@ int MainWindow::LoadFromFile(QFile *file) {
         stream >> ba;
         screenshots_.push_back(qMakePair(time, ba));
     }
-    // smaps
-    sMapsSections_.clear();
+    ReadSMaps(stream);
+    return stream.status() == QDataStream::Ok;
+}
+
+void MainWindow::ReadMemInfo(QDataStream& stream) {
+    qint32 value;
+    stream >> value;
+    maxMemInfoValue_ = value;
+    qint32 seriesCount;
+    stream >> seriesCount;
+    for (int i = 0; i < seriesCount; i++) {
+        int pointsCount;
+        stream >> pointsCount;
+        for (int j = 0; j < pointsCount; j++) {
+            QPointF point;
+            stream >> point;
+            if (i < memInfoSeries_.size())
+                memInfoSeries_[i]->append(point);
+        }
+    }
+}
+
+void MainWindow::ReadSymbolMap(QDataStream& stream) {
+    qint32 value;
+    stream >> value;
+    for (int i = 0; i < value; i++) {
+        QString str;
+        stream >> str;
+        qint32 size;
+        stream >> size;
+        auto& map = symbloMap_[str];
+        quint64 key;
+        QString value;
+        for (int j = 0; j < size; j++) {
+            stream >> key;
+            stream >> value;
+            map[key] = value;
+        }
+    }
+}
+
+void MainWindow::ReadSMaps(QDataStream& stream) {
+    qint32 value;
     stream >> value;
     sMapsSections_.reserve(value);
     for (int i = 0; i < value; i++) {
@@ -567,10 +715,12 @@ int MainWindow::LoadFromFile(QFile *file) {
         stream >> section.sharedDirty_;
         sMapsSections_.insert(name, section);
     }
-    ShowSummary();
-    OnTimelineRubberBandHide();
-    setWindowTitle(QFileInfo(*file).fileName());
-    return static_cast<qint32>(IOErrorCode::NONE);
+}
+
+void MainWindow::ReleaseLoliFile() {
+    for (auto& screenshot : screenshots_)
+        screenshot.second = QByteArray(screenshot.second.constData(), screenshot.second.size());
+    loliFile_.reset();
 }
 
 QString MainWindow::GetLastOpenDir() const {
@@ -654,6 +804,78 @@ void MainWindow::UpdateMemInfoRange() {
     memInfoAxisY_->setRange(0, maxMemInfoValue_);
 }
 
+void MainWindow::SampleLiveHeap() {
+    // MB like dumpsys meminfo's values
+    auto toMB = [](qint64 bytes) { return static_cast<double>(bytes) / (1024 * 1024); };
+    auto liveBytes = liveAddresses_.LiveBytes();
+    memInfoSeries_[LIVE_HEAP_SERIES]->append(time_, toMB(liveBytes));
+    for (int i = 0; i < LiveAddressMap::SIZE_CLASSES; i++) {
+        auto bytes = liveAddresses_.LiveBytes(static_cast<LiveAddressMap::SizeClass>(i));
+        memInfoSeries_[LIVE_HEAP_SERIES + 1 + i]->append(time_, toMB(bytes));
+    }
+    const auto& groupBytes = liveAddresses_.GroupBytes();
+    QVector<QPair<qint64, quint32>> largest;
+    largest.reserve(groupBytes.size());
+    for (auto it = groupBytes.begin(); it != groupBytes.end(); ++it)
+        largest.push_back(qMakePair(it.value(), it.key()));
+    auto count = std::min(LIVE_HEAP_LIBRARIES, largest.size());
+    std::partial_sort(largest.begin(), largest.begin() + count, largest.end(),
+        [](const QPair<qint64, quint32>& a, const QPair<qint64, quint32>& b) { return a.first > b.first; });
+    for (int i = 0; i < count; i++) {
+        auto library = largest[i].second;
+        if (liveHeapLibrarySeries_.contains(library) || liveHeapLibrarySeries_.size() >= LIVE_HEAP_LIBRARY_SERIES_MAX)
+            continue;
+        auto series = new QLineSeries();
+        series->setName(HashString(library).Get());
+        memInfoChart_->addSeries(series);
+        series->attachAxis(memInfoAxisX_);
+        series->attachAxis(memInfoAxisY_);
+        liveHeapLibrarySeries_.insert(library, series);
+    }
+    for (auto it = liveHeapLibrarySeries_.begin(); it != liveHeapLibrarySeries_.end(); ++it)
+        it.value()->append(time_, toMB(groupBytes.value(it.key())));
+    auto maxValue = static_cast<int>(toMB(liveBytes) * 1.2);
+    if (maxValue > maxMemInfoValue_) {
+        maxMemInfoValue_ = maxValue;
+        UpdateMemInfoRange();
+    }
+}
+
+quint32 MainWindow::LiveHeapLibrary(const RawStackInfo& stack, const StackTraceBatch& batch) const {
+    if (stack.recType_ == static_cast<quint8>(loliRecordTypes::NOSTACK_))
+        return stack.library_.hashcode_;
+    if (mapsProcess_->IsEmpty())
+        return 0;
+    const quint64* frames = nullptr;
+    int frameCount = 0;
+    if (stack.recType_ == static_cast<quint8>(loliRecordTypes::STACKTRACE_)) {
+        frames = batch.Frames(stack);
+        frameCount = static_cast<int>(stack.frameCount_);
+    } else if (stack.recType_ == static_cast<quint8>(loliRecordTypes::STACKID_)) {
+        // definitions that haven't arrived yet leave the record unattributed
+        if (auto stacktraces = stacktraceProcess_->FindStack(stack.stackId_)) {
+            frames = stacktraces->constData();
+            frameCount = stacktraces->size();
+        }
+    }
+    // the allocation site skips the profiler's hooks, see InterpretCallStack
+    static const auto loliLibrary = qHash(QString("libloli.so"));
+    for (int i = 0; i < frameCount; i++) {
+        auto library = mapsProcess_->FindLibrary(frames[i]);
+        if (library != loliLibrary)
+            return library;
+    }
+    return 0;
+}
+
+void MainWindow::ClearLiveHeapLibraries() {
+    for (auto series : liveHeapLibrarySeries_) {
+        memInfoChart_->removeSeries(series);
+        delete series;
+    }
+    liveHeapLibrarySeries_.clear();
+}
+
 QString MainWindow::TryAddNewAddress(const QString& lib, quint64 addr) {
     if (!symbloMap_.contains(lib))
         symbloMap_.insert(lib, {});
@@ -671,10 +893,9 @@ QString MainWindow::TryAddNewAddress(const QString& lib, quint64 addr) {
 void MainWindow::ShowCallStack(const QModelIndex& index) {
     if (!index.isValid())
         return;
-    auto proxyModel = static_cast<StackTraceProxyModel*>(ui->stackTableView->model());
-    auto srcModel = static_cast<StackTraceModel*>(proxyModel->sourceModel());
-    auto& selectedRecord = srcModel->recordAt(proxyModel->mapToSource(index).row());
-    auto& callstack = callStackMap_[selectedRecord.uuid_];
+    auto model = static_cast<StackTraceModel*>(ui->stackTableView->model());
+    auto& selectedRecord = model->recordAt(index.row());
+    const auto& callstack = callStacks_.At(selectedRecord.stackIndex_);
     for (int i = 0; i < callstack.size(); i++) {
         const auto& libName = callstack[i].first.Get();
         const auto& funcAddr = callstack[i].second;
@@ -685,176 +906,147 @@ void MainWindow::ShowCallStack(const QModelIndex& index) {
 }
 
 void MainWindow::ShowSummary() {
-    auto model = ui->stackTableView->model();
+    auto model = static_cast<StackTraceModel*>(ui->stackTableView->model());
     auto rowCount = model->rowCount();
     quint64 size = 0;
     for (int i = 0; i < rowCount; i++) {
-        size += model->data(model->index(i, 1), Qt::UserRole).toUInt();
+        size += static_cast<quint32>(model->recordAt(i).size_);
     }
     ui->recordCountLineEdit->setText(QString("%1 / %2").arg(rowCount).arg(sizeToString(size)));
 }
 
-// CustomTreeWidgetItem
-class CustomTreeWidgetItem : public QTreeWidgetItem {
-public:
-    CustomTreeWidgetItem(QString funcName, quint64 size, QTreeWidget* parent = nullptr)
-        : QTreeWidgetItem(parent), funcName_(funcName), size_(size) {
-        setData(0, Qt::DisplayRole, funcName_);
-        setData(1, Qt::DisplayRole, sizeToString(size_));
-        setData(1, Qt::UserRole, size_);
-        setData(2, Qt::DisplayRole, count_);
-    }
-    void setSize(quint64 size) {
-        size_ = size;
-        setData(1, Qt::DisplayRole, sizeToString(size_));
-        setData(1, Qt::UserRole, size_);
-    }
-    void setCount(quint64 count) {
-        count_ = count;
-        setData(2, Qt::DisplayRole, count_);
-    }
-    quint64 size() const { return size_; }
-    quint64 count() const { return count_; }
-    bool operator<(const QTreeWidgetItem &other) const {
-        auto casted = static_cast<const CustomTreeWidgetItem&>(other);
-        int column = treeWidget()->sortColumn();
-        if (column == 0) {
-            return funcName_ < casted.funcName_;
-        } else if (column == 1) {
-            return size_ < casted.size_;
-        } else {
-            return count_ < casted.count_;
-        }
-    }
-private:
-    QString funcName_;
-    quint64 size_;
-    quint64 count_ = 1;
-};
-
-void MainWindow::ShowMergedCallstacks(QList<QTreeWidgetItem*>& topLevelItems, std::function<void(QTreeWidget*)> widgetCallback) {
+void MainWindow::ShowMergedCallstacks(CallTreeModel* model, std::function<void(QTreeView*)> widgetCallback) {
     QDialog fragDialog(this, Qt::WindowTitleHint | Qt::WindowCloseButtonHint);
     auto layout = new QVBoxLayout(&fragDialog);
     layout->setSpacing(2);
     fragDialog.setLayout(layout);
-    auto treeWidget = new QTreeWidget(&fragDialog);
-    treeWidget->setHeaderLabels(QStringList() << "Function" << "Size" << "Count");
-    treeWidget->setContextMenuPolicy(Qt::CustomContextMenu);
-    connect(treeWidget, &QTreeWidget::customContextMenuRequested, this, [this, treeWidget](const QPoint &pos) {
+    auto treeView = new QTreeView(&fragDialog);
+    treeView->setModel(model);
+    treeView->setUniformRowHeights(true);
+    treeView->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(treeView, &QTreeView::customContextMenuRequested, this, [this, treeView, model](const QPoint &pos) {
         QMenu menu;
-        auto actionDeepCopy = new QAction("DeepCopy", treeWidget);
-        connect(actionDeepCopy, &QAction::triggered, [treeWidget, pos]() {
-            auto item = treeWidget->itemAt(pos);
-            if (!item) return;
+        auto actionDeepCopy = new QAction("DeepCopy", treeView);
+        connect(actionDeepCopy, &QAction::triggered, [treeView, model, pos]() {
+            auto index = treeView->indexAt(pos);
+            if (!index.isValid()) return;
 
             QStringList result;
-            std::function<void(QTreeWidgetItem*, int)> collectItems = [&](QTreeWidgetItem* node, int depth) {
+            std::function<void(const QModelIndex&, int)> collectItems = [&](const QModelIndex& item, int depth) {
                 QString indent(depth, '\t');
-                auto customItem = static_cast<CustomTreeWidgetItem*>(node);
+                auto node = model->node(item);
                 QString line = QString("%1%2, %3, %4").arg(indent)
-                    .arg(customItem->data(0, Qt::DisplayRole).toString())
-                    .arg(sizeToString(customItem->size()))
-                    .arg(customItem->count());
+                    .arg(model->name(node))
+                    .arg(sizeToString(model->size(node)))
+                    .arg(model->count(node));
                 result << line;
 
-                for (int i = 0; i < node->childCount(); ++i) {
-                    collectItems(node->child(i), depth + 1);
+                auto childCount = model->rowCount(item);
+                for (int i = 0; i < childCount; ++i) {
+                    collectItems(model->index(i, 0, item), depth + 1);
                 }
             };
 
-            collectItems(item, 0);
+            collectItems(index.sibling(index.row(), 0), 0);
             QApplication::clipboard()->setText(result.join("\n"));
         });
         menu.addAction(actionDeepCopy);
         
-        auto actionExpandAll = new QAction("Expand All", treeWidget);
-        connect(actionExpandAll, &QAction::triggered, [treeWidget, pos]() {
-            auto item = treeWidget->itemAt(pos);
-            if (!item) return;
+        auto actionExpandAll = new QAction("Expand All", treeView);
+        connect(actionExpandAll, &QAction::triggered, [treeView, model, pos]() {
+            auto index = treeView->indexAt(pos);
+            if (!index.isValid()) return;
             
-            std::function<void(QTreeWidgetItem*)> expandRecursive = [&](QTreeWidgetItem* node) {
-                node->setExpanded(true);
-                for (int i = 0; i < node->childCount(); ++i) {
-                    expandRecursive(node->child(i));
+            std::function<void(const QModelIndex&)> expandRecursive = [&](const QModelIndex& item) {
+                treeView->setExpanded(item, true);
+                auto childCount = model->rowCount(item);
+                for (int i = 0; i < childCount; ++i) {
+                    expandRecursive(model->index(i, 0, item));
                 }
             };
             
-            expandRecursive(item);
+            expandRecursive(index.sibling(index.row(), 0));
         });
         menu.addAction(actionExpandAll);
         
-        auto actionCollapseAll = new QAction("Collapse All", treeWidget);
-        connect(actionCollapseAll, &QAction::triggered, [treeWidget, pos]() {
-            auto item = treeWidget->itemAt(pos);
-            if (!item) return;
+        auto actionCollapseAll = new QAction("Collapse All", treeView);
+        connect(actionCollapseAll, &QAction::triggered, [treeView, model, pos]() {
+            auto index = treeView->indexAt(pos);
+            if (!index.isValid()) return;
             
-            std::function<void(QTreeWidgetItem*)> collapseRecursive = [&](QTreeWidgetItem* node) {
-                for (int i = 0; i < node->childCount(); ++i) {
-                    collapseRecursive(node->child(i));
+            // only expanded rows have children that could be expanded
+            std::function<void(const QModelIndex&)> collapseRecursive = [&](const QModelIndex& item) {
+                if (!treeView->isExpanded(item))
+                    return;
+                auto childCount = model->rowCount(item);
+                for (int i = 0; i < childCount; ++i) {
+                    collapseRecursive(model->index(i, 0, item));
                 }
-                node->setExpanded(false);
+                treeView->setExpanded(item, false);
             };
             
-            collapseRecursive(item);
+            collapseRecursive(index.sibling(index.row(), 0));
         });
         menu.addAction(actionCollapseAll);
         
-        menu.exec(treeWidget->viewport()->mapToGlobal(pos));
+        menu.exec(treeView->viewport()->mapToGlobal(pos));
     });
-    treeWidget->addTopLevelItems(topLevelItems);
-    treeWidget->resizeColumnToContents(0);
-    treeWidget->header()->resizeSections(QHeaderView::ResizeMode::ResizeToContents);
-    treeWidget->setSortingEnabled(true);
-    treeWidget->sortByColumn(1, Qt::SortOrder::DescendingOrder);
+    treeView->setSortingEnabled(true);
+    treeView->sortByColumn(1, Qt::SortOrder::DescendingOrder);
+    treeView->header()->resizeSections(QHeaderView::ResizeMode::ResizeToContents);
     if (widgetCallback)
-        widgetCallback(treeWidget);
+        widgetCallback(treeView);
     auto searchLineEdit = new QLineEdit(&fragDialog);
     searchLineEdit->setPlaceholderText("Type keyword to do fuzzy search, then press enter to review one by one.");
     searchLineEdit->setClearButtonEnabled(true);
     QString prevKeyword;
     int matchIndex = 0;
-    QList<QTreeWidgetItem*> matches;
+    QVector<quint32> matches;
+    // names are matched on a worker, results of outdated keywords are dropped
+    QFutureWatcher<QVector<quint32>> searchWatcher;
+    QElapsedTimer searchTimer;
+    connect(&searchWatcher, &QFutureWatcher<QVector<quint32>>::finished, [&](){
+        matches = searchWatcher.result();
+        matchIndex = 0;
+        ui->statusBar->showMessage(QString("Found %1 matches in %2 ms, press enter to review one by one")
+            .arg(matches.size()).arg(searchTimer.elapsed()), 10000);
+    });
     connect(searchLineEdit, &QLineEdit::editingFinished, [&](){
         auto keyword = searchLineEdit->text();
         if (prevKeyword == keyword)
             return;
-        treeWidget->clearSelection();
+        treeView->clearSelection();
         matches.clear();
         matchIndex = 0;
         prevKeyword = keyword;
         if (keyword.size() == 0)
             return;
-        auto startTime = sclock::now();
-        matches = treeWidget->findItems(keyword, Qt::MatchContains | Qt::MatchRecursive, 0);
-        auto ms = std::chrono::duration<double, std::milli>(sclock::now() - startTime).count();
-        ui->statusBar->showMessage(QString("Found %1 matches in %2 ms, press enter to review one by one")
-            .arg(matches.size()).arg(ms), 10000);
+        searchTimer.start();
+        searchWatcher.setFuture(model->search(keyword));
     });
     connect(searchLineEdit, &QLineEdit::returnPressed, [&](){
         if (matches.size() <= 0) {
             return;
         }
-        auto item = matches[matchIndex];
-        item->setSelected(true);
-        auto rowCount = 1;
-        auto curItem = item->parent();
-        while (curItem) {
-            rowCount++;
-            if (!curItem->isExpanded())
-                curItem->setExpanded(true);
-            curItem = curItem->parent();
+        auto index = model->indexOf(matches[matchIndex]);
+        treeView->selectionModel()->select(index, QItemSelectionModel::ClearAndSelect | QItemSelectionModel::Rows);
+        auto curIndex = index.parent();
+        while (curIndex.isValid()) {
+            if (!treeView->isExpanded(curIndex))
+                treeView->setExpanded(curIndex, true);
+            curIndex = curIndex.parent();
         }
         // scroll to item
-        treeWidget->scrollToItem(item, QAbstractItemView::ScrollHint::PositionAtCenter);
-        auto itemRect = treeWidget->visualItemRect(item);
-        auto hscrollbar = treeWidget->horizontalScrollBar();
+        treeView->scrollTo(index, QAbstractItemView::ScrollHint::PositionAtCenter);
+        auto itemRect = treeView->visualRect(index);
+        auto hscrollbar = treeView->horizontalScrollBar();
         hscrollbar->setValue(hscrollbar->value() + itemRect.x());
         matchIndex++;
         if (matchIndex > matches.size() - 1) {
             matchIndex = 0;
         }
     });
-    layout->addWidget(treeWidget);
+    layout->addWidget(treeView);
     layout->addWidget(searchLineEdit);
     layout->setMargin(0);
     fragDialog.setWindowTitle("Merged Callstacks");
@@ -863,13 +1055,13 @@ void MainWindow::ShowMergedCallstacks(QList<QTreeWidgetItem*>& topLevelItems, st
     fragDialog.exec();
 }
 
-void MainWindow::ShowMergedCallstacksInTreeMap(QList<QTreeWidgetItem*>& topLevelItems) {
+void MainWindow::ShowMergedCallstacksInTreeMap(CallTreeModel* model) {
     QDialog fragDialog(this, Qt::WindowTitleHint | Qt::WindowCloseButtonHint);
     auto layout = new QVBoxLayout(&fragDialog);
     layout->setSpacing(2);
     fragDialog.setLayout(layout);
-    auto treeMap = new TreeMapGraphicsView(topLevelItems);
-    treeMap->Generate(nullptr, QRectF(0, 0, 1024, 512), 10);
+    auto treeMap = new TreeMapGraphicsView(model);
+    treeMap->Generate(QModelIndex(), QRectF(0, 0, 1024, 512), 10);
     layout->addWidget(treeMap);
     layout->setMargin(0);
     fragDialog.setWindowTitle("Show Callstacks TreeMap");
@@ -888,57 +1080,19 @@ StackTraceModel* MainWindow::GetCurrentModelChecked() {
 
 void MainWindow::FilterStackTraceModel() {
     FilterStackTraceModel(filteredStacktraceModel_, minTime_, maxTime_);
-    SwitchStackTraceModel(filteredStacktraceProxyModel_);
+    SwitchStackTraceModel(filteredStacktraceModel_);
 }
 
 void MainWindow::FilterStackTraceModel(StackTraceModel* filteredModel, double minTime, double maxTime) {
-    auto sizeFilter = ui->memSizeComboBox->currentIndex();
+    auto sizeFilter = static_cast<RecordIndex::SizeFilter>(ui->memSizeComboBox->currentIndex());
     auto libraryFilter = ui->libraryComboBox->currentIndex() == 0 ? QString() : ui->libraryComboBox->currentText();
     auto persistentFilter = ui->allocComboBox->currentIndex() == 1;
 //    TimerProfiler profler("FilterStackTraceModel");
-    filteredModel->clear();
-    QVector<StackRecord> filteredRecords;
-    int recordCount = stacktraceModel_->rowCount();
-    for (int i = 0; i < recordCount; i++) {
-        const auto& record = stacktraceModel_->recordAt(i);
-        auto timeInSecond = record.time_ / 1000;
-        if (timeInSecond < minTime || timeInSecond > maxTime)
-            continue;
-        if (sizeFilter > 0) {
-            auto size = record.size_;
-            switch(sizeFilter) {
-            case 1: // large
-                if (size < 1048576)
-                    continue;
-                break;
-            case 2: // medium
-                if (size >= 1048576 || size <= 1024)
-                    continue;
-                break;
-            case 3: // small
-                if (size > 1024)
-                    continue;
-                break;
-            }
-        }
-        if (libraryFilter.size() > 0) {
-            if (record.library_.Get() != libraryFilter)
-                continue;
-        }
-        if (persistentFilter) {
-            auto it = freeAddrMap_.find(record.addr_);
-            if (it != freeAddrMap_.end()) {
-                if (record.seq_ < it.value()) {
-                    continue;
-                }
-            }
-        }
-        filteredRecords.push_back(record);
-    }
-    filteredModel->append(filteredRecords);
+    filteredModel->setRows(stacktraceModel_,
+        recordIndex_.Filter(minTime, maxTime, sizeFilter, libraryFilter, persistentFilter));
 }
 
-void MainWindow::SwitchStackTraceModel(StackTraceProxyModel* model) {
+void MainWindow::SwitchStackTraceModel(StackTraceModel* model) {
     if (model == ui->stackTableView->model())
         return;
     ui->stackTableView->setModel(model);
@@ -1013,46 +1167,13 @@ void MainWindow::ReadSMapsFile(QFile* file) {
     }
 }
 
-QHash<uint, CustomTreeWidgetItem*> MainWindow::GetMergedCallstacks(StackTraceModel* model, QList<QTreeWidgetItem*>& topLevelItems) {
+void MainWindow::GetMergedCallstacks(StackTraceModel* model, CallTreeBuilder& builder) {
     auto count = model->rowCount();
-    QHash<uint, CustomTreeWidgetItem*> itemMap;
-    for (int i = 0; i < count; i++) {
-        const auto& record = model->recordAt(i);
-        const auto& callstacks = callStackMap_[record.uuid_];
-        CustomTreeWidgetItem* child = nullptr;
-        QStringList callstackNames;
-        for (int j = 0; j < callstacks.size(); j ++) {
-            const auto& libName = callstacks[j].first.Get();
-            const auto& funcAddr = callstacks[j].second;
-            const auto& funcName = TryAddNewAddress(libName, funcAddr);
-            callstackNames << funcName;
-        }
-        for (auto it = callstackNames.begin(); it != callstackNames.end(); ++it) {
-            auto curHash = qHashRange(it, callstackNames.end());
-            auto itemIt = itemMap.find(curHash);
-            CustomTreeWidgetItem* item = nullptr;
-            if (itemIt != itemMap.end()) {
-                item = itemIt.value();
-                auto parent = item;
-                while (parent != nullptr) {
-                    parent->setSize(parent->size() + static_cast<quint64>(record.size_));
-                    parent->setCount(parent->count() + 1);
-                    parent = static_cast<CustomTreeWidgetItem*>(parent->parent());
-                }
-                if (child != nullptr)
-                    item->addChild(child);
-                break;
-            }
-            item = new CustomTreeWidgetItem(*it, static_cast<quint64>(record.size_));
-            itemMap.insert(curHash, item);
-            if (child != nullptr)
-                item->addChild(child);
-            child = item;
-        }
-        if (child != nullptr && child->parent() == nullptr)
-            topLevelItems.push_back(child);
-    }
-    return itemMap;
+    for (int i = 0; i < count; i++)
+        builder.Add(model->recordAt(i));
+    builder.Build([this](const HashString& library, quint64 addr) {
+        return TryAddNewAddress(library.Get(), addr);
+    });
 }
 
 void MainWindow::ResetFilters() {
@@ -1081,73 +1202,116 @@ void MainWindow::PushEmptySMapsFile() {
     process.close();
 }
 
-void MainWindow::ReadStacktraceData(const QVector<RawStackInfo>& stacks) {
+void MainWindow::ReadStacktraceData(const StackTraceBatch& batch) {
     auto isNoStack = ConfigDialog::IsNoStackMode();
-    if (stacks.size() > 0) {
-        for (const auto& stack : stacks) {
+    if (batch.stacks_.size() > 0) {
+        for (const auto& stack : batch.stacks_) {
+            auto reuseSlot = liveOnly_ && !freeRecordSlots_.isEmpty();
+            auto index = reuseSlot ? freeRecordSlots_.last() : static_cast<quint32>(recordsCache_.size());
+            bool live;
+            auto released = liveAddresses_.Allocate(stack.addr_, stack.seq_, index,
+                stack.size_, LiveHeapLibrary(stack, batch), live);
+            if (liveOnly_ && !live)
+                continue;
             StackRecord record;
-            record.uuid_ = QUuid::createUuid();
             record.seq_ = stack.seq_;
             record.time_ = stack.time_;
             record.size_ = stack.size_;
             record.addr_ = stack.addr_;
             if (isNoStack) {
                 record.library_ = HashString(stack.library_);
+            } else if (stack.recType_ == static_cast<quint8>(loliRecordTypes::STACKID_)) {
+                record.stackIndex_ = agentStacks_.Index(stack.stackId_, stacktraceProcess_->FindStack(stack.stackId_));
             } else {
-                auto& callstack = callStackMap_[record.uuid_];
-                for (int i = 0; i < stack.stacktraces_.size(); i++) {
-                    callstack.append(qMakePair(QString(), stack.stacktraces_[i]));
-                }
+                record.stackIndex_ = callStacks_.Intern(batch.Frames(stack), static_cast<int>(stack.frameCount_));
             }
-            recordsCache_.push_back(record);
+            if (reuseSlot) {
+                freeRecordSlots_.removeLast();
+                recordsCache_[static_cast<int>(index)] = record;
+            } else {
+                recordsCache_.push_back(record);
+            }
+            if (liveOnly_ && released != LiveAddressMap::NONE)
+                freeRecordSlots_.push_back(released);
         }
     }
 }
 
 void MainWindow::ReadStacktraceDataCache() {
-    auto cachePath = QApplication::applicationDirPath() + "/cache";
-    QDir cacheDir(cachePath);
-    auto files = cacheDir.entryList(QDir::Filter::Files, QDir::SortFlag::Time);
+    if (!spillWriter_)
+        return;
+    auto paths = spillWriter_->Finish();
+    if (spillWriter_->HasFailed())
+        Print("Failed to write spill files, some records or callstacks are missing.");
+    auto isNoStack = ConfigDialog::IsNoStackMode();
     quint32 recordCount = 0;
-    QVector<RawStackInfo> stacks;
-    for (auto filePath : files) {
-        QFile file(cachePath + "/" + filePath);
-        stacks.clear();
-        if (file.open(QFile::OpenModeFlag::ReadOnly)) {
-            QDataStream stream(&file);
-            while (!stream.atEnd()) {
-                qint32 size;
-                stream >> size;
-                recordCount += size;
-                for (int i = 0; i < size; i++) {
-                    RawStackInfo stack;
-                    stream >> stack.seq_ >> stack.addr_ >> stack.size_ >> stack.time_
-                           >> stack.library_.hashcode_ >> stack.recType_ >> stack.stacktraces_;
-                    // ignore freed records
-                    auto it = freeAddrMap_.find(stack.addr_);
-                    if (it != freeAddrMap_.end()) {
-                        if (stack.seq_ < it.value())
-                            continue;
-                    }
-                    stacks.push_back(stack);
-                }
+    {
+        SpillReader reader;
+        if (!reader.Open(paths))
+            Print("Failed to map spill files.");
+        // live records by spill order, unless records went missing and the
+        // order doesn't match, their seqs are compared to the last frees then
+        auto inOrder = reader.RecordCount() == static_cast<int>(spilledRecords_);
+        QVector<bool> liveRecords(inOrder ? reader.RecordCount() : 0, false);
+        for (auto index : liveAddresses_.LiveIndices()) {
+            if (index < static_cast<quint32>(liveRecords.size()))
+                liveRecords[static_cast<int>(index)] = true;
+        }
+        // callstack index of every spilled callstack, interned on first use
+        QVector<quint32> spilledStacks(reader.StackCount(), std::numeric_limits<quint32>::max());
+        recordsCache_.reserve(recordsCache_.size() + reader.RecordCount());
+        reader.ForEachRecord([&](const SpillRecord& spilled) {
+            // ignore freed records
+            if (inOrder) {
+                if (!liveRecords[static_cast<int>(recordCount++)])
+                    return;
+            } else {
+                recordCount++;
+                auto it = freeAddrMap_.find(spilled.addr_);
+                if (it != freeAddrMap_.end() && spilled.seq_ < it.value())
+                    return;
             }
-            ReadStacktraceData(stacks);
-            file.remove();
-        }
+            StackRecord record;
+            record.seq_ = spilled.seq_;
+            record.time_ = static_cast<qint32>(spilled.time_);
+            record.size_ = static_cast<qint32>(spilled.size_);
+            record.addr_ = spilled.addr_;
+            if (isNoStack) {
+                record.library_ = HashString(spilled.library_);
+            } else if (spilled.recType_ == static_cast<quint8>(loliRecordTypes::STACKID_)) {
+                record.stackIndex_ = agentStacks_.Index(spilled.stack_, stacktraceProcess_->FindStack(spilled.stack_));
+            } else if (spilled.recType_ == static_cast<quint8>(loliRecordTypes::STACKTRACE_) &&
+                       spilled.stack_ < static_cast<quint32>(spilledStacks.size())) {
+                // a stack of a block that failed to write comes back empty
+                auto& index = spilledStacks[static_cast<int>(spilled.stack_)];
+                if (index == std::numeric_limits<quint32>::max())
+                    index = callStacks_.Intern(reader.Stack(spilled.stack_));
+                record.stackIndex_ = index;
+            }
+            recordsCache_.push_back(record);
+        });
     }
+    spillWriter_.reset();
+    for (const auto& path : paths)
+        QFile::remove(path);
     Print(QString("Cached %1 records.").arg(recordCount));
 }
 
-void MainWindow::FilterPersistentRecords() {
-    recordsCache_.erase(std::remove_if(recordsCache_.begin(), recordsCache_.end(), [this](const StackRecord& record) {
-        auto it = freeAddrMap_.find(record.addr_);
-        if (it != freeAddrMap_.end()) {
-            if (record.seq_ < it.value())
-                return true;
-        }
-        return false;
-    }), recordsCache_.end());
+void MainWindow::DropFreedRecords() {
+    QVector<bool> freed(recordsCache_.size(), false);
+    for (auto index : freeRecordSlots_)
+        freed[static_cast<int>(index)] = true;
+    int count = 0;
+    for (int i = 0; i < recordsCache_.size(); i++) {
+        if (!freed[i])
+            recordsCache_[count++] = recordsCache_[i];
+    }
+    recordsCache_.resize(count);
+    freeRecordSlots_.clear();
+    // reused slots are out of order
+    std::sort(recordsCache_.begin(), recordsCache_.end(), [](const StackRecord& a, const StackRecord& b) {
+        return a.seq_ < b.seq_;
+    });
 }
 
 void MainWindow::StopCaptureProcess() {
@@ -1184,12 +1348,16 @@ void MainWindow::StopCaptureProcess() {
         file.remove();
     }
     progressDialog_->setValue(1);
+    // the last free of every address, the persistent filter and saved files use it
+    freeAddrMap_ = liveAddresses_.Frees();
     if (!readSMaps) {
         Print("Failed to cat proc/pid/smaps");
     } else {
         if (useCache_) {
             progressDialog_->setLabelText("Reading cached record files ...");
             ReadStacktraceDataCache();
+        } else if (liveOnly_) {
+            DropFreedRecords();
         }
         InterpretStacktraceData();
     }
@@ -1219,11 +1387,7 @@ void MainWindow::StopCaptureProcess() {
 
 static QVector<QPair<HashString, SMapsSection*>> sMapsCache_;
 
-void MainWindow::InterpretRecordLibrary(StackRecord& record, StacktraceData& data) {
-    auto it = callStackMap_.find(record.uuid_);
-    if (it == callStackMap_.end())
-        return;
-    auto& callStack = it.value();
+void MainWindow::InterpretCallStack(CallStack& callStack, StacktraceData& data) {
     for (int i = 0; i < callStack.size(); i++) {
         auto& libName = callStack[i].first;
         auto& funcAddr = callStack[i].second;
@@ -1231,7 +1395,7 @@ void MainWindow::InterpretRecordLibrary(StackRecord& record, StacktraceData& dat
         for (int i = 0; i < sMapsCache_.size(); i++) {
             const auto& cache = sMapsCache_[i];
             quint64 symbolVAddr;
-            if (cache.second->Contains(funcAddr, record.size_, symbolVAddr)) {
+            if (cache.second->Contains(funcAddr, 0, symbolVAddr)) {
                 funcAddr = symbolVAddr;  // Convert runtime address to symbol virtual address
                 libName = cache.first;
                 data.records_.push_back(qMakePair(libName, funcAddr));
@@ -1242,27 +1406,27 @@ void MainWindow::InterpretRecordLibrary(StackRecord& record, StacktraceData& dat
         if (!found)
             libName = HashString(qHash("unknown"));
     }
-    if (callStack.size() == 0)
+    if (callStack.size() == 0) {
+        data.allocSites_.push_back(qMakePair(HashString(), 0ull));
         return;
-    record.library_ = callStack[0].first;
-    record.funcAddr_ = callStack[0].second;
+    }
+    auto allocSite = callStack[0];
     int level = 1;
-    while (record.library_.Get() == "libloli.so" && level < callStack.size()) {
-        record.library_ = callStack[level].first;
-        record.funcAddr_ = callStack[level].second;
+    while (allocSite.first.Get() == "libloli.so" && level < callStack.size()) {
+        allocSite = callStack[level];
         level++;
     }
-    if (record.library_.hashcode_ == 0) {
-        record.library_ = callStack[0].first = HashString(qHash("unknown"));
+    if (allocSite.first.hashcode_ == 0) {
+        allocSite.first = callStack[0].first = HashString(qHash("unknown"));
     }
-    if (!data.libraries_.contains(record.library_.Get()))
-        data.libraries_.push_back(record.library_.Get());
+    data.allocSites_.push_back(allocSite);
 }
 
-MainWindow::StacktraceData MainWindow::InterpretRecordsLibrary(int start, int count) {
+MainWindow::StacktraceData MainWindow::InterpretCallStacks(int start, int count) {
     StacktraceData data;
+    data.allocSites_.reserve(count);
     for (int i = 0; i < count; i++)
-        InterpretRecordLibrary(recordsCache_[start + i], data);
+        InterpretCallStack(callStacks_[static_cast<quint32>(start + i)], data);
     return data;
 }
 
@@ -1284,21 +1448,35 @@ void MainWindow::InterpretStacktraceData() {
                 sMapsCache_.push_back(qMakePair(HashString(library), &sections));
             }
         }
+        // callstacks of freed records are dropped, the others are translated
+        // once no matter how many records share them
+        QVector<bool> usedStacks(callStacks_.Size(), false);
+        for (const auto& record : recordsCache_)
+            usedStacks[static_cast<int>(record.stackIndex_)] = true;
+        auto stackIndices = callStacks_.Compact(usedStacks);
+        for (auto& record : recordsCache_)
+            record.stackIndex_ = stackIndices[static_cast<int>(record.stackIndex_)];
+        agentStacks_.Clear();
         auto threadCount = std::max(2, QThread::idealThreadCount());
-        auto payload = recordsCache_.size() / threadCount;
+        auto stackCount = callStacks_.Size() - 1;
+        auto payload = stackCount / threadCount;
         QVector<QFuture<StacktraceData>> futures;
-        int currentIndex = 0;
+        int currentIndex = 1;
         for (int i = 0; i < threadCount - 1; i++) {
-            futures.push_back(QtConcurrent::run(this, &MainWindow::InterpretRecordsLibrary, currentIndex, payload));
+            futures.push_back(QtConcurrent::run(this, &MainWindow::InterpretCallStacks, currentIndex, payload));
             currentIndex += payload;
         }
-        futures.push_back(QtConcurrent::run(this, &MainWindow::InterpretRecordsLibrary, 
-            currentIndex, recordsCache_.size() - currentIndex));
-        progressDialog_->setLabelText(QString("Translating %1 records by %2 jobs").arg(recordsCache_.size()).arg(threadCount));
+        futures.push_back(QtConcurrent::run(this, &MainWindow::InterpretCallStacks, 
+            currentIndex, callStacks_.Size() - currentIndex));
+        progressDialog_->setLabelText(QString("Translating %1 callstacks of %2 records by %3 jobs")
+            .arg(stackCount).arg(recordsCache_.size()).arg(threadCount));
         progressDialog_->setMinimum(0);
         progressDialog_->setMaximum(progressDialog_->maximum() + threadCount);
         progressDialog_->raise();
         QCoreApplication::instance()->sendPostedEvents();
+        QVector<QPair<HashString, quint64>> allocSites;
+        allocSites.reserve(callStacks_.Size());
+        allocSites.push_back(qMakePair(HashString(), 0ull));
         for (int i = 0; i < futures.size(); i++) {
             progressDialog_->setValue(progressDialog_->value() + 1);
             auto& future = futures[i];
@@ -1306,15 +1484,21 @@ void MainWindow::InterpretStacktraceData() {
             for (const auto& record : trace.records_) {
                 TryAddNewAddress(record.first.Get(), record.second);
             }
-            for (const auto& library : trace.libraries_) {
-                if (!libraries_.contains(library)) {
-                    libraries_.insert(library);
-                }
+            allocSites += trace.allocSites_;
+        }
+        for (auto& record : recordsCache_) {
+            if (callStacks_.At(record.stackIndex_).isEmpty())
+                continue;
+            record.library_ = allocSites[static_cast<int>(record.stackIndex_)].first;
+            record.funcAddr_ = allocSites[static_cast<int>(record.stackIndex_)].second;
+            if (!libraries_.contains(record.library_.Get())) {
+                libraries_.insert(record.library_.Get());
             }
         }
     }
     ResetFilters();
     stacktraceModel_->append(recordsCache_);
+    recordIndex_.Build(stacktraceModel_->records(), freeAddrMap_);
     FilterStackTraceModel();
     recordsCache_.clear();
     sMapsCache_.clear();
@@ -1332,11 +1516,22 @@ void MainWindow::FixedUpdate() {
         if (!memInfoProcess_->IsRunning() && !memInfoProcess_->HasErrors()) {
             memInfoProcess_->DumpMemInfoAsync(appName_, subProcessName_);
         }
+        // libraries loaded later show up in the next read, the first one
+        // is done as soon as the pid is known
+        auto appPid = memInfoProcess_->GetAppPid();
+        if (isCapturing_ && !ConfigDialog::IsNoStackMode() && !appPid.isEmpty() &&
+            time_ - lastMapsTime_ >= LIBRARY_MAPS_INTERVAL &&
+            !mapsProcess_->IsRunning() && !mapsProcess_->HasErrors()) {
+            lastMapsTime_ = time_;
+            mapsProcess_->DumpMapsAsync(appName_, appPid, startAppProcess_->IsRootDevice());
+        }
     }
     if (!stacktraceProcess_->IsConnecting() && !stacktraceProcess_->IsConnected()) {
         stacktraceProcess_->ConnectToServer(8000);
         Print("Connecting to application server ... ");
     }
+    if (isCapturing_)
+        SampleLiveHeap();
     time_++;
 }
 
@@ -1379,10 +1574,9 @@ void MainWindow::OnStackTableViewContextMenu(const QPoint & pos) {
         auto selectedIndex = indexes.front();
         if (!selectedIndex.isValid())
             return;
-        auto proxyModel = static_cast<StackTraceProxyModel*>(ui->stackTableView->model());
-        auto srcModel = static_cast<StackTraceModel*>(proxyModel->sourceModel());
-        auto& selectedRecord = srcModel->recordAt(proxyModel->mapToSource(selectedIndex).row());
-        auto& callStack = callStackMap_[selectedRecord.uuid_];
+        auto model = static_cast<StackTraceModel*>(ui->stackTableView->model());
+        auto& selectedRecord = model->recordAt(selectedIndex.row());
+        const auto& callStack = callStacks_.At(selectedRecord.stackIndex_);
         for (int i = 0; i < callStack.size(); i++) {
             const auto& libName = callStack[i].first.Get();
             const auto& funcAddr = callStack[i].second;
@@ -1405,15 +1599,9 @@ void MainWindow::OnDumpingLineNumbers() {
     auto selectedIndex = indexes.front();
     if (!selectedIndex.isValid())
         return;
-    auto addr2linePath = PathUtils::GetNDKToolPath("addr2line", ConfigDialog::GetCurrentSettings().arch_ != "arm64-v8a");
-    if (addr2linePath.isEmpty() || !QFile::exists(addr2linePath)) {
-        QMessageBox::warning(this, "Warning", ANDROID_NDK_NOTFOUND_MSG);
-        return;
-    }
-    auto proxyModel = static_cast<StackTraceProxyModel*>(ui->stackTableView->model());
-    auto srcModel = static_cast<StackTraceModel*>(proxyModel->sourceModel());
-    auto& selectedRecord = srcModel->recordAt(proxyModel->mapToSource(selectedIndex).row());
-    auto& callStack = callStackMap_[selectedRecord.uuid_];
+    auto model = static_cast<StackTraceModel*>(ui->stackTableView->model());
+    auto& selectedRecord = model->recordAt(selectedIndex.row());
+    const auto& callStack = callStacks_.At(selectedRecord.stackIndex_);
     static QString symbolSearchPath = QString();
     bool selectSymbolSearchPath = false;
     if (symbolSearchPath.isEmpty()) {
@@ -1444,47 +1632,26 @@ void MainWindow::OnDumpingLineNumbers() {
         }
         return QString();
     };
-    // <libName, <libPath, List of lib addresses>>
-    QMap<QString, QPair<QString, QStringList>> libraries;
-    for (int i = 0; i < callStack.size(); i++) {
-        const auto& libName = callStack[i].first.Get();
-        const auto& funcAddr = QString::number(callStack[i].second, 16);
-        if (libraries.contains(libName)) {
-            libraries[libName].second << funcAddr;
-            continue;
-        }
-        auto& libInfo = libraries[libName];
-        libInfo.first = QString();
-        auto symbloPath = findSymbol(libName);
-        if (!QFile::exists(symbloPath))
-            continue;
-        libInfo.first = symbloPath;
-        libInfo.second << funcAddr;
-    }
     // <libName + address, sourcecode path and line number>
     QMap<QString, QString> addressInfos;
-    for (auto it = libraries.begin(); it != libraries.end(); ++it) {
-        auto libName = it.key();
-        auto libInfo = it.value();
-        auto libPath = libInfo.first;
-        const auto& addresses = libInfo.second;
-        if (libPath.isEmpty())
-            continue;
-        QProcess addr2lineProcess;
-        auto arguments = QStringList() << "-e" << libPath << addresses;
-        AdbProcess::SetArguments(&addr2lineProcess, arguments);
-        addr2lineProcess.setProgram(addr2linePath);
-        addr2lineProcess.start();
-        if (addr2lineProcess.waitForStarted()) {
-            if (addr2lineProcess.waitForFinished()) {
-                QString retStr = addr2lineProcess.readAll();
-                QTextStream stream(&retStr);
-                QString line;
-                for (int i = 0; i < addresses.size() && stream.readLineInto(&line); i++) {
-                    addressInfos[libName + addresses[i]] = line;
-                }
+    QHash<QString, QSharedPointer<ElfSymbolizer>> symbolizers;
+    for (int i = 0; i < callStack.size(); i++) {
+        const auto& libName = callStack[i].first.Get();
+        auto symbolizerIt = symbolizers.find(libName);
+        if (symbolizerIt == symbolizers.end()) {
+            QSharedPointer<ElfSymbolizer> symbolizer;
+            auto symbloPath = findSymbol(libName);
+            if (QFile::exists(symbloPath)) {
+                symbolizer.reset(new ElfSymbolizer());
+                if (!symbolizer->Open(symbloPath))
+                    symbolizer.reset();
             }
+            symbolizerIt = symbolizers.insert(libName, symbolizer);
         }
+        if (symbolizerIt.value().isNull())
+            continue;
+        const auto& funcAddr = callStack[i].second;
+        addressInfos[libName + QString::number(funcAddr, 16)] = symbolizerIt.value()->LineInfo(funcAddr);
     }
     QString output;
     QTextStream stream(&output);
@@ -1525,7 +1692,9 @@ void MainWindow::StartAppProcessFinished(AdbProcess* process) {
     stacktraceProcess_->SetExecutablePath(PathUtils::GetADBExecutablePath());
 //    stacktraceProcess_->ForwardPort(port_);
     memInfoProcess_->SetExecutablePath(PathUtils::GetADBExecutablePath());
+    mapsProcess_->SetExecutablePath(PathUtils::GetADBExecutablePath());
     lastScreenshotTime_ = time_ = 0;
+    lastMapsTime_ = -LIBRARY_MAPS_INTERVAL;
     Print("Application Started!");
     memInfoProcess_->DumpMemInfoAsync(appName_, subProcessName_);
 }
@@ -1593,43 +1762,28 @@ void MainWindow::ScreenshotProcessErrorOccurred() {
 void MainWindow::StacktraceDataReceived() {
     if (!isConnected_ || !isCapturing_)
         return;
-    const auto& stacks = stacktraceProcess_->GetStackInfo();
-    const auto& frees = stacktraceProcess_->GetFreeInfo();
+    const auto& batch = stacktraceProcess_->GetBatch();
+    if (agentStacks_.HasPending()) {
+        for (const auto& definition : batch.definitions_)
+            agentStacks_.Define(definition.stackId_, batch.frames_.constData() + definition.frameOffset_,
+                                static_cast<int>(definition.frameCount_));
+    }
     if (useCache_) {
-        static quint32 cacheIndex = 0;
-        auto cacheDirPath = QApplication::applicationDirPath() + "/cache";
-        if (!QDir(cacheDirPath).exists()) {
-            QDir().mkdir(cacheDirPath);
-        }
-        auto cachePath = QString("%1/cache_%2.bin").arg(cacheDirPath).arg(cacheIndex);
-        QFile cacheFile(cachePath);
-        if (!cacheFile.open(QFile::OpenModeFlag::WriteOnly | QFile::OpenModeFlag::Append)) {
-            Print("Failed to open cache file: " + cachePath);
-            return;
-        }
-        QDataStream stream(&cacheFile);
-        stream << static_cast<qint32>(stacks.size());
-        for (auto& stack : stacks) {
-            stream << stack.seq_ << stack.addr_ << stack.size_ << stack.time_
-                   << stack.library_.hashcode_ << stack.recType_ << stack.stacktraces_;
-        }
-        cacheFile.flush();
-        if (cacheFile.size() > 1024 * 1024 * 512) {
-            cacheIndex++;
-        }
-        cacheFile.close();
+        if (spillWriter_)
+            spillWriter_->Append(batch);
+        // spilled records are tracked by the order they're spilled in
+        bool live;
+        for (const auto& stack : batch.stacks_)
+            liveAddresses_.Allocate(stack.addr_, stack.seq_, spilledRecords_++,
+                stack.size_, LiveHeapLibrary(stack, batch), live);
     } else {
-        ReadStacktraceData(stacks);
+        ReadStacktraceData(batch);
     }
     // read free call infos
-    if (frees.size() > 0) {
-        for (const auto& free : frees) {
-            const auto address = free.second;
-            auto curSeq = freeAddrMap_[address];
-            if (free.first > curSeq) {
-                freeAddrMap_[address] = free.first;
-            }
-        }
+    for (const auto& free : batch.frees_) {
+        auto index = liveAddresses_.Free(free.second, free.first);
+        if (liveOnly_ && index != LiveAddressMap::NONE)
+            freeRecordSlots_.push_back(index);
     }
 }
 
@@ -1687,7 +1841,13 @@ void MainWindow::on_actionSave_triggered() {
         QMessageBox::warning(this, "Warning", "Can't create file!", QMessageBox::StandardButton::Ok);
         return;
     }
-    SaveToFile(&tempFile);
+    if (!SaveToFile(&tempFile)) {
+        QMessageBox::warning(this, "Warning", "Error writing file!", QMessageBox::StandardButton::Ok);
+        return;
+    }
+    // the file being replaced may be the one the screenshots are mapped from
+    if (QFileInfo::exists(fileName))
+        ReleaseLoliFile();
     if (QFileInfo::exists(fileName) && !QFile(fileName).remove()) {
         QMessageBox::warning(this, "Warning", "Error removing file!", QMessageBox::StandardButton::Ok);
         return;
@@ -1736,20 +1896,22 @@ void MainWindow::on_actionVisualize_SMaps_triggered() {
 }
 
 void MainWindow::on_actionShow_Merged_Callstacks_triggered() {
-    QList<QTreeWidgetItem*> topLevelItems;
+    CallTreeModel model;
     if (auto currentModel = GetCurrentModelChecked()) {
-        GetMergedCallstacks(currentModel, topLevelItems);
-        if (topLevelItems.size() == 0)
+        CallTreeBuilder builder(callStacks_);
+        GetMergedCallstacks(currentModel, builder);
+        if (builder.Nodes().size() == 0)
             return;
+        model.setTree(builder.Nodes(), builder.Names());
     } else {
         return;
     }
 
     auto choice = QMessageBox::question(this, "Select View Mode", "Please select prefered view mode.", "TreeView", "TreeMap");
     if (choice == 0) {
-        ShowMergedCallstacks(topLevelItems);
+        ShowMergedCallstacks(&model);
     } else {
-        ShowMergedCallstacksInTreeMap(topLevelItems);
+        ShowMergedCallstacksInTreeMap(&model);
     }
 }
 
@@ -1763,87 +1925,36 @@ void MainWindow::on_actionShow_Leaks_triggered() {
         return;
     }
 
-    auto firstModel = new StackTraceModel(this);
-    auto secondModel = new StackTraceModel(this);
-    FilterStackTraceModel(firstModel, 0, minTime_);
-    FilterStackTraceModel(secondModel, 0, maxTime_);
-
-    QList<QTreeWidgetItem*> firstTopLevelItems, secondTopLevelItems;
-    auto firstHashmap = GetMergedCallstacks(firstModel, firstTopLevelItems);
-    auto secondHashmap = GetMergedCallstacks(secondModel, secondTopLevelItems);
-
-    quint64 sizeLimiter = 1024; // 1 KiB
-    QList<CustomTreeWidgetItem*> leafItems;
-    for (auto it = secondHashmap.begin(); it != secondHashmap.end(); ++it) {
-        auto key = it.key();
-        auto widgetItem = it.value();
-        auto firstIt = firstHashmap.find(key);
-
-        // diff leaf nodes only.
-        if (widgetItem->childCount() != 0 || firstIt == firstHashmap.end()) {
-            widgetItem->setSize(0);
-            widgetItem->setCount(0);
-            continue;
-        }
-
-        leafItems.append(widgetItem);
-
-        auto firstWidgetItem = firstIt.value();
-        auto newSize = widgetItem->size() - firstWidgetItem->size();
-        auto newCount = widgetItem->count() - firstWidgetItem->count();
-
-        if (newSize < sizeLimiter || newCount <= 0) {
-            widgetItem->setSize(0);
-            widgetItem->setCount(0);
-        } else {
-            widgetItem->setSize(newSize);
-            widgetItem->setCount(newCount);
-        }
-    }
-
-    // release unused memories.
-    for (auto& item : firstTopLevelItems)
-        delete item;
-    firstTopLevelItems.clear();
-    firstHashmap.clear();
-
-    // recalculate parent size & count data by leaf nodes.
-    for (auto leaf : leafItems) {
-        auto parent = static_cast<CustomTreeWidgetItem*>(leaf->parent());
-        while (parent != nullptr) {
-            parent->setSize(parent->size() + leaf->size());
-            parent->setCount(parent->count() + leaf->count());
-            parent = static_cast<CustomTreeWidgetItem*>(parent->parent());
-        }
-    }
-    leafItems.clear();
-
-    // remove redundant records.
-    QList<CustomTreeWidgetItem*> valideItems;
-    for (auto item : secondHashmap) {
-        if (item->count() > 0) {
-            valideItems.append(item);
-            continue;
-        }
-        if (item->parent()) {
-            item->parent()->removeChild(item);
-        } else {
-            secondTopLevelItems.removeOne(item);
-        }
+    // records up to the end of the range, the ones up to its start are the
+    // baseline, both are counted in one tree
+    StackTraceModel rangeModel(nullptr);
+    FilterStackTraceModel(&rangeModel, 0, maxTime_);
+    CallTreeBuilder builder(callStacks_);
+    auto count = rangeModel.rowCount();
+    for (int i = 0; i < count; i++) {
+        const auto& record = rangeModel.recordAt(i);
+        builder.Add(record);
+        if (record.time_ / 1000 <= minTime_)
+            builder.AddBaseline(record);
     }
-    secondHashmap.clear();
+    builder.Build([this](const HashString& library, quint64 addr) {
+        return TryAddNewAddress(library.Get(), addr);
+    });
+    LeakDiff leaks(builder, 1024); // ignore growth under 1 KiB
+    CallTreeModel model;
+    model.setTree(leaks.Nodes(), builder.Names());
 
     auto choice = QMessageBox::question(this, "Select View Mode", "Please select prefered view mode.", "TreeView", "TreeMap");
     if (choice == 0) {
-        ShowMergedCallstacks(secondTopLevelItems, [&valideItems](QTreeWidget* widget) {
-            widget->expandAll();
+        ShowMergedCallstacks(&model, [&model](QTreeView* view) {
             quint64 expandLimiter = 10 * 1024 * 1024; // expand leaks greater than 10 MiBs only.
-            for (auto item : valideItems) {
-                item->setExpanded(item->size() >= expandLimiter);
+            for (quint32 node = 0; node < model.nodeCount(); node++) {
+                if (model.size(node) >= expandLimiter)
+                    view->setExpanded(model.indexOf(node), true);
             }
         });
     } else {
-        ShowMergedCallstacksInTreeMap(secondTopLevelItems);
+        ShowMergedCallstacksInTreeMap(&model);
     }
 }
 
@@ -1945,6 +2056,7 @@ void MainWindow::on_launchPushButton_clicked() {
     stacktraceProcess_->SetDeviceSerial(selectedDeviceSerial);
     startAppProcess_->SetDeviceSerial(selectedDeviceSerial);
     memInfoProcess_->SetDeviceSerial(selectedDeviceSerial);
+    mapsProcess_->SetDeviceSerial(selectedDeviceSerial);
     screenshotProcess_->SetDeviceSerial(selectedDeviceSerial);
     for (auto* addrProc : addrProcesses_) {
         addrProc->SetDeviceSerial(selectedDeviceSerial);
@@ -1958,10 +2070,18 @@ void MainWindow::on_launchPushButton_clicked() {
         return;
     }
 
-    auto enableCacheInfo = QMessageBox::information(
-                this, "Enable Data Optimization?", STRIP_NON_PERSISTENT_MSG, "Yes", "No", "Cancel", 0, 2);
-    useCache_ = enableCacheInfo == 0;
-    if (enableCacheInfo == 2) {
+    QMessageBox cacheInfo(QMessageBox::Icon::Information, "Enable Data Optimization?", STRIP_NON_PERSISTENT_MSG,
+                          QMessageBox::StandardButton::NoButton, this);
+    auto cacheButton = cacheInfo.addButton("Yes", QMessageBox::ButtonRole::AcceptRole);
+    auto liveOnlyButton = cacheInfo.addButton("Live Only", QMessageBox::ButtonRole::AcceptRole);
+    cacheInfo.addButton("No", QMessageBox::ButtonRole::AcceptRole);
+    auto cancelButton = cacheInfo.addButton("Cancel", QMessageBox::ButtonRole::RejectRole);
+    cacheInfo.setDefaultButton(cacheButton);
+    cacheInfo.setEscapeButton(cancelButton);
+    cacheInfo.exec();
+    useCache_ = cacheInfo.clickedButton() == cacheButton;
+    liveOnly_ = cacheInfo.clickedButton() == liveOnlyButton;
+    if (cacheInfo.clickedButton() == cancelButton) {
         return;
     }
 
@@ -1977,8 +2097,9 @@ void MainWindow::on_launchPushButton_clicked() {
     libraries_.clear();
     filteredStacktraceModel_->clear();
     stacktraceModel_->clear();
+    recordIndex_.Clear();
     sMapsSections_.clear();
-    SwitchStackTraceModel(stacktraceProxyModel_);
+    SwitchStackTraceModel(stacktraceModel_);
     ResetFilters();
     while (ui->libraryComboBox->count() > 1)
         ui->libraryComboBox->removeItem(ui->libraryComboBox->count() - 1);
@@ -1995,17 +2116,25 @@ void MainWindow::on_launchPushButton_clicked() {
     ui->stackTableView->setSortingEnabled(false);
     for (auto& series : memInfoSeries_)
         series->clear();
+    ClearLiveHeapLibraries();
     screenshots_.clear();
+    loliFile_.reset();
     symbloMap_.clear();
     recordsCache_.clear();
     freeAddrMap_.clear();
-    callStackMap_.clear();
+    liveAddresses_.Clear();
+    mapsProcess_->Clear();
+    freeRecordSlots_.clear();
+    spilledRecords_ = 0;
+    callStacks_.Clear();
+    agentStacks_.Clear();
     callStackModel_->clear();
     HashString::hashmap_.clear();
 
     maxMemInfoValue_ = 128;
     UpdateMemInfoRange();
 
+    spillWriter_.reset();
     if (useCache_) { // clear cache folder
         auto cachePath = QApplication::applicationDirPath() + "/cache";
         auto cacheDir = QDir(cachePath);
@@ -2014,7 +2143,11 @@ void MainWindow::on_launchPushButton_clicked() {
             for (auto fileName : files) {
                 cacheDir.remove(fileName);
             }
+        } else {
+            QDir().mkdir(cachePath);
         }
+        spillWriter_.reset(new SpillWriter(cachePath));
+        spillWriter_->start();
     }
 
     auto settings = ConfigDialog::GetCurrentSettings();
@@ -2037,123 +2170,43 @@ void MainWindow::on_chartScaleHSlider_valueChanged(int value) {
 }
 
 void MainWindow::on_symbloPushButton_clicked() {
-    auto symbloPath = QFileDialog::getOpenFileName(this, tr("Select Symblo File"),
+    auto symbloPaths = QFileDialog::getOpenFileNames(this, tr("Select Symblo Files"),
         GetLastSymbolDir(), tr("Library Files (*.sym *.sym.so *.so)"));
-    if (!QFile::exists(symbloPath))
-        return;
-    lastSymbolDir_ = QFileInfo(symbloPath).dir().absolutePath();
-    auto nmPath = PathUtils::GetNDKToolPath("nm", ConfigDialog::GetCurrentSettings().arch_ != "arm64-v8a");
-    if (nmPath.isEmpty() || !QFile::exists(nmPath)) {
-        QMessageBox::warning(this, "Warning", ANDROID_NDK_NOTFOUND_MSG);
-        return;
-    }
-    QFileInfo info(symbloPath);
-    auto soName = info.baseName() + ".so";
-    auto it = symbloMap_.find(soName);
-    if (it == symbloMap_.end())
+    if (symbloPaths.isEmpty())
         return;
+    lastSymbolDir_ = QFileInfo(symbloPaths.front()).dir().absolutePath();
     QElapsedTimer timer;
     timer.start();
 
     progressDialog_->setWindowTitle("Symbol Load Progress");
-    progressDialog_->setLabelText("Dumping symbol map from so library.");
+    progressDialog_->setLabelText(QString("Reading symbols from %1 so libraries, translating ....").arg(symbloPaths.size()));
     progressDialog_->setMinimum(0);
-    progressDialog_->setMaximum(3);
+    progressDialog_->setMaximum(1);
     progressDialog_->setValue(0);
     progressDialog_->setCancelButtonText(QString());
     progressDialog_->show();
-
-    QString symbolMapFilePath = symbloPath + ".txt";
-    {
-//        TimerProfiler profile("NM");
-        QProcess nmProcess;
-        // -n, --numeric-sort     Sort symbols numerically by address
-        // -C, --demangle
-        // -S, --print-size       Print size of defined symbols
-        AdbProcess::SetArguments(&nmProcess, QStringList() << "-nCS" << symbloPath);
-        nmProcess.setStandardOutputFile(symbolMapFilePath);
-        nmProcess.setProgram(nmPath);
-        nmProcess.start();
-        if (!nmProcess.waitForStarted()) {
-            progressDialog_->hide();
-            QMessageBox::warning(this, "Warning", "ERROR starting nm process!");
-            return;
-        }
-        while (!nmProcess.waitForFinished(3000)) {
-            QCoreApplication::instance()->sendPostedEvents();
-        }
-    }
-
-    progressDialog_->setValue(1);
-    progressDialog_->setLabelText("Reading & Parsing symbol map.");
-    QCoreApplication::instance()->sendPostedEvents();
-
-    struct SymbolRecord {
-        QString name;
-        quint64 addr;
-        quint32 size;
-    };
-    QVector<SymbolRecord> sortedRecords;
-
-    {
-        // TimerProfiler profile("Load Symbol");
-        QFile symbolMapFile(symbolMapFilePath);
-        if (!symbolMapFile.open(QFile::OpenModeFlag::ReadOnly)) {
-            progressDialog_->hide();
-            QMessageBox::warning(this, "Warning", QString("ERROR reading file: %1").arg(symbolMapFilePath));
-            return;
-        }
-        QRegExp recordRx("([0-9a-z]+)\\s([0-9a-z]+)\\s(\\w)\\s(.+)");
-        QTextStream in(&symbolMapFile);
-        while (!in.atEnd()) {
-            QString line = in.readLine();
-            if (recordRx.indexIn(line) < 0)
-                continue;
-            SymbolRecord record;
-            record.name = recordRx.cap(4);
-            record.size = recordRx.cap(2).toUInt(nullptr, 16);
-            record.addr = recordRx.cap(1).toULong(nullptr, 16);
-            sortedRecords.push_back(record);
-        }
-        symbolMapFile.close();
-    }
-
-    progressDialog_->setValue(2);
-    progressDialog_->setLabelText(QString("Loaded %1 symbols, translating ....").arg(sortedRecords.size()));
     QCoreApplication::instance()->sendPostedEvents();
 
-    if (sortedRecords.size() > 0) {
-        // TimerProfiler profile("Translate Symbol");
-        auto& addrMap = it.value();
-        auto addrMapIt = addrMap.begin();
-        for (; addrMapIt != addrMap.end(); ++addrMapIt) {
-            if (addrMapIt.value().size() != 0)
-                continue;
-            auto addr = addrMapIt.key();
-            int left = 0;
-            int right = sortedRecords.size() - 1;
-            while (left != right) {
-                auto mid = static_cast<int>(std::ceil(static_cast<float>(left + right) / 2));
-                auto& midRecord = sortedRecords[mid];
-                if (addr >= midRecord.addr && addr <= midRecord.addr + midRecord.size) {
-                    addrMap[addrMapIt.key()] = midRecord.name;
-                    break;
-                } else if (midRecord.addr + midRecord.size > addr) {
-                    right = mid - 1;
-                } else {
-                    left = mid;
-                }
-            }
-        }
+    auto libraries = ElfSymbolizer::TranslateLibraries(symbloPaths, symbloMap_);
+    QStringList errors;
+    int translated = 0;
+    for (const auto& library : libraries) {
+        if (!library.error_.isEmpty())
+            errors << library.error_;
+        else if (library.symbolCount_ == 0)
+            Print(QString("Symbols not found in %1, make sure this so has symbols!").arg(library.name_));
+        translated += library.translated_;
+    }
+    if (translated > 0) {
         auto selectedIndexes = ui->stackTableView->selectionModel()->selection().indexes();
         if (selectedIndexes.size() > 0)
             ShowCallStack(selectedIndexes.front());
-    } else {
-        Print("Symbols not found, make sure this so has symbols!");
     }
 
-    progressDialog_->setValue(3);
+    progressDialog_->setValue(1);
     progressDialog_->hide();
+    if (!errors.isEmpty())
+        QMessageBox::warning(this, "Warning", errors.join('\n'));
     Print(QString("Symbols loaded in %1 seconds.").arg(timer.elapsed() / 1000));
 }
 
@@ -2222,11 +2275,16 @@ void MainWindow::on_allocComboBox_currentIndexChanged(int) {
 }
 
 void MainWindow::on_actionExport_To_Text_triggered() {
-    QString fileName = QFileDialog::getSaveFileName(nullptr, tr("Save Text File"),
-                                                    GetLastOpenDir(), tr("Text files (*.txt)"));
+    QString selectedFilter;
+    QString fileName = QFileDialog::getSaveFileName(nullptr, tr("Save Text File"), GetLastOpenDir(),
+                                                    tr("Text files (*.txt);;Compressed text files (*.txt.gz)"),
+                                                    &selectedFilter);
     if (fileName.isEmpty())
         return;
-    if (!fileName.endsWith("txt", Qt::CaseInsensitive))
+    bool compressed = fileName.endsWith(".gz", Qt::CaseInsensitive) || selectedFilter.contains("*.txt.gz");
+    if (compressed && !fileName.endsWith(".gz", Qt::CaseInsensitive))
+        fileName += fileName.endsWith("txt", Qt::CaseInsensitive) ? ".gz" : ".txt.gz";
+    else if (!compressed && !fileName.endsWith("txt", Qt::CaseInsensitive))
         fileName += ".txt";
     QTemporaryFile tempFile;
     if (!tempFile.open()) {
@@ -2235,7 +2293,10 @@ void MainWindow::on_actionExport_To_Text_triggered() {
     }
     bool optimal = QMessageBox::information(this, "Export Option", "Export smaller text file?",
         QMessageBox::StandardButton::Yes | QMessageBox::StandardButton::No) == QMessageBox::StandardButton::Yes;
-    ExportToText(&tempFile, optimal);
+    if (!ExportToText(&tempFile, optimal, compressed)) {
+        QMessageBox::warning(this, "Warning", "Error writing file!", QMessageBox::StandardButton::Ok);
+        return;
+    }
     if (QFileInfo::exists(fileName) && !QFile(fileName).remove()) {
         QMessageBox::warning(this, "Warning", "Error removing file!", QMessageBox::StandardButton::Ok);
         return;
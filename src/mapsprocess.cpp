@@ -0,0 +1,67 @@
+#include "mapsprocess.h"
+#include "hashstring.h"
+#include <QRegularExpression>
+
+#include <algorithm>
+
+MapsProcess::MapsProcess(QObject* parent)
+    : AdbProcess(parent) {
+}
+
+void MapsProcess::DumpMapsAsync(const QString& appName, const QString& appPid, bool rootDevice) {
+    QStringList arguments;
+    // Inject device serial if set
+    if (!deviceSerial_.isEmpty()) {
+        arguments << "-s" << deviceSerial_;
+    }
+    if (rootDevice) {
+        arguments << "shell" << "su" << "-c" << "\"cat" << "/proc/" + appPid + "/maps\"";
+    } else {
+        arguments << "shell" << "run-as" << appName << "cat" << "/proc/" + appPid + "/maps";
+    }
+    ExecuteAsync(arguments);
+}
+
+quint32 MapsProcess::FindLibrary(quint64 addr) const {
+    auto it = std::upper_bound(ranges_.begin(), ranges_.end(), addr, [](quint64 value, const LibraryRange& range) {
+        return value < range.start_;
+    });
+    if (it == ranges_.begin() || addr >= (--it)->end_)
+        return 0;
+    return it->library_;
+}
+
+void MapsProcess::OnProcessFinihed() {
+    QString retStr = process_->readAll();
+    process_->close();
+
+    // start-end perms offset dev inode path, only code of libraries is kept
+    QVector<LibraryRange> ranges;
+    auto lines = retStr.split('\n', Qt::SkipEmptyParts);
+    for (const auto& line : lines) {
+        auto list = line.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
+        if (list.size() < 6 || !list[1].contains('x'))
+            continue;
+        auto path = list.mid(5).join(' ');
+        if (!path.endsWith(".so"))
+            continue;
+        auto addrs = list[0].split('-');
+        if (addrs.size() != 2)
+            continue;
+        bool startOk, endOk;
+        auto start = addrs[0].toULongLong(&startOk, 16);
+        auto end = addrs[1].toULongLong(&endOk, 16);
+        if (!startOk || !endOk || end <= start)
+            continue;
+        // named like the libraries of the smaps dump
+        auto slashIndex = path.lastIndexOf('/');
+        auto library = HashString(slashIndex > 0 ? path.mid(slashIndex + 1) : path);
+        ranges.push_back({start, end, library.hashcode_});
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const LibraryRange& a, const LibraryRange& b) {
+        return a.start_ < b.start_;
+    });
+    // a failed read keeps the ranges of the last one
+    if (!ranges.isEmpty())
+        ranges_.swap(ranges);
+}
@@ -1,16 +1,33 @@
 #include "profilecomparator.h"
 #include "stacktracemodel.h"
 #include "smaps/smapssection.h"
+#include "lolifile.h"
+#include "leakdiff.h"
+#include "leaktrend.h"
+#include "textwriter.h"
 #include <QFile>
 #include <QDataStream>
-#include <QTextStream>
 #include <QDebug>
 #include <QPointF>
+#include <QtConcurrent>
 #include <functional>
 #include <algorithm>
+#include <random>
 
 #define APP_MAGIC 0xA4B3C2D1
-#define APP_VERSION 106
+// QDataStream files before the section container of LoliFile::VERSION,
+// records referenced their callstack by uuid in APP_VERSION_UUID
+#define APP_VERSION_STREAM 107
+#define APP_VERSION_UUID 106
+// shape of GenerateProfile's profiles: records per callstack, libraries,
+// functions per library at every depth and the deepest callstack
+#define SYNTHETIC_STACK_RECORDS 16
+#define SYNTHETIC_LIBRARIES 8
+#define SYNTHETIC_FUNCTIONS 64
+#define SYNTHETIC_MAX_DEPTH 32
+// profiles CompareTrend reads at a time, the readers decode their sections
+// in parallel already so a couple keep the workers busy
+#define TREND_LOAD_WINDOW 2
 
 ProfileComparator::ProfileComparator()
     : baselineLoaded_(false)
@@ -35,6 +52,12 @@ bool ProfileComparator::LoadProfile(const QString& filePath, bool isBaseline)
             .arg(filePath);
         return false;
     }
+
+    // Update global HashString map (needed for HashString::Get() to work),
+    // the loaders leave it alone so profiles can be read on worker threads
+    for (auto it = data.stringHashMap.begin(); it != data.stringHashMap.end(); ++it) {
+        HashString::hashmap_[it.key()] = it.value();
+    }
     
     if (isBaseline) {
         baselineLoaded_ = true;
@@ -46,8 +69,72 @@ bool ProfileComparator::LoadProfile(const QString& filePath, bool isBaseline)
     return true;
 }
 
+void ProfileComparator::GenerateProfile(int recordCount, bool isBaseline)
+{
+    ProfileData& data = isBaseline ? baselineData_ : comparisonData_;
+    data = ProfileData();
+
+    QVector<HashString> libraries;
+    for (int i = 0; i < SYNTHETIC_LIBRARIES; i++) {
+        auto name = QString("libsynthetic%1.so").arg(i);
+        libraries.push_back(HashString(name));
+        data.stringHashMap.insert(libraries.back().hashcode_, name);
+        // every 16th function has no symbol, like frames of stripped libraries
+        auto& symbols = data.symbolMap[name];
+        for (int j = 0; j < SYNTHETIC_FUNCTIONS * SYNTHETIC_MAX_DEPTH; j++) {
+            if (j % 16 != 15)
+                symbols.insert(0x1000 + j * 16, QString("synthetic_%1_%2()").arg(i).arg(j));
+        }
+    }
+
+    // callstacks are seeded by their index so both profiles share them, every
+    // 8th one of the comparison is new. Functions are picked per depth, the
+    // callstacks branch out like the ones of a real capture.
+    auto stackCount = qMax(recordCount / SYNTHETIC_STACK_RECORDS, 1);
+    data.callStacks.Reserve(stackCount + 1);
+    QVector<quint32> stacks(stackCount);
+    CallStack callStack;
+    for (int i = 0; i < stackCount; i++) {
+        std::mt19937 random(static_cast<quint32>(isBaseline || i % 8 != 0 ? i : i + stackCount));
+        auto depth = 4 + static_cast<int>(random() % (SYNTHETIC_MAX_DEPTH - 4));
+        callStack.resize(depth);
+        for (int j = 0; j < depth; j++) {
+            auto function = j * SYNTHETIC_FUNCTIONS + static_cast<int>(random() % SYNTHETIC_FUNCTIONS);
+            callStack[depth - j - 1] = qMakePair(libraries[static_cast<int>(random() % SYNTHETIC_LIBRARIES)],
+                static_cast<quint64>(0x1000 + function * 16));
+        }
+        stacks[i] = data.callStacks.Intern(callStack);
+    }
+
+    std::mt19937 random(isBaseline ? 1 : 2);
+    data.stackRecords.resize(recordCount);
+    for (int i = 0; i < recordCount; i++) {
+        auto& record = data.stackRecords[i];
+        record.seq_ = static_cast<quint32>(i);
+        record.time_ = i / 1000;
+        record.size_ = 16 << (random() % 12);
+        record.stackIndex_ = stacks[static_cast<int>(random() % static_cast<quint32>(stackCount))];
+        record.addr_ = 0x70000000ull + static_cast<quint64>(i) * 16;
+        const auto& frame = data.callStacks.At(record.stackIndex_).front();
+        record.funcAddr_ = frame.second;
+        record.library_ = frame.first;
+    }
+
+    if (isBaseline) {
+        baselineLoaded_ = true;
+    } else {
+        comparisonLoaded_ = true;
+    }
+    compared_ = false;
+}
+
 bool ProfileComparator::LoadFromFile(const QString& filePath, ProfileData& data)
 {
+    LoliFileReader loliFile;
+    qint32 version = 0;
+    if (loliFile.Open(filePath, &version))
+        return LoadFromLoliFile(loliFile, filePath, data);
+    
     QFile file(filePath);
     if (!file.open(QIODevice::ReadOnly)) {
         errorMessage_ = QString("Cannot open file: %1").arg(filePath);
@@ -67,9 +154,13 @@ bool ProfileComparator::LoadFromFile(const QString& filePath, ProfileData& data)
     }
     
     stream >> version;
-    if (version != APP_VERSION) {
+    if (version == LoliFile::VERSION) {
+        errorMessage_ = QString("Corrupted file: %1").arg(filePath);
+        return false;
+    }
+    if (version != APP_VERSION_STREAM && version != APP_VERSION_UUID) {
         errorMessage_ = QString("Version mismatch in file: %1 (expected %2, got %3)")
-            .arg(filePath).arg(APP_VERSION).arg(version);
+            .arg(filePath).arg(LoliFile::VERSION).arg(version);
         return false;
     }
     
@@ -94,48 +185,38 @@ bool ProfileComparator::LoadFromFile(const QString& filePath, ProfileData& data)
     data.stringHashMap.clear();
     stream >> data.stringHashMap;
     
-    // Update global HashString map (needed for HashString::Get() to work)
-    for (auto it = data.stringHashMap.begin(); it != data.stringHashMap.end(); ++it) {
-        HashString::hashmap_[it.key()] = it.value();
-    }
-    
     // Read stack trace records
     qint32 recordCount;
     stream >> recordCount;
     data.stackRecords.clear();
     data.stackRecords.reserve(recordCount);
+    QVector<QString> uuids;
     
     for (int i = 0; i < recordCount; i++) {
         StackRecord record;
-        QString uuidStr;
-        stream >> uuidStr;
-        record.uuid_ = QUuid::fromString(uuidStr);
+        if (version == APP_VERSION_UUID) {
+            QString uuidStr;
+            stream >> uuidStr;
+            uuids.append(uuidStr);
+        }
         stream >> record.seq_;
         stream >> record.time_;
         stream >> record.size_;
         stream >> record.addr_;
         stream >> record.funcAddr_;
         stream >> record.library_.hashcode_;
+        if (version != APP_VERSION_UUID)
+            stream >> record.stackIndex_;
         data.stackRecords.append(record);
     }
     
-    // Read call stack map
-    data.callStackMap.clear();
-    qint32 callStackMapSize;
-    stream >> callStackMapSize;
-    for (int i = 0; i < callStackMapSize; i++) {
-        QString uuidStr;
-        qint32 stackSize;
-        stream >> uuidStr >> stackSize;
-        
-        QVector<QPair<HashString, quint64>> callstack;
-        callstack.reserve(stackSize);
-        for (int j = 0; j < stackSize; j++) {
-            QPair<HashString, quint64> pair;
-            stream >> pair.first.hashcode_ >> pair.second;
-            callstack.append(pair);
-        }
-        data.callStackMap.insert(QUuid::fromString(uuidStr), callstack);
+    // Read call stack table
+    if (version == APP_VERSION_UUID) {
+        auto indices = data.callStacks.ReadLegacy(stream);
+        for (int i = 0; i < data.stackRecords.size(); i++)
+            data.stackRecords[i].stackIndex_ = indices.value(uuids[i], 0);
+    } else {
+        data.callStacks.Read(stream);
     }
     
     // Read symbol map
@@ -211,118 +292,85 @@ bool ProfileComparator::LoadFromFile(const QString& filePath, ProfileData& data)
     return true;
 }
 
-QHash<uint, ProfileComparator::CallTreeNode*> ProfileComparator::BuildCallTreeWithHashMap(
-    const ProfileData& data, QVector<CallTreeNode*>& roots)
+bool ProfileComparator::LoadFromLoliFile(LoliFileReader& loliFile, const QString& filePath, ProfileData& data)
 {
-    // Build a tree structure matching MainWindow::GetMergedCallstacks logic
-    // This uses hash of callstack suffix for O(1) node lookup
-    QHash<uint, CallTreeNode*> nodeMap;
+    // Only the sections the call trees need, charts, screenshots and smaps stay on disk
+    data.memInfoSeries.clear();
+    data.screenshots.clear();
+    data.smapsSections.clear();
     
-    for (const auto& record : data.stackRecords) {
-        // Get the call stack for this record
-        auto stackIt = data.callStackMap.find(record.uuid_);
-        if (stackIt == data.callStackMap.end()) {
-            continue;
-        }
-        
-        const auto& callStack = stackIt.value();
-        
-        // Skip if call stack is too short after skipRootLevels_
-        if (callStack.size() <= skipRootLevels_) {
-            continue;
-        }
-        
-        // Build list of function names and metadata, skipping root levels
-        // Call stacks are stored leaf-first (index 0 = allocation site, last index = root)
-        // We iterate from 0 to (size - skipRootLevels_) to match MainWindow::GetMergedCallstacks
-        QStringList callstackNames;
-        QVector<QPair<QString, quint64>> callstackMetadata;  // Store library + address for each frame
-        int endIndex = callStack.size() - skipRootLevels_;
-        for (int i = 0; i < endIndex; ++i) {
-            const auto& frame = callStack[i];
-            QString libraryName = frame.first.Get();
-            quint64 funcAddr = frame.second;
-
-            // Resolve function name from symbol map
-            QString funcName;
-            auto libIt = data.symbolMap.find(libraryName);
-            if (libIt != data.symbolMap.end()) {
-                auto symIt = libIt.value().find(funcAddr);
-                if (symIt != libIt.value().end()) {
-                    funcName = symIt.value();
-                } else {
-                    funcName = QString("%1!0x%2").arg(libraryName).arg(funcAddr, 0, 16);
-                }
-            } else {
-                funcName = QString("%1!0x%2").arg(libraryName).arg(funcAddr, 0, 16);
+    data.stringHashMap.clear();
+    bool loaded = loliFile.ReadBlob(LoliFile::Section::STRINGS, [&data](QDataStream& stream) {
+        stream >> data.stringHashMap;
+    });
+    
+    data.stackRecords.clear();
+    loaded = loaded && loliFile.ReadRecords(data.stackRecords);
+    loaded = loaded && loliFile.ReadStacks(data.callStacks);
+    
+    data.symbolMap.clear();
+    loaded = loaded && loliFile.ReadBlob(LoliFile::Section::SYMBOLS, [&data](QDataStream& stream) {
+        qint32 symbolMapSize;
+        stream >> symbolMapSize;
+        for (int i = 0; i < symbolMapSize; i++) {
+            QString libraryName;
+            stream >> libraryName;
+            qint32 symbolCount;
+            stream >> symbolCount;
+            
+            QHash<quint64, QString>& symbols = data.symbolMap[libraryName];
+            for (int j = 0; j < symbolCount; j++) {
+                quint64 addr;
+                QString funcName;
+                stream >> addr >> funcName;
+                symbols[addr] = funcName;
             }
-
-            callstackNames << funcName;
-            callstackMetadata.append(qMakePair(libraryName, funcAddr));
         }
+    });
+    
+    loaded = loaded && loliFile.ReadFrees(data.freeAddrMap);
+    if (!loaded) {
+        errorMessage_ = QString("Corrupted file: %1").arg(filePath);
+    }
+    return loaded;
+}
 
-        // Now build the tree using hash-based merging (same as MainWindow::GetMergedCallstacks)
-        CallTreeNode* child = nullptr;
-        for (int idx = 0; idx < callstackNames.size(); ++idx) {
-            // Hash of the suffix from current position to end - this uniquely identifies a path
-            auto it = callstackNames.begin() + idx;
-            auto curHash = qHashRange(it, callstackNames.end());
-            auto itemIt = nodeMap.find(curHash);
-            CallTreeNode* node = nullptr;
-
-            if (itemIt != nodeMap.end()) {
-                // Node exists - update size/count for entire parent chain
-                node = itemIt.value();
-                CallTreeNode* parent = node;
-                while (parent != nullptr) {
-                    parent->size += record.size_;
-                    parent->count += 1;
-                    parent = parent->parent;
-                }
-
-                // Attach child if we created one
-                if (child != nullptr) {
-                    node->children.append(child);
-                    child->parent = node;
-                }
-                break;  // Stop - rest of the chain already exists
-            }
-
-            // Create new node
-            node = new CallTreeNode();
-            node->functionName = callstackNames[idx];
-            node->libraryName = callstackMetadata[idx].first;
-            node->functionAddress = callstackMetadata[idx].second;
-            node->size = record.size_;
-            node->count = 1;
-            node->parent = nullptr;
-            nodeMap.insert(curHash, node);
-            
-            // Attach child
-            if (child != nullptr) {
-                node->children.append(child);
-                child->parent = node;
-            }
-            
-            child = node;
+QString ProfileComparator::ResolveFrame(const ProfileData& data, const HashString& library, quint64 funcAddr)
+{
+    // Resolve function name from symbol map, empty if there is none
+    auto libIt = data.symbolMap.find(library.Get());
+    if (libIt != data.symbolMap.end()) {
+        auto symIt = libIt.value().find(funcAddr);
+        if (symIt != libIt.value().end()) {
+            return symIt.value();
         }
-        
-        // Add to roots if this is a top-level node
-        if (child != nullptr && child->parent == nullptr) {
-            bool alreadyInRoots = false;
-            for (CallTreeNode* root : roots) {
-                if (root == child) {
-                    alreadyInRoots = true;
-                    break;
-                }
-            }
-            if (!alreadyInRoots) {
-                roots.append(child);
-            }
+    }
+    return QString();
+}
+
+void ProfileComparator::BuildCallTree(const CallTreeBuilder& builder,
+    const QVector<CallTreeBuilder::Node>& treeNodes, QVector<CallTreeNode*>& roots)
+{
+    QVector<CallTreeNode*> nodes(treeNodes.size());
+    for (int i = 0; i < treeNodes.size(); ++i) {
+        const auto& treeNode = treeNodes[i];
+        const auto& frame = builder.Frame(treeNode);
+        auto node = new CallTreeNode();
+        node->functionName = builder.Name(treeNode);
+        node->libraryName = frame.first.Get();
+        node->functionAddress = frame.second;
+        node->size = static_cast<qint64>(treeNode.size_);
+        node->count = static_cast<qint64>(treeNode.count_);
+
+        // Parents are created before their children
+        if (treeNode.parent_ == CallTreeBuilder::NONE) {
+            roots.append(node);
+        } else {
+            node->parent = nodes[static_cast<int>(treeNode.parent_)];
+            node->parent->children.append(node);
         }
+        nodes[i] = node;
     }
-    
-    return nodeMap;
 }
 
 bool ProfileComparator::Compare(int skipRootLevels)
@@ -332,7 +380,7 @@ bool ProfileComparator::Compare(int skipRootLevels)
         return false;
     }
     
-    // Save skipRootLevels for use in BuildCallTreeWithHashMap
+    // Save skipRootLevels for use when building the call tree
     skipRootLevels_ = skipRootLevels;
     
     // Clean up previous delta tree
@@ -344,121 +392,36 @@ bool ProfileComparator::Compare(int skipRootLevels)
     stats_.baselineAllocCount = baselineData_.stackRecords.size();
     stats_.comparisonAllocCount = comparisonData_.stackRecords.size();
     
+    // Both profiles are merged into one tree, baseline records are counted apart
+    CallTreeBuilder builder(comparisonData_.callStacks, baselineData_.callStacks);
     for (const auto& record : baselineData_.stackRecords) {
         stats_.baselineTotalSize += record.size_;
+        builder.AddBaseline(record);
     }
     
     for (const auto& record : comparisonData_.stackRecords) {
         stats_.comparisonTotalSize += record.size_;
+        builder.Add(record);
     }
     
     stats_.sizeDelta = static_cast<qint64>(stats_.comparisonTotalSize) - 
                        static_cast<qint64>(stats_.baselineTotalSize);
     
-    // Build call trees with hash maps (efficient O(1) lookup by hash)
-    QVector<CallTreeNode*> baselineRoots;
-    QVector<CallTreeNode*> comparisonRoots;
-    
-    auto baselineHashmap = BuildCallTreeWithHashMap(baselineData_, baselineRoots);
-    auto comparisonHashmap = BuildCallTreeWithHashMap(comparisonData_, comparisonRoots);
-    
-    // Size limiter - ignore small differences (1 KiB)
-    quint64 sizeLimiter = 1024;
-
-    // Collect leaf nodes for delta calculation
-    QList<CallTreeNode*> leafItems;
-
-    // Counter for new allocations
-    int newAllocationsCounter = 0;
-
-    // Diff leaf nodes only (matching MainWindow::on_actionShow_Leaks_triggered logic)
-    for (auto it = comparisonHashmap.begin(); it != comparisonHashmap.end(); ++it) {
-        auto key = it.key();
-        auto compNode = it.value();
-        auto baselineIt = baselineHashmap.find(key);
-
-        // Skip non-leaf nodes
-        if (compNode->children.size() != 0) {
-            compNode->size = 0;
-            compNode->count = 0;
-            continue;
-        }
-
-        leafItems.append(compNode);
-
-        if (baselineIt == baselineHashmap.end()) {
-            // NEW ALLOCATION - exists in comparison only
-            // Full size/count is the delta (was 0 in baseline)
-            if (compNode->size < static_cast<qint64>(sizeLimiter)) {
-                compNode->size = 0;
-                compNode->count = 0;
-            } else {
-                // Keep original values as delta, count as new allocation
-                newAllocationsCounter++;
-            }
-        } else {
-            // EXISTING ALLOCATION - calculate delta
-            auto baseNode = baselineIt.value();
-            qint64 newSize = compNode->size - baseNode->size;
-            qint64 newCount = compNode->count - baseNode->count;
-
-            // Filter small differences
-            if (newSize < static_cast<qint64>(sizeLimiter) || newCount <= 0) {
-                compNode->size = 0;
-                compNode->count = 0;
-            } else {
-                compNode->size = newSize;
-                compNode->count = newCount;
-            }
-        }
-    }
-    
-    // Release baseline tree - no longer needed
-    qDeleteAll(baselineRoots);
-    baselineRoots.clear();
-    baselineHashmap.clear();
-    
-    // Recalculate parent size & count from leaf nodes (bottom-up propagation)
-    // First, reset all non-leaf nodes to zero
-    for (auto it = comparisonHashmap.begin(); it != comparisonHashmap.end(); ++it) {
-        auto node = it.value();
-        if (node->children.size() > 0) {
-            node->size = 0;
-            node->count = 0;
-        }
-    }
-    
-    // Then propagate leaf values up to parents
-    for (auto leaf : leafItems) {
-        auto parent = leaf->parent;
-        while (parent != nullptr) {
-            parent->size += leaf->size;
-            parent->count += leaf->count;
-            parent = parent->parent;
-        }
-    }
-    leafItems.clear();
+    // Frames of either profile, comparison symbols take precedence
+    builder.Build([this](const HashString& library, quint64 funcAddr) {
+        auto name = ResolveFrame(comparisonData_, library, funcAddr);
+        if (name.isEmpty())
+            name = ResolveFrame(baselineData_, library, funcAddr);
+        if (name.isEmpty())
+            name = QString("%1!0x%2").arg(library.Get()).arg(funcAddr, 0, 16);
+        return name;
+    }, skipRootLevels_);
     
-    // Count statistics and remove zero-count nodes
-    stats_.changedAllocations = 0;
-    stats_.newAllocationsCount = newAllocationsCounter;
-
-    for (auto node : comparisonHashmap) {
-        if (node->count > 0) {
-            stats_.changedAllocations++;
-        } else {
-            // Remove from parent's children list
-            if (node->parent) {
-                node->parent->children.removeOne(node);
-            } else {
-                comparisonRoots.removeOne(node);
-            }
-        }
-    }
-    comparisonHashmap.clear();
-
-    // Store delta roots for export (transfer ownership)
-    deltaRoots_ = comparisonRoots;
+    // Same diff as MainWindow::on_actionShow_Leaks_triggered, ignores growth under 1 KiB
+    LeakDiff diff(builder, 1024);
+    stats_.changedAllocations = diff.GrownCount();
+    stats_.newAllocationsCount = diff.NewCount();
+    BuildCallTree(builder, diff.Nodes(), deltaRoots_);
 
     compared_ = true;
     return true;
@@ -471,46 +434,193 @@ bool ProfileComparator::DumpProfile(int skipRootLevels)
         return false;
     }
 
-    // Save skipRootLevels for use in BuildCallTreeWithHashMap
+    // Save skipRootLevels for use when building the call tree
     skipRootLevels_ = skipRootLevels;
 
     // Clean up previous delta tree
     qDeleteAll(deltaRoots_);
     deltaRoots_.clear();
 
+    // Calculate statistics from live allocations
+    stats_ = ComparisonStats();
+    stats_.baselineAllocCount = 0;
+    stats_.comparisonAllocCount = 0;
+    stats_.baselineTotalSize = 0;
+    stats_.comparisonTotalSize = 0;
+    stats_.sizeDelta = 0;
+    stats_.changedAllocations = 0;
+    stats_.newAllocationsCount = 0;
+
     // Filter out freed allocations to show only live memory
     // This matches GUI behavior which filters via freeAddrMap_
-    ProfileData filteredData;
-    filteredData.callStackMap = baselineData_.callStackMap;
-    filteredData.symbolMap = baselineData_.symbolMap;
-    filteredData.stringHashMap = baselineData_.stringHashMap;
-
+    CallTreeBuilder builder(baselineData_.callStacks);
     for (const auto& record : baselineData_.stackRecords) {
         auto it = baselineData_.freeAddrMap.find(record.addr_);
         if (it != baselineData_.freeAddrMap.end() && record.seq_ < it.value()) {
             continue;  // This allocation was freed later, skip it
         }
-        filteredData.stackRecords.append(record);
+        stats_.baselineAllocCount++;
+        stats_.baselineTotalSize += record.size_;
+        builder.Add(record);
+    }
+
+    // Build call tree from live allocations
+    builder.Build([this](const HashString& library, quint64 funcAddr) {
+        auto name = ResolveFrame(baselineData_, library, funcAddr);
+        if (name.isEmpty())
+            name = QString("%1!0x%2").arg(library.Get()).arg(funcAddr, 0, 16);
+        return name;
+    }, skipRootLevels_);
+    BuildCallTree(builder, builder.Nodes(), deltaRoots_);
+
+    compared_ = true;
+    return true;
+}
+
+bool ProfileComparator::CompareTrend(const QStringList& filePaths, int skipRootLevels)
+{
+    if (filePaths.size() < 2) {
+        errorMessage_ = "A trend needs at least two profiles";
+        return false;
     }
 
-    // Calculate statistics from filtered (live) allocations
+    // Save skipRootLevels for use when building the call tree
+    skipRootLevels_ = skipRootLevels;
+
+    // Clean up previous delta tree and trend
+    qDeleteAll(deltaRoots_);
+    deltaRoots_.clear();
+    trendData_ = ProfileData();
+    trendSnapshots_.clear();
+    trendCallsites_.clear();
     stats_ = ComparisonStats();
-    stats_.baselineAllocCount = filteredData.stackRecords.size();
-    stats_.comparisonAllocCount = 0;
-    stats_.baselineTotalSize = 0;
-    stats_.comparisonTotalSize = 0;
-    stats_.sizeDelta = 0;
-    stats_.changedAllocations = 0;
-    stats_.newAllocationsCount = 0;
 
-    for (const auto& record : filteredData.stackRecords) {
-        stats_.baselineTotalSize += record.size_;
+    // Profiles are read on worker threads, a window of them at a time. They
+    // are merged in capture order and dropped right away, memory follows the
+    // unique callstacks rather than the records of all profiles.
+    int profileCount = filePaths.size();
+    int window = TREND_LOAD_WINDOW;
+    QVector<ProfileData> profiles(profileCount);
+    QVector<QFuture<bool>> loads(profileCount);
+    auto startLoad = [&filePaths, &profiles, &loads](int index) {
+        auto filePath = filePaths[index];
+        auto data = &profiles[index];
+        loads[index] = QtConcurrent::run([filePath, data]() {
+            ProfileComparator loader;
+            return loader.LoadFromFile(filePath, *data);
+        });
+    };
+    for (int i = 0; i < qMin(window, profileCount); i++) {
+        startLoad(i);
+    }
+
+    // Size and count of the live allocations of every merged callstack, per profile
+    QVector<QVector<quint64>> sizes(profileCount);
+    QVector<QVector<quint64>> counts(profileCount);
+    bool loaded = true;
+    for (int i = 0; i < profileCount; i++) {
+        if (!loads[i].result()) {
+            errorMessage_ = QString("Failed to load profile %1: %2").arg(i + 1).arg(filePaths[i]);
+            loaded = false;
+            break;
+        }
+        if (i + window < profileCount) {
+            startLoad(i + window);
+        }
+
+        ProfileData& data = profiles[i];
+        for (auto it = data.stringHashMap.begin(); it != data.stringHashMap.end(); ++it) {
+            HashString::hashmap_[it.key()] = it.value();
+            trendData_.stringHashMap.insert(it.key(), it.value());
+        }
+        // Symbols of earlier profiles take precedence
+        for (auto it = data.symbolMap.begin(); it != data.symbolMap.end(); ++it) {
+            auto& symbols = trendData_.symbolMap[it.key()];
+            for (auto symIt = it.value().begin(); symIt != it.value().end(); ++symIt) {
+                if (!symbols.contains(symIt.key())) {
+                    symbols.insert(symIt.key(), symIt.value());
+                }
+            }
+        }
+
+        // Live allocations only, like DumpProfile
+        TrendSnapshot snapshot = { filePaths[i], 0, 0 };
+        QVector<quint64> stackSizes(data.callStacks.Size(), 0);
+        QVector<quint64> stackCounts(data.callStacks.Size(), 0);
+        for (const auto& record : data.stackRecords) {
+            auto it = data.freeAddrMap.find(record.addr_);
+            if (it != data.freeAddrMap.end() && record.seq_ < it.value()) {
+                continue;
+            }
+            snapshot.allocCount++;
+            snapshot.totalSize += record.size_;
+            if (record.stackIndex_ < static_cast<quint32>(stackSizes.size())) {
+                stackSizes[static_cast<int>(record.stackIndex_)] += static_cast<quint64>(record.size_);
+                stackCounts[static_cast<int>(record.stackIndex_)]++;
+            }
+        }
+        trendSnapshots_.push_back(snapshot);
+
+        // Callstacks of the profile in the merged table
+        QVector<quint32> merged(stackCounts.size(), 0);
+        for (int j = 0; j < stackCounts.size(); j++) {
+            if (stackCounts[j] > 0) {
+                merged[j] = trendData_.callStacks.Intern(data.callStacks.At(static_cast<quint32>(j)));
+            }
+        }
+        sizes[i].fill(0, trendData_.callStacks.Size());
+        counts[i].fill(0, trendData_.callStacks.Size());
+        for (int j = 0; j < stackCounts.size(); j++) {
+            if (stackCounts[j] > 0) {
+                sizes[i][static_cast<int>(merged[j])] += stackSizes[j];
+                counts[i][static_cast<int>(merged[j])] += stackCounts[j];
+            }
+        }
+
+        data = ProfileData();
+    }
+    // Workers write into profiles, none may be left running
+    for (auto& load : loads) {
+        load.waitForFinished();
+    }
+    if (!loaded) {
+        return false;
+    }
+
+    // One tree over the callstacks of all profiles, LeakTrend follows the
+    // allocations of its nodes from profile to profile
+    CallTreeBuilder builder(trendData_.callStacks);
+    for (int i = 0; i < profileCount; i++) {
+        for (int j = 0; j < counts[i].size(); j++) {
+            builder.Add(static_cast<quint32>(j), sizes[i][j], counts[i][j]);
+        }
     }
+    builder.Build([this](const HashString& library, quint64 funcAddr) {
+        auto name = ResolveFrame(trendData_, library, funcAddr);
+        if (name.isEmpty())
+            name = QString("%1!0x%2").arg(library.Get()).arg(funcAddr, 0, 16);
+        return name;
+    }, skipRootLevels_);
+
+    // Same size limit as Compare, growth under 1 KiB is ignored
+    LeakTrend trend(builder, sizes, counts, 1024);
+    for (const auto& callsite : trend.Callsites()) {
+        TrendCallsite trendCallsite;
+        trendCallsite.functionName = builder.Name(trend.Nodes()[static_cast<int>(callsite.node_)]);
+        trendCallsite.slope = callsite.slope_;
+        trendCallsite.sizes = callsite.sizes_;
+        trendCallsites_.push_back(trendCallsite);
+    }
+    BuildCallTree(builder, trend.Nodes(), deltaRoots_);
 
-    // Build call tree from filtered profile
-    // Return value intentionally discarded - nodeMap is only needed during construction.
-    // Node ownership is managed through root -> children hierarchy.
-    BuildCallTreeWithHashMap(filteredData, deltaRoots_);
+    stats_.baselineAllocCount = trendSnapshots_.first().allocCount;
+    stats_.baselineTotalSize = trendSnapshots_.first().totalSize;
+    stats_.comparisonAllocCount = trendSnapshots_.last().allocCount;
+    stats_.comparisonTotalSize = trendSnapshots_.last().totalSize;
+    stats_.sizeDelta = static_cast<qint64>(stats_.comparisonTotalSize) -
+                       static_cast<qint64>(stats_.baselineTotalSize);
+    stats_.changedAllocations = trend.Callsites().size();
+    stats_.newAllocationsCount = trend.NewCount();
 
     compared_ = true;
     return true;
@@ -523,14 +633,19 @@ bool ProfileComparator::ExportDumpToText(const QString& outputPath)
         return false;
     }
 
+    // Gzip output when asked for by the extension
     QFile file(outputPath);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+    bool compressed = outputPath.endsWith(".gz", Qt::CaseInsensitive);
+    QIODevice::OpenMode mode = QIODevice::WriteOnly;
+    if (!compressed) {
+        mode |= QIODevice::Text;
+    }
+    if (!file.open(mode)) {
         errorMessage_ = QString("Cannot create output file: %1").arg(outputPath);
         return false;
     }
 
-    QTextStream stream(&file);
-    stream.setCodec("UTF-8");
+    TextWriter stream(&file, compressed);
 
     // Write header
     stream << "=== LoliProfiler Profile Report ===" << "\n\n";
@@ -539,18 +654,13 @@ bool ProfileComparator::ExportDumpToText(const QString& outputPath)
 
     stream << "=== Memory Allocations ===" << "\n\n";
 
-    // Sort root nodes by size (descending order) before writing
-    QVector<CallTreeNode*> sortedRoots = deltaRoots_;
-    std::sort(sortedRoots.begin(), sortedRoots.end(),
-        [](CallTreeNode* a, CallTreeNode* b) {
-            return a->size > b->size;  // Descending order (largest first)
-        });
-
     // Write sorted call tree with absolute values
-    for (CallTreeNode* root : sortedRoots) {
-        WriteCallTreeToTextAbsolute(stream, root, 0);
-    }
+    WriteCallTree(stream, deltaRoots_, false);
 
+    if (!stream.Finish()) {
+        errorMessage_ = QString("Failed to write output file: %1").arg(outputPath);
+        return false;
+    }
     file.close();
     return true;
 }
@@ -562,15 +672,20 @@ bool ProfileComparator::ExportToText(const QString& outputPath)
         return false;
     }
     
+    // Gzip output when asked for by the extension
     QFile file(outputPath);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+    bool compressed = outputPath.endsWith(".gz", Qt::CaseInsensitive);
+    QIODevice::OpenMode mode = QIODevice::WriteOnly;
+    if (!compressed) {
+        mode |= QIODevice::Text;
+    }
+    if (!file.open(mode)) {
         errorMessage_ = QString("Cannot create output file: %1").arg(outputPath);
         return false;
     }
-    
-    QTextStream stream(&file);
-    stream.setCodec("UTF-8");
-    
+
+    TextWriter stream(&file, compressed);
+
     // Write header
     stream << "=== LoliProfiler Comparison Report ===" << "\n\n";
     stream << "Baseline allocations: " << stats_.baselineAllocCount << "\n";
@@ -590,106 +705,152 @@ bool ProfileComparator::ExportToText(const QString& outputPath)
 
     stream << "=== Memory Growth (Delta: Comparison - Baseline) ===" << "\n\n";
 
-    // Sort root nodes by size (descending order) before writing
-    QVector<CallTreeNode*> sortedRoots = deltaRoots_;
-    std::sort(sortedRoots.begin(), sortedRoots.end(),
-        [](CallTreeNode* a, CallTreeNode* b) {
-            return a->size > b->size;  // Descending order (largest first)
-        });
-
     // Write sorted delta tree
-    for (CallTreeNode* root : sortedRoots) {
-        WriteCallTreeToText(stream, root, 0);
+    WriteCallTree(stream, deltaRoots_, true);
+
+    if (!stream.Finish()) {
+        errorMessage_ = QString("Failed to write output file: %1").arg(outputPath);
+        return false;
     }
-    
     file.close();
     return true;
 }
 
-void ProfileComparator::WriteCallTreeToText(QTextStream& stream, CallTreeNode* node, int depth)
+bool ProfileComparator::ExportTrendToText(const QString& outputPath)
 {
-    if (!node) return;
-
-    // Write indentation
-    for (int i = 0; i < depth; ++i) {
-        stream << "    ";  // 4 spaces for indentation
+    if (!compared_ || trendSnapshots_.isEmpty()) {
+        errorMessage_ = "Must call CompareTrend() before exporting";
+        return false;
     }
 
-    // Write function name
-    stream << node->functionName << ", ";
-
-    // Write size with +/- prefix for deltas
-    if (node->size > 0) {
-        stream << "+" << sizeToString(static_cast<quint64>(node->size));
-    } else if (node->size < 0) {
-        stream << "-" << sizeToString(static_cast<quint64>(-node->size));
-    } else {
-        stream << sizeToString(0);
+    // Gzip output when asked for by the extension
+    QFile file(outputPath);
+    bool compressed = outputPath.endsWith(".gz", Qt::CaseInsensitive);
+    QIODevice::OpenMode mode = QIODevice::WriteOnly;
+    if (!compressed) {
+        mode |= QIODevice::Text;
+    }
+    if (!file.open(mode)) {
+        errorMessage_ = QString("Cannot create output file: %1").arg(outputPath);
+        return false;
     }
 
-    stream << ", ";
+    TextWriter stream(&file, compressed);
 
-    // Write count with +/- prefix for deltas
-    if (node->count > 0) {
-        stream << "+" << node->count;
-    } else if (node->count < 0) {
-        stream << node->count;  // Already has negative sign
+    // Write header
+    stream << "=== LoliProfiler Trend Report ===" << "\n\n";
+    stream << "Profiles: " << trendSnapshots_.size() << "\n";
+    for (int i = 0; i < trendSnapshots_.size(); ++i) {
+        const auto& snapshot = trendSnapshots_[i];
+        stream << "  " << (i + 1) << ". " << snapshot.filePath << ", "
+               << sizeToString(snapshot.totalSize) << ", " << snapshot.allocCount << "\n";
+    }
+    stream << "Size delta (first to last): ";
+    if (stats_.sizeDelta >= 0) {
+        stream << "+" << sizeToString(static_cast<quint64>(stats_.sizeDelta));
     } else {
-        stream << "0";
+        stream << "-" << sizeToString(static_cast<quint64>(-stats_.sizeDelta));
     }
+    stream << "\n\n";
 
+    stream << "Growing call sites (never shrinking, >1KB growth): " << stats_.changedAllocations << "\n";
+    stream << "New call sites (not in first profile): " << stats_.newAllocationsCount << "\n\n";
+
+    // Steepest first, sizes of every profile in capture order
+    stream << "=== Growing Call Sites (by slope per profile) ===" << "\n\n";
+    for (const auto& callsite : trendCallsites_) {
+        stream << callsite.functionName << ", +"
+               << sizeToString(static_cast<quint64>(qMax(callsite.slope, 0.0))) << "/profile, ";
+        for (int i = 0; i < callsite.sizes.size(); ++i) {
+            if (i > 0) {
+                stream << " -> ";
+            }
+            stream << sizeToString(callsite.sizes[i]);
+        }
+        stream << "\n";
+    }
     stream << "\n";
 
-    // Sort children by size (descending order) before writing
-    QVector<CallTreeNode*> sortedChildren = node->children;
-    std::sort(sortedChildren.begin(), sortedChildren.end(),
-        [](CallTreeNode* a, CallTreeNode* b) {
-            return a->size > b->size;  // Descending order (largest first)
-        });
+    stream << "=== Memory Growth (Delta: Last - First) ===" << "\n\n";
 
-    // Recursively write sorted children
-    for (CallTreeNode* child : sortedChildren) {
-        WriteCallTreeToText(stream, child, depth + 1);
+    // Write sorted delta tree
+    WriteCallTree(stream, deltaRoots_, true);
+
+    if (!stream.Finish()) {
+        errorMessage_ = QString("Failed to write output file: %1").arg(outputPath);
+        return false;
     }
+    file.close();
+    return true;
 }
 
-void ProfileComparator::WriteCallTreeToTextAbsolute(QTextStream& stream, CallTreeNode* node, int depth)
+void ProfileComparator::WriteCallTree(TextWriter& stream, const QVector<CallTreeNode*>& roots, bool delta)
 {
-    if (!node) return;
+    // Largest first on every level
+    auto bySize = [](CallTreeNode* a, CallTreeNode* b) {
+        return a->size > b->size;
+    };
 
-    // Write indentation
-    for (int i = 0; i < depth; ++i) {
-        stream << "    ";  // 4 spaces for indentation
+    // Depth first with an explicit stack, deep callstacks can't overflow it
+    QVector<QPair<CallTreeNode*, int>> pending;
+    QVector<CallTreeNode*> sorted = roots;
+    std::sort(sorted.begin(), sorted.end(), bySize);
+    for (int i = sorted.size() - 1; i >= 0; --i) {
+        pending.push_back(qMakePair(sorted[i], 0));
     }
 
-    // Write function name, absolute size, absolute count (no +/- prefix)
-    stream << node->functionName << ", "
-           << sizeToString(static_cast<quint64>(node->size)) << ", "
-           << node->count << "\n";
+    while (!pending.isEmpty()) {
+        CallTreeNode* node = pending.last().first;
+        int depth = pending.last().second;
+        pending.pop_back();
+        if (!node) continue;
 
-    // Sort children by size (descending order) before writing
-    QVector<CallTreeNode*> sortedChildren = node->children;
-    std::sort(sortedChildren.begin(), sortedChildren.end(),
-        [](CallTreeNode* a, CallTreeNode* b) {
-            return a->size > b->size;  // Descending order (largest first)
-        });
+        // Write indentation
+        for (int i = 0; i < depth; ++i) {
+            stream << "    ";  // 4 spaces for indentation
+        }
+
+        // Write function name
+        stream << node->functionName << ", ";
+
+        if (delta) {
+            // Write size and count with +/- prefix for deltas
+            if (node->size > 0) {
+                stream << "+" << sizeToString(static_cast<quint64>(node->size));
+            } else if (node->size < 0) {
+                stream << "-" << sizeToString(static_cast<quint64>(-node->size));
+            } else {
+                stream << sizeToString(0);
+            }
+            stream << ", ";
+            if (node->count > 0) {
+                stream << "+";
+            }
+            stream << node->count << "\n";
+        } else {
+            // Absolute size and count (no +/- prefix)
+            stream << sizeToString(static_cast<quint64>(node->size)) << ", " << node->count << "\n";
+        }
 
-    // Recursively write sorted children
-    for (CallTreeNode* child : sortedChildren) {
-        WriteCallTreeToTextAbsolute(stream, child, depth + 1);
+        // Children in reverse, the largest is popped first
+        sorted = node->children;
+        std::sort(sorted.begin(), sorted.end(), bySize);
+        for (int i = sorted.size() - 1; i >= 0; --i) {
+            pending.push_back(qMakePair(sorted[i], depth + 1));
+        }
     }
 }
 
 void ProfileComparator::ConvertDeltaTreeToRecords(
     QVector<StackRecord>& stackRecords,
-    QHash<QUuid, QVector<QPair<HashString, quint64>>>& callStackMap)
+    CallStackTable& callStacks)
 {
     // Convert delta tree back to StackRecords format
     // Each leaf node in the delta tree becomes a StackRecord
     // We need to reconstruct the call stack path for each leaf
 
     stackRecords.clear();
-    callStackMap.clear();
+    callStacks.Clear();
 
     quint32 seqCounter = 0;
 
@@ -701,17 +862,21 @@ void ProfileComparator::ConvertDeltaTreeToRecords(
         // Add current node to path
         callStackPath.append(node);
 
-        // If this is a leaf node with non-zero delta, create a StackRecord
-        if (node->children.isEmpty() && (node->size != 0 || node->count != 0)) {
-            // Create UUID for this call stack
-            QUuid uuid = QUuid::createUuid();
+        // Delta of the node's own allocations, what its children don't account for
+        qint64 selfSize = node->size;
+        qint64 selfCount = node->count;
+        for (CallTreeNode* child : node->children) {
+            selfSize -= child->size;
+            selfCount -= child->count;
+        }
 
+        // If the node has a non-zero delta of its own, create a StackRecord
+        if (selfSize != 0 || selfCount != 0) {
             // Create StackRecord (we create one record to represent the delta)
             StackRecord record;
-            record.uuid_ = uuid;
             record.seq_ = seqCounter++;
             record.time_ = 0;  // Delta comparison doesn't have meaningful timestamp
-            record.size_ = static_cast<qint32>(node->size);
+            record.size_ = static_cast<qint32>(selfSize);
             record.addr_ = 0;  // Not meaningful in delta
             record.funcAddr_ = 0;  // Will be set per frame in callstack
             record.library_ = HashString();  // Will be set from top frame
@@ -752,8 +917,8 @@ void ProfileComparator::ConvertDeltaTreeToRecords(
             }
 
             // Store record and callstack
+            record.stackIndex_ = callStacks.Intern(callstack);
             stackRecords.append(record);
-            callStackMap.insert(uuid, callstack);
         }
 
         // Recurse to children
@@ -785,88 +950,81 @@ bool ProfileComparator::ExportToLoli(const QString& outputPath)
         return false;
     }
 
-    QDataStream stream(&file);
-    stream.setVersion(QDataStream::Qt_5_12);
-
-    // Write magic and version
-    stream << static_cast<quint32>(APP_MAGIC);
-    stream << static_cast<qint32>(APP_VERSION);
+    LoliFileWriter writer(&file);
 
     // Convert delta tree to records and callstack map
     QVector<StackRecord> stackRecords;
-    QHash<QUuid, QVector<QPair<HashString, quint64>>> callStackMap;
-    ConvertDeltaTreeToRecords(stackRecords, callStackMap);
+    CallStackTable callStacks;
+    ConvertDeltaTreeToRecords(stackRecords, callStacks);
 
     // Write meminfo (empty for delta comparison)
-    stream << static_cast<qint32>(0);  // maxMemInfoValue
-    stream << static_cast<qint32>(0);  // series count
+    writer.WriteBlob(LoliFile::Section::MEMINFO, [](QDataStream& stream) {
+        stream << static_cast<qint32>(0);  // maxMemInfoValue
+        stream << static_cast<qint32>(0);  // series count
+    });
 
     // Write string hashes
-    stream << HashString::hashmap_;
+    writer.WriteBlob(LoliFile::Section::STRINGS, [](QDataStream& stream) {
+        stream << HashString::hashmap_;
+    });
 
     // Write stack trace records
-    stream << static_cast<qint32>(stackRecords.size());
-    for (const auto& record : stackRecords) {
-        stream << record.uuid_.toString();
-        stream << record.seq_;
-        stream << record.time_;
-        stream << record.size_;
-        stream << record.addr_;
-        stream << record.funcAddr_;
-        stream << record.library_.hashcode_;
-    }
-
-    // Write callstack map
-    stream << static_cast<qint32>(callStackMap.size());
-    for (auto it = callStackMap.begin(); it != callStackMap.end(); ++it) {
-        stream << it.key().toString();
-        const auto& callstack = it.value();
-        stream << static_cast<qint32>(callstack.size());
-        for (const auto& frame : callstack) {
-            stream << frame.first.hashcode_ << frame.second;
-        }
-    }
+    writer.WriteRecords(stackRecords);
+
+    // Write callstack table
+    writer.WriteStacks(callStacks);
 
     // Write symbol map from comparison data (use merged symbol map from both profiles)
     QHash<QString, QHash<quint64, QString>> mergedSymbolMap = comparisonData_.symbolMap;
 
-    // Merge baseline symbols that aren't in comparison
-    for (auto it = baselineData_.symbolMap.begin(); it != baselineData_.symbolMap.end(); ++it) {
-        const QString& libraryName = it.key();
-        const auto& baselineSymbols = it.value();
+    // Merge baseline and trend symbols that aren't in comparison
+    for (const ProfileData* data : { &baselineData_, &trendData_ }) {
+        for (auto it = data->symbolMap.begin(); it != data->symbolMap.end(); ++it) {
+            const QString& libraryName = it.key();
+            const auto& symbols = it.value();
 
-        if (!mergedSymbolMap.contains(libraryName)) {
-            mergedSymbolMap[libraryName] = baselineSymbols;
-        } else {
-            // Merge symbols for this library
-            auto& targetSymbols = mergedSymbolMap[libraryName];
-            for (auto symIt = baselineSymbols.begin(); symIt != baselineSymbols.end(); ++symIt) {
-                if (!targetSymbols.contains(symIt.key())) {
-                    targetSymbols[symIt.key()] = symIt.value();
+            if (!mergedSymbolMap.contains(libraryName)) {
+                mergedSymbolMap[libraryName] = symbols;
+            } else {
+                // Merge symbols for this library
+                auto& targetSymbols = mergedSymbolMap[libraryName];
+                for (auto symIt = symbols.begin(); symIt != symbols.end(); ++symIt) {
+                    if (!targetSymbols.contains(symIt.key())) {
+                        targetSymbols[symIt.key()] = symIt.value();
+                    }
                 }
             }
         }
     }
 
-    stream << static_cast<qint32>(mergedSymbolMap.size());
-    for (auto it = mergedSymbolMap.begin(); it != mergedSymbolMap.end(); ++it) {
-        stream << it.key();
-        const auto& symbols = it.value();
-        stream << static_cast<qint32>(symbols.size());
-        for (auto symIt = symbols.begin(); symIt != symbols.end(); ++symIt) {
-            stream << symIt.key();
-            stream << symIt.value();
+    writer.WriteBlob(LoliFile::Section::SYMBOLS, [&mergedSymbolMap](QDataStream& stream) {
+        stream << static_cast<qint32>(mergedSymbolMap.size());
+        for (auto it = mergedSymbolMap.begin(); it != mergedSymbolMap.end(); ++it) {
+            stream << it.key();
+            const auto& symbols = it.value();
+            stream << static_cast<qint32>(symbols.size());
+            for (auto symIt = symbols.begin(); symIt != symbols.end(); ++symIt) {
+                stream << symIt.key();
+                stream << symIt.value();
+            }
         }
-    }
+    });
 
     // Write empty free address map
-    stream << static_cast<qint32>(0);
+    writer.WriteFrees(QHash<quint64, quint32>());
 
     // Write empty screenshots
-    stream << static_cast<qint32>(0);
+    writer.WriteScreenshots(QVector<QPair<int, QByteArray>>());
 
     // Write empty smaps sections
-    stream << static_cast<qint32>(0);
+    writer.WriteBlob(LoliFile::Section::SMAPS, [](QDataStream& stream) {
+        stream << static_cast<qint32>(0);
+    });
+
+    if (!writer.Finish()) {
+        errorMessage_ = QString("Failed to write output file: %1").arg(outputPath);
+        return false;
+    }
 
     file.close();
     return true;
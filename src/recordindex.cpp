@@ -0,0 +1,120 @@
+#include "recordindex.h"
+
+#include <QtAlgorithms>
+
+#include <algorithm>
+
+static void SetBit(QVector<quint64>& bitmap, quint32 row) {
+    bitmap[static_cast<int>(row >> 6)] |= 1ull << (row & 63);
+}
+
+void RecordIndex::Build(const QVector<StackRecord>& records, const QHash<quint64, quint32>& freeAddrMap) {
+    Clear();
+    count_ = records.size();
+    auto words = (count_ + 63) / 64;
+    // records arrive in about the order of their time, usually nothing to sort
+    timeOrder_.resize(count_);
+    for (int i = 0; i < count_; i++)
+        timeOrder_[i] = static_cast<quint32>(i);
+    auto byTime = [&records](quint32 a, quint32 b) {
+        return records[static_cast<int>(a)].time_ < records[static_cast<int>(b)].time_;
+    };
+    if (!std::is_sorted(timeOrder_.begin(), timeOrder_.end(), byTime))
+        std::stable_sort(timeOrder_.begin(), timeOrder_.end(), byTime);
+    seconds_.resize(count_);
+    for (int i = 0; i < count_; i++)
+        seconds_[i] = records[static_cast<int>(timeOrder_[i])].time_ / 1000;
+
+    for (auto& bitmap : sizes_)
+        bitmap.fill(0, words);
+    persistent_.fill(0, words);
+    for (int i = 0; i < count_; i++) {
+        const auto& record = records[i];
+        auto row = static_cast<quint32>(i);
+        if (record.size_ >= 1048576)
+            SetBit(sizes_[LARGE - 1], row);
+        else if (record.size_ > 1024)
+            SetBit(sizes_[MEDIUM - 1], row);
+        else
+            SetBit(sizes_[SMALL - 1], row);
+        auto libraryIt = libraries_.find(record.library_.hashcode_);
+        if (libraryIt == libraries_.end())
+            libraryIt = libraries_.insert(record.library_.hashcode_, Bitmap(words, 0));
+        SetBit(libraryIt.value(), row);
+        auto freeIt = freeAddrMap.find(record.addr_);
+        if (freeIt == freeAddrMap.end() || record.seq_ >= freeIt.value())
+            SetBit(persistent_, row);
+    }
+}
+
+void RecordIndex::Clear() {
+    count_ = 0;
+    timeOrder_.clear();
+    seconds_.clear();
+    libraries_.clear();
+    for (auto& bitmap : sizes_)
+        bitmap.clear();
+    persistent_.clear();
+}
+
+QVector<quint32> RecordIndex::Filter(double minTime, double maxTime, SizeFilter sizeFilter,
+    const QString& library, bool persistent) const {
+    auto words = (count_ + 63) / 64;
+    Bitmap mask;
+    auto masked = false;
+    auto intersect = [&mask, &masked, words](const Bitmap& bitmap) {
+        if (!masked) {
+            mask = bitmap;
+            masked = true;
+            return;
+        }
+        for (int i = 0; i < words; i++)
+            mask[i] &= bitmap[i];
+    };
+    if (sizeFilter != ANY_SIZE)
+        intersect(sizes_[sizeFilter - 1]);
+    if (!library.isEmpty()) {
+        // names may be shared by several hashcodes, a library matches by name
+        Bitmap libraries(words, 0);
+        for (auto it = libraries_.begin(); it != libraries_.end(); ++it) {
+            if (HashString(it.key()).Get() != library)
+                continue;
+            for (int i = 0; i < words; i++)
+                libraries[i] |= it.value()[i];
+        }
+        intersect(libraries);
+    }
+    if (persistent)
+        intersect(persistent_);
+    auto begin = std::lower_bound(seconds_.begin(), seconds_.end(), minTime,
+        [](qint32 time, double value) { return time < value; }) - seconds_.begin();
+    auto end = std::upper_bound(seconds_.begin(), seconds_.end(), maxTime,
+        [](double value, qint32 time) { return value < time; }) - seconds_.begin();
+    if (begin > 0 || end < count_) {
+        Bitmap times(words, 0);
+        for (auto i = begin; i < end; i++)
+            SetBit(times, timeOrder_[static_cast<int>(i)]);
+        intersect(times);
+    }
+
+    QVector<quint32> rows;
+    if (!masked) {
+        rows.resize(count_);
+        for (int i = 0; i < count_; i++)
+            rows[i] = static_cast<quint32>(i);
+        return rows;
+    }
+    int count = 0;
+    for (auto word : mask)
+        count += static_cast<int>(qPopulationCount(word));
+    rows.reserve(count);
+    for (int i = 0; i < words; i++) {
+        auto word = mask[i];
+        while (word != 0) {
+            auto bit = qCountTrailingZeroBits(word);
+            rows.push_back(static_cast<quint32>(i) * 64 + bit);
+            word &= word - 1;
+        }
+    }
+    return rows;
+}
@@ -0,0 +1,250 @@
+#include "spilllog.h"
+
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#include <cstring>
+
+#define SPILLBLOCKSIZE (64 * 1024)
+// [u32 type][u32 used bytes, header included]
+#define SPILLBLOCKHEADERSIZE 8
+#define SPILLFILESIZE (static_cast<qint64>(256) * 1024 * 1024)
+// [u32 frame count][u32 stack index][u64 frames], an entry fits in a block
+#define SPILLSTACKHEADERSIZE 8
+#define MAXSPILLFRAMES ((SPILLBLOCKSIZE - SPILLBLOCKHEADERSIZE - SPILLSTACKHEADERSIZE) / 8)
+
+static_assert(sizeof(SpillRecord) == 40, "spill records are fixed size");
+
+enum class SpillBlockTypes : quint32 {
+    NONE_ = 0, // preallocated, nothing written past it
+    RECORDS_ = 1,
+    STACKS_ = 2,
+};
+
+static quint64 MixFrame(quint64 addr) {
+    addr ^= addr >> 33;
+    addr *= 0xff51afd7ed558ccdull;
+    addr ^= addr >> 33;
+    addr *= 0xc4ceb9fe1a85ec53ull;
+    addr ^= addr >> 33;
+    return addr;
+}
+
+SpillWriter::SpillWriter(const QString& dirPath, QObject* parent)
+    : QThread(parent)
+    , dirPath_(dirPath) {
+}
+
+SpillWriter::~SpillWriter() {
+    Finish();
+}
+
+void SpillWriter::Append(const StackTraceBatch& batch) {
+    if (batch.stacks_.isEmpty())
+        return;
+    QMutexLocker locker(&mutex_);
+    queue_.push_back(batch);
+    condition_.wakeOne();
+}
+
+QStringList SpillWriter::Finish() {
+    {
+        QMutexLocker locker(&mutex_);
+        finishing_ = true;
+        condition_.wakeOne();
+    }
+    wait();
+    return paths_;
+}
+
+void SpillWriter::run() {
+    recordBlock_.reserve(SPILLBLOCKSIZE);
+    stackBlock_.reserve(SPILLBLOCKSIZE);
+    while (true) {
+        QVector<StackTraceBatch> batches;
+        {
+            QMutexLocker locker(&mutex_);
+            while (queue_.isEmpty() && !finishing_)
+                condition_.wait(&mutex_);
+            if (queue_.isEmpty())
+                break;
+            batches.swap(queue_);
+        }
+        for (const auto& batch : batches) {
+            for (const auto& stack : batch.stacks_)
+                Write(stack, batch);
+        }
+    }
+    WriteBlock(stackBlock_);
+    WriteBlock(recordBlock_);
+    CloseFile();
+}
+
+void SpillWriter::Write(const RawStackInfo& stack, const StackTraceBatch& batch) {
+    SpillRecord record;
+    memset(&record, 0, sizeof(record));
+    record.seq_ = stack.seq_;
+    record.size_ = stack.size_;
+    record.time_ = stack.time_;
+    record.addr_ = stack.addr_;
+    record.library_ = stack.library_.hashcode_;
+    record.recType_ = stack.recType_;
+    if (stack.recType_ == static_cast<quint8>(loliRecordTypes::STACKID_)) {
+        record.stack_ = stack.stackId_;
+    } else if (stack.recType_ == static_cast<quint8>(loliRecordTypes::STACKTRACE_)) {
+        record.stack_ = SpillStack(batch.Frames(stack), static_cast<int>(stack.frameCount_));
+    }
+    memcpy(Reserve(recordBlock_, static_cast<quint32>(SpillBlockTypes::RECORDS_), sizeof(record)),
+           &record, sizeof(record));
+}
+
+quint32 SpillWriter::SpillStack(const quint64* stacktraces, int count) {
+    count = qMin(count, MAXSPILLFRAMES);
+    quint64 hash = MixFrame(static_cast<quint64>(count));
+    for (int i = 0; i < count; i++)
+        hash = (hash ^ MixFrame(stacktraces[i])) * 0x100000001b3ull;
+    auto it = stackIndices_.find(hash);
+    if (it != stackIndices_.end())
+        return it.value();
+    auto index = static_cast<quint32>(stackIndices_.size());
+    stackIndices_.insert(hash, index);
+    auto data = Reserve(stackBlock_, static_cast<quint32>(SpillBlockTypes::STACKS_), SPILLSTACKHEADERSIZE + count * 8);
+    // the reader places stacks by index, a lost block leaves a gap instead
+    // of shifting the stacks after it
+    quint32 header[2] = { static_cast<quint32>(count), index };
+    memcpy(data, header, sizeof(header));
+    memcpy(data + SPILLSTACKHEADERSIZE, stacktraces, static_cast<size_t>(count) * 8);
+    return index;
+}
+
+char* SpillWriter::Reserve(QByteArray& block, quint32 type, int size) {
+    if (block.size() + size > SPILLBLOCKSIZE)
+        WriteBlock(block);
+    if (block.isEmpty()) {
+        quint32 header[2] = { type, 0 };
+        block.append(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+    auto offset = block.size();
+    block.resize(offset + size);
+    return block.data() + offset;
+}
+
+void SpillWriter::WriteBlock(QByteArray& block) {
+    if (block.isEmpty())
+        return;
+    auto used = static_cast<quint32>(block.size());
+    memcpy(block.data() + 4, &used, sizeof(used));
+    if (!file_.isOpen() || fileOffset_ + SPILLBLOCKSIZE > SPILLFILESIZE) {
+        CloseFile();
+        if (!OpenFile())
+            failed_ = true;
+    }
+    // the rest of the block is left as preallocated zeros
+    if (file_.isOpen()) {
+        if (!file_.seek(fileOffset_) || file_.write(block) != block.size())
+            failed_ = true;
+        fileOffset_ += SPILLBLOCKSIZE;
+    }
+    // keeps the reserved capacity
+    block.resize(0);
+}
+
+bool SpillWriter::OpenFile() {
+    auto path = QString("%1/spill_%2.bin").arg(dirPath_).arg(paths_.size());
+    file_.setFileName(path);
+    if (!file_.open(QFile::OpenModeFlag::WriteOnly | QFile::OpenModeFlag::Truncate))
+        return false;
+    paths_.push_back(path);
+    fileOffset_ = 0;
+    if (!file_.resize(SPILLFILESIZE)) {
+        file_.close();
+        return false;
+    }
+    return true;
+}
+
+void SpillWriter::CloseFile() {
+    if (!file_.isOpen())
+        return;
+    // drops the preallocated blocks that weren't used
+    file_.resize(fileOffset_);
+    file_.close();
+}
+
+SpillReader::~SpillReader() {
+    // unmaps the files
+    qDeleteAll(files_);
+}
+
+bool SpillReader::Open(const QStringList& paths) {
+    // no index can be past the number of stack headers that fit the files
+    qint64 maxStacks = 0;
+    for (const auto& path : paths)
+        maxStacks += QFileInfo(path).size() / SPILLSTACKHEADERSIZE;
+    for (const auto& path : paths) {
+        auto file = new QFile(path);
+        files_.push_back(file);
+        if (!file->open(QFile::OpenModeFlag::ReadOnly))
+            return false;
+        auto size = file->size();
+        if (size < SPILLBLOCKSIZE)
+            continue;
+        auto data = file->map(0, size);
+        if (data == nullptr)
+            return false;
+        for (qint64 offset = 0; offset + SPILLBLOCKSIZE <= size; offset += SPILLBLOCKSIZE) {
+            auto block = data + offset;
+            quint32 header[2];
+            memcpy(header, block, sizeof(header));
+            auto type = static_cast<SpillBlockTypes>(header[0]);
+            auto used = header[1];
+            // the unused tail is cut off when a file is closed, a block
+            // that's still zero failed to write, the blocks after it are fine
+            if (type == SpillBlockTypes::NONE_ || used < SPILLBLOCKHEADERSIZE || used > SPILLBLOCKSIZE)
+                continue;
+            if (type == SpillBlockTypes::RECORDS_) {
+                recordBlocks_.push_back(block);
+                recordCount_ += static_cast<int>((used - SPILLBLOCKHEADERSIZE) / sizeof(SpillRecord));
+            } else if (type == SpillBlockTypes::STACKS_) {
+                quint32 pos = SPILLBLOCKHEADERSIZE;
+                while (pos + SPILLSTACKHEADERSIZE <= used) {
+                    quint32 header[2];
+                    memcpy(header, block + pos, sizeof(header));
+                    auto entrySize = SPILLSTACKHEADERSIZE + static_cast<quint64>(header[0]) * 8;
+                    if (pos + entrySize > used || header[1] >= maxStacks)
+                        break;
+                    auto index = static_cast<int>(header[1]);
+                    if (index >= stacks_.size())
+                        stacks_.resize(index + 1);
+                    stacks_[index] = block + pos;
+                    pos += static_cast<quint32>(entrySize);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void SpillReader::ForEachRecord(const std::function<void(const SpillRecord&)>& visit) const {
+    SpillRecord record;
+    for (auto block : recordBlocks_) {
+        quint32 used;
+        memcpy(&used, block + 4, sizeof(used));
+        for (auto pos = SPILLBLOCKHEADERSIZE; pos + sizeof(record) <= used; pos += sizeof(record)) {
+            memcpy(&record, block + pos, sizeof(record));
+            visit(record);
+        }
+    }
+}
+
+QVector<quint64> SpillReader::Stack(quint32 index) const {
+    QVector<quint64> frames;
+    if (index >= static_cast<quint32>(stacks_.size()) || stacks_[static_cast<int>(index)] == nullptr)
+        return frames;
+    auto entry = stacks_[static_cast<int>(index)];
+    quint32 count;
+    memcpy(&count, entry, sizeof(count));
+    frames.resize(static_cast<int>(count));
+    memcpy(frames.data(), entry + SPILLSTACKHEADERSIZE, static_cast<size_t>(count) * 8);
+    return frames;
+}
@@ -0,0 +1,406 @@
+#include "stacktracedecoder.h"
+
+#include "lz4/lz4.h"
+
+#include <QtEndian>
+#include <QFile>
+#include <QTcpSocket>
+#include <QThread>
+#include <QDebug>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#define BUFFER_SIZE 1048576
+// highest agent protocol we understand, 1 adds streamed lz4 packets
+#define LOLI_PROTOCOL_VERSION 1
+#define LZ4_DICT_SIZE (64 * 1024)
+// a batch is queued early once it holds this many records
+#define BATCH_RECORDS 65536
+// [u8 type][u32 seq][i64 time][u32 size][u64 addr][u8 recType]
+#define RECORD_HEADER_SIZE 26
+
+StackTraceDecoder::StackTraceDecoder(QObject* parent)
+    : QObject(parent), socket_(new QTcpSocket(this)) {
+    buffer_ = new char[BUFFER_SIZE];
+    compressBuffer_ = new char[compressBufferSize_];
+    socket_->setReadBufferSize(BUFFER_SIZE);
+    connect(socket_, &QTcpSocket::readyRead, this, &StackTraceDecoder::OnReadyRead);
+    connect(socket_, &QTcpSocket::connected, this, &StackTraceDecoder::OnConnected);
+    connect(socket_, &QTcpSocket::disconnected, this, &StackTraceDecoder::OnDisconnected);
+    for (auto& batch : batches_)
+        freeBatches_.Push(&batch);
+}
+
+StackTraceDecoder::~StackTraceDecoder() {
+    delete[] buffer_;
+    delete[] compressBuffer_;
+    SetRecordFile(nullptr);
+}
+
+void StackTraceDecoder::Connect(int port, quint32 connection) {
+    connection_ = connection;
+    if (batch_ != nullptr) {
+        batch_->Clear();
+        batch_->connection_ = connection_;
+    }
+    // the main thread clears its HashStrings when a capture is launched
+    libraries_.clear();
+    streamHistory_.clear();
+    socket_->connectToHost("127.0.0.1", static_cast<quint16>(port));
+}
+
+void StackTraceDecoder::Abort() {
+    socket_->abort();
+    packetSize_ = 0;
+    bufferCache_.resize(0);
+}
+
+void StackTraceDecoder::Send(const QByteArray& bytes) {
+    socket_->write(bytes);
+}
+
+void StackTraceDecoder::SetRecordFile(QFile* file) {
+    if (recordFile_) {
+        recordFile_->close();
+        delete recordFile_;
+    }
+    recordFile_ = file;
+}
+
+bool StackTraceDecoder::TakeBatch(StackTraceBatch*& batch) {
+    return readyBatches_.Pop(batch);
+}
+
+void StackTraceDecoder::RecycleBatch(StackTraceBatch* batch) {
+    freeBatches_.Push(batch);
+}
+
+StackTraceBatch* StackTraceDecoder::Batch() {
+    if (batch_ != nullptr)
+        return batch_;
+    // every batch is queued, the socket isn't read meanwhile so the agent
+    // keeps its backlog instead of the main thread falling further behind
+    while (!freeBatches_.Pop(batch_)) {
+        if (stopping_.load()) {
+            batch_ = &discarded_;
+            break;
+        }
+        QThread::usleep(100);
+    }
+    batch_->Clear();
+    batch_->connection_ = connection_;
+    return batch_;
+}
+
+void StackTraceDecoder::PushBatch() {
+    if (batch_ == nullptr)
+        return;
+    if (batch_ == &discarded_) {
+        batch_ = nullptr;
+        return;
+    }
+    if (batch_->stacks_.isEmpty() && batch_->frees_.isEmpty() &&
+        batch_->definitions_.isEmpty() && batch_->libraries_.isEmpty())
+        return;
+    // can't fail, there are as many slots as batches
+    readyBatches_.Push(batch_);
+    batch_ = nullptr;
+    if (!drainPending_.exchange(true))
+        emit BatchesReady();
+}
+
+void StackTraceDecoder::ReadPacket(const QByteArray& bytes) {
+    quint32 packetType = *reinterpret_cast<const quint32*>(bytes.data());
+    if (packetType == 0) { // stack trace data
+        ReadStackTracePacket(bytes, false);
+    } else if (packetType == 1) { // recived command
+        // records sent before the command reach the main thread first
+        PushBatch();
+        emit CommandReceived(*reinterpret_cast<const quint32*>(bytes.data() + 4), bytes);
+    } else if (packetType == 2) { // stack trace data, next block of the lz4 stream
+        ReadStackTracePacket(bytes, true);
+    } else {
+        qDebug() << "Unknown packetType: " << packetType;
+    }
+}
+
+void StackTraceDecoder::ReadStackTracePacket(const QByteArray &bytes, bool streamed) {
+    quint32 originSize = *reinterpret_cast<const quint32*>(bytes.data() + 4);
+    if (originSize > compressBufferSize_) {
+        compressBufferSize_ = static_cast<quint32>(originSize * 1.5f);
+        delete[] compressBuffer_;
+        compressBuffer_ = new char[compressBufferSize_];
+    }
+    int decompressSize = 0;
+    if (streamed) {
+        // blocks reference up to 64KB of the data decompressed before them
+        LZ4_streamDecode_t streamDecode;
+        LZ4_setStreamDecode(&streamDecode, streamHistory_.constData(), streamHistory_.size());
+        decompressSize = LZ4_decompress_safe_continue(&streamDecode, bytes.data() + 8, compressBuffer_,
+            bytes.size() - 8, static_cast<qint32>(compressBufferSize_));
+    } else {
+        decompressSize = LZ4_decompress_safe(bytes.data() + 8, compressBuffer_,
+            bytes.size() - 8, static_cast<qint32>(compressBufferSize_));
+    }
+    if (decompressSize <= 0) {
+        qDebug() << "LZ4 decompression failed!";
+        return;
+    }
+    if (streamed) {
+        if (decompressSize >= LZ4_DICT_SIZE) {
+            streamHistory_ = QByteArray(compressBuffer_ + decompressSize - LZ4_DICT_SIZE, LZ4_DICT_SIZE);
+        } else {
+            streamHistory_.append(compressBuffer_, decompressSize);
+            if (streamHistory_.size() > LZ4_DICT_SIZE)
+                streamHistory_.remove(0, streamHistory_.size() - LZ4_DICT_SIZE);
+        }
+    }
+    if (recordFile_) {
+        quint32 recordSize = static_cast<quint32>(decompressSize);
+        recordFile_->write(reinterpret_cast<const char*>(&recordSize), sizeof(recordSize));
+        recordFile_->write(compressBuffer_, decompressSize);
+    }
+    // threads send from their own buffers, an munmap may be decoded before the mmap
+    // it unmaps when both are in the same packet, so unmaps are applied last
+    unmaps_.resize(0);
+    quint64 records = 0;
+    auto data = reinterpret_cast<const uchar*>(compressBuffer_);
+    auto end = data + decompressSize;
+    while (data < end) {
+        if (end - data < 2) {
+            qDebug() << "Intepreting data failed!";
+            break;
+        }
+        auto lineSize = qFromLittleEndian<quint16>(data);
+        data += 2;
+        if (lineSize == 0 || end - data < lineSize) {
+            qDebug() << "Intepreting data failed!";
+            break;
+        }
+        auto batch = Batch();
+        auto stackCount = batch->stacks_.size();
+        if (!ReadRecord(data, data + lineSize, batch))
+            break;
+        records += static_cast<quint64>(batch->stacks_.size() - stackCount);
+        data += lineSize;
+        if (batch->stacks_.size() >= BATCH_RECORDS)
+            PushBatch();
+    }
+    std::sort(unmaps_.begin(), unmaps_.end(), [](const UnmapInfo& a, const UnmapInfo& b) {
+        return a.seq_ < b.seq_;
+    });
+    for (const auto& unmap : unmaps_)
+        UnmapRange(unmap.seq_, unmap.addr_, unmap.length_);
+    decodedBytes_.fetch_add(static_cast<quint64>(decompressSize), std::memory_order_relaxed);
+    decodedRecords_.fetch_add(records, std::memory_order_relaxed);
+}
+
+// appends the u64 frames up to end to the batch's frame pool
+static void ReadFrames(const uchar* data, const uchar* end, StackTraceBatch* batch,
+                       quint32& frameOffset, quint32& frameCount) {
+    auto count = static_cast<int>((end - data) / 8);
+    auto offset = batch->frames_.size();
+    batch->frames_.resize(offset + count);
+    qFromLittleEndian<quint64>(data, count, batch->frames_.data() + offset);
+    frameOffset = static_cast<quint32>(offset);
+    frameCount = static_cast<quint32>(count);
+}
+
+bool StackTraceDecoder::ReadRecord(const uchar* data, const uchar* end, StackTraceBatch* batch) {
+    auto type = *data;
+    if (type == static_cast<quint8>(loliFlags::FREE_)) {
+        if (end - data < 13) {
+            qDebug() << "Invalid free record!";
+            return false;
+        }
+        batch->frees_.push_back(qMakePair(qFromLittleEndian<quint32>(data + 1),
+                                          qFromLittleEndian<quint64>(data + 5)));
+    } else if (type == static_cast<quint8>(loliFlags::MUNMAP_)) {
+        if (end - data < 21) {
+            qDebug() << "Invalid munmap record!";
+            return false;
+        }
+        UnmapInfo unmap;
+        unmap.seq_ = qFromLittleEndian<quint32>(data + 1);
+        unmap.addr_ = qFromLittleEndian<quint64>(data + 5);
+        unmap.length_ = qFromLittleEndian<quint64>(data + 13);
+        unmaps_.push_back(unmap);
+    } else if (type == static_cast<quint8>(loliFlags::STACK_)) {
+        if (end - data < 5) {
+            qDebug() << "Invalid stack record!";
+            return false;
+        }
+        StackDefinition definition;
+        definition.stackId_ = qFromLittleEndian<quint32>(data + 1);
+        ReadFrames(data + 5, end, batch, definition.frameOffset_, definition.frameCount_);
+        batch->definitions_.push_back(definition);
+    } else {
+        if (end - data < RECORD_HEADER_SIZE) {
+            qDebug() << "Invalid record!";
+            return false;
+        }
+        RawStackInfo info;
+        info.seq_ = qFromLittleEndian<quint32>(data + 1);
+        info.time_ = qFromLittleEndian<qint64>(data + 5);
+        info.size_ = qFromLittleEndian<quint32>(data + 13);
+        info.addr_ = qFromLittleEndian<quint64>(data + 17);
+        info.recType_ = data[25];
+        data += RECORD_HEADER_SIZE;
+        if (info.recType_ == static_cast<quint8>(loliRecordTypes::NOSTACK_)) {
+            if (end - data < 2 || end - data - 2 < qFromLittleEndian<quint16>(data)) {
+                qDebug() << "Error reading library name string!";
+                return false;
+            }
+            auto strlen = qFromLittleEndian<quint16>(data);
+            QString name(QByteArray::fromRawData(reinterpret_cast<const char*>(data + 2), strlen));
+            auto hashcode = qHash(name);
+            if (!libraries_.contains(hashcode)) {
+                libraries_.insert(hashcode);
+                batch->libraries_.push_back(qMakePair(hashcode, name));
+            }
+            info.library_ = HashString(hashcode);
+        } else if (info.recType_ == static_cast<quint8>(loliRecordTypes::STACKTRACE_)) {
+            ReadFrames(data, end, batch, info.frameOffset_, info.frameCount_);
+        } else if (info.recType_ == static_cast<quint8>(loliRecordTypes::STACKID_)) {
+            if (end - data < 4) {
+                qDebug() << "Invalid stack id!";
+                return false;
+            }
+            info.stackId_ = qFromLittleEndian<quint32>(data);
+        } else {
+            qDebug() << "Unknown recType!";
+            return false;
+        }
+        if (type == static_cast<quint8>(loliFlags::MMAP_))
+            MapRange(info, batch);
+        batch->stacks_.push_back(info);
+    }
+    return true;
+}
+
+void StackTraceDecoder::MapRange(const RawStackInfo& info, const StackTraceBatch* batch) {
+    // MAP_FIXED replaces whatever was mapped there before
+    UnmapRange(info.seq_, info.addr_, info.size_);
+    // the range outlives the batch, it keeps a copy of its frames
+    MappedRange range;
+    range.info_ = info;
+    range.frames_.resize(static_cast<int>(info.frameCount_));
+    memcpy(range.frames_.data(), batch->Frames(info), info.frameCount_ * sizeof(quint64));
+    mappedRanges_.insert(info.addr_, range);
+}
+
+void StackTraceDecoder::UnmapRange(quint32 seq, quint64 addr, quint64 length) {
+    const quint64 end = addr + length;
+    auto it = mappedRanges_.lowerBound(addr);
+    if (it != mappedRanges_.begin()) {
+        auto prev = std::prev(it);
+        if (prev.key() + prev.value().info_.size_ > addr)
+            it = prev;
+    }
+    auto batch = Batch();
+    QVector<MappedRange> remains;
+    while (it != mappedRanges_.end() && it.key() < end) {
+        const MappedRange& range = it.value();
+        const quint64 rangeEnd = it.key() + range.info_.size_;
+        // ranges mapped after this munmap are not affected
+        if (rangeEnd <= addr || range.info_.seq_ >= seq) {
+            ++it;
+            continue;
+        }
+        // the remains are recorded with the munmap's seq, so the free only matches the old range
+        batch->frees_.push_back(qMakePair(seq, it.key()));
+        if (it.key() < addr) {
+            MappedRange head = range;
+            head.info_.seq_ = seq;
+            head.info_.size_ = static_cast<quint32>(addr - it.key());
+            remains.push_back(head);
+        }
+        if (rangeEnd > end) {
+            MappedRange tail = range;
+            tail.info_.seq_ = seq;
+            tail.info_.addr_ = end;
+            tail.info_.size_ = static_cast<quint32>(rangeEnd - end);
+            remains.push_back(tail);
+        }
+        it = mappedRanges_.erase(it);
+    }
+    for (const auto& remain : remains) {
+        mappedRanges_.insert(remain.info_.addr_, remain);
+        RawStackInfo info = remain.info_;
+        info.frameOffset_ = static_cast<quint32>(batch->frames_.size());
+        batch->frames_.append(remain.frames_);
+        batch->stacks_.push_back(info);
+    }
+}
+
+void StackTraceDecoder::OnReadyRead() {
+    while (socket_->bytesAvailable() > 0) {
+        auto size = socket_->read(buffer_, BUFFER_SIZE);
+        if (size <= 0)
+            break;
+        qint64 bufferPos = 0; // pos = size - remains
+        qint64 remainBytes = size;
+        while (remainBytes > 0) {
+            if (packetSize_ == 0) {
+                // handles the condiction when buffer's size is less than 4 byte
+                // because we need at least 4 byte to interpret the packet's size
+                if (bufferCache_.size() + remainBytes < 4) {
+                    bufferCache_.append(buffer_ + bufferPos, static_cast<int>(remainBytes));
+                    break;
+                } else {
+                    int remainSize = 4 - bufferCache_.size();
+                    if (remainSize > 0) {
+                        bufferCache_.append(buffer_ + bufferPos, remainSize);
+                        remainBytes -= remainSize;
+                    }
+                }
+                packetSize_ = *reinterpret_cast<quint32*>(bufferCache_.data());
+                bufferPos = size - remainBytes;
+                bufferCache_.resize(0);
+                if (remainBytes > 0) {
+                    if (packetSize_ <= remainBytes) { // the data is stored in the same packet, then read them all
+                        bufferCache_.append(buffer_ + bufferPos, static_cast<int>(packetSize_));
+                        remainBytes -= packetSize_;
+                        bufferPos = size - remainBytes;
+                        ReadPacket(bufferCache_);
+                        bufferCache_.resize(0);
+                        packetSize_ = 0;
+                    } else { // the data is splited to another packet, we just append whatever we got
+                        bufferCache_.append(buffer_ + bufferPos, static_cast<int>(remainBytes));
+                        break;
+                    }
+                }
+            } else {
+                auto remainPacketSize = packetSize_ - static_cast<uint>(bufferCache_.size());
+                if (remainPacketSize <= remainBytes) { // the remaining data is stored in this packet, read what we need
+                    bufferCache_.append(buffer_ + bufferPos, static_cast<int>(remainPacketSize));
+                    remainBytes -= remainPacketSize;
+                    bufferPos = size - remainBytes;
+                    ReadPacket(bufferCache_);
+                    bufferCache_.resize(0);
+                    packetSize_ = 0;
+                } else { // the remaining data is splited to another packet, we just append whatever we got
+                    bufferCache_.append(buffer_ + bufferPos, static_cast<int>(remainBytes));
+                    break;
+                }
+            }
+        }
+    }
+    // everything read so far is handed over at once
+    PushBatch();
+}
+
+void StackTraceDecoder::OnConnected() {
+    mappedRanges_.clear();
+    // agents that predate the handshake ignore it and keep sending independent packets,
+    // the version byte is never 0 so it can't be mistaken for SMAPS_DUMP
+    const char handshake[2] = {static_cast<char>(loliCommands::PROTOCOL_VERSION), LOLI_PROTOCOL_VERSION};
+    socket_->write(handshake, sizeof(handshake));
+    emit Connected(connection_);
+}
+
+void StackTraceDecoder::OnDisconnected() {
+    emit Disconnected(connection_);
+}
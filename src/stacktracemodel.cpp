@@ -1,5 +1,88 @@
 #include "stacktracemodel.h"
 
+#include <QFuture>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <cstring>
+
+// rows radix sorted by one worker before the sorted chunks are merged
+#define SORT_CHUNK_SIZE (256 * 1024)
+
+struct SortItem {
+    quint64 key_;
+    quint32 row_;
+};
+
+static bool KeyLess(const SortItem& a, const SortItem& b) {
+    return a.key_ < b.key_;
+}
+
+// stable lsd radix sort, bytes that are equal in all keys are skipped.
+// Returns items or buffer, whichever ended up with the sorted items.
+static SortItem* RadixSort(SortItem* items, SortItem* buffer, int count, quint64 differing) {
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((differing >> shift) & 0xff) == 0)
+            continue;
+        int offsets[256] = {};
+        for (int i = 0; i < count; i++)
+            offsets[(items[i].key_ >> shift) & 0xff]++;
+        int total = 0;
+        for (auto& offset : offsets) {
+            auto bucket = offset;
+            offset = total;
+            total += bucket;
+        }
+        for (int i = 0; i < count; i++)
+            buffer[offsets[(items[i].key_ >> shift) & 0xff]++] = items[i];
+        std::swap(items, buffer);
+    }
+    return items;
+}
+
+// rows ordered by their key, rows with equal keys keep their order
+static QVector<quint32> SortRows(const QVector<quint64>& keys) {
+    auto count = keys.size();
+    QVector<SortItem> items(count);
+    QVector<SortItem> buffer(count);
+    quint64 differing = 0;
+    for (int i = 0; i < count; i++) {
+        items[i] = {keys[i], static_cast<quint32>(i)};
+        differing |= keys[i] ^ keys[0];
+    }
+    auto src = items.data();
+    auto dst = buffer.data();
+    QVector<QFuture<void>> futures;
+    for (int begin = 0; begin < count; begin += SORT_CHUNK_SIZE) {
+        auto size = qMin(SORT_CHUNK_SIZE, count - begin);
+        futures.push_back(QtConcurrent::run([=]() {
+            auto sorted = RadixSort(src + begin, dst + begin, size, differing);
+            if (sorted != src + begin)
+                memcpy(src + begin, sorted, sizeof(SortItem) * static_cast<size_t>(size));
+        }));
+    }
+    for (auto& future : futures)
+        future.waitForFinished();
+    // sorted runs are merged pairwise until one is left
+    for (int width = SORT_CHUNK_SIZE; width < count; width *= 2) {
+        futures.clear();
+        for (int begin = 0; begin < count; begin += 2 * width) {
+            auto middle = qMin(begin + width, count);
+            auto end = qMin(middle + width, count);
+            futures.push_back(QtConcurrent::run([=]() {
+                std::merge(src + begin, src + middle, src + middle, src + end, dst + begin, KeyLess);
+            }));
+        }
+        for (auto& future : futures)
+            future.waitForFinished();
+        std::swap(src, dst);
+    }
+    QVector<quint32> rows(count);
+    for (int i = 0; i < count; i++)
+        rows[i] = src[i].row_;
+    return rows;
+}
+
 QString sizeToString(quint64 size) {
     if (size >= 1024 * 1024 * 1024) {
         return QString::number(static_cast<double>(size) / 1024 / 1024 / 1024, 'f', 2) + " GB";
@@ -31,7 +114,7 @@ StackTraceModel::StackTraceModel(QObject* parent)
 }
 
 int StackTraceModel::rowCount(const QModelIndex &) const {
-    return records_.size();
+    return source_ != nullptr ? rows_.size() : records_.size();
 }
 
 int StackTraceModel::columnCount(const QModelIndex &) const {
@@ -41,9 +124,9 @@ int StackTraceModel::columnCount(const QModelIndex &) const {
 QVariant StackTraceModel::data(const QModelIndex &index, int role) const {
     int row = index.row();
     int column = index.column();
-    if (row >= 0 && row < records_.size()) {
+    if (row >= 0 && row < rowCount()) {
         if (role == Qt::DisplayRole) {
-            auto record = records_[row];
+            const auto& record = recordAt(row);
             switch(column) {
                 case 0:
                     return timeToString(record.time_);
@@ -57,7 +140,7 @@ QVariant StackTraceModel::data(const QModelIndex &index, int role) const {
                     return QString("0x%1").arg(record.funcAddr_, 0, 16);
             }
         } else if (role == Qt::UserRole) {
-            auto record = records_[row];
+            const auto& record = recordAt(row);
             switch(column) {
                 case 0:
                     return record.time_;
@@ -95,9 +178,95 @@ QVariant StackTraceModel::headerData(int section, Qt::Orientation orientation, i
     return QVariant();
 }
 
+void StackTraceModel::sort(int column, Qt::SortOrder order) {
+    if (column >= COLUMNS)
+        return;
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+    // selection and current index follow their records
+    auto persistent = persistentIndexList();
+    QVector<int> unsortedRows;
+    unsortedRows.reserve(persistent.size());
+    for (const auto& persistentIndex : persistent)
+        unsortedRows.push_back(sortedRow(persistentIndex.row()));
+    if (column >= 0)
+        buildOrder(column);
+    sortColumn_ = column;
+    sortOrder_ = order;
+    if (!persistent.isEmpty()) {
+        QVector<int> positions(rowCount());
+        for (int i = 0; i < positions.size(); i++)
+            positions[sortedRow(i)] = i;
+        QModelIndexList moved;
+        moved.reserve(persistent.size());
+        for (int i = 0; i < persistent.size(); i++)
+            moved.push_back(index(positions[unsortedRows[i]], persistent[i].column()));
+        changePersistentIndexList(persistent, moved);
+    }
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
+
+void StackTraceModel::buildOrder(int column) {
+    auto count = rowCount();
+    if (!orders_[column].isEmpty() || count == 0)
+        return;
+    // libraries sort by name, every library gets the rank of its name
+    QHash<quint32, quint64> libraryRanks;
+    if (column == 3) {
+        for (int i = 0; i < count; i++)
+            libraryRanks.insert(unsortedAt(i).library_.hashcode_, 0);
+        QVector<QPair<QString, quint32>> libraries;
+        for (auto it = libraryRanks.begin(); it != libraryRanks.end(); ++it)
+            libraries.push_back(qMakePair(HashString(it.key()).Get(), it.key()));
+        std::sort(libraries.begin(), libraries.end());
+        for (int i = 0; i < libraries.size(); i++)
+            libraryRanks[libraries[i].second] = static_cast<quint64>(i);
+    }
+    QVector<quint64> keys(count);
+    for (int i = 0; i < count; i++) {
+        const auto& record = unsortedAt(i);
+        switch (column) {
+            case 0: // signed fields keep their order with the sign bit flipped
+                keys[i] = static_cast<quint32>(record.time_) ^ 0x80000000u;
+                break;
+            case 1:
+                keys[i] = static_cast<quint32>(record.size_) ^ 0x80000000u;
+                break;
+            case 2:
+                keys[i] = record.addr_;
+                break;
+            case 3:
+                keys[i] = libraryRanks.value(record.library_.hashcode_);
+                break;
+            case 4:
+                keys[i] = record.funcAddr_;
+                break;
+        }
+    }
+    orders_[column] = SortRows(keys);
+}
+
+void StackTraceModel::resetOrders() {
+    for (auto& order : orders_)
+        order.clear();
+    if (sortColumn_ >= 0)
+        buildOrder(sortColumn_);
+}
+
 void StackTraceModel::clear() {
     beginResetModel();
     records_.clear();
+    source_ = nullptr;
+    rows_.clear();
+    resetOrders();
+    endResetModel();
+}
+
+void StackTraceModel::setRows(const StackTraceModel* source, const QVector<quint32>& rows) {
+    beginResetModel();
+    records_.clear();
+    source_ = source;
+    rows_ = rows;
+    resetOrders();
     endResetModel();
 }
 
@@ -105,7 +274,16 @@ void StackTraceModel::append(const QVector<StackRecord>& records) {
     auto size = records.size();
     if (size == 0)
         return;
+    // sorted rows would land anywhere
+    if (sortColumn_ >= 0) {
+        beginResetModel();
+        records_.append(records);
+        resetOrders();
+        endResetModel();
+        return;
+    }
     beginInsertRows({}, records_.size(), records_.size() + size - 1);
     records_.append(records);
+    resetOrders();
     endInsertRows();
 }
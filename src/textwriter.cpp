@@ -0,0 +1,174 @@
+#include "textwriter.h"
+
+#include <QIODevice>
+#include <QThread>
+#include <QtConcurrent>
+
+// text collected before it's written or compressed
+#define TEXTBUFFERSIZE (4 * 1024 * 1024)
+// qCompress output: big endian size, 2 byte zlib header, deflate data, adler32
+#define ZLIBHEADERSIZE 6
+#define ZLIBTRAILERSIZE 4
+
+static const char DIGITPAIRS[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static quint32 Crc32(const QByteArray& data) {
+    static const QVector<quint32> table = []() {
+        QVector<quint32> crcs(256);
+        for (quint32 i = 0; i < 256; i++) {
+            auto crc = i;
+            for (int bit = 0; bit < 8; bit++)
+                crc = (crc & 1) ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+            crcs[static_cast<int>(i)] = crc;
+        }
+        return crcs;
+    }();
+    auto crc = 0xffffffffu;
+    auto bytes = reinterpret_cast<const uchar*>(data.constData());
+    for (int i = 0; i < data.size(); i++)
+        crc = table[static_cast<int>((crc ^ bytes[i]) & 0xff)] ^ (crc >> 8);
+    return crc ^ 0xffffffffu;
+}
+
+static void AppendLittleEndian(QByteArray& data, quint32 value) {
+    for (int i = 0; i < 4; i++)
+        data.append(static_cast<char>((value >> (i * 8)) & 0xff));
+}
+
+// a gzip member around the raw deflate data of qCompress, empty if it
+// failed
+static QByteArray Compress(const QByteArray& text) {
+    auto zlib = qCompress(text);
+    if (zlib.size() < ZLIBHEADERSIZE + ZLIBTRAILERSIZE)
+        return QByteArray();
+    // magic, deflate, no flags, no time, no extra flags, unknown os
+    static const char header[] = { '\x1f', '\x8b', '\x08', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\xff' };
+    QByteArray member;
+    member.reserve(zlib.size() + static_cast<int>(sizeof(header)) + 8);
+    member.append(header, static_cast<int>(sizeof(header)));
+    member.append(zlib.constData() + ZLIBHEADERSIZE, zlib.size() - ZLIBHEADERSIZE - ZLIBTRAILERSIZE);
+    AppendLittleEndian(member, Crc32(text));
+    AppendLittleEndian(member, static_cast<quint32>(text.size()));
+    return member;
+}
+
+TextWriter::TextWriter() {
+}
+
+TextWriter::TextWriter(QIODevice* device, bool compressed)
+    : device_(device), compressed_(compressed) {
+    buffer_.reserve(TEXTBUFFERSIZE);
+}
+
+void TextWriter::Append(const char* data, int size) {
+    buffer_.append(data, size);
+    if (device_ != nullptr && buffer_.size() >= TEXTBUFFERSIZE)
+        Flush();
+}
+
+TextWriter& TextWriter::operator<<(char c) {
+    Append(&c, 1);
+    return *this;
+}
+
+TextWriter& TextWriter::operator<<(const char* text) {
+    Append(text, static_cast<int>(qstrlen(text)));
+    return *this;
+}
+
+TextWriter& TextWriter::operator<<(const QByteArray& text) {
+    Append(text.constData(), text.size());
+    return *this;
+}
+
+TextWriter& TextWriter::operator<<(const QString& text) {
+    return *this << text.toUtf8();
+}
+
+TextWriter& TextWriter::operator<<(qint64 value) {
+    if (value < 0) {
+        Append("-", 1);
+        return *this << (0 - static_cast<quint64>(value));
+    }
+    return *this << static_cast<quint64>(value);
+}
+
+TextWriter& TextWriter::operator<<(quint64 value) {
+    // two digits at a time from the back
+    char digits[20];
+    auto end = digits + sizeof(digits);
+    auto begin = end;
+    while (value >= 100) {
+        auto pair = static_cast<int>(value % 100) * 2;
+        value /= 100;
+        *--begin = DIGITPAIRS[pair + 1];
+        *--begin = DIGITPAIRS[pair];
+    }
+    if (value >= 10) {
+        auto pair = static_cast<int>(value) * 2;
+        *--begin = DIGITPAIRS[pair + 1];
+        *--begin = DIGITPAIRS[pair];
+    } else {
+        *--begin = static_cast<char>('0' + value);
+    }
+    Append(begin, static_cast<int>(end - begin));
+    return *this;
+}
+
+TextWriter& TextWriter::operator<<(Hex value) {
+    char digits[16];
+    auto end = digits + sizeof(digits);
+    auto begin = end;
+    auto remaining = value.value_;
+    do {
+        *--begin = "0123456789abcdef"[remaining & 0xf];
+        remaining >>= 4;
+    } while (remaining != 0);
+    Append(begin, static_cast<int>(end - begin));
+    return *this;
+}
+
+void TextWriter::Write(const QByteArray& data) {
+    if (device_->write(data) != data.size())
+        ok_ = false;
+}
+
+void TextWriter::WriteMember(const QByteArray& member) {
+    // members come from non empty chunks, an empty one failed to compress
+    if (member.isEmpty())
+        ok_ = false;
+    else
+        Write(member);
+}
+
+void TextWriter::Flush() {
+    if (buffer_.isEmpty())
+        return;
+    if (!compressed_) {
+        Write(buffer_);
+        buffer_.resize(0);
+        return;
+    }
+    // the chunk goes to a worker, a few are deflated while the next is filled
+    auto text = buffer_;
+    pending_.push_back(QtConcurrent::run([text]() { return Compress(text); }));
+    buffer_ = QByteArray();
+    buffer_.reserve(TEXTBUFFERSIZE);
+    while (pending_.size() > qMax(QThread::idealThreadCount(), 1)) {
+        WriteMember(pending_.first().result());
+        pending_.removeFirst();
+    }
+}
+
+bool TextWriter::Finish() {
+    if (device_ == nullptr)
+        return true;
+    Flush();
+    for (auto& member : pending_)
+        WriteMember(member.result());
+    pending_.clear();
+    return ok_;
+}
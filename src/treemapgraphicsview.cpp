@@ -1,5 +1,5 @@
 #include "treemapgraphicsview.h"
-#include <QTreeWidget>
+#include <QAbstractItemModel>
 #include <QGraphicsScene>
 #include <QGraphicsSceneMouseEvent>
 #include <QTimer>
@@ -171,8 +171,8 @@ void TreeMapNode::mousePressEvent(QGraphicsSceneMouseEvent* event) {
 
 // TreeMapGraphicsView
 
-TreeMapGraphicsView::TreeMapGraphicsView(QList<QTreeWidgetItem*>& topLevelItems, QWidget *parent)
-    : QGraphicsView(parent), mainTimer_(new QTimer(this)), topLevelItems_(topLevelItems) {
+TreeMapGraphicsView::TreeMapGraphicsView(QAbstractItemModel* model, QWidget *parent)
+    : QGraphicsView(parent), mainTimer_(new QTimer(this)), model_(model) {
     setHorizontalScrollBarPolicy(Qt::ScrollBarPolicy::ScrollBarAlwaysOff);
     setVerticalScrollBarPolicy(Qt::ScrollBarPolicy::ScrollBarAlwaysOff);
     setDragMode(QGraphicsView::NoDrag);
@@ -182,12 +182,7 @@ TreeMapGraphicsView::TreeMapGraphicsView(QList<QTreeWidgetItem*>& topLevelItems,
     mainTimer_->start(1000);
 }
 
-TreeMapGraphicsView::~TreeMapGraphicsView() {
-    for (auto item : topLevelItems_)
-        delete item;
-}
-
-void TreeMapGraphicsView::Generate(QTreeWidgetItem* parent, QRectF rect, int depth) {
+void TreeMapGraphicsView::Generate(const QModelIndex& parent, QRectF rect, int depth) {
     if (scene_ == nullptr) {
         scene_ = new QGraphicsScene(this);
         setScene(scene_);
@@ -201,10 +196,10 @@ void TreeMapGraphicsView::Generate(QTreeWidgetItem* parent, QRectF rect, int dep
     auto curMemSize = 0ull;
     auto childCount = GetChildCount(parent);
     for (int i = 0; i < childCount; i++) {
-        curMemSize += GetChild(parent, i)->data(1, Qt::UserRole).toULongLong();
+        curMemSize += GetChild(parent, i).sibling(i, 1).data(Qt::UserRole).toULongLong();
     }
     ItemInfo curInfo;
-    curInfo.treeItem_ = parent;
+    curInfo.index_ = parent;
     curInfo.rect_ = rect;
     curInfo.size_ = curMemSize;
     curInfo.depth_ = 0;
@@ -213,21 +208,21 @@ void TreeMapGraphicsView::Generate(QTreeWidgetItem* parent, QRectF rect, int dep
     Generate(parent, depth);
 }
 
-void TreeMapGraphicsView::Generate(QTreeWidgetItem* parentTreeItem, int maxDepth) {
+void TreeMapGraphicsView::Generate(const QModelIndex& parentTreeItem, int maxDepth) {
     auto& parentTreeItemInfo = itemInfoMap_[parentTreeItem];
     auto totalSize = 0ull;
     auto childCount = GetChildCount(parentTreeItem);
     for (int i = 0; i < childCount; i++) {
-        totalSize += GetChild(parentTreeItem, i)->data(1, Qt::UserRole).toULongLong();
+        totalSize += GetChild(parentTreeItem, i).sibling(i, 1).data(Qt::UserRole).toULongLong();
     }
     QList<ItemInfo> childItems;
     for (int i = 0; i < childCount; i++) {
         auto child = GetChild(parentTreeItem, i);
-        auto size = child->data(1, Qt::UserRole).toULongLong();
+        auto size = child.sibling(i, 1).data(Qt::UserRole).toULongLong();
         if ((static_cast<double>(size) / totalSize) < 0.1)
             continue;
         ItemInfo childItemInfo;
-        childItemInfo.treeItem_ = child;
+        childItemInfo.index_ = child;
         childItemInfo.size_ = size;
         childItemInfo.depth_ = parentTreeItemInfo.depth_ + 1;
         itemInfoMap_[child] = childItemInfo;
@@ -251,35 +246,30 @@ void TreeMapGraphicsView::Generate(QTreeWidgetItem* parentTreeItem, int maxDepth
         auto childItem = childItems[i];
         childItem.rect_ = newRect;
         childItem.node_ = GetTreeMapNode(childItem, newRect);
-        itemInfoMap_[childItem.treeItem_] = childItem;
+        itemInfoMap_[childItem.index_] = childItem;
         if (childItem.rect_.width() > 40 && childItem.rect_.height() > 40) {
             if (parentTreeItemInfo.depth_ + 1 < maxDepth) {
-                Generate(childItem.treeItem_, maxDepth);
+                Generate(childItem.index_, maxDepth);
             }
         }
     }
 }
 
-QTreeWidgetItem* TreeMapGraphicsView::GetChild(QTreeWidgetItem* item, int index) const {
-    if (item)
-        return item->child(index);
-    else
-        return topLevelItems_[index];
+QModelIndex TreeMapGraphicsView::GetChild(const QModelIndex& item, int index) const {
+    return model_->index(index, 0, item);
 }
 
-int TreeMapGraphicsView::GetChildCount(QTreeWidgetItem* item) const {
-    if (item)
-        return item->childCount();
-    else
-        return topLevelItems_.size();
+int TreeMapGraphicsView::GetChildCount(const QModelIndex& item) const {
+    return model_->rowCount(item);
 }
 
 TreeMapNode* TreeMapGraphicsView::GetTreeMapNode(ItemInfo& info, QRectF rect) {
     QString title;
-    if (info.treeItem_) {
-        auto countStr = info.treeItem_->data(2, Qt::DisplayRole).toString();
-        auto sizeStr = info.treeItem_->data(1, Qt::DisplayRole).toString();
-        auto nameStr = info.treeItem_->data(0, Qt::DisplayRole).toString();
+    if (info.index_.isValid()) {
+        auto row = info.index_.row();
+        auto countStr = info.index_.sibling(row, 2).data(Qt::DisplayRole).toString();
+        auto sizeStr = info.index_.sibling(row, 1).data(Qt::DisplayRole).toString();
+        auto nameStr = info.index_.data(Qt::DisplayRole).toString();
         title = sizeStr + " (" + countStr + "): " + nameStr;
     }
     auto node = new TreeMapNode(rect, title);
@@ -287,10 +277,10 @@ TreeMapNode* TreeMapGraphicsView::GetTreeMapNode(ItemInfo& info, QRectF rect) {
     node->setZValue(info.depth_);
     connect(node, &TreeMapNode::onClicked, [&, info]() {
         if (info.depth_ == 0) {
-            if (info.treeItem_)
-                Generate(info.treeItem_->parent(), QRectF(0, 0, prevWidth_, prevHeight_), 10);
+            if (info.index_.isValid())
+                Generate(info.index_.parent(), QRectF(0, 0, prevWidth_, prevHeight_), 10);
         } else {
-            Generate(info.treeItem_, QRectF(0, 0, prevWidth_, prevHeight_), 10);
+            Generate(info.index_, QRectF(0, 0, prevWidth_, prevHeight_), 10);
         }
     });
     return node;
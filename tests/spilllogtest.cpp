@@ -0,0 +1,121 @@
+#include "spilllog.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QTemporaryDir>
+
+#include <cstdio>
+
+#define RECORDCOUNT 20000
+#define FRAMECOUNT 6
+#define BLOCKSIZE (64 * 1024)
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static quint64 Frame(quint32 seq, int i) {
+    return static_cast<quint64>(seq) * FRAMECOUNT + static_cast<quint64>(i) + 1;
+}
+
+// zeroes the nth block of a type, like a block whose write failed
+static qint64 ZeroBlock(const QString& path, quint32 type, int nth) {
+    QFile file(path);
+    if (!file.open(QFile::OpenModeFlag::ReadWrite))
+        return -1;
+    for (qint64 offset = 0; offset + BLOCKSIZE <= file.size(); offset += BLOCKSIZE) {
+        quint32 blockType = 0;
+        if (!file.seek(offset) || file.read(reinterpret_cast<char*>(&blockType), sizeof(blockType)) != sizeof(blockType))
+            return -1;
+        if (blockType != type || nth-- > 0)
+            continue;
+        if (!file.seek(offset) || file.write(QByteArray(BLOCKSIZE, 0)) != BLOCKSIZE)
+            return -1;
+        return offset;
+    }
+    return -1;
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QTemporaryDir dir;
+    CHECK(dir.isValid());
+
+    // every record has its own callstack, so records and stacks both span
+    // many blocks
+    StackTraceBatch batch;
+    for (quint32 seq = 0; seq < RECORDCOUNT; seq++) {
+        RawStackInfo info;
+        info.seq_ = seq;
+        info.time_ = seq;
+        info.size_ = 16;
+        info.addr_ = 0x1000 + static_cast<quint64>(seq) * 16;
+        info.recType_ = static_cast<quint8>(loliRecordTypes::STACKTRACE_);
+        info.frameOffset_ = static_cast<quint32>(batch.frames_.size());
+        info.frameCount_ = FRAMECOUNT;
+        for (int i = 0; i < FRAMECOUNT; i++)
+            batch.frames_.push_back(Frame(seq, i));
+        batch.stacks_.push_back(info);
+    }
+    SpillWriter writer(dir.path());
+    writer.start();
+    writer.Append(batch);
+    auto paths = writer.Finish();
+    CHECK(!writer.HasFailed());
+    CHECK(paths.size() == 1);
+    if (failures > 0)
+        return 1;
+
+    // a record block and a stack block with blocks after them, the stacks
+    // of the zeroed stack block aren't used by the zeroed records
+    auto recordBlock = ZeroBlock(paths[0], 1, 1);
+    auto stackBlock = ZeroBlock(paths[0], 2, 4);
+    CHECK(recordBlock > 0);
+    CHECK(stackBlock > 0);
+
+    SpillReader reader;
+    CHECK(reader.Open(paths));
+    auto recordsPerBlock = (BLOCKSIZE - 8) / static_cast<int>(sizeof(SpillRecord));
+    auto stacksPerBlock = (BLOCKSIZE - 8) / (8 + FRAMECOUNT * 8);
+    CHECK(reader.RecordCount() == RECORDCOUNT - recordsPerBlock);
+    CHECK(reader.StackCount() == RECORDCOUNT);
+
+    int records = 0;
+    int lostStacks = 0;
+    quint32 lastSeq = 0;
+    reader.ForEachRecord([&](const SpillRecord& record) {
+        records++;
+        lastSeq = record.seq_;
+        // the records of the zeroed block are gone
+        CHECK(record.seq_ < static_cast<quint32>(recordsPerBlock) || record.seq_ >= static_cast<quint32>(recordsPerBlock * 2));
+        CHECK(record.stack_ == record.seq_);
+        auto frames = reader.Stack(record.stack_);
+        if (frames.isEmpty()) {
+            lostStacks++;
+            return;
+        }
+        CHECK(frames.size() == FRAMECOUNT);
+        for (int i = 0; i < frames.size(); i++)
+            CHECK(frames[i] == Frame(record.seq_, i));
+    });
+    CHECK(records == reader.RecordCount());
+    CHECK(lastSeq == RECORDCOUNT - 1);
+    // the stacks of the zeroed stack block, their records are still there
+    CHECK(lostStacks == stacksPerBlock);
+    CHECK(reader.Stack(stacksPerBlock * 4).isEmpty());
+    CHECK(reader.Stack(stacksPerBlock * 5).size() == FRAMECOUNT);
+    CHECK(reader.Stack(RECORDCOUNT - 1).size() == FRAMECOUNT);
+
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("spilllog: ok\n");
+    return 0;
+}